@@ -0,0 +1,557 @@
+#ifndef C4C_TAC_TO_MAKEDA_H
+#define C4C_TAC_TO_MAKEDA_H
+
+#include <map>
+#include "../../../middle_end/tac/include/tac.hpp"
+#include "../../../middle_end/makeda/include/isa.hpp"
+
+
+/*
+ * Lowers a TACProgram to a makeda program that the vm runs directly.
+ *
+ * Every tac value lives in an 8 byte slot, locals in the frame of their
+ * function and globals in vm memory from address 8 on, address 0 stays
+ * null. An instruction loads its sources onto the operand stack, applies
+ * the operation and stores the result back, so the stack is empty between
+ * tac instructions and every label is reached at depth 0.
+ *
+ * A function starts with ENTER, CALL moves the arguments into the first
+ * slots of the new frame and the return value is left on the stack. 32 bit
+ * values are kept sign or zero extended to 64 bits. The program entry is a
+ * stub after the last function that initialises the globals and calls main,
+ * main's return value is what the vm halts with.
+ */
+
+class TacToMakeda
+{
+public:
+	std::string file_name;
+	TACProgram *tac_program;
+	Program program;
+
+	std::map<int,i64> globals;
+	std::map<std::string,i64> functions;
+	std::vector<std::pair<i64,std::string>> calls;
+
+	std::map<int,i64> locals;
+	std::map<int,i64> labels;
+	std::vector<std::pair<i64,int>> jumps;
+
+	int function_count = 0;
+	i64 slot_count = 0;
+
+	TacToMakeda(std::string file_name,TACProgram *tac_program)
+	{
+		this->file_name = file_name;
+		this->tac_program = tac_program;
+
+		for (TACDeclaration *decl : this->tac_program->decls)
+		{
+			if (decl == nullptr)
+			{
+				break;
+			}
+
+			if (decl->type == TACDeclarationType::VARDECL)
+			{
+				TACGlobalVariable *global = (TACGlobalVariable *)decl->decl;
+				this->globals[global->id] = (this->globals.size() + 1) * sizeof(i64);
+			}
+		}
+
+		for (TACDeclaration *decl : this->tac_program->decls)
+		{
+			if (decl == nullptr)
+			{
+				break;
+			}
+
+			if (decl->type == TACDeclarationType::FUNCTION)
+			{
+				convert_function((TACFunction *)decl->decl);
+			}
+		}
+
+		convert_entry();
+		resolve_calls();
+	}
+
+
+	void print_stats()
+	{
+		std::cout << "makeda : " << this->function_count << " functions, " << this->program.instructions.size() <<
+			" instructions, " << this->slot_count << " frame slots, " << this->globals.size() << " globals" << std::endl;
+	}
+
+
+	i64 emit(InstructionType type,i64 operand = 0,i64 immediate = 0)
+	{
+		this->program.add_instruction(Instruction(type,operand,immediate));
+		return this->program.instructions.size() - 1;
+	}
+
+
+	void convert_function(TACFunction *fn)
+	{
+		this->functions[fn->ident] = this->program.instructions.size();
+		this->program.symbols.push_back(ProgramSymbol{fn->ident,(i64)this->program.instructions.size()});
+		this->function_count++;
+
+		this->locals.clear();
+		this->labels.clear();
+		this->jumps.clear();
+
+		// CALL leaves the arguments in the first slots in order
+		for (TACArgument &arg : fn->arguments)
+		{
+			this->locals[arg.id] = this->locals.size();
+		}
+
+		i64 enter = emit(InstructionType::ENTER);
+		bool returned = false;
+
+		for (TACInstruction *inst : fn->instructions)
+		{
+			if (inst == nullptr)
+			{
+				continue;
+			}
+
+			convert_instruction(inst);
+			returned = inst->type == TACInstructionType::RETURN;
+		}
+
+		if (not returned)
+		{
+			emit(InstructionType::PUSH,0);
+			emit(InstructionType::RET);
+		}
+
+		this->program.instructions[enter].operand = this->locals.size();
+		this->slot_count += this->locals.size();
+
+		for (auto &jump : this->jumps)
+		{
+			auto label = this->labels.find(jump.second);
+			if (label == this->labels.end())
+			{
+				DEBUG_PANIC("makeda : " + fn->ident + " jumps to a missing label " + get_label_name(jump.second));
+			}
+
+			this->program.instructions[jump.first].operand = label->second;
+		}
+	}
+
+
+	/*
+	 * The entry stub gets a frame that covers the null cell and the globals
+	 * so its slots are the global addresses, it stores every initial value
+	 * and calls main. The program halts when main returns into it.
+	 */
+
+	void convert_entry()
+	{
+		if (this->functions.find("main") == this->functions.end())
+		{
+			DEBUG_PANIC("makeda : " + this->file_name + " has no main to run");
+		}
+
+		this->program.entry = emit(InstructionType::ENTER,this->globals.size() + 1);
+
+		for (TACDeclaration *decl : this->tac_program->decls)
+		{
+			if (decl == nullptr)
+			{
+				break;
+			}
+
+			if (decl->type != TACDeclarationType::VARDECL)
+			{
+				continue;
+			}
+
+			TACGlobalVariable *global = (TACGlobalVariable *)decl->decl;
+			i64 value = 0;
+
+			if (global->data != nullptr)
+			{
+				value = global->data_type == TACType::I64 or global->data_type == TACType::U64 ?
+					*(long int *)global->data : *(int *)global->data;
+			}
+
+			emit(InstructionType::PUSH,value);
+			emit(InstructionType::STORE_LOCAL,this->globals[global->id] / sizeof(i64));
+		}
+
+		this->calls.push_back({emit(InstructionType::CALL,0,0),"main"});
+	}
+
+
+	void resolve_calls()
+	{
+		for (auto &call : this->calls)
+		{
+			auto fn = this->functions.find(call.second);
+			if (fn == this->functions.end())
+			{
+				DEBUG_PANIC("makeda : " + call.second + " is not defined in " + this->file_name + ", the vm cannot call native functions");
+			}
+
+			this->program.instructions[call.first].operand = fn->second;
+		}
+	}
+
+
+	void convert_instruction(TACInstruction *inst)
+	{
+		switch (inst->type)
+		{
+			case TACInstructionType::RETURN:
+			{
+				TACReturnInst *ret = (TACReturnInst *)inst->instruction;
+				load_or_zero(ret->value);
+				emit(InstructionType::RET);
+				break;
+			}
+			case TACInstructionType::UNARY:
+			{
+				TACUnaryInst *unary = (TACUnaryInst *)inst->instruction;
+				begin_store(unary->dst);
+				load(unary->src);
+				emit(unary->op == TACUnaryOperator::NEGATE ? InstructionType::NEG : InstructionType::NOT);
+				extend(unary->dst->data_type);
+				end_store(unary->dst);
+				break;
+			}
+			case TACInstructionType::BINARY:
+			{
+				convert_binary_inst((TACBinaryInst *)inst->instruction);
+				break;
+			}
+			case TACInstructionType::JMP:
+			{
+				this->jumps.push_back({emit(InstructionType::JMP),((TACJmpInst *)inst->instruction)->label});
+				break;
+			}
+			case TACInstructionType::JMP_ZERO:
+			{
+				TACJmpIfZeroInst *jmp = (TACJmpIfZeroInst *)inst->instruction;
+				load(jmp->value);
+				this->jumps.push_back({emit(InstructionType::JZ),jmp->label});
+				break;
+			}
+			case TACInstructionType::JMP_NOT_ZERO:
+			{
+				TACJmpIfNotZeroInst *jmp = (TACJmpIfNotZeroInst *)inst->instruction;
+				load(jmp->value);
+				this->jumps.push_back({emit(InstructionType::JNZ),jmp->label});
+				break;
+			}
+			case TACInstructionType::LABEL:
+			{
+				this->labels[((TACLabelInst *)inst->instruction)->label] = this->program.instructions.size();
+				break;
+			}
+			case TACInstructionType::COPY:
+			{
+				TACCopyInst *copy = (TACCopyInst *)inst->instruction;
+				convert_move(copy->dst,copy->src,false);
+				break;
+			}
+			case TACInstructionType::SIGN_EXTEND:
+			{
+				TACSignExtendInst *ext = (TACSignExtendInst *)inst->instruction;
+				convert_move(ext->dst,ext->src,false);
+				break;
+			}
+			case TACInstructionType::ZERO_EXTEND:
+			{
+				TACZeroExtendInst *ext = (TACZeroExtendInst *)inst->instruction;
+				begin_store(ext->dst);
+				load(ext->src);
+				emit(InstructionType::ZEXT32);
+				end_store(ext->dst);
+				break;
+			}
+			case TACInstructionType::TRUNCATE:
+			{
+				TACTruncateInst *trunc = (TACTruncateInst *)inst->instruction;
+				convert_move(trunc->dst,trunc->src,true);
+				break;
+			}
+			case TACInstructionType::FUNCTION_CALL:
+			{
+				convert_function_call_inst((TACFunctionCallInst *)inst->instruction);
+				break;
+			}
+			case TACInstructionType::GET_ADDRESS:
+			{
+				TACGetAddressInst *addr = (TACGetAddressInst *)inst->instruction;
+				begin_store(addr->dst);
+				load_address(addr->src);
+				end_store(addr->dst);
+				break;
+			}
+			case TACInstructionType::LOAD:
+			{
+				TACLoadInst *load_inst = (TACLoadInst *)inst->instruction;
+				begin_store(load_inst->dst);
+				load(load_inst->src);
+				emit(InstructionType::LOAD);
+				end_store(load_inst->dst);
+				break;
+			}
+			case TACInstructionType::STORE:
+			{
+				TACStoreInst *store = (TACStoreInst *)inst->instruction;
+				load(store->dst);
+				load(store->src);
+				emit(InstructionType::STORE);
+				break;
+			}
+		}
+	}
+
+
+	void convert_move(TACValue *dst,TACValue *src,bool truncate)
+	{
+		begin_store(dst);
+		load(src);
+
+		if (truncate)
+		{
+			extend(dst->data_type);
+		}
+
+		end_store(dst);
+	}
+
+
+	void convert_function_call_inst(TACFunctionCallInst *inst)
+	{
+		begin_store(inst->dst);
+
+		for (TACValue *arg : inst->arguments)
+		{
+			load(arg);
+		}
+
+		this->calls.push_back({emit(InstructionType::CALL,0,inst->arguments.size()),inst->ident});
+
+		if (inst->dst == nullptr)
+		{
+			emit(InstructionType::POP);
+			return;
+		}
+
+		end_store(inst->dst);
+	}
+
+
+	void convert_binary_inst(TACBinaryInst *inst)
+	{
+		// signedness follows the operands, a comparison's result is always I32
+		bool is_unsigned = inst->src1->data_type == TACType::U64 or inst->src1->data_type == TACType::PTR;
+		bool is_32 = inst->dst->data_type == TACType::I32 or inst->dst->data_type == TACType::U32;
+
+		begin_store(inst->dst);
+
+		if (inst->op == TACBinaryOperator::AND or inst->op == TACBinaryOperator::OR)
+		{
+			load_bool(inst->src1);
+			load_bool(inst->src2);
+			emit(inst->op == TACBinaryOperator::AND ? InstructionType::AND : InstructionType::OR);
+			end_store(inst->dst);
+			return;
+		}
+
+		load(inst->src1);
+		load(inst->src2);
+
+		InstructionType type = InstructionType::ADD;
+		bool wraps = true;
+
+		switch (inst->op)
+		{
+			case TACBinaryOperator::ADD:            type = InstructionType::ADD; break;
+			case TACBinaryOperator::SUB:            type = InstructionType::SUB; break;
+			case TACBinaryOperator::MUL:            type = InstructionType::MUL; break;
+			case TACBinaryOperator::DIV:            type = is_unsigned ? InstructionType::DIVU : InstructionType::DIV; break;
+			case TACBinaryOperator::MOD:            type = is_unsigned ? InstructionType::MODU : InstructionType::MOD; break;
+			case TACBinaryOperator::SHIFT_LEFT:     type = InstructionType::SHL; break;
+			case TACBinaryOperator::SHIFT_RIGHT:
+			{
+				type = is_unsigned or inst->src1->data_type == TACType::U32 ? InstructionType::SHRU : InstructionType::SHR;
+				wraps = false;
+				break;
+			}
+			case TACBinaryOperator::BIT_AND:        type = InstructionType::AND; wraps = false; break;
+			case TACBinaryOperator::BIT_OR:         type = InstructionType::OR; wraps = false; break;
+			case TACBinaryOperator::BIT_XOR:        type = InstructionType::XOR; wraps = false; break;
+			case TACBinaryOperator::LESS:           type = is_unsigned ? InstructionType::LU : InstructionType::L; wraps = false; break;
+			case TACBinaryOperator::LESS_EQUAL:     type = is_unsigned ? InstructionType::LEU : InstructionType::LE; wraps = false; break;
+			case TACBinaryOperator::GREATER:        type = is_unsigned ? InstructionType::GU : InstructionType::G; wraps = false; break;
+			case TACBinaryOperator::GREATER_EQUAL:  type = is_unsigned ? InstructionType::GEU : InstructionType::GE; wraps = false; break;
+			case TACBinaryOperator::EQUAL:          type = InstructionType::EQ; wraps = false; break;
+			case TACBinaryOperator::NOT_EQUAL:      type = InstructionType::NE; wraps = false; break;
+			default:
+			{
+				DEBUG_PANIC("makeda : unsupported binary operator " + std::to_string((int)inst->op));
+			}
+		}
+
+		emit(type);
+
+		if (wraps and is_32)
+		{
+			extend(inst->dst->data_type);
+		}
+
+		end_store(inst->dst);
+	}
+
+
+	// brings a 64 bit result back to the canonical form of a 32 bit type
+	void extend(TACType data_type)
+	{
+		if (data_type == TACType::I32)
+		{
+			emit(InstructionType::SEXT32);
+		}
+		else if (data_type == TACType::U32)
+		{
+			emit(InstructionType::ZEXT32);
+		}
+	}
+
+
+	bool is_global(TACVariable *var)
+	{
+		return this->globals.find(var->id) != this->globals.end();
+	}
+
+
+	i64 get_slot(TACVariable *var)
+	{
+		auto slot = this->locals.find(var->id);
+		if (slot != this->locals.end())
+		{
+			return slot->second;
+		}
+
+		i64 index = this->locals.size();
+		this->locals[var->id] = index;
+		return index;
+	}
+
+
+	void load(TACValue *value)
+	{
+		if (value->type == TACValueType::CONSTANT)
+		{
+			emit(InstructionType::PUSH,get_constant((TACConstant *)value->value));
+			return;
+		}
+
+		TACVariable *var = (TACVariable *)value->value;
+
+		if (is_global(var))
+		{
+			emit(InstructionType::PUSH,this->globals[var->id]);
+			emit(InstructionType::LOAD);
+			return;
+		}
+
+		emit(InstructionType::LOAD_LOCAL,get_slot(var));
+	}
+
+
+	void load_or_zero(TACValue *value)
+	{
+		if (value == nullptr)
+		{
+			emit(InstructionType::PUSH,0);
+			return;
+		}
+
+		load(value);
+	}
+
+
+	void load_bool(TACValue *value)
+	{
+		load(value);
+		emit(InstructionType::PUSH,0);
+		emit(InstructionType::NE);
+	}
+
+
+	void load_address(TACValue *value)
+	{
+		if (value->type != TACValueType::VARIABLE)
+		{
+			DEBUG_PANIC("makeda : cannot take the address of a constant");
+		}
+
+		TACVariable *var = (TACVariable *)value->value;
+
+		if (is_global(var))
+		{
+			emit(InstructionType::PUSH,this->globals[var->id]);
+			return;
+		}
+
+		emit(InstructionType::ADDR_LOCAL,get_slot(var));
+	}
+
+
+	// a global's address goes below the value so STORE finds both
+	void begin_store(TACValue *dst)
+	{
+		if (dst != nullptr and is_global((TACVariable *)dst->value))
+		{
+			emit(InstructionType::PUSH,this->globals[((TACVariable *)dst->value)->id]);
+		}
+	}
+
+
+	void end_store(TACValue *dst)
+	{
+		TACVariable *var = (TACVariable *)dst->value;
+
+		if (is_global(var))
+		{
+			emit(InstructionType::STORE);
+			return;
+		}
+
+		emit(InstructionType::STORE_LOCAL,get_slot(var));
+	}
+
+
+	static i64 get_constant(TACConstant *constant)
+	{
+		switch (constant->type)
+		{
+			case TACConstantType::I32:
+			{
+				return *(int *)constant->constant;
+			}
+			case TACConstantType::U32:
+			{
+				return *(unsigned int *)constant->constant;
+			}
+			case TACConstantType::I64:
+			case TACConstantType::U64:
+			{
+				return *(long int *)constant->constant;
+			}
+		}
+
+		return 0;
+	}
+
+};
+
+
+#endif
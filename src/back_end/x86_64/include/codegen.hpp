@@ -2,42 +2,62 @@
 #define C4C_CODEGEN_H
 
 #include "intel64.hpp"
+#include "encoder.hpp"
+#include "../../../utils/include/output_sink.hpp"
 
 class Codegen
 {
 public:
 	std::string file_name;
 	ASMProgram *program;
-	std::string string = "\n\nsection  .text\n\n";
-	std::string data_string;
-	bool data = false;
+	OutputSink *out;
+	std::set<std::string> externs;
 	
-	Codegen(std::string file_name,ASMProgram *program)
+	Codegen(std::string file_name,ASMProgram *program,OutputSink *out)
 	{
 		this->file_name = file_name;
 		this->program = program;
+		this->out = out;
 
+		// globals first, the .data and .bss sections lead the file
 		for (ASMDeclaration *decl : this->program->decls)
 		{
 			if (decl == nullptr)
 			{
 				break;
 			}
-			gen_decl(decl);
+
+			if (decl->type == ASMDeclarationType::VARDECL)
+			{
+				gen_decl(decl);
+			}
+		}
+
+		write_body("\n\nsection  .text\n\n");
+		gen_externs();
+
+		for (ASMDeclaration *decl : this->program->decls)
+		{
+			if (decl == nullptr)
+			{
+				break;
+			}
+
+			if (decl->type == ASMDeclarationType::FUNCTION)
+			{
+				gen_decl(decl);
+			}
 		}
-	
-		this->string = this->data_string + this->string;
-		//DEBUG_PRINT(" ASM \n\n",this->string);
 	}
 
-	void write_data(std::string string)
+	void write_data(const std::string &string)
 	{
-		this->data_string += string;
+		this->out->write(string);
 	}
 
-	void write_body(std::string string)
+	void write_body(const std::string &string)
 	{
-		this->string += string;
+		this->out->write(string);
 	}
 
 	void gen_decl(ASMDeclaration *decl)
@@ -61,24 +81,44 @@ public:
 
 	void gen_global_vardecl(ASMGlobalVariable *decl)
 	{
-		if (this->data == false)
+		if (decl->data_type != ASMType::I32 and decl->data_type != ASMType::I64)
+		{
+			return;
+		}
+
+		std::string directive;
+
+		if (decl->is_public)
 		{
-			write_data("\nsection .data\n");
+			directive += "\nglobal " + decl->ident;
 		}
 
+		// zero initialized globals take no space in the object file
+		if (Encoder::is_zero_initialized(decl))
+		{
+			directive += "\nsection .bss\n";
+			directive += "\t" + decl->ident + (decl->data_type == ASMType::I32 ? " resd 1\n" : " resq 1\n");
+			write_data(directive);
+			return;
+		}
+
+		directive += "\nsection .data\n";
+
 		switch (decl->data_type)
 		{
 			case ASMType::I32:
 			{
-				write_data("\t" + decl->ident + " dd " + std::to_string(*((int *)decl->data)) + "\n");
+				directive += "\t" + decl->ident + " dd " + std::to_string(*((int *)decl->data)) + "\n";
 				break;
 			}
 			case ASMType::I64:
 			{
-				write_data("\t" + decl->ident + " dq " + std::to_string(*((long int *)decl->data)) + "\n");
+				directive += "\t" + decl->ident + " dq " + std::to_string(*((long int *)decl->data)) + "\n";
 				break;
 			}
 		}
+
+		write_data(directive);
 	}
 
 	void gen_function(ASMFunction *decl)
@@ -185,6 +225,56 @@ public:
 				gen_movsx_inst((ASMMovSxInst *)inst->instruction);
 				break;
 			}
+			case ASMInstructionType::IMUL:
+			{
+				gen_binary_inst("imul",((ASMImulInst *)inst->instruction)->dst,((ASMImulInst *)inst->instruction)->src);
+				break;
+			}
+			case ASMInstructionType::AND:
+			{
+				gen_binary_inst("and",((ASMAndInst *)inst->instruction)->dst,((ASMAndInst *)inst->instruction)->src);
+				break;
+			}
+			case ASMInstructionType::OR:
+			{
+				gen_binary_inst("or",((ASMOrInst *)inst->instruction)->dst,((ASMOrInst *)inst->instruction)->src);
+				break;
+			}
+			case ASMInstructionType::XOR:
+			{
+				gen_binary_inst("xor",((ASMXorInst *)inst->instruction)->dst,((ASMXorInst *)inst->instruction)->src);
+				break;
+			}
+			case ASMInstructionType::SHL:
+			{
+				gen_binary_inst("shl",((ASMShlInst *)inst->instruction)->dst,((ASMShlInst *)inst->instruction)->src);
+				break;
+			}
+			case ASMInstructionType::SAR:
+			{
+				gen_binary_inst("sar",((ASMSarInst *)inst->instruction)->dst,((ASMSarInst *)inst->instruction)->src);
+				break;
+			}
+			case ASMInstructionType::SHR:
+			{
+				gen_binary_inst("shr",((ASMShrInst *)inst->instruction)->dst,((ASMShrInst *)inst->instruction)->src);
+				break;
+			}
+			case ASMInstructionType::MUL:
+			{
+				gen_mul_inst((ASMMulInst *)inst->instruction);
+				break;
+			}
+			case ASMInstructionType::DIV:
+			{
+				gen_div_inst((ASMDivInst *)inst->instruction);
+				break;
+			}
+			case ASMInstructionType::CDQ:
+			{
+				gen_cdq_inst((ASMCdqInst *)inst->instruction);
+				break;
+			}
 			default:
 			{
 				return;
@@ -197,6 +287,49 @@ public:
 
 	
 	
+	// call targets that no function here defines, native "C" functions
+	// among them, are left to the linker and called through the plt like
+	// the Encoder does
+	void gen_externs()
+	{
+		std::set<std::string> defined;
+		std::set<std::string> called;
+
+		for (ASMDeclaration *decl : this->program->decls)
+		{
+			if (decl == nullptr)
+			{
+				break;
+			}
+
+			if (decl->type != ASMDeclarationType::FUNCTION)
+			{
+				continue;
+			}
+
+			ASMFunction *fn = (ASMFunction *)decl->decl;
+			defined.insert(fn->ident);
+
+			for (ASMInstruction *inst : fn->instructions)
+			{
+				if (inst != nullptr and inst->type == ASMInstructionType::CALL)
+				{
+					called.insert(((ASMCallInst *)inst->instruction)->label);
+				}
+			}
+		}
+
+		for (const std::string &ident : called)
+		{
+			if (not defined.count(ident))
+			{
+				this->externs.insert(ident);
+				write_body("extern " + ident + "\n");
+			}
+		}
+	}
+
+
 	void gen_global(std::string global)
 	{
 		write_body("global " + global + "\n");
@@ -273,6 +406,12 @@ public:
 
 	void gen_call_inst(ASMCallInst *inst)
 	{
+		if (this->externs.count(inst->label))
+		{
+			write_body("\tcall " + inst->label + " wrt ..plt\n");
+			return;
+		}
+
 		write_body("\tcall " + inst->label + "\n");
 	}
 
@@ -367,6 +506,16 @@ public:
 	{
 		switch(inst->condition)
 		{
+			case ASMCondition::EQUAL:
+			{
+				write_body("\tsete ");
+				break;
+			}
+			case ASMCondition::NOT_EQUAL:
+			{
+				write_body("\tsetne ");
+				break;
+			}
 			case ASMCondition::LESS:
 			{
 				write_body("\tsetl ");
@@ -422,6 +571,34 @@ public:
 		write_body("\n");
 	}
 
+	void gen_binary_inst(std::string name,ASMOperand *dst,ASMOperand *src)
+	{
+		write_body("\t" + name + " ");
+		gen_operand(dst);
+		write_body(",");
+		gen_operand(src);
+		write_body("\n");
+	}
+
+	void gen_mul_inst(ASMMulInst *inst)
+	{
+		write_body(inst->is_signed ? "\timul " : "\tmul ");
+		gen_operand(inst->src);
+		write_body("\n");
+	}
+
+	void gen_div_inst(ASMDivInst *inst)
+	{
+		write_body(inst->is_signed ? "\tidiv " : "\tdiv ");
+		gen_operand(inst->src);
+		write_body("\n");
+	}
+
+	void gen_cdq_inst(ASMCdqInst *inst)
+	{
+		write_body(inst->data_type == ASMType::I32 or inst->data_type == ASMType::U32 ? "\tcdq\n" : "\tcqo\n");
+	}
+
 	void gen_neg_inst(ASMNegInst *inst)
 	{
 		write_body("\tneg ");
@@ -443,7 +620,7 @@ public:
 	void gen_push_inst(ASMPushInst *inst)
 	{
 		write_body("\tpush ");
-		gen_operand(inst->dst);
+		gen_operand(inst->dst,8);
 		write_body("\n");
 	}
 	
@@ -473,7 +650,7 @@ public:
 			case ASMOperandType::REGISTER:
 			{
 				ASMRegister *asm_reg = (ASMRegister *)operand->operand;
-				gen_register(asm_reg);
+				gen_register(asm_reg,size);
 				break;
 			}
 			case ASMOperandType::STACK:
@@ -528,6 +705,25 @@ public:
 
 
 
+	// slots sit below the base, incoming stack arguments above it
+	static std::string get_stack_address(ASMStack *asm_stack)
+	{
+		std::string address = asm_stack->address;
+
+		if (not asm_stack->index_address.empty())
+		{
+			address += " + " + asm_stack->index_address + "*" + std::to_string(asm_stack->scale);
+		}
+
+		if (asm_stack->index < 0)
+		{
+			return address + " + " + std::to_string(-asm_stack->index);
+		}
+
+		return address + " - " + std::to_string(asm_stack->index);
+	}
+
+
 	void gen_stack(ASMStack *asm_stack,int size = 0)
 	{
 		if (size == 0)
@@ -539,17 +735,17 @@ public:
 		{
 			case 1:
 			{
-				write_body("BYTE [" + asm_stack->address + " - " + std::to_string(asm_stack->index) + "]");
+				write_body("BYTE [" + get_stack_address(asm_stack) + "]");
 				break;
 			}
 			case 4:
 			{
-				write_body("DWORD [" + asm_stack->address + " - " + std::to_string(asm_stack->index) + "]");
+				write_body("DWORD [" + get_stack_address(asm_stack) + "]");
 				break;
 			}
 			case 8:
 			{
-				write_body("QWORD [" + asm_stack->address + " - " + std::to_string(asm_stack->index) + "]");
+				write_body("QWORD [" + get_stack_address(asm_stack) + "]");
 				break;
 			}
 		}
@@ -557,192 +753,121 @@ public:
 
 
 
-	void gen_register(ASMRegister *asm_reg)
+	void gen_register(ASMRegister *asm_reg,int size = 0)
 	{
+		if (size == 0)
+		{
+			size = asm_reg->size;
+		}
+
 		switch(asm_reg->type)
 		{
 			case ASMRegisterType::RAX:
 			{
-				if (asm_reg->size == 4)
-				{
-					write_body("eax");
-				}
-				else if (asm_reg->size == 8)
-				{
-					write_body("rax");
-				}
-				else
-				{
-					std::cout << (int)asm_reg->type << std::endl;
-					DEBUG_PANIC("unknown register size " + std::to_string(asm_reg->size));
-				}
-				
+				write_register(asm_reg,size,"al","eax","rax");
 				break;
 			}
 			case ASMRegisterType::RBX:
 			{
-				if (asm_reg->size == 4)
-				{
-					write_body("ebx");
-				}
-				else if (asm_reg->size == 8)
-				{
-					write_body("rbx");
-				}
-				else
-				{
-					std::cout << (int)asm_reg->type << std::endl;
-					DEBUG_PANIC("unknown register size " + std::to_string(asm_reg->size));
-				}
-				
+				write_register(asm_reg,size,"bl","ebx","rbx");
 				break;
 			}
 			case ASMRegisterType::RCX:
 			{
-				if (asm_reg->size == 4)
-				{
-					write_body("ecx");
-				}
-				else if (asm_reg->size == 8)
-				{
-					write_body("rcx");
-				}
-				else
-				{
-					std::cout << (int)asm_reg->type << std::endl;
-					DEBUG_PANIC("unknown register size " + std::to_string(asm_reg->size));
-				}
-				
+				write_register(asm_reg,size,"cl","ecx","rcx");
 				break;
 			}
 			case ASMRegisterType::RDX:
 			{
-				if (asm_reg->size == 4)
-				{
-					write_body("edx");
-				}
-				else if (asm_reg->size == 8)
-				{
-					write_body("rdx");
-				}
-				else
-				{
-					std::cout << (int)asm_reg->type << std::endl;
-					DEBUG_PANIC("unknown register size " + std::to_string(asm_reg->size));
-				}
-				
+				write_register(asm_reg,size,"dl","edx","rdx");
 				break;
 			}
 			case ASMRegisterType::RDI:
 			{
-				if (asm_reg->size == 4)
-				{
-					write_body("edi");
-				}
-				else if (asm_reg->size == 8)
-				{
-					write_body("rdi");
-				}
-				else
-				{
-					std::cout << (int)asm_reg->type << std::endl;
-					DEBUG_PANIC("unknown register size " + std::to_string(asm_reg->size));
-				}
-				
+				write_register(asm_reg,size,"dil","edi","rdi");
 				break;
 			}
 			case ASMRegisterType::RSI:
 			{
-				if (asm_reg->size == 4)
-				{
-					write_body("esi");
-				}
-				else if (asm_reg->size == 8)
-				{
-					write_body("rsi");
-				}
-				else
-				{
-					std::cout << (int)asm_reg->type << std::endl;
-					DEBUG_PANIC("unknown register size " + std::to_string(asm_reg->size));
-				}
-				
+				write_register(asm_reg,size,"sil","esi","rsi");
 				break;
 			}
 			case ASMRegisterType::RBP:
 			{
-				if (asm_reg->size == 4)
-				{
-					write_body("ebp");
-				}
-				else if (asm_reg->size == 8)
-				{
-					write_body("rbp");
-				}
-				else
-				{
-					std::cout << (int)asm_reg->type << std::endl;
-					DEBUG_PANIC("unknown register size " + std::to_string(asm_reg->size));
-				}
-				
+				write_register(asm_reg,size,"bpl","ebp","rbp");
 				break;
 			}
 			case ASMRegisterType::RSP:
 			{
-				if (asm_reg->size == 4)
-				{
-					write_body("esp");
-				}
-				else if (asm_reg->size == 8)
-				{
-					write_body("rsp");
-				}
-				else
-				{
-					std::cout << (int)asm_reg->type << std::endl;
-					DEBUG_PANIC("unknown register size " + std::to_string(asm_reg->size));
-				}
-				
+				write_register(asm_reg,size,"spl","esp","rsp");
+				break;
+			}
+			case ASMRegisterType::R8:
+			{
+				write_register(asm_reg,size,"r8b","r8d","r8");
+				break;
+			}
+			case ASMRegisterType::R9:
+			{
+				write_register(asm_reg,size,"r9b","r9d","r9");
+				break;
+			}
+			case ASMRegisterType::R10:
+			{
+				write_register(asm_reg,size,"r10b","r10d","r10");
 				break;
 			}
 			case ASMRegisterType::R11:
 			{
-				if (asm_reg->size == 4)
-				{
-					write_body("r11d");
-				}
-				else if (asm_reg->size == 8)
-				{
-					write_body("r11");
-				}
-				else
-				{
-					std::cout << (int)asm_reg->type << std::endl;
-					DEBUG_PANIC("unknown register size " + std::to_string(asm_reg->size));
-				}
-				
+				write_register(asm_reg,size,"r11b","r11d","r11");
 				break;
 			}
 			case ASMRegisterType::R12:
 			{
-				if (asm_reg->size == 4)
-				{
-					write_body("r12d");
-				}
-				else if (asm_reg->size == 8)
-				{
-					write_body("r12");
-				}
-				else
-				{
-					std::cout << (int)asm_reg->type << std::endl;
-					DEBUG_PANIC("unknown register size " + std::to_string(asm_reg->size));
-				}
-				
+				write_register(asm_reg,size,"r12b","r12d","r12");
+				break;
+			}
+			case ASMRegisterType::R13:
+			{
+				write_register(asm_reg,size,"r13b","r13d","r13");
+				break;
+			}
+			case ASMRegisterType::R14:
+			{
+				write_register(asm_reg,size,"r14b","r14d","r14");
+				break;
+			}
+			case ASMRegisterType::R15:
+			{
+				write_register(asm_reg,size,"r15b","r15d","r15");
 				break;
 			}
 		}
 	}
+
+
+	void write_register(ASMRegister *asm_reg,int size,std::string byte,std::string dword,std::string qword)
+	{
+		if (size == 1)
+		{
+			write_body(byte);
+		}
+		else if (size == 4)
+		{
+			write_body(dword);
+		}
+		else if (size == 8)
+		{
+			write_body(qword);
+		}
+		else
+		{
+			std::cout << (int)asm_reg->type << std::endl;
+			DEBUG_PANIC("unknown register size " + std::to_string(size));
+		}
+	}
+
+
 	void gen_immediate(ASMImmediate *asm_imm)
 	{
 		switch(asm_imm->type)
@@ -0,0 +1,427 @@
+#ifndef C4C_ELF64_H
+#define C4C_ELF64_H
+
+#include "encoder.hpp"
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <unistd.h>
+#include <sys/wait.h>
+
+
+/*
+ * Relocatable ELF64 object from the sections the Encoder produced.
+ *
+ * Layout : header, .text, .data, .symtab, .strtab, .rela.text, .shstrtab
+ * and the section header table last. .bss has no file contents and the
+ * empty .note.GNU-stack keeps the linker from asking for an executable
+ * stack.
+ */
+
+class ELF64Writer
+{
+public:
+	std::string file_name;
+	Encoder *encoder;
+	std::string bytes;
+
+	static const int SECTION_COUNT = 9;
+	static const int SHSTRTAB_INDEX = 8;
+	static const int SYMTAB_INDEX = 5;
+	static const int STRTAB_INDEX = 6;
+
+	std::string shstrtab = std::string(1,'\0');
+	std::string strtab = std::string(1,'\0');
+	std::string symtab;
+	std::string rela;
+	std::map<std::string,int> symbol_number;
+	int first_global = 0;
+
+	ELF64Writer(std::string file_name,Encoder *encoder)
+	{
+		this->file_name = file_name;
+		this->encoder = encoder;
+
+		build_symtab();
+		build_rela();
+		write_file();
+	}
+
+
+	static void write_value(std::string &bytes,long int value,int size)
+	{
+		Encoder::write_value(bytes,value,size);
+	}
+
+
+	int add_string(std::string &table,std::string string)
+	{
+		int offset = table.size();
+		table += string;
+		table += '\0';
+		return offset;
+	}
+
+
+	static int get_section_index(ObjectSection section)
+	{
+		switch (section)
+		{
+			case ObjectSection::TEXT: return 1;
+			case ObjectSection::DATA: return 2;
+			case ObjectSection::BSS: return 3;
+			default: return 0;
+		}
+	}
+
+
+	void add_symbol(int name,int bind,int type,int section,long int value,long int size)
+	{
+		write_value(this->symtab,name,4);
+		write_value(this->symtab,(bind << 4) | type,1);
+		write_value(this->symtab,0,1);
+		write_value(this->symtab,section,2);
+		write_value(this->symtab,value,8);
+		write_value(this->symtab,size,8);
+	}
+
+
+	// null, file, one per section, then locals before globals as ELF requires
+	void build_symtab()
+	{
+		add_symbol(0,0,0,0,0,0);
+		add_symbol(add_string(this->strtab,this->file_name),0,4,0xFFF1,0,0);
+
+		for (int section = 1; section <= 3; section++)
+		{
+			add_symbol(0,0,3,section,0,0);
+		}
+
+		int count = 5;
+
+		for (bool global : {false,true})
+		{
+			if (global)
+			{
+				this->first_global = count;
+			}
+
+			for (ObjectSymbol &symbol : this->encoder->symbols)
+			{
+				if (symbol.is_global != global)
+				{
+					continue;
+				}
+
+				int type = symbol.is_function ? 2 : (symbol.section == ObjectSection::DATA or symbol.section == ObjectSection::BSS) ? 1 : 0;
+				add_symbol(add_string(this->strtab,symbol.name),global ? 1 : 0,type,get_section_index(symbol.section),symbol.offset,symbol.size);
+				this->symbol_number[symbol.name] = count++;
+			}
+		}
+	}
+
+
+	void build_rela()
+	{
+		for (ObjectRelocation &relocation : this->encoder->relocations)
+		{
+			long int symbol;
+
+			if (relocation.section != ObjectSection::UNDEFINED)
+			{
+				// section symbols follow the file symbol
+				symbol = 1 + get_section_index(relocation.section);
+			}
+			else
+			{
+				symbol = this->symbol_number[relocation.symbol];
+			}
+
+			write_value(this->rela,relocation.offset,8);
+			write_value(this->rela,(symbol << 32) | (long int)relocation.type,8);
+			write_value(this->rela,relocation.addend,8);
+		}
+	}
+
+
+	void align(int alignment)
+	{
+		while (this->bytes.size() % alignment != 0)
+		{
+			this->bytes += '\0';
+		}
+	}
+
+
+	void add_section_header(std::string &headers,std::string name,int type,long int flags,long int offset,long int size,int link,int info,long int alignment,long int entry_size)
+	{
+		write_value(headers,add_string(this->shstrtab,name),4);
+		write_value(headers,type,4);
+		write_value(headers,flags,8);
+		write_value(headers,0,8);
+		write_value(headers,offset,8);
+		write_value(headers,size,8);
+		write_value(headers,link,4);
+		write_value(headers,info,4);
+		write_value(headers,alignment,8);
+		write_value(headers,entry_size,8);
+	}
+
+
+	void write_file()
+	{
+		this->bytes = std::string(64,'\0');
+
+		align(16);
+		long int text_offset = this->bytes.size();
+		this->bytes += this->encoder->text;
+
+		align(4);
+		long int data_offset = this->bytes.size();
+		this->bytes += this->encoder->data;
+
+		align(8);
+		long int symtab_offset = this->bytes.size();
+		this->bytes += this->symtab;
+
+		long int strtab_offset = this->bytes.size();
+		this->bytes += this->strtab;
+
+		align(8);
+		long int rela_offset = this->bytes.size();
+		this->bytes += this->rela;
+
+		std::string headers(64,'\0');
+		add_section_header(headers,".text",1,0x6,text_offset,this->encoder->text.size(),0,0,16,0);
+		add_section_header(headers,".data",1,0x3,data_offset,this->encoder->data.size(),0,0,4,0);
+		add_section_header(headers,".bss",8,0x3,data_offset + this->encoder->data.size(),this->encoder->bss_size,0,0,4,0);
+		add_section_header(headers,".note.GNU-stack",1,0,data_offset + this->encoder->data.size(),0,0,0,1,0);
+		add_section_header(headers,".symtab",2,0,symtab_offset,this->symtab.size(),STRTAB_INDEX,this->first_global,8,24);
+		add_section_header(headers,".strtab",3,0,strtab_offset,this->strtab.size(),0,0,1,0);
+		add_section_header(headers,".rela.text",4,0x40,rela_offset,this->rela.size(),SYMTAB_INDEX,1,8,24);
+
+		long int shstrtab_offset = this->bytes.size();
+		int shstrtab_name = add_string(this->shstrtab,".shstrtab");
+
+		// the shstrtab header names itself, so its size is known only now
+		write_value(headers,shstrtab_name,4);
+		write_value(headers,3,4);
+		write_value(headers,0,8);
+		write_value(headers,0,8);
+		write_value(headers,shstrtab_offset,8);
+		write_value(headers,this->shstrtab.size(),8);
+		write_value(headers,0,4);
+		write_value(headers,0,4);
+		write_value(headers,1,8);
+		write_value(headers,0,8);
+
+		this->bytes += this->shstrtab;
+		align(8);
+		long int header_offset = this->bytes.size();
+		this->bytes += headers;
+
+		std::string header;
+		header += "\x7f" "ELF";
+		write_value(header,2,1);
+		write_value(header,1,1);
+		write_value(header,1,1);
+		header += std::string(9,'\0');
+		write_value(header,1,2);
+		write_value(header,62,2);
+		write_value(header,1,4);
+		write_value(header,0,8);
+		write_value(header,0,8);
+		write_value(header,header_offset,8);
+		write_value(header,0,4);
+		write_value(header,64,2);
+		write_value(header,0,2);
+		write_value(header,0,2);
+		write_value(header,64,2);
+		write_value(header,SECTION_COUNT,2);
+		write_value(header,SHSTRTAB_INDEX,2);
+
+		this->bytes.replace(0,64,header);
+	}
+
+};
+
+
+
+/*
+ * Assembles the text Codegen printed with nasm and compares the contents
+ * of .text and .data, the size of .bss and the offset, type and addend of
+ * every relocation with the object the Encoder wrote.
+ */
+
+class ObjectCheck
+{
+public:
+	std::string asm_file;
+	bool ok = true;
+	std::string report;
+
+	ObjectCheck(std::string asm_file,std::string object)
+	{
+		this->asm_file = asm_file;
+		std::string nasm_file = asm_file + ".nasm.o";
+
+		if (not run_nasm(asm_file,nasm_file))
+		{
+			std::remove(nasm_file.c_str());
+			this->ok = false;
+			this->report = "object check : nasm failed on " + asm_file;
+			return;
+		}
+
+		std::ifstream file(nasm_file,std::ios::binary);
+		std::stringstream buf;
+		buf << file.rdbuf();
+		std::string reference = buf.str();
+		file.close();
+		std::remove(nasm_file.c_str());
+
+		compare(".text",get_section(object,".text"),get_section(reference,".text"));
+		compare(".data",get_section(object,".data"),get_section(reference,".data"));
+		compare(".bss size",std::to_string(get_section_size(object,".bss")),std::to_string(get_section_size(reference,".bss")));
+		compare(".rela.text",get_relocations(object),get_relocations(reference));
+
+		if (this->ok)
+		{
+			this->report = "object check : " + std::to_string(get_section(object,".text").size()) + " bytes of .text, "
+			             + std::to_string(get_section(object,".data").size()) + " bytes of .data identical to nasm";
+		}
+	}
+
+
+	// nasm is started directly, the paths never go through a shell
+	static bool run_nasm(std::string asm_file,std::string nasm_file)
+	{
+		pid_t pid = fork();
+
+		if (pid < 0)
+		{
+			return false;
+		}
+
+		if (pid == 0)
+		{
+			execlp("nasm","nasm","-felf64",asm_file.c_str(),"-o",nasm_file.c_str(),(char *)nullptr);
+			_exit(127);
+		}
+
+		int status = 0;
+
+		if (waitpid(pid,&status,0) != pid)
+		{
+			return false;
+		}
+
+		return WIFEXITED(status) and WEXITSTATUS(status) == 0;
+	}
+
+
+	void print_stats()
+	{
+		std::cout << this->report << std::endl;
+	}
+
+
+	void compare(std::string what,std::string object,std::string reference)
+	{
+		if (not this->ok or object == reference)
+		{
+			return;
+		}
+
+		int offset = 0;
+
+		while (offset < object.size() and offset < reference.size() and object[offset] == reference[offset])
+		{
+			offset++;
+		}
+
+		this->ok = false;
+		this->report = "object check : " + what + " differs from nasm at byte " + std::to_string(offset)
+		             + " (" + std::to_string(object.size()) + " bytes, nasm " + std::to_string(reference.size()) + ")";
+	}
+
+
+	static long int read_value(std::string &bytes,long int offset,int size)
+	{
+		unsigned long int value = 0;
+
+		for (int i = size - 1; i >= 0; i--)
+		{
+			value = (value << 8) | (unsigned char)bytes[offset + i];
+		}
+
+		return value;
+	}
+
+
+	// offset of the header of the named section, -1 if there is none
+	static long int find_section(std::string &bytes,std::string name)
+	{
+		if (bytes.size() < 64)
+		{
+			return -1;
+		}
+
+		long int headers = read_value(bytes,0x28,8);
+		int count = read_value(bytes,0x3C,2);
+		long int names = read_value(bytes,headers + 64 * read_value(bytes,0x3E,2) + 0x18,8);
+
+		for (int i = 0; i < count; i++)
+		{
+			long int header = headers + 64 * i;
+
+			if (std::string(bytes.c_str() + names + read_value(bytes,header,4)) == name)
+			{
+				return header;
+			}
+		}
+
+		return -1;
+	}
+
+
+	static std::string get_section(std::string &bytes,std::string name)
+	{
+		long int header = find_section(bytes,name);
+
+		if (header == -1)
+		{
+			return "";
+		}
+
+		return bytes.substr(read_value(bytes,header + 0x18,8),read_value(bytes,header + 0x20,8));
+	}
+
+
+	static long int get_section_size(std::string &bytes,std::string name)
+	{
+		long int header = find_section(bytes,name);
+		return header == -1 ? 0 : read_value(bytes,header + 0x20,8);
+	}
+
+
+	// the symbol index is left out : nasm numbers its symbols differently
+	static std::string get_relocations(std::string &bytes)
+	{
+		std::string relocations = get_section(bytes,".rela.text");
+		std::string result;
+
+		for (int i = 0; i + 24 <= relocations.size(); i += 24)
+		{
+			result += relocations.substr(i,12);
+			result += relocations.substr(i + 16,8);
+		}
+
+		return result;
+	}
+
+};
+
+
+
+#endif
@@ -0,0 +1,1266 @@
+#ifndef C4C_ENCODER_H
+#define C4C_ENCODER_H
+
+#include "intel64.hpp"
+#include "liveness.hpp"
+#include <map>
+
+
+/*
+ * Machine code for the instructions in intel64.hpp, laid out as the
+ * sections of a relocatable object (see elf64.hpp).
+ *
+ * Every choice follows what nasm -felf64 makes of the text Codegen prints,
+ * so the two can be compared byte for byte : reg,reg forms use the
+ * r/m,reg opcode, immediates and displacements take their short form when
+ * they fit, mov r64,imm becomes mov r32,imm for values below 2^32 and
+ * jumps start short and grow until every displacement fits.
+ *
+ * Jumps and calls inside the file are resolved here. Calls to functions
+ * defined elsewhere get a PLT32 relocation and [rel x] data operands a
+ * PC32 relocation, against the section symbol like nasm does for non
+ * global symbols.
+ */
+
+enum class ObjectSection
+{
+	UNDEFINED = 0,
+	TEXT,
+	DATA,
+	BSS,
+};
+
+class ObjectSymbol
+{
+public:
+	std::string name;
+	ObjectSection section;
+	long int offset = 0;
+	int size = 0;
+	bool is_global = false;
+	bool is_function = false;
+
+	ObjectSymbol(std::string name,ObjectSection section,long int offset)
+	{
+		this->name = name;
+		this->section = section;
+		this->offset = offset;
+	}
+};
+
+enum class ObjectRelocationType
+{
+	PC32 = 2,
+	PLT32 = 4,
+};
+
+class ObjectRelocation
+{
+public:
+	long int offset;
+	ObjectRelocationType type;
+	std::string symbol;
+	ObjectSection section = ObjectSection::UNDEFINED;
+	long int addend;
+
+	ObjectRelocation(long int offset,ObjectRelocationType type,std::string symbol,long int addend)
+	{
+		this->offset = offset;
+		this->type = type;
+		this->symbol = symbol;
+		this->addend = addend;
+	}
+};
+
+
+enum class EncodedKind
+{
+	PLAIN,
+	LABEL,
+	JUMP,
+	CALL,
+};
+
+// one instruction, jumps and calls keep their target until layout is known
+class EncodedInstruction
+{
+public:
+	EncodedKind kind;
+	std::string bytes;
+	std::string label;
+	bool conditional = false;
+	int condition_code = 0;
+	bool is_long = false;
+	long int offset = 0;
+
+	// [rel x] operands : position of the displacement, symbol, bytes after it
+	std::vector<std::tuple<int,std::string,int>> data_refs;
+
+	EncodedInstruction(EncodedKind kind)
+	{
+		this->kind = kind;
+	}
+
+	int get_size()
+	{
+		switch (this->kind)
+		{
+			case EncodedKind::LABEL:
+			{
+				return 0;
+			}
+			case EncodedKind::JUMP:
+			{
+				if (not this->is_long)
+				{
+					return 2;
+				}
+
+				return this->conditional ? 6 : 5;
+			}
+			case EncodedKind::CALL:
+			{
+				return 5;
+			}
+			default:
+			{
+				return this->bytes.size();
+			}
+		}
+	}
+};
+
+
+class Encoder
+{
+public:
+	std::string file_name;
+	ASMProgram *program;
+
+	std::string text;
+	std::string data;
+	long int bss_size = 0;
+	std::vector<ObjectSymbol> symbols;
+	std::vector<ObjectRelocation> relocations;
+
+	std::vector<EncodedInstruction> code;
+	std::map<std::string,int> symbol_index;
+
+	int relaxed = 0;
+
+	Encoder(std::string file_name,ASMProgram *program)
+	{
+		this->file_name = file_name;
+		this->program = program;
+
+		for (ASMDeclaration *decl : this->program->decls)
+		{
+			if (decl != nullptr and decl->type == ASMDeclarationType::VARDECL)
+			{
+				encode_global_vardecl((ASMGlobalVariable *)decl->decl);
+			}
+		}
+
+		for (ASMDeclaration *decl : this->program->decls)
+		{
+			if (decl != nullptr and decl->type == ASMDeclarationType::FUNCTION)
+			{
+				encode_function((ASMFunction *)decl->decl);
+			}
+		}
+
+		layout();
+		emit();
+	}
+
+
+	void add_symbol(ObjectSymbol symbol)
+	{
+		if (this->symbol_index.count(symbol.name))
+		{
+			DEBUG_PANIC("encoder : symbol defined twice " + symbol.name);
+		}
+
+		this->symbol_index[symbol.name] = this->symbols.size();
+		this->symbols.push_back(symbol);
+	}
+
+
+	ObjectSymbol *find_symbol(std::string name)
+	{
+		auto it = this->symbol_index.find(name);
+
+		if (it == this->symbol_index.end())
+		{
+			return nullptr;
+		}
+
+		return &this->symbols[it->second];
+	}
+
+
+	static bool is_zero_initialized(ASMGlobalVariable *decl)
+	{
+		if (decl->data == nullptr)
+		{
+			return true;
+		}
+
+		switch (decl->data_type)
+		{
+			case ASMType::I32:
+			{
+				return *(int *)decl->data == 0;
+			}
+			case ASMType::I64:
+			{
+				return *(long int *)decl->data == 0;
+			}
+			default:
+			{
+				return false;
+			}
+		}
+	}
+
+
+	void encode_global_vardecl(ASMGlobalVariable *decl)
+	{
+		int size;
+
+		switch (decl->data_type)
+		{
+			case ASMType::I32:
+			{
+				size = 4;
+				break;
+			}
+			case ASMType::I64:
+			{
+				size = 8;
+				break;
+			}
+			default:
+			{
+				// Codegen does not print these either
+				return;
+			}
+		}
+
+		if (is_zero_initialized(decl))
+		{
+			ObjectSymbol symbol(decl->ident,ObjectSection::BSS,this->bss_size);
+			symbol.size = size;
+			symbol.is_global = decl->is_public;
+			add_symbol(symbol);
+			this->bss_size += size;
+			return;
+		}
+
+		ObjectSymbol symbol(decl->ident,ObjectSection::DATA,this->data.size());
+		symbol.size = size;
+		symbol.is_global = decl->is_public;
+		add_symbol(symbol);
+
+		long int value = size == 4 ? *(int *)decl->data : *(long int *)decl->data;
+		write_value(this->data,value,size);
+	}
+
+
+	void encode_function(ASMFunction *decl)
+	{
+		ObjectSymbol symbol(decl->ident,ObjectSection::TEXT,0);
+		symbol.is_global = decl->is_public;
+		symbol.is_function = true;
+
+		EncodedInstruction label(EncodedKind::LABEL);
+		label.label = decl->ident;
+		this->code.push_back(label);
+		add_symbol(symbol);
+
+		for (ASMInstruction *inst : decl->instructions)
+		{
+			if (inst != nullptr)
+			{
+				encode_instruction(inst);
+			}
+		}
+	}
+
+
+	// offsets with every jump as short as its displacement allows
+	void layout()
+	{
+		bool changed = true;
+		std::map<std::string,long int> labels;
+
+		while (changed)
+		{
+			changed = false;
+			long int offset = 0;
+
+			for (EncodedInstruction &inst : this->code)
+			{
+				inst.offset = offset;
+				offset += inst.get_size();
+
+				if (inst.kind == EncodedKind::LABEL)
+				{
+					labels[inst.label] = inst.offset;
+				}
+			}
+
+			for (EncodedInstruction &inst : this->code)
+			{
+				if (inst.kind != EncodedKind::JUMP or inst.is_long)
+				{
+					continue;
+				}
+
+				auto it = labels.find(inst.label);
+
+				if (it == labels.end())
+				{
+					DEBUG_PANIC("encoder : jump to unknown label " + inst.label);
+				}
+
+				long int displacement = it->second - (inst.offset + 2);
+
+				if (displacement < -128 or displacement > 127)
+				{
+					inst.is_long = true;
+					this->relaxed++;
+					changed = true;
+				}
+			}
+		}
+
+		for (auto &[label,offset] : labels)
+		{
+			this->symbols[this->symbol_index[label]].offset = offset;
+		}
+	}
+
+
+	void emit()
+	{
+		std::map<std::string,long int> labels;
+
+		for (EncodedInstruction &inst : this->code)
+		{
+			if (inst.kind == EncodedKind::LABEL)
+			{
+				labels[inst.label] = inst.offset;
+			}
+		}
+
+		for (EncodedInstruction &inst : this->code)
+		{
+			switch (inst.kind)
+			{
+				case EncodedKind::LABEL:
+				{
+					break;
+				}
+				case EncodedKind::JUMP:
+				{
+					long int target = labels[inst.label];
+
+					if (not inst.is_long)
+					{
+						this->text += (char)(inst.conditional ? 0x70 + inst.condition_code : 0xEB);
+						write_value(this->text,target - (inst.offset + 2),1);
+					}
+					else if (inst.conditional)
+					{
+						this->text += (char)0x0F;
+						this->text += (char)(0x80 + inst.condition_code);
+						write_value(this->text,target - (inst.offset + 6),4);
+					}
+					else
+					{
+						this->text += (char)0xE9;
+						write_value(this->text,target - (inst.offset + 5),4);
+					}
+					break;
+				}
+				case EncodedKind::CALL:
+				{
+					this->text += (char)0xE8;
+					auto it = labels.find(inst.label);
+
+					if (it != labels.end())
+					{
+						write_value(this->text,it->second - (inst.offset + 5),4);
+						break;
+					}
+
+					if (find_symbol(inst.label) == nullptr)
+					{
+						ObjectSymbol symbol(inst.label,ObjectSection::UNDEFINED,0);
+						symbol.is_global = true;
+						add_symbol(symbol);
+					}
+
+					this->relocations.push_back(ObjectRelocation(inst.offset + 1,ObjectRelocationType::PLT32,inst.label,-4));
+					write_value(this->text,0,4);
+					break;
+				}
+				default:
+				{
+					for (auto &[position,name,trailing] : inst.data_refs)
+					{
+						ObjectSymbol *symbol = find_symbol(name);
+
+						if (symbol == nullptr or symbol->section == ObjectSection::TEXT)
+						{
+							DEBUG_PANIC("encoder : unknown data symbol " + name);
+						}
+
+						long int addend = -4 - trailing;
+						ObjectRelocation relocation(inst.offset + position,ObjectRelocationType::PC32,name,addend);
+
+						if (not symbol->is_global)
+						{
+							relocation.section = symbol->section;
+							relocation.addend += symbol->offset;
+						}
+
+						this->relocations.push_back(relocation);
+					}
+
+					this->text += inst.bytes;
+				}
+			}
+		}
+	}
+
+
+	static void write_value(std::string &bytes,long int value,int size)
+	{
+		for (int i = 0; i < size; i++)
+		{
+			bytes += (char)((value >> (8 * i)) & 0xFF);
+		}
+	}
+
+
+	static int get_register_code(ASMRegisterType reg)
+	{
+		switch (reg)
+		{
+			case ASMRegisterType::RAX: return 0;
+			case ASMRegisterType::RCX: return 1;
+			case ASMRegisterType::RDX: return 2;
+			case ASMRegisterType::RBX: return 3;
+			case ASMRegisterType::RSP: return 4;
+			case ASMRegisterType::RBP: return 5;
+			case ASMRegisterType::RSI: return 6;
+			case ASMRegisterType::RDI: return 7;
+			default: return (int)reg - (int)ASMRegisterType::R8 + 8;
+		}
+	}
+
+
+	// base register of a stack operand, "rbp" or a pointer held in a register
+	static int get_address_code(std::string address)
+	{
+		for (int reg = 1; reg <= ASMLiveness::REGISTER_COUNT; reg++)
+		{
+			if (ASMLiveness::get_register_name((ASMRegisterType)reg) == address)
+			{
+				return get_register_code((ASMRegisterType)reg);
+			}
+		}
+
+		DEBUG_PANIC("encoder : unknown address register " + address);
+	}
+
+
+	static int get_scale_code(int scale)
+	{
+		switch (scale)
+		{
+			case 1:
+			{
+				return 0;
+			}
+			case 2:
+			{
+				return 1;
+			}
+			case 4:
+			{
+				return 2;
+			}
+			case 8:
+			{
+				return 3;
+			}
+		}
+
+		DEBUG_PANIC("encoder : invalid index scale " + std::to_string(scale));
+	}
+
+
+	static long int get_immediate(ASMOperand *operand)
+	{
+		ASMImmediate *asm_imm = (ASMImmediate *)operand->operand;
+
+		switch (asm_imm->type)
+		{
+			case ASMImmediateType::I32:
+			{
+				return *(int *)asm_imm->value;
+			}
+			case ASMImmediateType::I64:
+			{
+				return *(long int *)asm_imm->value;
+			}
+			case ASMImmediateType::U32:
+			{
+				return *(unsigned int *)asm_imm->value;
+			}
+			case ASMImmediateType::U64:
+			{
+				return (long int)*(unsigned long int *)asm_imm->value;
+			}
+		}
+
+		return 0;
+	}
+
+
+	static int get_size(ASMOperand *operand)
+	{
+		switch (operand->type)
+		{
+			case ASMOperandType::REGISTER:
+			{
+				return ((ASMRegister *)operand->operand)->size;
+			}
+			case ASMOperandType::STACK:
+			{
+				return ((ASMStack *)operand->operand)->size;
+			}
+			case ASMOperandType::DATA:
+			{
+				return ((ASMData *)operand->operand)->size;
+			}
+			default:
+			{
+				return 0;
+			}
+		}
+	}
+
+
+	static bool is_memory(ASMOperand *operand)
+	{
+		return operand->type == ASMOperandType::STACK or operand->type == ASMOperandType::DATA;
+	}
+
+
+	static bool fits_byte(long int value)
+	{
+		return value >= -128 and value <= 127;
+	}
+
+
+	static bool fits_dword(long int value)
+	{
+		return value >= -2147483648L and value <= 2147483647L;
+	}
+
+
+	// operand size of a two operand instruction : the register if there is
+	// one, the memory operand otherwise
+	static int get_operation_size(ASMOperand *dst,ASMOperand *src)
+	{
+		if (dst->type == ASMOperandType::REGISTER)
+		{
+			return get_size(dst);
+		}
+
+		if (src != nullptr and src->type == ASMOperandType::REGISTER)
+		{
+			return get_size(src);
+		}
+
+		return get_size(dst);
+	}
+
+
+	/*
+	 * prefix, opcode, modrm (+ sib and displacement) for an instruction with
+	 * rm as its r/m operand. reg is a register code or an opcode extension,
+	 * byte_reg says it names a register in a byte operation (spl, bpl, sil
+	 * and dil need a REX prefix). The immediate, if any, is appended by the
+	 * caller : immediate_size is only needed for the rip relative addend.
+	 */
+	void encode_rm(EncodedInstruction &inst,std::vector<int> opcode,int size,int reg,bool byte_reg,ASMOperand *rm,int immediate_size)
+	{
+		int rex = 0;
+
+		if (size == 8)
+		{
+			rex |= 0x48;
+		}
+
+		if (reg >= 8)
+		{
+			rex |= 0x44;
+		}
+
+		if (size == 1 and byte_reg and reg >= 4 and reg < 8)
+		{
+			rex |= 0x40;
+		}
+
+		int rm_code = 0;
+		int index_code = -1;
+
+		switch (rm->type)
+		{
+			case ASMOperandType::REGISTER:
+			{
+				rm_code = get_register_code(((ASMRegister *)rm->operand)->type);
+
+				// the byte source of a movsx is narrower than the operation
+				bool byte_rm = size == 1 or ((ASMRegister *)rm->operand)->size == 1;
+
+				if (byte_rm and rm_code >= 4 and rm_code < 8)
+				{
+					rex |= 0x40;
+				}
+				break;
+			}
+			case ASMOperandType::STACK:
+			{
+				ASMStack *asm_stack = (ASMStack *)rm->operand;
+				rm_code = get_address_code(asm_stack->address);
+
+				if (not asm_stack->index_address.empty())
+				{
+					index_code = get_address_code(asm_stack->index_address);
+
+					if (index_code >= 8)
+					{
+						rex |= 0x42;
+					}
+				}
+				break;
+			}
+			case ASMOperandType::DATA:
+			{
+				rm_code = 5;
+				break;
+			}
+			default:
+			{
+				DEBUG_PANIC("encoder : unsupported r/m operand");
+			}
+		}
+
+		if (rm->type != ASMOperandType::DATA and rm_code >= 8)
+		{
+			rex |= 0x41;
+		}
+
+		if (rex != 0)
+		{
+			inst.bytes += (char)rex;
+		}
+
+		for (int byte : opcode)
+		{
+			inst.bytes += (char)byte;
+		}
+
+		int reg_bits = (reg & 7) << 3;
+
+		switch (rm->type)
+		{
+			case ASMOperandType::REGISTER:
+			{
+				inst.bytes += (char)(0xC0 | reg_bits | (rm_code & 7));
+				break;
+			}
+			case ASMOperandType::STACK:
+			{
+				long int displacement = -(long int)((ASMStack *)rm->operand)->index;
+				int mod = 0;
+
+				// [rbp] and [r13] have no displacement free form
+				if (displacement != 0 or (rm_code & 7) == 5)
+				{
+					mod = fits_byte(displacement) ? 1 : 2;
+				}
+
+				if (index_code != -1)
+				{
+					int scale_bits = get_scale_code(((ASMStack *)rm->operand)->scale) << 6;
+					inst.bytes += (char)((mod << 6) | reg_bits | 4);
+					inst.bytes += (char)(scale_bits | ((index_code & 7) << 3) | (rm_code & 7));
+				}
+				else
+				{
+					inst.bytes += (char)((mod << 6) | reg_bits | (rm_code & 7));
+
+					// [rsp] and [r12] always need a sib byte
+					if ((rm_code & 7) == 4)
+					{
+						inst.bytes += (char)0x24;
+					}
+				}
+
+				if (mod == 1)
+				{
+					write_value(inst.bytes,displacement,1);
+				}
+				else if (mod == 2)
+				{
+					write_value(inst.bytes,displacement,4);
+				}
+				break;
+			}
+			case ASMOperandType::DATA:
+			{
+				inst.bytes += (char)(reg_bits | 5);
+				inst.data_refs.push_back({(int)inst.bytes.size(),((ASMData *)rm->operand)->address,immediate_size});
+				write_value(inst.bytes,0,4);
+				break;
+			}
+		}
+	}
+
+
+	void add(EncodedInstruction inst)
+	{
+		this->code.push_back(inst);
+	}
+
+
+	void encode_instruction(ASMInstruction *inst)
+	{
+		switch(inst->type)
+		{
+			case ASMInstructionType::RET:
+			{
+				EncodedInstruction encoded(EncodedKind::PLAIN);
+				encoded.bytes += (char)0xC3;
+				add(encoded);
+				break;
+			}
+			case ASMInstructionType::MOV:
+			{
+				encode_mov_inst((ASMMovInst *)inst->instruction);
+				break;
+			}
+			case ASMInstructionType::LEA:
+			{
+				ASMLeaInst *lea = (ASMLeaInst *)inst->instruction;
+				EncodedInstruction encoded(EncodedKind::PLAIN);
+				encode_rm(encoded,{0x8D},get_size(lea->dst),get_register_code(((ASMRegister *)lea->dst->operand)->type),true,lea->src,0);
+				add(encoded);
+				break;
+			}
+			case ASMInstructionType::MOVSX:
+			{
+				encode_movsx_inst((ASMMovSxInst *)inst->instruction);
+				break;
+			}
+			case ASMInstructionType::ADD:
+			{
+				ASMAddInst *asm_add = (ASMAddInst *)inst->instruction;
+				encode_alu_inst(0x00,0,asm_add->dst,asm_add->src);
+				break;
+			}
+			case ASMInstructionType::SUB:
+			{
+				ASMSubInst *asm_sub = (ASMSubInst *)inst->instruction;
+				encode_alu_inst(0x28,5,asm_sub->dst,asm_sub->src);
+				break;
+			}
+			case ASMInstructionType::CMP:
+			{
+				ASMCmpInst *asm_cmp = (ASMCmpInst *)inst->instruction;
+				encode_alu_inst(0x38,7,asm_cmp->dst,asm_cmp->src);
+				break;
+			}
+			case ASMInstructionType::AND:
+			{
+				ASMAndInst *asm_and = (ASMAndInst *)inst->instruction;
+				encode_alu_inst(0x20,4,asm_and->dst,asm_and->src);
+				break;
+			}
+			case ASMInstructionType::OR:
+			{
+				ASMOrInst *asm_or = (ASMOrInst *)inst->instruction;
+				encode_alu_inst(0x08,1,asm_or->dst,asm_or->src);
+				break;
+			}
+			case ASMInstructionType::XOR:
+			{
+				ASMXorInst *asm_xor = (ASMXorInst *)inst->instruction;
+				encode_alu_inst(0x30,6,asm_xor->dst,asm_xor->src);
+				break;
+			}
+			case ASMInstructionType::IMUL:
+			{
+				encode_imul_inst((ASMImulInst *)inst->instruction);
+				break;
+			}
+			case ASMInstructionType::MUL:
+			{
+				ASMMulInst *asm_mul = (ASMMulInst *)inst->instruction;
+				encode_unary_inst(asm_mul->is_signed ? 5 : 4,asm_mul->src);
+				break;
+			}
+			case ASMInstructionType::DIV:
+			{
+				ASMDivInst *asm_div = (ASMDivInst *)inst->instruction;
+				encode_unary_inst(asm_div->is_signed ? 7 : 6,asm_div->src);
+				break;
+			}
+			case ASMInstructionType::CDQ:
+			{
+				ASMCdqInst *asm_cdq = (ASMCdqInst *)inst->instruction;
+				EncodedInstruction encoded(EncodedKind::PLAIN);
+
+				if (asm_cdq->data_type == ASMType::I64 or asm_cdq->data_type == ASMType::U64)
+				{
+					encoded.bytes += (char)0x48;
+				}
+
+				encoded.bytes += (char)0x99;
+				add(encoded);
+				break;
+			}
+			case ASMInstructionType::SHL:
+			{
+				ASMShlInst *shl = (ASMShlInst *)inst->instruction;
+				encode_shift_inst(4,shl->dst,shl->src);
+				break;
+			}
+			case ASMInstructionType::SHR:
+			{
+				ASMShrInst *shr = (ASMShrInst *)inst->instruction;
+				encode_shift_inst(5,shr->dst,shr->src);
+				break;
+			}
+			case ASMInstructionType::SAR:
+			{
+				ASMSarInst *sar = (ASMSarInst *)inst->instruction;
+				encode_shift_inst(7,sar->dst,sar->src);
+				break;
+			}
+			case ASMInstructionType::NEG:
+			{
+				encode_unary_inst(3,((ASMNegInst *)inst->instruction)->dst);
+				break;
+			}
+			case ASMInstructionType::NOT:
+			{
+				encode_unary_inst(2,((ASMNotInst *)inst->instruction)->dst);
+				break;
+			}
+			case ASMInstructionType::PUSH:
+			{
+				encode_push_inst(((ASMPushInst *)inst->instruction)->dst);
+				break;
+			}
+			case ASMInstructionType::POP:
+			{
+				encode_stack_inst(0x58,((ASMPopInst *)inst->instruction)->dst);
+				break;
+			}
+			case ASMInstructionType::CALL:
+			{
+				EncodedInstruction encoded(EncodedKind::CALL);
+				encoded.label = ((ASMCallInst *)inst->instruction)->label;
+				add(encoded);
+				break;
+			}
+			case ASMInstructionType::JMP:
+			{
+				EncodedInstruction encoded(EncodedKind::JUMP);
+				encoded.label = ((ASMJmpInst *)inst->instruction)->label;
+				add(encoded);
+				break;
+			}
+			case ASMInstructionType::JMP_COND:
+			{
+				ASMJmpCondInst *jump = (ASMJmpCondInst *)inst->instruction;
+				EncodedInstruction encoded(EncodedKind::JUMP);
+				encoded.label = jump->label;
+				encoded.conditional = true;
+				encoded.condition_code = get_condition_code(jump->condition);
+				add(encoded);
+				break;
+			}
+			case ASMInstructionType::SET_COND:
+			{
+				ASMSetCondInst *set = (ASMSetCondInst *)inst->instruction;
+				EncodedInstruction encoded(EncodedKind::PLAIN);
+				encode_rm(encoded,{0x0F,0x90 + get_condition_code(set->condition)},1,0,false,set->dst,0);
+				add(encoded);
+				break;
+			}
+			case ASMInstructionType::LABEL:
+			{
+				EncodedInstruction encoded(EncodedKind::LABEL);
+				encoded.label = ((ASMLabelInst *)inst->instruction)->label;
+				add(encoded);
+				add_symbol(ObjectSymbol(encoded.label,ObjectSection::TEXT,0));
+				break;
+			}
+			default:
+			{
+				// same set of instructions as Codegen::gen_instruction
+				return;
+			}
+		}
+	}
+
+
+	static int get_condition_code(ASMCondition condition)
+	{
+		switch (condition)
+		{
+			case ASMCondition::EQUAL: return 0x4;
+			case ASMCondition::NOT_EQUAL: return 0x5;
+			case ASMCondition::LESS: return 0xC;
+			case ASMCondition::LESS_EQUAL: return 0xE;
+			case ASMCondition::GREATER: return 0xF;
+			case ASMCondition::GREATER_EQUAL: return 0xD;
+			case ASMCondition::BELOW: return 0x2;
+			case ASMCondition::BELOW_EQUAL: return 0x6;
+			case ASMCondition::ABOVE: return 0x7;
+			case ASMCondition::ABOVE_EQUAL: return 0x3;
+		}
+
+		return 0;
+	}
+
+
+	void encode_mov_inst(ASMMovInst *inst)
+	{
+		ASMOperand *dst = inst->dst;
+		ASMOperand *src = inst->src;
+		EncodedInstruction encoded(EncodedKind::PLAIN);
+
+		// Codegen::fix_mov prints the source of an I32 mov as a 32 bit register
+		int src_size = get_size(src);
+
+		if (dst->data_type == ASMType::I32 and src->type == ASMOperandType::REGISTER)
+		{
+			src_size = 4;
+		}
+
+		if (src->type == ASMOperandType::IMMEDIATE)
+		{
+			long int value = get_immediate(src);
+			int size = get_size(dst);
+
+			if (dst->type == ASMOperandType::REGISTER)
+			{
+				int reg = get_register_code(((ASMRegister *)dst->operand)->type);
+
+				if (size == 8 and not (value >= 0 and value <= 0xFFFFFFFFL) and fits_dword(value))
+				{
+					encode_rm(encoded,{0xC7},8,0,false,dst,4);
+					write_value(encoded.bytes,value,4);
+					add(encoded);
+					return;
+				}
+
+				int immediate_size = size;
+
+				if (size == 8 and value >= 0 and value <= 0xFFFFFFFFL)
+				{
+					immediate_size = 4;
+				}
+
+				if (immediate_size == 8)
+				{
+					encoded.bytes += (char)(0x48 | (reg >= 8 ? 1 : 0));
+				}
+				else if (reg >= 8 or (size == 1 and reg >= 4))
+				{
+					encoded.bytes += (char)(0x40 | (reg >= 8 ? 1 : 0));
+				}
+
+				encoded.bytes += (char)((size == 1 ? 0xB0 : 0xB8) + (reg & 7));
+				write_value(encoded.bytes,value,immediate_size);
+				add(encoded);
+				return;
+			}
+
+			if (size == 8 and not fits_dword(value))
+			{
+				DEBUG_PANIC("encoder : 64 bit immediate stored to memory");
+			}
+
+			int immediate_size = size == 1 ? 1 : 4;
+			encode_rm(encoded,{size == 1 ? 0xC6 : 0xC7},size,0,false,dst,immediate_size);
+			write_value(encoded.bytes,value,immediate_size);
+			add(encoded);
+			return;
+		}
+
+		if (src->type == ASMOperandType::REGISTER)
+		{
+			int size = dst->type == ASMOperandType::REGISTER ? get_size(dst) : src_size;
+			int reg = get_register_code(((ASMRegister *)src->operand)->type);
+			encode_rm(encoded,{size == 1 ? 0x88 : 0x89},size,reg,true,dst,0);
+			add(encoded);
+			return;
+		}
+
+		if (dst->type == ASMOperandType::REGISTER and is_memory(src))
+		{
+			int size = get_size(dst);
+			int reg = get_register_code(((ASMRegister *)dst->operand)->type);
+			encode_rm(encoded,{size == 1 ? 0x8A : 0x8B},size,reg,true,src,0);
+			add(encoded);
+			return;
+		}
+
+		DEBUG_PANIC("encoder : mov between two memory operands");
+	}
+
+
+	void encode_movsx_inst(ASMMovSxInst *inst)
+	{
+		EncodedInstruction encoded(EncodedKind::PLAIN);
+		int size = get_size(inst->dst);
+		int reg = get_register_code(((ASMRegister *)inst->dst->operand)->type);
+
+		if (get_size(inst->src) == 4)
+		{
+			encode_rm(encoded,{0x63},size,reg,true,inst->src,0);
+		}
+		else
+		{
+			encode_rm(encoded,{0x0F,0xBE},size,reg,true,inst->src,0);
+		}
+
+		add(encoded);
+	}
+
+
+	// add, sub, cmp, and, or and xor : base is the r/m8,r8 opcode,
+	// extension the /digit of the immediate forms
+	void encode_alu_inst(int base,int extension,ASMOperand *dst,ASMOperand *src)
+	{
+		EncodedInstruction encoded(EncodedKind::PLAIN);
+		int size = get_operation_size(dst,src);
+
+		if (src->type == ASMOperandType::IMMEDIATE)
+		{
+			long int value = get_immediate(src);
+
+			if (size == 4)
+			{
+				value = (int)value;
+			}
+
+			bool accumulator = dst->type == ASMOperandType::REGISTER and ((ASMRegister *)dst->operand)->type == ASMRegisterType::RAX;
+
+			if (size == 1)
+			{
+				if (accumulator)
+				{
+					encoded.bytes += (char)(base + 4);
+				}
+				else
+				{
+					encode_rm(encoded,{0x80},1,extension,false,dst,1);
+				}
+
+				write_value(encoded.bytes,value,1);
+			}
+			else if (fits_byte(value))
+			{
+				encode_rm(encoded,{0x83},size,extension,false,dst,1);
+				write_value(encoded.bytes,value,1);
+			}
+			else
+			{
+				if (size == 8 and not fits_dword(value))
+				{
+					DEBUG_PANIC("encoder : 64 bit immediate operand");
+				}
+
+				if (accumulator)
+				{
+					if (size == 8)
+					{
+						encoded.bytes += (char)0x48;
+					}
+
+					encoded.bytes += (char)(base + 5);
+				}
+				else
+				{
+					encode_rm(encoded,{0x81},size,extension,false,dst,4);
+				}
+
+				write_value(encoded.bytes,value,4);
+			}
+
+			add(encoded);
+			return;
+		}
+
+		if (src->type == ASMOperandType::REGISTER)
+		{
+			int reg = get_register_code(((ASMRegister *)src->operand)->type);
+			encode_rm(encoded,{size == 1 ? base : base + 1},size,reg,true,dst,0);
+			add(encoded);
+			return;
+		}
+
+		if (dst->type == ASMOperandType::REGISTER)
+		{
+			int reg = get_register_code(((ASMRegister *)dst->operand)->type);
+			encode_rm(encoded,{size == 1 ? base + 2 : base + 3},size,reg,true,src,0);
+			add(encoded);
+			return;
+		}
+
+		DEBUG_PANIC("encoder : arithmetic between two memory operands");
+	}
+
+
+	// imul r,r/m and imul r,imm which is imul r,r,imm with the register twice
+	void encode_imul_inst(ASMImulInst *inst)
+	{
+		EncodedInstruction encoded(EncodedKind::PLAIN);
+
+		if (inst->dst->type != ASMOperandType::REGISTER)
+		{
+			DEBUG_PANIC("encoder : imul writes a register");
+		}
+
+		int size = get_size(inst->dst);
+		int reg = get_register_code(((ASMRegister *)inst->dst->operand)->type);
+
+		if (inst->src->type == ASMOperandType::IMMEDIATE)
+		{
+			long int value = get_immediate(inst->src);
+
+			if (size == 4)
+			{
+				value = (int)value;
+			}
+
+			if (fits_byte(value))
+			{
+				encode_rm(encoded,{0x6B},size,reg,true,inst->dst,1);
+				write_value(encoded.bytes,value,1);
+			}
+			else
+			{
+				if (not fits_dword(value))
+				{
+					DEBUG_PANIC("encoder : 64 bit immediate operand");
+				}
+
+				encode_rm(encoded,{0x69},size,reg,true,inst->dst,4);
+				write_value(encoded.bytes,value,4);
+			}
+
+			add(encoded);
+			return;
+		}
+
+		encode_rm(encoded,{0x0F,0xAF},size,reg,true,inst->src,0);
+		add(encoded);
+	}
+
+
+	// shl, shr and sar by an immediate or by cl, a count of 1 has its own opcode
+	void encode_shift_inst(int extension,ASMOperand *dst,ASMOperand *count)
+	{
+		EncodedInstruction encoded(EncodedKind::PLAIN);
+		int size = get_size(dst);
+
+		if (count->type == ASMOperandType::REGISTER)
+		{
+			encode_rm(encoded,{size == 1 ? 0xD2 : 0xD3},size,extension,false,dst,0);
+		}
+		else if (get_immediate(count) == 1)
+		{
+			encode_rm(encoded,{size == 1 ? 0xD0 : 0xD1},size,extension,false,dst,0);
+		}
+		else
+		{
+			encode_rm(encoded,{size == 1 ? 0xC0 : 0xC1},size,extension,false,dst,1);
+			write_value(encoded.bytes,get_immediate(count),1);
+		}
+
+		add(encoded);
+	}
+
+
+	void encode_unary_inst(int extension,ASMOperand *dst)
+	{
+		EncodedInstruction encoded(EncodedKind::PLAIN);
+		int size = get_size(dst);
+		encode_rm(encoded,{size == 1 ? 0xF6 : 0xF7},size,extension,false,dst,0);
+		add(encoded);
+	}
+
+
+	// stack arguments push immediates and memory as well, push is 64 bit
+	// without a REX.W
+	void encode_push_inst(ASMOperand *dst)
+	{
+		if (dst->type == ASMOperandType::REGISTER)
+		{
+			encode_stack_inst(0x50,dst);
+			return;
+		}
+
+		EncodedInstruction encoded(EncodedKind::PLAIN);
+
+		if (dst->type == ASMOperandType::IMMEDIATE)
+		{
+			long int value = get_immediate(dst);
+			encoded.bytes += (char)(fits_byte(value) ? 0x6A : 0x68);
+			write_value(encoded.bytes,value,fits_byte(value) ? 1 : 4);
+			add(encoded);
+			return;
+		}
+
+		encode_rm(encoded,{0xFF},4,6,false,dst,0);
+		add(encoded);
+	}
+
+
+	void encode_stack_inst(int opcode,ASMOperand *dst)
+	{
+		if (dst->type != ASMOperandType::REGISTER)
+		{
+			DEBUG_PANIC("encoder : push and pop take a register");
+		}
+
+		EncodedInstruction encoded(EncodedKind::PLAIN);
+		int reg = get_register_code(((ASMRegister *)dst->operand)->type);
+
+		if (reg >= 8)
+		{
+			encoded.bytes += (char)0x41;
+		}
+
+		encoded.bytes += (char)(opcode + (reg & 7));
+		add(encoded);
+	}
+
+};
+
+
+
+#endif
@@ -2,6 +2,7 @@
 #define C4C_FIXUP_H
 
 #include "pseudo.hpp"
+#include "liveness.hpp"
 
 
 class FixUp
@@ -15,12 +16,19 @@ public:
 	std::vector<ASMInstruction *> *inst = nullptr;
 	Arena *arena;
 
+	// leaf functions whose slots fit in the red zone keep them below rsp
+	// and skip the push rbp / mov rbp,rsp / sub rsp frame
+	static const int RED_ZONE = 128;
+	bool omit_frame_pointer = false;
+	int frameless = 0;
 
-	FixUp(std::string file_name,ASMProgram *program,Arena *arena)
+
+	FixUp(std::string file_name,ASMProgram *program,Arena *arena,bool omit_frame_pointer = false)
 	{
 		this->file_name = file_name;
 		this->program = program;
 		this->arena = arena;
+		this->omit_frame_pointer = omit_frame_pointer;
 
 		for(ASMDeclaration *decl : this->program->decls)
 		{
@@ -28,6 +36,12 @@ public:
 		}
 	}
 
+	void print_stats()
+	{
+		std::cout << "fixup : " << this->frameless << " leaf functions without a frame pointer" << std::endl;
+	}
+
+
 	int align(int number,int alignment)
 	{
 		return ((number + (alignment - 1)) & ~(alignment - 1));
@@ -56,8 +70,33 @@ public:
 		this->inst = &decl->instructions;
 		this->stack_counter = decl->stack_counter;
 
-		int aligned = align(this->stack_counter,8);
-		
+		// rsp is 16 byte aligned after push rbp, the frame keeps it that
+		// way for the calls made from it
+		int aligned = align(this->stack_counter,16);
+
+		if (this->omit_frame_pointer and is_leaf(decl) and aligned + 8 <= RED_ZONE)
+		{
+			remove_frame(decl);
+			this->frameless++;
+		}
+		else
+		{
+			add_frame(aligned);
+		}
+
+		for (this->index = 0; this->index < this->inst->size(); this->index++)
+		{
+			ASMInstruction *inst = this->inst->at(this->index);
+			fix_instruction(inst);
+		}
+
+
+		this->stack_counter = 0;
+	}
+
+
+	void add_frame(int aligned)
+	{
 		void *mem = alloc(sizeof(ASMRegister));
 		ASMRegister *asm_reg = new(mem) ASMRegister(ASMRegisterType::RSP,8);
 		
@@ -82,15 +121,91 @@ public:
 		mem = alloc(sizeof(ASMInstruction));
 		ASMInstruction *asm_inst = new(mem) ASMInstruction(ASMInstructionType::SUB,asm_sub);
 		this->inst->insert(this->inst->begin() + 2,asm_inst);
+	}
 
-		for (this->index = 0; this->index < this->inst->size(); this->index++)
+
+	static bool is_leaf(ASMFunction *decl)
+	{
+		for (ASMInstruction *inst : decl->instructions)
 		{
-			ASMInstruction *inst = this->inst->at(this->index);
-			fix_instruction(inst);
+			if (inst != nullptr and inst->type == ASMInstructionType::CALL)
+			{
+				return false;
+			}
 		}
 
+		return true;
+	}
 
-		this->stack_counter = 0;
+
+	static bool is_register(ASMOperand *operand,ASMRegisterType type)
+	{
+		if (operand->type != ASMOperandType::REGISTER)
+		{
+			return false;
+		}
+
+		return ((ASMRegister *)operand->operand)->type == type;
+	}
+
+
+	/*
+	 * Drops push rbp / mov rbp,rsp and the mov rsp,rbp / pop rbp before
+	 * every ret. Without the push rbp every rbp relative slot or stack
+	 * argument is 8 bytes closer to rsp : [rbp - n] becomes [rsp - (n + 8)]
+	 * and [rbp + 16] becomes [rsp + 8].
+	 */
+	void remove_frame(ASMFunction *decl)
+	{
+		std::vector<ASMInstruction *> &insts = decl->instructions;
+		insts.erase(insts.begin(),insts.begin() + 2);
+
+		for (int i = insts.size() - 1; i >= 2; i--)
+		{
+			if (insts[i]->type != ASMInstructionType::RET)
+			{
+				continue;
+			}
+
+			if (insts[i - 1]->type != ASMInstructionType::POP or insts[i - 2]->type != ASMInstructionType::MOV or
+			    not is_register(((ASMMovInst *)insts[i - 2]->instruction)->dst,ASMRegisterType::RSP))
+			{
+				DEBUG_PANIC("fixup : ret without epilogue in " + decl->ident);
+			}
+
+			insts.erase(insts.begin() + i - 2,insts.begin() + i);
+			i -= 2;
+		}
+
+		std::set<ASMStack *> moved;
+
+		for (ASMInstruction *inst : insts)
+		{
+			std::vector<ASMOperand *> operands;
+			ASMLiveness::get_operands(inst,operands,operands);
+
+			if (inst->type == ASMInstructionType::LEA)
+			{
+				operands.push_back(((ASMLeaInst *)inst->instruction)->src);
+			}
+
+			for (ASMOperand *operand : operands)
+			{
+				if (operand->type != ASMOperandType::STACK)
+				{
+					continue;
+				}
+
+				ASMStack *asm_stack = (ASMStack *)operand->operand;
+
+				if (asm_stack->address == "rbp" and not moved.count(asm_stack))
+				{
+					asm_stack->address = "rsp";
+					asm_stack->index += 8;
+					moved.insert(asm_stack);
+				}
+			}
+		}
 	}
 
 
@@ -113,6 +228,11 @@ public:
 				fix_mov_inst((ASMMovInst *)inst->instruction);
 				break;
 			}
+			case ASMInstructionType::MOVSX:
+			{
+				fix_movsx_inst((ASMMovSxInst *)inst->instruction);
+				break;
+			}
 			case ASMInstructionType::MOVZEROEXTEND:
 			{
 				fix_mov_zero_extend_inst((ASMMovZeroExtendInst *)inst->instruction);
@@ -138,6 +258,52 @@ public:
 				fix_neg_inst((ASMNegInst *)inst->instruction);
 				break;
 			}
+			case ASMInstructionType::IMUL:
+			{
+				fix_imul_inst((ASMImulInst *)inst->instruction);
+				break;
+			}
+			case ASMInstructionType::PUSH:
+			{
+				// push takes a sign extended 32 bit immediate at most
+				ASMPushInst *asm_push = (ASMPushInst *)inst->instruction;
+
+				if (is_wide_immediate(asm_push->dst))
+				{
+					asm_push->dst = load_scratch(asm_push->dst);
+				}
+				break;
+			}
+			case ASMInstructionType::MUL:
+			{
+				ASMMulInst *asm_mul = (ASMMulInst *)inst->instruction;
+				asm_mul->src = fix_wide_operand(asm_mul->src);
+				break;
+			}
+			case ASMInstructionType::DIV:
+			{
+				ASMDivInst *asm_div = (ASMDivInst *)inst->instruction;
+				asm_div->src = fix_wide_operand(asm_div->src);
+				break;
+			}
+			case ASMInstructionType::AND:
+			{
+				ASMAndInst *asm_and = (ASMAndInst *)inst->instruction;
+				asm_and->src = fix_logic_operand(asm_and->dst,asm_and->src);
+				break;
+			}
+			case ASMInstructionType::OR:
+			{
+				ASMOrInst *asm_or = (ASMOrInst *)inst->instruction;
+				asm_or->src = fix_logic_operand(asm_or->dst,asm_or->src);
+				break;
+			}
+			case ASMInstructionType::XOR:
+			{
+				ASMXorInst *asm_xor = (ASMXorInst *)inst->instruction;
+				asm_xor->src = fix_logic_operand(asm_xor->dst,asm_xor->src);
+				break;
+			}
 		}
 	}
 
@@ -147,13 +313,43 @@ public:
 	}
 
 
+	// movsx only writes a register : a memory destination gets the value
+	// extended into r11 and stored from there
+	void fix_movsx_inst(ASMMovSxInst *inst)
+	{
+		if (inst->dst->type == ASMOperandType::REGISTER)
+		{
+			return;
+		}
+
+		ASMOperand *dst = inst->dst;
+
+		void *mem = alloc(sizeof(ASMRegister));
+		ASMRegister *asm_reg = new(mem) ASMRegister(ASMRegisterType::R11,8);
+
+		mem = alloc(sizeof(ASMOperand));
+		ASMOperand *asm_scratch_reg = new(mem) ASMOperand(ASMOperandType::REGISTER,asm_reg);
+		asm_scratch_reg->add_type(dst->data_type);
+		inst->dst = asm_scratch_reg;
+
+		mem = alloc(sizeof(ASMMovInst));
+		ASMMovInst *asm_mov = new(mem) ASMMovInst(dst,asm_scratch_reg);
+		asm_mov->add_type(dst->data_type);
+
+		mem = alloc(sizeof(ASMInstruction));
+		ASMInstruction *asm_inst = new(mem) ASMInstruction(ASMInstructionType::MOV,asm_mov);
+		this->inst->insert(this->inst->begin() + this->index + 1,asm_inst);
+		this->index++;
+	}
+
+
 	void fix_mov_zero_extend_inst(ASMMovZeroExtendInst *inst)
 	{
 		if(inst->dst->type == ASMOperandType::REGISTER)
 		{
 			this->inst->at(this->index)->type = ASMInstructionType::MOV;
 		}
-		else if(inst->dst->type == ASMOperandType::STACK)
+		else
 		{
 			//ASMStack *src_stack = (ASMStack *)inst->src->operand;
 
@@ -367,6 +563,13 @@ public:
 		ASMOperand *dst = inst->dst;
 		ASMOperand *src = inst->src;
 
+		// a global against a stack slot or another global
+		if (dst->type == ASMOperandType::DATA or src->type == ASMOperandType::DATA)
+		{
+			inst->src = fix_logic_operand(dst,src);
+			return;
+		}
+
 		if (dst->type == ASMOperandType::STACK)
 		{
 			ASMStack *dst_stack = (ASMStack *)dst->operand;
@@ -407,6 +610,13 @@ public:
 		ASMOperand *dst = inst->dst;
 		ASMOperand *src = inst->src;
 
+		// a global against a stack slot or another global
+		if (dst->type == ASMOperandType::DATA or src->type == ASMOperandType::DATA)
+		{
+			inst->src = fix_logic_operand(dst,src);
+			return;
+		}
+
 		if (dst->type == ASMOperandType::STACK)
 		{
 			ASMStack *dst_stack = (ASMStack *)dst->operand;
@@ -444,9 +654,20 @@ public:
 
 	void fix_cmp_inst(ASMCmpInst *inst)
 	{
+		if (is_wide_immediate(inst->src))
+		{
+			inst->src = load_scratch(inst->src);
+		}
+
 		ASMOperand *dst = inst->dst;
 		ASMOperand *src = inst->src;
 
+		if (is_memory(dst) and is_memory(src) and (dst->type == ASMOperandType::DATA or src->type == ASMOperandType::DATA))
+		{
+			inst->src = load_scratch(src);
+			return;
+		}
+
 		if (dst->type == ASMOperandType::STACK)
 		{
 			ASMStack *dst_stack = (ASMStack *)dst->operand;
@@ -516,6 +737,113 @@ public:
 	{
 		return;
 	}
+
+
+	static bool is_memory(ASMOperand *operand)
+	{
+		return operand->type == ASMOperandType::STACK or operand->type == ASMOperandType::DATA;
+	}
+
+
+	static bool is_wide_immediate(ASMOperand *operand)
+	{
+		if (operand->type != ASMOperandType::IMMEDIATE)
+		{
+			return false;
+		}
+
+		ASMImmediate *asm_imm = (ASMImmediate *)operand->operand;
+
+		switch (asm_imm->type)
+		{
+			case ASMImmediateType::I64:
+			{
+				long int value = *(long int *)asm_imm->value;
+				return value < -2147483648L or value > 2147483647L;
+			}
+			case ASMImmediateType::U64:
+			{
+				return *(unsigned long int *)asm_imm->value > 2147483647UL;
+			}
+			default:
+			{
+				return false;
+			}
+		}
+	}
+
+
+	// r11 sized for operand, loaded from it by a mov inserted before the
+	// current instruction
+	ASMOperand *load_scratch(ASMOperand *operand)
+	{
+		int size = operand->data_type == ASMType::I32 or operand->data_type == ASMType::U32 ? 4 : 8;
+
+		void *mem = alloc(sizeof(ASMRegister));
+		ASMRegister *asm_reg = new(mem) ASMRegister(ASMRegisterType::R11,size);
+
+		mem = alloc(sizeof(ASMOperand));
+		ASMOperand *asm_scratch_reg = new(mem) ASMOperand(ASMOperandType::REGISTER,asm_reg);
+		asm_scratch_reg->add_type(operand->data_type);
+
+		mem = alloc(sizeof(ASMMovInst));
+		ASMMovInst *asm_mov = new(mem) ASMMovInst(asm_scratch_reg,operand);
+		asm_mov->add_type(operand->data_type);
+
+		mem = alloc(sizeof(ASMInstruction));
+		ASMInstruction *asm_inst = new(mem) ASMInstruction(ASMInstructionType::MOV,asm_mov);
+		this->inst->insert(this->inst->begin() + this->index,asm_inst);
+		this->index++;
+
+		return asm_scratch_reg;
+	}
+
+
+	// imul only writes a register : a memory destination is loaded into
+	// r11, multiplied there and stored back
+	void fix_imul_inst(ASMImulInst *inst)
+	{
+		if (inst->dst->type == ASMOperandType::REGISTER)
+		{
+			return;
+		}
+
+		ASMOperand *dst = inst->dst;
+		inst->dst = load_scratch(dst);
+
+		void *mem = alloc(sizeof(ASMMovInst));
+		ASMMovInst *asm_mov = new(mem) ASMMovInst(dst,inst->dst);
+		asm_mov->add_type(dst->data_type);
+
+		mem = alloc(sizeof(ASMInstruction));
+		ASMInstruction *asm_inst = new(mem) ASMInstruction(ASMInstructionType::MOV,asm_mov);
+		this->inst->insert(this->inst->begin() + this->index + 1,asm_inst);
+		this->index++;
+	}
+
+
+	// the operand of mul and div is a register or a stack slot, [rel x] has
+	// no size for nasm
+	ASMOperand *fix_wide_operand(ASMOperand *src)
+	{
+		if (src->type == ASMOperandType::IMMEDIATE or src->type == ASMOperandType::DATA)
+		{
+			return load_scratch(src);
+		}
+
+		return src;
+	}
+
+
+	ASMOperand *fix_logic_operand(ASMOperand *dst,ASMOperand *src)
+	{
+		if ((is_memory(dst) and is_memory(src)) or is_wide_immediate(src))
+		{
+			return load_scratch(src);
+		}
+
+		return src;
+	}
 	
 
 
@@ -23,6 +23,16 @@ enum class ASMInstructionType
 	MOVZX,
 	MOVZEROEXTEND,
 	LEA,
+	IMUL,
+	MUL,
+	DIV,
+	CDQ,
+	AND,
+	OR,
+	XOR,
+	SHL,
+	SAR,
+	SHR,
 };
 
 #include "../../include/asm_ast.hpp"
@@ -78,6 +88,9 @@ public:
 	int size = 0;
 	std::string address;
 	int index = 0;	
+	// optional scaled index register : [address + index_address * scale - index]
+	std::string index_address;
+	int scale = 1;
 	
 	ASMStack(int size,std::string address,int index)	
 	{
@@ -85,6 +98,12 @@ public:
 		this->address = address;
 		this->index = index;
 	}
+
+	void add_index(std::string index_address,int scale)
+	{
+		this->index_address = index_address;
+		this->scale = scale;
+	}
 };
 
 
@@ -372,6 +391,13 @@ class ASMCallInst
 {
 public:
 	std::string label;
+	int register_args = 0;
+
+	void add_register_args(int register_args)
+	{
+		this->register_args = register_args;
+	}
+
 	ASMCallInst(std::string label)
 	{
 		this->label = label;
@@ -433,6 +459,233 @@ public:
 
 
 
+// two operand imul, dst is a register and src may be an immediate
+class ASMImulInst
+{
+public:
+	ASMOperand *dst;
+	ASMOperand *src;
+	ASMType data_type;
+
+	void add_type(ASMType data_type)
+	{
+		this->data_type = data_type;
+	}
+
+	ASMImulInst(ASMOperand *dst,ASMOperand *src)
+	{
+		this->dst = dst;
+		this->src = src;
+	}
+
+};
+
+
+
+
+// one operand imul/mul : rdx:rax = rax * src
+class ASMMulInst
+{
+public:
+	ASMOperand *src;
+	bool is_signed;
+	ASMType data_type;
+
+	void add_type(ASMType data_type)
+	{
+		this->data_type = data_type;
+	}
+
+	ASMMulInst(ASMOperand *src,bool is_signed)
+	{
+		this->src = src;
+		this->is_signed = is_signed;
+	}
+
+};
+
+
+
+
+// idiv/div : rax = rdx:rax / src, rdx = rdx:rax % src
+class ASMDivInst
+{
+public:
+	ASMOperand *src;
+	bool is_signed;
+	ASMType data_type;
+
+	void add_type(ASMType data_type)
+	{
+		this->data_type = data_type;
+	}
+
+	ASMDivInst(ASMOperand *src,bool is_signed)
+	{
+		this->src = src;
+		this->is_signed = is_signed;
+	}
+
+};
+
+
+
+
+// cdq or cqo by data_type : sign extends rax into rdx
+class ASMCdqInst
+{
+public:
+	ASMType data_type;
+
+	void add_type(ASMType data_type)
+	{
+		this->data_type = data_type;
+	}
+
+};
+
+
+
+
+class ASMAndInst
+{
+public:
+	ASMOperand *dst;
+	ASMOperand *src;
+	ASMType data_type;
+
+	void add_type(ASMType data_type)
+	{
+		this->data_type = data_type;
+	}
+
+	ASMAndInst(ASMOperand *dst,ASMOperand *src)
+	{
+		this->dst = dst;
+		this->src = src;
+	}
+
+};
+
+
+
+
+class ASMOrInst
+{
+public:
+	ASMOperand *dst;
+	ASMOperand *src;
+	ASMType data_type;
+
+	void add_type(ASMType data_type)
+	{
+		this->data_type = data_type;
+	}
+
+	ASMOrInst(ASMOperand *dst,ASMOperand *src)
+	{
+		this->dst = dst;
+		this->src = src;
+	}
+
+};
+
+
+
+
+class ASMXorInst
+{
+public:
+	ASMOperand *dst;
+	ASMOperand *src;
+	ASMType data_type;
+
+	void add_type(ASMType data_type)
+	{
+		this->data_type = data_type;
+	}
+
+	ASMXorInst(ASMOperand *dst,ASMOperand *src)
+	{
+		this->dst = dst;
+		this->src = src;
+	}
+
+};
+
+
+
+
+// shifts : src is an immediate or cl
+class ASMShlInst
+{
+public:
+	ASMOperand *dst;
+	ASMOperand *src;
+	ASMType data_type;
+
+	void add_type(ASMType data_type)
+	{
+		this->data_type = data_type;
+	}
+
+	ASMShlInst(ASMOperand *dst,ASMOperand *src)
+	{
+		this->dst = dst;
+		this->src = src;
+	}
+
+};
+
+
+
+
+class ASMSarInst
+{
+public:
+	ASMOperand *dst;
+	ASMOperand *src;
+	ASMType data_type;
+
+	void add_type(ASMType data_type)
+	{
+		this->data_type = data_type;
+	}
+
+	ASMSarInst(ASMOperand *dst,ASMOperand *src)
+	{
+		this->dst = dst;
+		this->src = src;
+	}
+
+};
+
+
+
+
+class ASMShrInst
+{
+public:
+	ASMOperand *dst;
+	ASMOperand *src;
+	ASMType data_type;
+
+	void add_type(ASMType data_type)
+	{
+		this->data_type = data_type;
+	}
+
+	ASMShrInst(ASMOperand *dst,ASMOperand *src)
+	{
+		this->dst = dst;
+		this->src = src;
+	}
+
+};
+
+
+
+
 class ASMRetInst
 {
 public:
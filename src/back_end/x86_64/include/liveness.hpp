@@ -0,0 +1,681 @@
+#ifndef C4C_LIVENESS_H
+#define C4C_LIVENESS_H
+
+#include "intel64.hpp"
+#include <algorithm>
+#include <map>
+#include <set>
+
+
+/*
+ * Backward liveness over the instructions of one ASMFunction.
+ *
+ * Every physical register and every pseudo is a node : registers are
+ * nodes 0-15 ((int)ASMRegisterType - 1), pseudos follow in order of first
+ * appearance. rbp and rsp only ever hold the frame and are not tracked.
+ * Besides the explicit operands an instruction has implicit ones : a call
+ * reads its argument registers and writes every caller saved register, a
+ * ret reads rax, a one operand mul reads rax and writes rdx:rax, div reads
+ * and writes rdx:rax and cdq/cqo reads rax and writes rdx. The register in
+ * a memory operand such as [rax] is read even when the operand is written.
+ * The source of a lea is an address and is not a read.
+ */
+
+class ASMLiveness
+{
+public:
+	static const int REGISTER_COUNT = 16;
+
+	ASMFunction *fn;
+	std::vector<std::string> names;
+	std::map<std::string,int> pseudo_node;
+
+	std::vector<std::vector<int>> uses;
+	std::vector<std::vector<int>> defs;
+	std::vector<std::vector<int>> live_after;
+
+	std::vector<int> block_start;
+	std::vector<int> block_end;
+	std::vector<std::vector<int>> succs;
+	std::vector<std::vector<bool>> live_in;
+	std::vector<std::vector<bool>> live_out;
+
+	ASMLiveness(ASMFunction *fn)
+	{
+		this->fn = fn;
+
+		for (int reg = 1; reg <= REGISTER_COUNT; reg++)
+		{
+			this->names.push_back(get_register_name((ASMRegisterType)reg));
+		}
+
+		build_sets();
+		build_blocks();
+		solve();
+		build_live_after();
+	}
+
+
+	static std::string get_register_name(ASMRegisterType reg)
+	{
+		static const char *names[] = {"rax","rbx","rcx","rdx","rbp","rsp","rdi","rsi",
+		                              "r8","r9","r10","r11","r12","r13","r14","r15"};
+		return names[(int)reg - 1];
+	}
+
+
+	static int register_node(ASMRegisterType reg)
+	{
+		return (int)reg - 1;
+	}
+
+
+	static bool is_register_node(int node)
+	{
+		return node < REGISTER_COUNT;
+	}
+
+
+	static std::vector<ASMRegisterType> get_argument_registers()
+	{
+		return {
+			ASMRegisterType::RDI,
+			ASMRegisterType::RSI,
+			ASMRegisterType::RDX,
+			ASMRegisterType::RCX,
+			ASMRegisterType::R8,
+			ASMRegisterType::R9,
+		};
+	}
+
+
+	static std::vector<ASMRegisterType> get_caller_saved()
+	{
+		return {
+			ASMRegisterType::RAX,
+			ASMRegisterType::RCX,
+			ASMRegisterType::RDX,
+			ASMRegisterType::RSI,
+			ASMRegisterType::RDI,
+			ASMRegisterType::R8,
+			ASMRegisterType::R9,
+			ASMRegisterType::R10,
+			ASMRegisterType::R11,
+		};
+	}
+
+
+	// operands read and written by inst. read-modify-write operands are in
+	// both lists, the source of a LEA is an address and in neither.
+	static void get_operands(ASMInstruction *inst,std::vector<ASMOperand *> &reads,std::vector<ASMOperand *> &writes)
+	{
+		switch (inst->type)
+		{
+			case ASMInstructionType::MOV:
+			{
+				ASMMovInst *mov = (ASMMovInst *)inst->instruction;
+				reads.push_back(mov->src);
+				writes.push_back(mov->dst);
+				break;
+			}
+			case ASMInstructionType::MOVSX:
+			{
+				ASMMovSxInst *mov = (ASMMovSxInst *)inst->instruction;
+				reads.push_back(mov->src);
+				writes.push_back(mov->dst);
+				break;
+			}
+			case ASMInstructionType::MOVZX:
+			{
+				ASMMovZxInst *mov = (ASMMovZxInst *)inst->instruction;
+				reads.push_back(mov->src);
+				writes.push_back(mov->dst);
+				break;
+			}
+			case ASMInstructionType::MOVZEROEXTEND:
+			{
+				ASMMovZeroExtendInst *mov = (ASMMovZeroExtendInst *)inst->instruction;
+				reads.push_back(mov->src);
+				writes.push_back(mov->dst);
+				break;
+			}
+			case ASMInstructionType::LEA:
+			{
+				writes.push_back(((ASMLeaInst *)inst->instruction)->dst);
+				break;
+			}
+			case ASMInstructionType::ADD:
+			{
+				ASMAddInst *add = (ASMAddInst *)inst->instruction;
+				reads.push_back(add->dst);
+				reads.push_back(add->src);
+				writes.push_back(add->dst);
+				break;
+			}
+			case ASMInstructionType::SUB:
+			{
+				ASMSubInst *sub = (ASMSubInst *)inst->instruction;
+				reads.push_back(sub->dst);
+				reads.push_back(sub->src);
+				writes.push_back(sub->dst);
+				break;
+			}
+			case ASMInstructionType::IMUL:
+			{
+				ASMImulInst *imul = (ASMImulInst *)inst->instruction;
+				reads.push_back(imul->dst);
+				reads.push_back(imul->src);
+				writes.push_back(imul->dst);
+				break;
+			}
+			case ASMInstructionType::AND:
+			{
+				ASMAndInst *asm_and = (ASMAndInst *)inst->instruction;
+				reads.push_back(asm_and->dst);
+				reads.push_back(asm_and->src);
+				writes.push_back(asm_and->dst);
+				break;
+			}
+			case ASMInstructionType::OR:
+			{
+				ASMOrInst *asm_or = (ASMOrInst *)inst->instruction;
+				reads.push_back(asm_or->dst);
+				reads.push_back(asm_or->src);
+				writes.push_back(asm_or->dst);
+				break;
+			}
+			case ASMInstructionType::XOR:
+			{
+				ASMXorInst *asm_xor = (ASMXorInst *)inst->instruction;
+				reads.push_back(asm_xor->dst);
+				reads.push_back(asm_xor->src);
+				writes.push_back(asm_xor->dst);
+				break;
+			}
+			case ASMInstructionType::SHL:
+			{
+				ASMShlInst *shl = (ASMShlInst *)inst->instruction;
+				reads.push_back(shl->dst);
+				reads.push_back(shl->src);
+				writes.push_back(shl->dst);
+				break;
+			}
+			case ASMInstructionType::SAR:
+			{
+				ASMSarInst *sar = (ASMSarInst *)inst->instruction;
+				reads.push_back(sar->dst);
+				reads.push_back(sar->src);
+				writes.push_back(sar->dst);
+				break;
+			}
+			case ASMInstructionType::SHR:
+			{
+				ASMShrInst *shr = (ASMShrInst *)inst->instruction;
+				reads.push_back(shr->dst);
+				reads.push_back(shr->src);
+				writes.push_back(shr->dst);
+				break;
+			}
+			case ASMInstructionType::MUL:
+			{
+				reads.push_back(((ASMMulInst *)inst->instruction)->src);
+				break;
+			}
+			case ASMInstructionType::DIV:
+			{
+				reads.push_back(((ASMDivInst *)inst->instruction)->src);
+				break;
+			}
+			case ASMInstructionType::CMP:
+			{
+				ASMCmpInst *cmp = (ASMCmpInst *)inst->instruction;
+				reads.push_back(cmp->dst);
+				reads.push_back(cmp->src);
+				break;
+			}
+			case ASMInstructionType::NEG:
+			{
+				ASMNegInst *neg = (ASMNegInst *)inst->instruction;
+				reads.push_back(neg->dst);
+				writes.push_back(neg->dst);
+				break;
+			}
+			case ASMInstructionType::NOT:
+			{
+				ASMNotInst *asm_not = (ASMNotInst *)inst->instruction;
+				reads.push_back(asm_not->dst);
+				writes.push_back(asm_not->dst);
+				break;
+			}
+			case ASMInstructionType::SET_COND:
+			{
+				// setcc only writes the low byte
+				ASMSetCondInst *setcond = (ASMSetCondInst *)inst->instruction;
+				reads.push_back(setcond->dst);
+				writes.push_back(setcond->dst);
+				break;
+			}
+			case ASMInstructionType::PUSH:
+			{
+				reads.push_back(((ASMPushInst *)inst->instruction)->dst);
+				break;
+			}
+			case ASMInstructionType::POP:
+			{
+				writes.push_back(((ASMPopInst *)inst->instruction)->dst);
+				break;
+			}
+			default:
+			{
+				break;
+			}
+		}
+	}
+
+
+	static bool is_block_end(ASMInstruction *inst)
+	{
+		return inst->type == ASMInstructionType::JMP or inst->type == ASMInstructionType::JMP_COND or
+		       inst->type == ASMInstructionType::RET;
+	}
+
+
+	// node read or written through operand, -1 for immediates, data and frame registers
+	int get_node(ASMOperand *operand)
+	{
+		if (operand == nullptr)
+		{
+			return -1;
+		}
+
+		switch (operand->type)
+		{
+			case ASMOperandType::REGISTER:
+			{
+				ASMRegisterType reg = ((ASMRegister *)operand->operand)->type;
+
+				if (reg == ASMRegisterType::RBP or reg == ASMRegisterType::RSP)
+				{
+					return -1;
+				}
+
+				return register_node(reg);
+			}
+			case ASMOperandType::PSEUDO:
+			{
+				std::string ident = ((ASMPseudo *)operand->operand)->ident;
+				auto it = this->pseudo_node.find(ident);
+
+				if (it != this->pseudo_node.end())
+				{
+					return it->second;
+				}
+
+				this->pseudo_node[ident] = this->names.size();
+				this->names.push_back(ident);
+				return this->names.size() - 1;
+			}
+			default:
+			{
+				return -1;
+			}
+		}
+	}
+
+
+	// registers forming the address of a memory operand, rbp and data add none
+	void add_address_nodes(std::vector<int> &set,ASMOperand *operand)
+	{
+		if (operand == nullptr or operand->type != ASMOperandType::STACK)
+		{
+			return;
+		}
+
+		add_node(set,get_address_node(((ASMStack *)operand->operand)->address));
+		add_node(set,get_address_node(((ASMStack *)operand->operand)->index_address));
+	}
+
+
+	int get_address_node(std::string address)
+	{
+		for (int reg = 1; reg <= REGISTER_COUNT; reg++)
+		{
+			if (address == get_register_name((ASMRegisterType)reg) and
+			    (ASMRegisterType)reg != ASMRegisterType::RBP and (ASMRegisterType)reg != ASMRegisterType::RSP)
+			{
+				return register_node((ASMRegisterType)reg);
+			}
+		}
+
+		return -1;
+	}
+
+
+	void add_node(std::vector<int> &set,int node)
+	{
+		if (node != -1 and std::find(set.begin(),set.end(),node) == set.end())
+		{
+			set.push_back(node);
+		}
+	}
+
+
+	void build_sets()
+	{
+		std::vector<ASMInstruction *> &insts = this->fn->instructions;
+		this->uses.assign(insts.size(),std::vector<int>());
+		this->defs.assign(insts.size(),std::vector<int>());
+
+		for (int i = 0; i < insts.size(); i++)
+		{
+			std::vector<ASMOperand *> reads;
+			std::vector<ASMOperand *> writes;
+			get_operands(insts[i],reads,writes);
+
+			for (ASMOperand *operand : reads)
+			{
+				add_node(this->uses[i],get_node(operand));
+				add_address_nodes(this->uses[i],operand);
+			}
+
+			for (ASMOperand *operand : writes)
+			{
+				add_node(this->defs[i],get_node(operand));
+				add_address_nodes(this->uses[i],operand);
+			}
+
+			switch (insts[i]->type)
+			{
+				case ASMInstructionType::LEA:
+				{
+					add_address_nodes(this->uses[i],((ASMLeaInst *)insts[i]->instruction)->src);
+					break;
+				}
+				case ASMInstructionType::CALL:
+				{
+					ASMCallInst *call = (ASMCallInst *)insts[i]->instruction;
+					std::vector<ASMRegisterType> arguments = get_argument_registers();
+
+					for (int arg = 0; arg < call->register_args and arg < arguments.size(); arg++)
+					{
+						add_node(this->uses[i],register_node(arguments[arg]));
+					}
+
+					for (ASMRegisterType reg : get_caller_saved())
+					{
+						add_node(this->defs[i],register_node(reg));
+					}
+					break;
+				}
+				case ASMInstructionType::RET:
+				{
+					add_node(this->uses[i],register_node(ASMRegisterType::RAX));
+					break;
+				}
+				case ASMInstructionType::MUL:
+				{
+					add_node(this->uses[i],register_node(ASMRegisterType::RAX));
+					add_node(this->defs[i],register_node(ASMRegisterType::RAX));
+					add_node(this->defs[i],register_node(ASMRegisterType::RDX));
+					break;
+				}
+				case ASMInstructionType::DIV:
+				{
+					add_node(this->uses[i],register_node(ASMRegisterType::RAX));
+					add_node(this->uses[i],register_node(ASMRegisterType::RDX));
+					add_node(this->defs[i],register_node(ASMRegisterType::RAX));
+					add_node(this->defs[i],register_node(ASMRegisterType::RDX));
+					break;
+				}
+				case ASMInstructionType::CDQ:
+				{
+					add_node(this->uses[i],register_node(ASMRegisterType::RAX));
+					add_node(this->defs[i],register_node(ASMRegisterType::RDX));
+					break;
+				}
+				default:
+				{
+					break;
+				}
+			}
+		}
+	}
+
+
+	void build_blocks()
+	{
+		std::vector<ASMInstruction *> &insts = this->fn->instructions;
+		std::map<std::string,int> label_block;
+
+		for (int i = 0; i < insts.size(); i++)
+		{
+			if (i == 0 or insts[i]->type == ASMInstructionType::LABEL or is_block_end(insts[i - 1]))
+			{
+				this->block_start.push_back(i);
+			}
+
+			if (insts[i]->type == ASMInstructionType::LABEL)
+			{
+				label_block[((ASMLabelInst *)insts[i]->instruction)->label] = this->block_start.size() - 1;
+			}
+		}
+
+		int count = this->block_start.size();
+		this->block_end.assign(count,0);
+		this->succs.assign(count,std::vector<int>());
+
+		for (int b = 0; b < count; b++)
+		{
+			this->block_end[b] = b + 1 < count ? this->block_start[b + 1] : insts.size();
+			ASMInstruction *last = insts[this->block_end[b] - 1];
+
+			if (last->type == ASMInstructionType::JMP or last->type == ASMInstructionType::JMP_COND)
+			{
+				std::string label = last->type == ASMInstructionType::JMP ? ((ASMJmpInst *)last->instruction)->label
+				                                                        : ((ASMJmpCondInst *)last->instruction)->label;
+				auto it = label_block.find(label);
+
+				if (it == label_block.end())
+				{
+					DEBUG_PANIC("liveness : jump to unknown label " + label);
+				}
+
+				this->succs[b].push_back(it->second);
+			}
+
+			if (last->type != ASMInstructionType::JMP and last->type != ASMInstructionType::RET and b + 1 < count)
+			{
+				this->succs[b].push_back(b + 1);
+			}
+		}
+	}
+
+
+	void solve()
+	{
+		int count = this->block_start.size();
+		int nodes = this->names.size();
+		this->live_in.assign(count,std::vector<bool>(nodes,false));
+		this->live_out.assign(count,std::vector<bool>(nodes,false));
+		bool changed = true;
+
+		while (changed)
+		{
+			changed = false;
+
+			for (int b = count - 1; b >= 0; b--)
+			{
+				std::vector<bool> live(nodes,false);
+
+				for (int succ : this->succs[b])
+				{
+					for (int node = 0; node < nodes; node++)
+					{
+						live[node] = live[node] or this->live_in[succ][node];
+					}
+				}
+
+				this->live_out[b] = live;
+
+				for (int i = this->block_end[b] - 1; i >= this->block_start[b]; i--)
+				{
+					step(live,i);
+				}
+
+				if (live != this->live_in[b])
+				{
+					this->live_in[b] = live;
+					changed = true;
+				}
+			}
+		}
+	}
+
+
+	// live before instruction i from live after it
+	void step(std::vector<bool> &live,int i)
+	{
+		for (int node : this->defs[i])
+		{
+			live[node] = false;
+		}
+
+		for (int node : this->uses[i])
+		{
+			live[node] = true;
+		}
+	}
+
+
+	void build_live_after()
+	{
+		this->live_after.assign(this->fn->instructions.size(),std::vector<int>());
+
+		for (int b = 0; b < this->block_start.size(); b++)
+		{
+			std::vector<bool> live = this->live_out[b];
+
+			for (int i = this->block_end[b] - 1; i >= this->block_start[b]; i--)
+			{
+				for (int node = 0; node < live.size(); node++)
+				{
+					if (live[node])
+					{
+						this->live_after[i].push_back(node);
+					}
+				}
+
+				step(live,i);
+			}
+		}
+	}
+
+
+	bool is_live_after(int node,int i)
+	{
+		return std::find(this->live_after[i].begin(),this->live_after[i].end(),node) != this->live_after[i].end();
+	}
+
+
+	// a register or pseudo copy, the candidates for coalescing
+	bool is_move(int i)
+	{
+		ASMInstruction *inst = this->fn->instructions[i];
+
+		if (inst->type != ASMInstructionType::MOV)
+		{
+			return false;
+		}
+
+		ASMMovInst *mov = (ASMMovInst *)inst->instruction;
+		return get_node(mov->dst) != -1 and get_node(mov->src) != -1 and mov->dst->data_type == mov->src->data_type;
+	}
+};
+
+
+/*
+ * Interference graph built from ASMLiveness : every value written by an
+ * instruction interferes with everything live after it, except that the
+ * destination of a move does not interfere with its source. Moves are
+ * kept as pairs so an allocator can try to give both ends one register.
+ */
+
+class InterferenceGraph
+{
+public:
+	ASMLiveness *liveness;
+	std::vector<std::set<int>> adjacency;
+	std::vector<std::pair<int,int>> moves;
+	std::vector<std::vector<int>> move_partners;
+
+	InterferenceGraph(ASMLiveness *liveness)
+	{
+		this->liveness = liveness;
+		int nodes = liveness->names.size();
+		this->adjacency.assign(nodes,std::set<int>());
+		this->move_partners.assign(nodes,std::vector<int>());
+
+		for (int i = 0; i < liveness->fn->instructions.size(); i++)
+		{
+			int move_src = -1;
+
+			if (liveness->is_move(i))
+			{
+				ASMMovInst *mov = (ASMMovInst *)liveness->fn->instructions[i]->instruction;
+				int dst = liveness->get_node(mov->dst);
+				move_src = liveness->get_node(mov->src);
+
+				if (dst != move_src)
+				{
+					this->moves.push_back({dst,move_src});
+					this->move_partners[dst].push_back(move_src);
+					this->move_partners[move_src].push_back(dst);
+				}
+			}
+
+			for (int def : liveness->defs[i])
+			{
+				for (int live : liveness->live_after[i])
+				{
+					if (live != move_src)
+					{
+						add_edge(def,live);
+					}
+				}
+
+				// values written together clobber each other
+				for (int other : liveness->defs[i])
+				{
+					add_edge(def,other);
+				}
+			}
+		}
+	}
+
+
+	void add_edge(int a,int b)
+	{
+		if (a == b)
+		{
+			return;
+		}
+
+		this->adjacency[a].insert(b);
+		this->adjacency[b].insert(a);
+	}
+
+
+	bool interferes(int a,int b)
+	{
+		return this->adjacency[a].count(b) != 0;
+	}
+
+
+	int get_degree(int node)
+	{
+		return this->adjacency[node].size();
+	}
+};
+
+
+#endif
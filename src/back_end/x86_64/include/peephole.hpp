@@ -0,0 +1,590 @@
+#ifndef C4C_PEEPHOLE_H
+#define C4C_PEEPHOLE_H
+
+#include "intel64.hpp"
+#include "liveness.hpp"
+#include <iostream>
+
+
+/*
+ * Table driven peephole pass over the instructions of every function,
+ * run after FixUp so it sees the final operands. Each rule looks at a
+ * window starting at the current instruction and either copies nothing
+ * and returns 0, or appends its replacement to out and returns how many
+ * instructions it consumed. Rounds repeat until no rule fires.
+ *
+ * No rule relies on flags set by add or sub : every flag consumer the
+ * backend emits (setcc, jcc) directly follows a cmp, with at most the
+ * mov and setcc of a condition value in between, neither of which
+ * touches the flags.
+ */
+
+class Peephole;
+
+class PeepholeRule
+{
+public:
+	std::string name;
+	int (Peephole::*apply)(int index);
+	int hits = 0;
+
+	PeepholeRule(std::string name,int (Peephole::*apply)(int index))
+	{
+		this->name = name;
+		this->apply = apply;
+	}
+};
+
+
+class Peephole
+{
+public:
+	std::string file_name;
+	ASMProgram *program;
+	Arena *arena;
+
+	std::vector<PeepholeRule> rules;
+
+	ASMFunction *fn = nullptr;
+	ASMLiveness *liveness = nullptr;
+	std::vector<ASMInstruction *> out;
+
+	int removed = 0;
+
+	Peephole(std::string file_name,ASMProgram *program,Arena *arena)
+	{
+		this->file_name = file_name;
+		this->program = program;
+		this->arena = arena;
+
+		this->rules = {
+			PeepholeRule("self move",&Peephole::self_move),
+			PeepholeRule("reload after store",&Peephole::reload_after_store),
+			PeepholeRule("store after load",&Peephole::store_after_load),
+			PeepholeRule("branch on condition value",&Peephole::branch_on_condition),
+			PeepholeRule("add zero",&Peephole::add_zero),
+			PeepholeRule("sub zero",&Peephole::sub_zero),
+		};
+
+		for (ASMDeclaration *decl : this->program->decls)
+		{
+			if (decl->type == ASMDeclarationType::FUNCTION)
+			{
+				optimize_function((ASMFunction *)decl->decl);
+			}
+		}
+	}
+
+
+	void *alloc(int size)
+	{
+		return this->arena->alloc(size);
+	}
+
+
+	void print_stats()
+	{
+		std::cout << "peephole : " << this->removed << " instructions removed";
+
+		for (PeepholeRule &rule : this->rules)
+		{
+			std::cout << ", " << rule.name << " " << rule.hits;
+		}
+
+		std::cout << std::endl;
+	}
+
+
+	void optimize_function(ASMFunction *fn)
+	{
+		this->fn = fn;
+		int before = fn->instructions.size();
+		bool changed = true;
+
+		while (changed)
+		{
+			changed = false;
+
+			ASMLiveness liveness(fn);
+			this->liveness = &liveness;
+			this->out.clear();
+
+			for (int i = 0; i < fn->instructions.size();)
+			{
+				int consumed = 0;
+
+				for (PeepholeRule &rule : this->rules)
+				{
+					consumed = (this->*rule.apply)(i);
+
+					if (consumed != 0)
+					{
+						rule.hits++;
+						changed = true;
+						break;
+					}
+				}
+
+				if (consumed == 0)
+				{
+					this->out.push_back(fn->instructions[i]);
+					consumed = 1;
+				}
+
+				i += consumed;
+			}
+
+			fn->instructions = this->out;
+			this->liveness = nullptr;
+		}
+
+		this->removed += before - fn->instructions.size();
+	}
+
+
+	ASMInstruction *get(int index,ASMInstructionType type)
+	{
+		if (index >= this->fn->instructions.size() or this->fn->instructions[index]->type != type)
+		{
+			return nullptr;
+		}
+
+		return this->fn->instructions[index];
+	}
+
+
+	// size the operand is printed with, Codegen narrows the source register
+	// of a mov into an I32 destination
+	int get_size(ASMOperand *operand)
+	{
+		switch (operand->type)
+		{
+			case ASMOperandType::REGISTER:
+			{
+				return ((ASMRegister *)operand->operand)->size;
+			}
+			case ASMOperandType::STACK:
+			{
+				return ((ASMStack *)operand->operand)->size;
+			}
+			case ASMOperandType::DATA:
+			{
+				return ((ASMData *)operand->operand)->size;
+			}
+			default:
+			{
+				return 0;
+			}
+		}
+	}
+
+
+	// same register or memory location, regardless of size
+	bool same_location(ASMOperand *a,ASMOperand *b)
+	{
+		if (a->type != b->type)
+		{
+			return false;
+		}
+
+		switch (a->type)
+		{
+			case ASMOperandType::REGISTER:
+			{
+				return ((ASMRegister *)a->operand)->type == ((ASMRegister *)b->operand)->type;
+			}
+			case ASMOperandType::STACK:
+			{
+				ASMStack *x = (ASMStack *)a->operand;
+				ASMStack *y = (ASMStack *)b->operand;
+				return x->address == y->address and x->index == y->index and x->index_address == y->index_address and
+				       x->scale == y->scale;
+			}
+			case ASMOperandType::DATA:
+			{
+				return ((ASMData *)a->operand)->address == ((ASMData *)b->operand)->address;
+			}
+			default:
+			{
+				return false;
+			}
+		}
+	}
+
+
+	bool same_operand(ASMOperand *a,ASMOperand *b)
+	{
+		return same_location(a,b) and get_size(a) == get_size(b);
+	}
+
+
+	// reg is the base or the index of the memory operand
+	bool is_address_register(ASMOperand *memory,ASMOperand *reg)
+	{
+		if (memory->type != ASMOperandType::STACK or reg->type != ASMOperandType::REGISTER)
+		{
+			return false;
+		}
+
+		ASMStack *asm_stack = (ASMStack *)memory->operand;
+		std::string name = ASMLiveness::get_register_name(((ASMRegister *)reg->operand)->type);
+		return asm_stack->address == name or asm_stack->index_address == name;
+	}
+
+
+	bool is_memory(ASMOperand *operand)
+	{
+		return operand->type == ASMOperandType::STACK or operand->type == ASMOperandType::DATA;
+	}
+
+
+	bool is_zero(ASMOperand *operand)
+	{
+		if (operand->type != ASMOperandType::IMMEDIATE)
+		{
+			return false;
+		}
+
+		ASMImmediate *asm_imm = (ASMImmediate *)operand->operand;
+
+		switch (asm_imm->type)
+		{
+			case ASMImmediateType::I32:
+			{
+				return *(int *)asm_imm->value == 0;
+			}
+			case ASMImmediateType::I64:
+			{
+				return *(long int *)asm_imm->value == 0;
+			}
+			case ASMImmediateType::U32:
+			{
+				return *(unsigned int *)asm_imm->value == 0;
+			}
+			case ASMImmediateType::U64:
+			{
+				return *(unsigned long int *)asm_imm->value == 0;
+			}
+		}
+
+		return false;
+	}
+
+
+	// a mov that Codegen prints with 32 bit operands, writing a 32 bit
+	// register clears the upper half so it is never a no-op
+	bool is_dword_mov(ASMMovInst *mov)
+	{
+		return mov->dst->data_type == ASMType::I32 or get_size(mov->dst) == 4 or get_size(mov->src) == 4;
+	}
+
+
+	ASMCondition invert(ASMCondition condition)
+	{
+		switch (condition)
+		{
+			case ASMCondition::EQUAL:
+			{
+				return ASMCondition::NOT_EQUAL;
+			}
+			case ASMCondition::NOT_EQUAL:
+			{
+				return ASMCondition::EQUAL;
+			}
+			case ASMCondition::LESS:
+			{
+				return ASMCondition::GREATER_EQUAL;
+			}
+			case ASMCondition::LESS_EQUAL:
+			{
+				return ASMCondition::GREATER;
+			}
+			case ASMCondition::GREATER:
+			{
+				return ASMCondition::LESS_EQUAL;
+			}
+			case ASMCondition::GREATER_EQUAL:
+			{
+				return ASMCondition::LESS;
+			}
+			case ASMCondition::BELOW:
+			{
+				return ASMCondition::ABOVE_EQUAL;
+			}
+			case ASMCondition::BELOW_EQUAL:
+			{
+				return ASMCondition::ABOVE;
+			}
+			case ASMCondition::ABOVE:
+			{
+				return ASMCondition::BELOW_EQUAL;
+			}
+			case ASMCondition::ABOVE_EQUAL:
+			{
+				return ASMCondition::BELOW;
+			}
+		}
+
+		DEBUG_PANIC("peephole : unknown condition");
+	}
+
+
+	ASMOperand *make_register(ASMRegisterType type,int size)
+	{
+		void *mem = alloc(sizeof(ASMRegister));
+		ASMRegister *asm_reg = new(mem) ASMRegister(type,size);
+
+		mem = alloc(sizeof(ASMOperand));
+		return new(mem) ASMOperand(ASMOperandType::REGISTER,asm_reg);
+	}
+
+
+	// true if nothing but the instructions in [first,last] touches the
+	// value in operand, and it is not live after last
+	bool is_dead_after(ASMOperand *operand,int first,int last)
+	{
+		if (operand->type == ASMOperandType::REGISTER)
+		{
+			int node = this->liveness->get_node(operand);
+			return node != -1 and not this->liveness->is_live_after(node,last);
+		}
+
+		if (operand->type != ASMOperandType::STACK)
+		{
+			return false;
+		}
+
+		for (int i = 0; i < this->fn->instructions.size(); i++)
+		{
+			if (i >= first and i <= last)
+			{
+				continue;
+			}
+
+			std::vector<ASMOperand *> reads;
+			std::vector<ASMOperand *> writes;
+			ASMLiveness::get_operands(this->fn->instructions[i],reads,writes);
+
+			if (this->fn->instructions[i]->type == ASMInstructionType::LEA)
+			{
+				reads.push_back(((ASMLeaInst *)this->fn->instructions[i]->instruction)->src);
+			}
+
+			reads.insert(reads.end(),writes.begin(),writes.end());
+
+			for (ASMOperand *other : reads)
+			{
+				if (same_location(operand,other))
+				{
+					return false;
+				}
+			}
+		}
+
+		return true;
+	}
+
+
+	// mov r,r
+	int self_move(int index)
+	{
+		ASMInstruction *inst = get(index,ASMInstructionType::MOV);
+
+		if (inst == nullptr)
+		{
+			return 0;
+		}
+
+		ASMMovInst *mov = (ASMMovInst *)inst->instruction;
+
+		if (mov->dst->type != ASMOperandType::REGISTER or not same_operand(mov->dst,mov->src) or is_dword_mov(mov))
+		{
+			return 0;
+		}
+
+		return 1;
+	}
+
+
+	// mov m,r1 ; mov r2,m  =>  mov m,r1 ; mov r2,r1
+	int reload_after_store(int index)
+	{
+		ASMInstruction *store = get(index,ASMInstructionType::MOV);
+		ASMInstruction *load = get(index + 1,ASMInstructionType::MOV);
+
+		if (store == nullptr or load == nullptr)
+		{
+			return 0;
+		}
+
+		ASMMovInst *store_mov = (ASMMovInst *)store->instruction;
+		ASMMovInst *load_mov = (ASMMovInst *)load->instruction;
+
+		if (not is_memory(store_mov->dst) or store_mov->src->type != ASMOperandType::REGISTER)
+		{
+			return 0;
+		}
+
+		if (load_mov->dst->type != ASMOperandType::REGISTER or not same_operand(load_mov->src,store_mov->dst))
+		{
+			return 0;
+		}
+
+		if (get_size(load_mov->dst) != get_size(store_mov->src) or get_size(store_mov->src) != get_size(store_mov->dst))
+		{
+			return 0;
+		}
+
+		this->out.push_back(store);
+
+		if (same_location(load_mov->dst,store_mov->src))
+		{
+			return 2;
+		}
+
+		ASMRegister *src_reg = (ASMRegister *)store_mov->src->operand;
+
+		void *mem = alloc(sizeof(ASMMovInst));
+		ASMMovInst *asm_mov = new(mem) ASMMovInst(load_mov->dst,make_register(src_reg->type,src_reg->size));
+		asm_mov->add_type(load_mov->data_type);
+		asm_mov->src->add_type(load_mov->src->data_type);
+
+		mem = alloc(sizeof(ASMInstruction));
+		this->out.push_back(new(mem) ASMInstruction(ASMInstructionType::MOV,asm_mov));
+		return 2;
+	}
+
+
+	// mov r,m ; mov m,r  =>  mov r,m
+	int store_after_load(int index)
+	{
+		ASMInstruction *load = get(index,ASMInstructionType::MOV);
+		ASMInstruction *store = get(index + 1,ASMInstructionType::MOV);
+
+		if (load == nullptr or store == nullptr)
+		{
+			return 0;
+		}
+
+		ASMMovInst *load_mov = (ASMMovInst *)load->instruction;
+		ASMMovInst *store_mov = (ASMMovInst *)store->instruction;
+
+		if (load_mov->dst->type != ASMOperandType::REGISTER or not is_memory(load_mov->src))
+		{
+			return 0;
+		}
+
+		if (not same_operand(store_mov->dst,load_mov->src) or not same_operand(store_mov->src,load_mov->dst))
+		{
+			return 0;
+		}
+
+		// mov rax,[rax] ; mov [rax],rax stores somewhere else
+		if (is_address_register(load_mov->src,load_mov->dst))
+		{
+			return 0;
+		}
+
+		if (get_size(load_mov->dst) != get_size(load_mov->src))
+		{
+			return 0;
+		}
+
+		this->out.push_back(load);
+		return 2;
+	}
+
+
+	// mov t,0 ; setcc t ; cmp t,0 ; je/jne l  =>  jncc/jcc l
+	// the mov and setcc stay when t is read anywhere else
+	int branch_on_condition(int index)
+	{
+		ASMInstruction *clear = get(index,ASMInstructionType::MOV);
+		ASMInstruction *set = get(index + 1,ASMInstructionType::SET_COND);
+		ASMInstruction *cmp = get(index + 2,ASMInstructionType::CMP);
+		ASMInstruction *jump = get(index + 3,ASMInstructionType::JMP_COND);
+
+		if (clear == nullptr or set == nullptr or cmp == nullptr or jump == nullptr)
+		{
+			return 0;
+		}
+
+		ASMMovInst *clear_mov = (ASMMovInst *)clear->instruction;
+		ASMSetCondInst *set_cond = (ASMSetCondInst *)set->instruction;
+		ASMCmpInst *cmp_inst = (ASMCmpInst *)cmp->instruction;
+		ASMJmpCondInst *jump_cond = (ASMJmpCondInst *)jump->instruction;
+
+		ASMOperand *value = clear_mov->dst;
+
+		if (not is_zero(clear_mov->src) or not same_location(set_cond->dst,value))
+		{
+			return 0;
+		}
+
+		if (not same_operand(cmp_inst->dst,value) or not is_zero(cmp_inst->src))
+		{
+			return 0;
+		}
+
+		ASMCondition condition;
+
+		if (jump_cond->condition == ASMCondition::EQUAL)
+		{
+			condition = invert(set_cond->condition);
+		}
+		else if (jump_cond->condition == ASMCondition::NOT_EQUAL)
+		{
+			condition = set_cond->condition;
+		}
+		else
+		{
+			return 0;
+		}
+
+		if (not is_dead_after(value,index,index + 3))
+		{
+			this->out.push_back(clear);
+			this->out.push_back(set);
+		}
+
+		void *mem = alloc(sizeof(ASMJmpCondInst));
+		ASMJmpCondInst *asm_jump = new(mem) ASMJmpCondInst(condition,jump_cond->label);
+
+		mem = alloc(sizeof(ASMInstruction));
+		this->out.push_back(new(mem) ASMInstruction(ASMInstructionType::JMP_COND,asm_jump));
+		return 4;
+	}
+
+
+	// add x,0
+	int add_zero(int index)
+	{
+		ASMInstruction *inst = get(index,ASMInstructionType::ADD);
+
+		if (inst == nullptr or not is_zero(((ASMAddInst *)inst->instruction)->src))
+		{
+			return 0;
+		}
+
+		return 1;
+	}
+
+
+	// sub x,0, including the sub rsp,0 of a function without stack slots
+	int sub_zero(int index)
+	{
+		ASMInstruction *inst = get(index,ASMInstructionType::SUB);
+
+		if (inst == nullptr or not is_zero(((ASMSubInst *)inst->instruction)->src))
+		{
+			return 0;
+		}
+
+		return 1;
+	}
+
+};
+
+
+
+#endif
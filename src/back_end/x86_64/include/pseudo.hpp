@@ -2,8 +2,36 @@
 #define C4C_PSEUDO_H
 
 #include "intel64.hpp"
+#include "liveness.hpp"
 #include <map>
 
+
+/*
+ * Stack slots for the pseudos left after register allocation.
+ *
+ * With share_slots the slots are coloured : pseudos that never interfere
+ * (InterferenceGraph over ASMLiveness) and have the same size share one
+ * slot. 8 byte slots are laid out first and 4 byte slots after them, so
+ * every slot is aligned to its size. Address taken pseudos can be reached
+ * through a pointer while they are not live and keep a slot of their own.
+ */
+
+class FrameInfo
+{
+public:
+	std::string ident;
+	int pseudos = 0;
+	int slots = 0;
+	int unshared_size = 0;
+	int size = 0;
+
+	FrameInfo(std::string ident)
+	{
+		this->ident = ident;
+	}
+};
+
+
 class Pseudo
 {
 public:
@@ -14,14 +42,17 @@ public:
 	std::map<std::string,int> table;
 	Arena *arena;
 	SymbolTable symbol_table;
+	bool share_slots = true;
+	std::vector<FrameInfo> frames;
 
 	int offset = 0;
-	Pseudo(std::string file_name,ASMProgram *program,Arena *arena,SymbolTable symbol_table)
+	Pseudo(std::string file_name,ASMProgram *program,Arena *arena,SymbolTable symbol_table,bool share_slots = true)
 	{
 		this->file_name = file_name;
 		this->program = program;
 		this->arena = arena;
 		this->symbol_table = symbol_table;
+		this->share_slots = share_slots;
 
 		for(ASMDeclaration *decl : this->program->decls)
 		{
@@ -48,14 +79,196 @@ public:
 	}
 
 
+	void print_stats()
+	{
+		int size = 0;
+		int unshared_size = 0;
+
+		for (FrameInfo &frame : this->frames)
+		{
+			size += frame.size;
+			unshared_size += frame.unshared_size;
+		}
+
+		std::cout << "pseudo : " << size << " bytes of stack slots in " << this->frames.size()
+		          << " functions, " << unshared_size << " without sharing" << std::endl;
+	}
+
+
+	void print_report()
+	{
+		for (FrameInfo &frame : this->frames)
+		{
+			std::cout << "frame " << frame.ident << " : " << frame.pseudos << " pseudos in " << frame.slots << " slots, "
+			          << frame.size << " bytes (" << frame.unshared_size << " without sharing)" << std::endl;
+		}
+	}
+
+
 	void replace_function(ASMFunction *decl)
 	{	
 		this->stack_counter = 0;
+		this->table.clear();
+		this->frames.push_back(FrameInfo(decl->ident));
+
+		if (this->share_slots)
+		{
+			assign_slots(decl);
+		}
+
 		for (ASMInstruction *inst : decl->instructions)
 		{
 			replace_instruction(inst);
 		}
 		decl->add_stack_counter(this->stack_counter);
+
+		this->frames.back().size = this->stack_counter;
+	}
+
+
+	static int get_slot_size(ASMType type)
+	{
+		switch (type)
+		{
+			case ASMType::I32:
+			case ASMType::U32:
+			{
+				return 4;
+			}
+			case ASMType::I64:
+			case ASMType::U64:
+			{
+				return 8;
+			}
+			default:
+			{
+				DEBUG_PANIC("replace pseudo => unsupported data type");
+			}
+		}
+
+		return 0;
+	}
+
+
+	// offset of a slot of its own, aligned to its size
+	int add_slot(int size)
+	{
+		this->stack_counter = (this->stack_counter + size - 1) / size * size + size;
+		return this->stack_counter;
+	}
+
+
+	void assign_slots(ASMFunction *decl)
+	{
+		std::set<std::string> address_taken;
+		std::map<std::string,int> sizes;
+
+		for (ASMInstruction *inst : decl->instructions)
+		{
+			std::vector<ASMOperand *> operands;
+			ASMLiveness::get_operands(inst,operands,operands);
+
+			for (ASMOperand *operand : operands)
+			{
+				if (operand->type == ASMOperandType::PSEUDO)
+				{
+					ASMPseudo *asm_pseudo = (ASMPseudo *)operand->operand;
+					sizes[asm_pseudo->ident] = std::max(sizes[asm_pseudo->ident],get_slot_size(asm_pseudo->data_type));
+				}
+			}
+
+			if (inst->type == ASMInstructionType::LEA)
+			{
+				ASMOperand *src = ((ASMLeaInst *)inst->instruction)->src;
+
+				if (src->type == ASMOperandType::PSEUDO)
+				{
+					address_taken.insert(((ASMPseudo *)src->operand)->ident);
+				}
+			}
+		}
+
+		ASMLiveness liveness(decl);
+		InterferenceGraph graph(&liveness);
+
+		// largest first, then in order of first appearance
+		std::vector<std::pair<int,int>> order;
+
+		for (auto &[ident,node] : liveness.pseudo_node)
+		{
+			bool global = this->symbol_table.lookup(ident) and this->symbol_table.get(ident).global;
+
+			if (not global and not address_taken.count(ident))
+			{
+				order.push_back({-sizes[ident],node});
+			}
+		}
+
+		std::sort(order.begin(),order.end());
+
+		std::vector<std::vector<int>> slots;
+		std::vector<int> slot_size;
+		std::vector<int> slot_of(liveness.names.size(),-1);
+		FrameInfo &frame = this->frames.back();
+
+		for (auto &[negative_size,node] : order)
+		{
+			int size = -negative_size;
+			int slot = 0;
+
+			for (; slot < slots.size(); slot++)
+			{
+				if (slot_size[slot] != size)
+				{
+					continue;
+				}
+
+				bool free = true;
+
+				for (int other : slots[slot])
+				{
+					if (graph.interferes(node,other))
+					{
+						free = false;
+						break;
+					}
+				}
+
+				if (free)
+				{
+					break;
+				}
+			}
+
+			if (slot == slots.size())
+			{
+				slots.push_back({});
+				slot_size.push_back(size);
+			}
+
+			slots[slot].push_back(node);
+			slot_of[node] = slot;
+			frame.unshared_size += size;
+		}
+
+		// sizes are in decreasing order, so the offsets stay aligned
+		std::vector<int> slot_offset;
+
+		for (int slot = 0; slot < slots.size(); slot++)
+		{
+			slot_offset.push_back(add_slot(slot_size[slot]));
+		}
+
+		for (auto &[ident,node] : liveness.pseudo_node)
+		{
+			if (slot_of[node] != -1)
+			{
+				this->table[ident] = slot_offset[slot_of[node]];
+			}
+		}
+
+		frame.pseudos = this->table.size();
+		frame.slots = slots.size();
 	}
 
 
@@ -73,6 +286,16 @@ public:
 				replace_mov_inst((ASMMovInst *)inst->instruction);
 				break;
 			}
+			case ASMInstructionType::MOVSX:
+			{
+				replace_movsx_inst((ASMMovSxInst *)inst->instruction);
+				break;
+			}
+			case ASMInstructionType::MOVZEROEXTEND:
+			{
+				replace_mov_zero_extend_inst((ASMMovZeroExtendInst *)inst->instruction);
+				break;
+			}
 			case ASMInstructionType::LEA:
 			{
 				replace_lea_inst((ASMLeaInst *)inst->instruction);
@@ -103,6 +326,56 @@ public:
 				replace_neg_inst((ASMNegInst *)inst->instruction);
 				break;
 			}
+			case ASMInstructionType::IMUL:
+			{
+				replace_imul_inst((ASMImulInst *)inst->instruction);
+				break;
+			}
+			case ASMInstructionType::AND:
+			{
+				replace_and_inst((ASMAndInst *)inst->instruction);
+				break;
+			}
+			case ASMInstructionType::OR:
+			{
+				replace_or_inst((ASMOrInst *)inst->instruction);
+				break;
+			}
+			case ASMInstructionType::XOR:
+			{
+				replace_xor_inst((ASMXorInst *)inst->instruction);
+				break;
+			}
+			case ASMInstructionType::SHL:
+			{
+				replace_shl_inst((ASMShlInst *)inst->instruction);
+				break;
+			}
+			case ASMInstructionType::SAR:
+			{
+				replace_sar_inst((ASMSarInst *)inst->instruction);
+				break;
+			}
+			case ASMInstructionType::SHR:
+			{
+				replace_shr_inst((ASMShrInst *)inst->instruction);
+				break;
+			}
+			case ASMInstructionType::MUL:
+			{
+				replace_mul_inst((ASMMulInst *)inst->instruction);
+				break;
+			}
+			case ASMInstructionType::DIV:
+			{
+				replace_div_inst((ASMDivInst *)inst->instruction);
+				break;
+			}
+			case ASMInstructionType::PUSH:
+			{
+				replace_push_inst((ASMPushInst *)inst->instruction);
+				break;
+			}
 		}
 	}
 
@@ -123,6 +396,18 @@ public:
 		replace_operand(inst->dst);
 		replace_operand(inst->src);
 	}
+
+	void replace_movsx_inst(ASMMovSxInst *inst)
+	{
+		replace_operand(inst->dst);
+		replace_operand(inst->src);
+	}
+
+	void replace_mov_zero_extend_inst(ASMMovZeroExtendInst *inst)
+	{
+		replace_operand(inst->dst);
+		replace_operand(inst->src);
+	}
 	
 	void replace_add_inst(ASMAddInst *inst)
 	{
@@ -151,6 +436,63 @@ public:
 	{
 		replace_operand(inst->dst);
 	}
+
+	void replace_imul_inst(ASMImulInst *inst)
+	{
+		replace_operand(inst->dst);
+		replace_operand(inst->src);
+	}
+
+	void replace_and_inst(ASMAndInst *inst)
+	{
+		replace_operand(inst->dst);
+		replace_operand(inst->src);
+	}
+
+	void replace_or_inst(ASMOrInst *inst)
+	{
+		replace_operand(inst->dst);
+		replace_operand(inst->src);
+	}
+
+	void replace_xor_inst(ASMXorInst *inst)
+	{
+		replace_operand(inst->dst);
+		replace_operand(inst->src);
+	}
+
+	void replace_shl_inst(ASMShlInst *inst)
+	{
+		replace_operand(inst->dst);
+		replace_operand(inst->src);
+	}
+
+	void replace_sar_inst(ASMSarInst *inst)
+	{
+		replace_operand(inst->dst);
+		replace_operand(inst->src);
+	}
+
+	void replace_shr_inst(ASMShrInst *inst)
+	{
+		replace_operand(inst->dst);
+		replace_operand(inst->src);
+	}
+
+	void replace_mul_inst(ASMMulInst *inst)
+	{
+		replace_operand(inst->src);
+	}
+
+	void replace_div_inst(ASMDivInst *inst)
+	{
+		replace_operand(inst->src);
+	}
+
+	void replace_push_inst(ASMPushInst *inst)
+	{
+		replace_operand(inst->dst);
+	}
 	
 
 
@@ -182,7 +524,7 @@ public:
 							case ASMType::I64:
 							{
 								void *mem = alloc(sizeof(ASMData));
-								ASMData *asm_data = new(mem) ASMData(4,key);
+								ASMData *asm_data = new(mem) ASMData(8,key);
 								operand->type = ASMOperandType::DATA;
 								operand->operand = asm_data;
 								break;
@@ -198,7 +540,7 @@ public:
 							case ASMType::U64:
 							{
 								void *mem = alloc(sizeof(ASMData));
-								ASMData *asm_data = new(mem) ASMData(4,key);
+								ASMData *asm_data = new(mem) ASMData(8,key);
 								operand->type = ASMOperandType::DATA;
 								operand->operand = asm_data;
 								break;
@@ -211,100 +553,23 @@ public:
 					}
 					else
 					{
-						switch(type)
-						{
-							case ASMType::I32:
-							{
-								void *mem = alloc(sizeof(ASMStack));
-								this->stack_counter += 4;
-								this->table[key] = this->stack_counter;
-								ASMStack *asm_stack = new(mem) ASMStack(4,"rbp",this->stack_counter);
-								operand->type = ASMOperandType::STACK;
-								operand->operand = asm_stack;
-								break;
-							}
-							case ASMType::I64:
-							{
-								void *mem = alloc(sizeof(ASMStack));
-								this->stack_counter += 8;
-								this->table[key] = this->stack_counter;
-								ASMStack *asm_stack = new(mem) ASMStack(8,"rbp",this->stack_counter);
-								operand->type = ASMOperandType::STACK;
-								operand->operand = asm_stack;
-								break;
-							}
-							case ASMType::U32:
-							{
-								void *mem = alloc(sizeof(ASMStack));
-								this->stack_counter += 4;
-								this->table[key] = this->stack_counter;
-								ASMStack *asm_stack = new(mem) ASMStack(4,"rbp",this->stack_counter);
-								operand->type = ASMOperandType::STACK;
-								operand->operand = asm_stack;
-								break;
-							}
-							case ASMType::U64:
-							{
-								void *mem = alloc(sizeof(ASMStack));
-								this->stack_counter += 8;
-								this->table[key] = this->stack_counter;
-								ASMStack *asm_stack = new(mem) ASMStack(8,"rbp",this->stack_counter);
-								operand->type = ASMOperandType::STACK;
-								operand->operand = asm_stack;
-								break;
-							}
-							default:
-							{
-								DEBUG_PANIC("replace pseudo => unsupported data type");
-							}
-						}
+						// address taken, or every pseudo without share_slots
+						int size = get_slot_size(type);
+						this->table[key] = add_slot(size);
+
+						FrameInfo &frame = this->frames.back();
+						frame.pseudos++;
+						frame.slots++;
+						frame.unshared_size += size;
 					}
 				}
-				else
+
+				if (this->table.count(key))
 				{
-					switch (type)
-					{
-						case ASMType::I32:
-						{
-							void *mem = alloc(sizeof(ASMStack));
-							int tmp_stack_counter = this->table[key];
-							ASMStack *asm_stack = new(mem) ASMStack(4,"rbp",tmp_stack_counter);
-							operand->type = ASMOperandType::STACK;
-							operand->operand = asm_stack;
-							break;
-						}
-						case ASMType::I64:
-						{
-							void *mem = alloc(sizeof(ASMStack));
-							int tmp_stack_counter = this->table[key];
-							ASMStack *asm_stack = new(mem) ASMStack(8,"rbp",tmp_stack_counter);
-							operand->type = ASMOperandType::STACK;
-							operand->operand = asm_stack;
-							break;
-						}
-						case ASMType::U32:
-						{
-							void *mem = alloc(sizeof(ASMStack));
-							int tmp_stack_counter = this->table[key];
-							ASMStack *asm_stack = new(mem) ASMStack(4,"rbp",tmp_stack_counter);
-							operand->type = ASMOperandType::STACK;
-							operand->operand = asm_stack;
-							break;
-						}
-						case ASMType::U64:
-						{
-							void *mem = alloc(sizeof(ASMStack));
-							int tmp_stack_counter = this->table[key];
-							ASMStack *asm_stack = new(mem) ASMStack(8,"rbp",tmp_stack_counter);
-							operand->type = ASMOperandType::STACK;
-							operand->operand = asm_stack;
-							break;
-						}
-						default:
-						{
-							DEBUG_PANIC("replace pseudo => unsupported data type");
-						}
-					}
+					void *mem = alloc(sizeof(ASMStack));
+					ASMStack *asm_stack = new(mem) ASMStack(get_slot_size(type),"rbp",this->table[key]);
+					operand->type = ASMOperandType::STACK;
+					operand->operand = asm_stack;
 				}
 			}
 		}
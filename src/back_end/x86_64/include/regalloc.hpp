@@ -0,0 +1,534 @@
+#ifndef C4C_REGALLOC_H
+#define C4C_REGALLOC_H
+
+#include "intel64.hpp"
+#include "liveness.hpp"
+#include <algorithm>
+#include <map>
+#include <set>
+
+
+/*
+ * Linear scan register allocation (Poletto and Sarkar) over the pseudo
+ * operands produced by TacToIntel64. Runs before Pseudo : everything left
+ * as a pseudo afterwards (spills, globals, address taken values) still
+ * gets a stack slot there.
+ *
+ * Intervals come from ASMLiveness, so a value that is live around a loop
+ * back edge covers the whole loop. A physical register is blocked wherever
+ * ASMLiveness has it live (argument setup up to the call, return value up
+ * to the ret, every caller saved register at a call). Caller saved
+ * registers are tried first, values live across a call end up in rbx or
+ * r12-r15 which are saved in the prologue and restored before every ret.
+ * A value that is move related to an allocated one tries that register
+ * first so the move becomes a self move. rax and r11 stay free as
+ * scratch for TacToIntel64 and FixUp.
+ */
+
+class LiveInterval
+{
+public:
+	std::string ident;
+	ASMType data_type;
+	int node;
+	int start = -1;
+	int end = -1;
+	bool has_register = false;
+	ASMRegisterType reg;
+
+	LiveInterval(std::string ident,ASMType data_type,int node)
+	{
+		this->ident = ident;
+		this->data_type = data_type;
+		this->node = node;
+	}
+
+	void extend(int position)
+	{
+		if (this->start == -1 or position < this->start)
+		{
+			this->start = position;
+		}
+
+		if (position > this->end)
+		{
+			this->end = position;
+		}
+	}
+};
+
+
+class RegAlloc
+{
+public:
+	std::string file_name;
+	ASMProgram *program;
+	Arena *arena;
+	SymbolTable symbol_table;
+
+	std::vector<LiveInterval> intervals;
+	std::map<std::string,int> interval_of;
+	std::map<ASMRegisterType,std::vector<int>> fixed;
+	std::set<ASMRegisterType> callee_saved_used;
+
+	int total = 0;
+	int allocated = 0;
+	int spilled = 0;
+	int coalesced = 0;
+	int saved = 0;
+
+	RegAlloc(std::string file_name,ASMProgram *program,Arena *arena,SymbolTable symbol_table)
+	{
+		this->file_name = file_name;
+		this->program = program;
+		this->arena = arena;
+		this->symbol_table = symbol_table;
+
+		for (ASMDeclaration *decl : this->program->decls)
+		{
+			if (decl->type == ASMDeclarationType::FUNCTION)
+			{
+				allocate_function((ASMFunction *)decl->decl);
+			}
+		}
+	}
+
+
+	void *alloc(int size)
+	{
+		return this->arena->alloc(size);
+	}
+
+
+	void print_stats()
+	{
+		std::cout << "regalloc : " << this->allocated << " of " << this->total << " values in registers, "
+		          << this->spilled << " spilled, " << this->coalesced << " moves coalesced, "
+		          << this->saved << " callee saved registers" << std::endl;
+	}
+
+
+	static std::vector<ASMRegisterType> get_allocatable()
+	{
+		return {
+			ASMRegisterType::R10,
+			ASMRegisterType::R9,
+			ASMRegisterType::R8,
+			ASMRegisterType::RCX,
+			ASMRegisterType::RDX,
+			ASMRegisterType::RSI,
+			ASMRegisterType::RDI,
+			ASMRegisterType::RBX,
+			ASMRegisterType::R12,
+			ASMRegisterType::R13,
+			ASMRegisterType::R14,
+			ASMRegisterType::R15,
+		};
+	}
+
+
+	static bool is_callee_saved(ASMRegisterType reg)
+	{
+		return reg == ASMRegisterType::RBX or reg == ASMRegisterType::R12 or reg == ASMRegisterType::R13 or
+		       reg == ASMRegisterType::R14 or reg == ASMRegisterType::R15;
+	}
+
+
+	bool is_candidate(std::string ident,std::set<std::string> &address_taken)
+	{
+		if (address_taken.count(ident))
+		{
+			return false;
+		}
+
+		return not (this->symbol_table.lookup(ident) and this->symbol_table.get(ident).global);
+	}
+
+
+	void allocate_function(ASMFunction *fn)
+	{
+		this->intervals.clear();
+		this->interval_of.clear();
+		this->fixed.clear();
+		this->callee_saved_used.clear();
+
+		ASMLiveness liveness(fn);
+		InterferenceGraph graph(&liveness);
+
+		build_intervals(fn,liveness);
+		linear_scan(graph);
+		rewrite(fn->instructions);
+		save_callee_saved(fn);
+	}
+
+
+	void build_intervals(ASMFunction *fn,ASMLiveness &liveness)
+	{
+		std::vector<ASMInstruction *> &insts = fn->instructions;
+		std::set<std::string> address_taken;
+		std::map<std::string,ASMType> data_types;
+
+		for (ASMInstruction *inst : insts)
+		{
+			std::vector<ASMOperand *> reads;
+			std::vector<ASMOperand *> writes;
+			ASMLiveness::get_operands(inst,reads,writes);
+			reads.insert(reads.end(),writes.begin(),writes.end());
+
+			for (ASMOperand *operand : reads)
+			{
+				if (operand->type == ASMOperandType::PSEUDO)
+				{
+					data_types[((ASMPseudo *)operand->operand)->ident] = ((ASMPseudo *)operand->operand)->data_type;
+				}
+			}
+
+			if (inst->type == ASMInstructionType::LEA)
+			{
+				ASMOperand *src = ((ASMLeaInst *)inst->instruction)->src;
+
+				if (src->type == ASMOperandType::PSEUDO)
+				{
+					address_taken.insert(((ASMPseudo *)src->operand)->ident);
+				}
+			}
+		}
+
+		std::vector<int> interval_of_node(liveness.names.size(),-1);
+
+		for (auto &[ident,node] : liveness.pseudo_node)
+		{
+			if (is_candidate(ident,address_taken))
+			{
+				interval_of_node[node] = this->intervals.size();
+				this->interval_of[ident] = this->intervals.size();
+				this->intervals.push_back(LiveInterval(ident,data_types[ident],node));
+			}
+		}
+
+		// a register is blocked wherever it is read, written or live
+		for (int i = 0; i < insts.size(); i++)
+		{
+			for (std::vector<int> *nodes : {&liveness.live_after[i],&liveness.defs[i],&liveness.uses[i]})
+			{
+				for (int node : *nodes)
+				{
+					if (ASMLiveness::is_register_node(node))
+					{
+						std::vector<int> &positions = this->fixed[(ASMRegisterType)(node + 1)];
+
+						if (positions.empty() or positions.back() != i)
+						{
+							positions.push_back(i);
+						}
+					}
+					else if (interval_of_node[node] != -1)
+					{
+						this->intervals[interval_of_node[node]].extend(i);
+					}
+				}
+			}
+		}
+	}
+
+
+	// true if reg is blocked anywhere inside [start,end]
+	bool is_blocked(ASMRegisterType reg,int start,int end)
+	{
+		auto it = this->fixed.find(reg);
+
+		if (it == this->fixed.end())
+		{
+			return false;
+		}
+
+		auto position = std::lower_bound(it->second.begin(),it->second.end(),start);
+		return position != it->second.end() and *position <= end;
+	}
+
+
+	// register of an allocated move partner, taking it turns the move
+	// between them into a self move
+	bool get_hint(LiveInterval &interval,InterferenceGraph &graph,std::set<ASMRegisterType> &busy,ASMRegisterType &reg)
+	{
+		for (int partner : graph.move_partners[interval.node])
+		{
+			if (ASMLiveness::is_register_node(partner))
+			{
+				continue;
+			}
+
+			auto it = this->interval_of.find(graph.liveness->names[partner]);
+
+			if (it == this->interval_of.end())
+			{
+				continue;
+			}
+
+			LiveInterval &other = this->intervals[it->second];
+
+			if (other.has_register and not busy.count(other.reg) and not is_blocked(other.reg,interval.start,interval.end))
+			{
+				reg = other.reg;
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+
+	void linear_scan(InterferenceGraph &graph)
+	{
+		std::vector<int> order;
+
+		for (int i = 0; i < this->intervals.size(); i++)
+		{
+			if (this->intervals[i].start != -1)
+			{
+				order.push_back(i);
+			}
+		}
+
+		std::sort(order.begin(),order.end(),[this](int a,int b)
+		{
+			return this->intervals[a].start < this->intervals[b].start;
+		});
+
+		std::vector<int> active;
+
+		for (int current : order)
+		{
+			LiveInterval &interval = this->intervals[current];
+			this->total++;
+
+			// an interval ending where this one starts only reads there, so the
+			// register can be reused for the value written at the same position
+			active.erase(std::remove_if(active.begin(),active.end(),[this,&interval](int other)
+			{
+				return this->intervals[other].end <= interval.start;
+			}),active.end());
+
+			std::set<ASMRegisterType> busy;
+
+			for (int other : active)
+			{
+				busy.insert(this->intervals[other].reg);
+			}
+
+			ASMRegisterType hint;
+
+			if (get_hint(interval,graph,busy,hint))
+			{
+				interval.has_register = true;
+				interval.reg = hint;
+				this->coalesced++;
+			}
+
+			for (ASMRegisterType reg : get_allocatable())
+			{
+				if (interval.has_register)
+				{
+					break;
+				}
+
+				if (not busy.count(reg) and not is_blocked(reg,interval.start,interval.end))
+				{
+					interval.has_register = true;
+					interval.reg = reg;
+				}
+			}
+
+			if (interval.has_register)
+			{
+				active.push_back(current);
+				continue;
+			}
+
+			// spill whichever usable interval lives longest
+			int victim = -1;
+
+			for (int other : active)
+			{
+				if (is_blocked(this->intervals[other].reg,interval.start,interval.end))
+				{
+					continue;
+				}
+
+				if (victim == -1 or this->intervals[other].end > this->intervals[victim].end)
+				{
+					victim = other;
+				}
+			}
+
+			if (victim != -1 and this->intervals[victim].end > interval.end)
+			{
+				interval.has_register = true;
+				interval.reg = this->intervals[victim].reg;
+				this->intervals[victim].has_register = false;
+				active.erase(std::find(active.begin(),active.end(),victim));
+				active.push_back(current);
+			}
+
+			this->spilled++;
+		}
+
+		for (LiveInterval &interval : this->intervals)
+		{
+			if (interval.has_register)
+			{
+				this->allocated++;
+
+				if (is_callee_saved(interval.reg))
+				{
+					this->callee_saved_used.insert(interval.reg);
+				}
+			}
+		}
+	}
+
+
+	int get_size(ASMType data_type)
+	{
+		switch (data_type)
+		{
+			case ASMType::I32:
+			case ASMType::U32:
+			{
+				return 4;
+			}
+			default:
+			{
+				return 8;
+			}
+		}
+	}
+
+
+	ASMOperand *make_register(ASMRegisterType reg,int size,ASMType data_type)
+	{
+		void *mem = alloc(sizeof(ASMRegister));
+		ASMRegister *asm_reg = new(mem) ASMRegister(reg,size);
+
+		mem = alloc(sizeof(ASMOperand));
+		ASMOperand *asm_operand = new(mem) ASMOperand(ASMOperandType::REGISTER,asm_reg);
+		asm_operand->add_type(data_type);
+		return asm_operand;
+	}
+
+
+	void rewrite_operand(ASMOperand *operand)
+	{
+		if (operand == nullptr or operand->type != ASMOperandType::PSEUDO)
+		{
+			return;
+		}
+
+		auto it = this->interval_of.find(((ASMPseudo *)operand->operand)->ident);
+
+		if (it == this->interval_of.end() or not this->intervals[it->second].has_register)
+		{
+			return;
+		}
+
+		LiveInterval &interval = this->intervals[it->second];
+
+		void *mem = alloc(sizeof(ASMRegister));
+		operand->operand = new(mem) ASMRegister(interval.reg,get_size(interval.data_type));
+		operand->type = ASMOperandType::REGISTER;
+	}
+
+
+	void rewrite(std::vector<ASMInstruction *> &insts)
+	{
+		for (ASMInstruction *inst : insts)
+		{
+			std::vector<ASMOperand *> reads;
+			std::vector<ASMOperand *> writes;
+			ASMLiveness::get_operands(inst,reads,writes);
+
+			for (ASMOperand *operand : reads)
+			{
+				rewrite_operand(operand);
+			}
+
+			for (ASMOperand *operand : writes)
+			{
+				rewrite_operand(operand);
+			}
+		}
+	}
+
+
+	ASMInstruction *make_mov(ASMOperand *dst,ASMOperand *src)
+	{
+		void *mem = alloc(sizeof(ASMMovInst));
+		ASMMovInst *asm_mov = new(mem) ASMMovInst(dst,src);
+		asm_mov->add_type(ASMType::I64);
+
+		mem = alloc(sizeof(ASMInstruction));
+		return new(mem) ASMInstruction(ASMInstructionType::MOV,asm_mov);
+	}
+
+
+	// callee saved registers go to pseudo slots that Pseudo turns into
+	// stack slots, stored after `push rbp ; mov rbp,rsp` and reloaded
+	// before the `mov rsp,rbp` of every epilogue
+	void save_callee_saved(ASMFunction *fn)
+	{
+		std::vector<ASMInstruction *> &insts = fn->instructions;
+
+		for (ASMRegisterType reg : this->callee_saved_used)
+		{
+			this->saved++;
+
+			void *mem = alloc(sizeof(ASMPseudo));
+			ASMPseudo *asm_pseudo = new(mem) ASMPseudo("c4_save." + ASMLiveness::get_register_name(reg));
+			asm_pseudo->add_type(ASMType::I64);
+
+			mem = alloc(sizeof(ASMOperand));
+			ASMOperand *slot = new(mem) ASMOperand(ASMOperandType::PSEUDO,asm_pseudo);
+			slot->add_type(ASMType::I64);
+
+			insts.insert(insts.begin() + 2,make_mov(slot,make_register(reg,8,ASMType::I64)));
+
+			for (int i = 0; i < insts.size(); i++)
+			{
+				if (insts[i]->type != ASMInstructionType::RET)
+				{
+					continue;
+				}
+
+				int epilogue = i;
+
+				while (epilogue > 0)
+				{
+					epilogue--;
+
+					if (insts[epilogue]->type != ASMInstructionType::MOV)
+					{
+						continue;
+					}
+
+					ASMOperand *dst = ((ASMMovInst *)insts[epilogue]->instruction)->dst;
+
+					if (dst->type == ASMOperandType::REGISTER and ((ASMRegister *)dst->operand)->type == ASMRegisterType::RSP)
+					{
+						break;
+					}
+				}
+
+				if (epilogue == 0)
+				{
+					DEBUG_PANIC("regalloc : ret without epilogue in " + fn->ident);
+				}
+
+				insts.insert(insts.begin() + epilogue,make_mov(make_register(reg,8,ASMType::I64),slot));
+				i++;
+			}
+		}
+	}
+};
+
+
+#endif
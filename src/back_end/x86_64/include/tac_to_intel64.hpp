@@ -3,6 +3,22 @@
 
 #include "intel64.hpp"
 //#include "../../../middle_end/tac/include/tac.hpp"
+#include "../../../middle_end/tac/include/tac_cfg.hpp"
+
+
+// base + index * scale + displacement matched over a tree of single use
+// temporaries, direct is the variable when the tree is just &variable
+class ASMAddressMode
+{
+public:
+	TACValue *base = nullptr;
+	TACValue *index = nullptr;
+	int scale = 1;
+	long int displacement = 0;
+	TACValue *direct = nullptr;
+	std::vector<int> folded;
+};
+
 
 class TacToIntel64
 {
@@ -13,6 +29,14 @@ public:
 	std::string string;
 	Arena *arena;
 	std::vector<ASMInstruction *> *inst = nullptr;
+	std::vector<TACInstruction *> *tac_inst = nullptr;
+	std::map<int,int> use_count;
+	std::map<int,int> def_index;
+	std::set<int> folded;
+	std::map<int,ASMAddressMode> address_modes;
+	int fused_branches = 0;
+	int folded_addresses = 0;
+	int lea_adds = 0;
 	
 	TacToIntel64(std::string file_name,TACProgram *tac_program,Arena *arena)
 	{
@@ -42,6 +66,13 @@ public:
 	}
 
 
+	void print_stats()
+	{
+		std::cout << "isel : " << this->fused_branches << " compare and branch pairs fused, " << this->folded_addresses <<
+			" addresses folded, " << this->lea_adds << " add chains as lea" << std::endl;
+	}
+
+
 	ASMDeclaration *convert_decl(TACDeclaration *decl)
 	{
 		void *mem = alloc(sizeof(ASMDeclaration));
@@ -149,12 +180,6 @@ public:
 		
 		for (int i = 0; i < decl->arguments.size(); i++)
 		{
-			ASMRegisterType reg = arg_registers[i];
-			if (i >= 6)
-			{
-				break;
-			}
-
 			TACArgument arg = decl->arguments[i];
 			int size =0;
 
@@ -188,36 +213,61 @@ public:
 			asm_dst = new(mem) ASMOperand(ASMOperandType::PSEUDO,asm_pseudo);
 			asm_dst->add_type(data_type);
 
-			mem = alloc(sizeof(ASMRegister));
-			ASMRegister *asm_reg = new(mem) ASMRegister(reg,size);
-			
-			mem = alloc(sizeof(ASMOperand));
-			ASMOperand *asm_src = new(mem) ASMOperand(ASMOperandType::REGISTER,asm_reg);
-			asm_src->add_type(data_type);
+			ASMOperand *asm_src;
 
-			mem = alloc(sizeof(ASMMovInst));
-			ASMMovInst *asm_mov = new(mem) ASMMovInst(asm_dst,asm_src);
-			asm_mov->add_type(data_type);
-			
-			mem = alloc(sizeof(ASMInstruction));
-			ASMInstruction *asm_inst = new(mem) ASMInstruction(ASMInstructionType::MOV,asm_mov);
-			this->inst->push_back(asm_inst);	
+			if (i < 6)
+			{
+				asm_src = make_register(arg_registers[i],size,data_type);
+			}
+			else
+			{
+				// the caller pushed the rest right to left, the first one
+				// sits above the return address and the saved rbp
+				mem = alloc(sizeof(ASMStack));
+				ASMStack *asm_stack = new(mem) ASMStack(size,"rbp",-(16 + 8 * (i - 6)));
+
+				mem = alloc(sizeof(ASMOperand));
+				asm_src = new(mem) ASMOperand(ASMOperandType::STACK,asm_stack);
+				asm_src->add_type(data_type);
+			}
+
+			add_mov(asm_dst,asm_src);
 		}
 
 
 
 
 		
-		for (TACInstruction *inst : decl->instructions)
+		count_uses(decl);
+		select_addresses(decl);
+
+		for (int i = 0; i < decl->instructions.size(); i++)
 		{
-			if (inst == nullptr)
+			TACInstruction *inst = decl->instructions[i];
+			if (inst == nullptr or this->folded.count(i))
 			{
 				continue;
 			}
 			DEBUG_PRINT("here "," inst loop");
+
+			if (i + 1 < decl->instructions.size() and convert_compare_and_branch(inst,decl->instructions[i + 1]))
+			{
+				i++;
+				continue;
+			}
+
+			auto mode = this->address_modes.find(i);
+
+			if (mode != this->address_modes.end())
+			{
+				convert_address_root(inst,mode->second);
+				continue;
+			}
 			convert_instruction(inst);
 		}
 
+		this->tac_inst = nullptr;
+
 		this->inst = nullptr;
 		return asm_fn;
 	}
@@ -292,6 +342,11 @@ public:
 				convert_sign_extend_inst((TACSignExtendInst *)inst->instruction);
 				break;
 			}
+			case TACInstructionType::ZERO_EXTEND:
+			{
+				convert_zero_extend_inst((TACZeroExtendInst *)inst->instruction);
+				break;
+			}
 			case TACInstructionType::TRUNCATE:
 			{
 				convert_truncate_inst((TACTruncateInst *)inst->instruction);
@@ -499,6 +554,7 @@ public:
 
 		void *mem = alloc(sizeof(ASMCallInst));
 		ASMCallInst *asm_call = new(mem) ASMCallInst(inst->ident);
+		asm_call->add_register_args(register_args.size());
 		
 		mem = alloc(sizeof(ASMInstruction));
 		ASMInstruction *asm_inst = new(mem) ASMInstruction(ASMInstructionType::CALL,asm_call);
@@ -571,7 +627,7 @@ public:
 	void convert_label_inst(TACLabelInst *inst)
 	{
 		void *mem = alloc(sizeof(ASMLabelInst));
-		ASMLabelInst *asm_label = new(mem) ASMLabelInst(inst->label);
+		ASMLabelInst *asm_label = new(mem) ASMLabelInst(get_label_name(inst->label));
 
 		mem = alloc(sizeof(ASMInstruction));
 		ASMInstruction *asm_inst = new(mem) ASMInstruction(ASMInstructionType::LABEL,asm_label);
@@ -579,410 +635,1574 @@ public:
 
 	}
 
-	void convert_jmp_zero_inst(TACJmpIfZeroInst *inst)
+	void count_uses(TACFunction *decl)
 	{
-		ASMOperand *asm_value = convert_value(inst->value);
-
-		void *mem = alloc(sizeof(int));
-		int *int_value = new(mem) int;
-		*int_value = 0;
+		this->use_count.clear();
 
-		mem = alloc(sizeof(ASMImmediate));
-		ASMImmediate *asm_imm = new(mem) ASMImmediate(ASMImmediateType::I32,int_value);
-		
-		mem = alloc(sizeof(ASMOperand));
-		ASMOperand *asm_operand = new(mem) ASMOperand(ASMOperandType::IMMEDIATE,asm_imm);
+		for (TACInstruction *inst : decl->instructions)
+		{
+			if (inst == nullptr)
+			{
+				continue;
+			}
 
-		mem = alloc(sizeof(ASMCmpInst));
-		ASMCmpInst *asm_cmp = new(mem) ASMCmpInst(asm_value,asm_operand);
+			for (TACValue **slot : TacCfg::get_use_slots(inst))
+			{
+				if ((*slot)->type == TACValueType::VARIABLE)
+				{
+					this->use_count[((TACVariable *)(*slot)->value)->id]++;
+				}
+			}
+		}
+	}
 
-		mem = alloc(sizeof(ASMInstruction));
-		ASMInstruction *asm_inst = new(mem) ASMInstruction(ASMInstructionType::CMP,asm_cmp);
-		this->inst->push_back(asm_inst);
 
+	/*
+	 * Tree patterns over single use temporaries. A load or store through
+	 * base + index * scale + displacement takes the whole tree as one memory
+	 * operand, &variable is read or written in place, and an add chain that
+	 * computes such an address becomes one lea. Roots are matched last to
+	 * first so a tree folded into a later root is never a root itself.
+	 */
+	void select_addresses(TACFunction *decl)
+	{
+		this->tac_inst = &decl->instructions;
+		this->def_index.clear();
+		this->folded.clear();
+		this->address_modes.clear();
 
-		mem = alloc(sizeof(ASMJmpCondInst));
-		ASMJmpCondInst *asm_jmp_cond = new(mem) ASMJmpCondInst(ASMCondition::EQUAL,inst->label);
-		
-		mem = alloc(sizeof(ASMInstruction));
-		asm_inst = new(mem) ASMInstruction(ASMInstructionType::JMP_COND,asm_jmp_cond);
-		this->inst->push_back(asm_inst);
+		std::vector<TACInstruction *> &insts = decl->instructions;
 
-	}
+		for (int i = 0; i < insts.size(); i++)
+		{
+			int id = insts[i] == nullptr ? -1 : TacCfg::get_id(TacCfg::get_def(insts[i]));
 
+			if (id != -1)
+			{
+				this->def_index[id] = this->def_index.count(id) ? -1 : i;
+			}
+		}
 
-	void convert_jmp_not_zero_inst(TACJmpIfNotZeroInst *inst)
-	{
-		ASMOperand *asm_value = convert_value(inst->value);
+		for (int i = insts.size() - 1; i >= 0; i--)
+		{
+			if (insts[i] == nullptr or this->folded.count(i))
+			{
+				continue;
+			}
 
-		void *mem = alloc(sizeof(int));
-		int *int_value = new(mem) int;
-		*int_value = 0;
+			ASMAddressMode mode;
 
-		mem = alloc(sizeof(ASMImmediate));
-		ASMImmediate *asm_imm = new(mem) ASMImmediate(ASMImmediateType::I32,int_value);
-		
-		mem = alloc(sizeof(ASMOperand));
-		ASMOperand *asm_operand = new(mem) ASMOperand(ASMOperandType::IMMEDIATE,asm_imm);
+			switch (insts[i]->type)
+			{
+				case TACInstructionType::LOAD:
+				{
+					TACLoadInst *load = (TACLoadInst *)insts[i]->instruction;
+					match_pointer(load->src,load->dst,i,mode);
+					break;
+				}
+				case TACInstructionType::STORE:
+				{
+					TACStoreInst *store = (TACStoreInst *)insts[i]->instruction;
+					match_pointer(store->dst,store->src,i,mode);
+					break;
+				}
+				case TACInstructionType::BINARY:
+				{
+					TACBinaryInst *bin = (TACBinaryInst *)insts[i]->instruction;
 
-		mem = alloc(sizeof(ASMCmpInst));
-		ASMCmpInst *asm_cmp = new(mem) ASMCmpInst(asm_value,asm_operand);
+					if (is_address_type(bin->data_type) and not match_binary(bin,i,true,mode))
+					{
+						mode.folded.clear();
+					}
 
-		mem = alloc(sizeof(ASMInstruction));
-		ASMInstruction *asm_inst = new(mem) ASMInstruction(ASMInstructionType::CMP,asm_cmp);
-		this->inst->push_back(asm_inst);
+					if (not mode.folded.empty())
+					{
+						this->lea_adds++;
+					}
+					break;
+				}
+				default:
+				{
+					break;
+				}
+			}
 
+			if (mode.folded.empty())
+			{
+				continue;
+			}
 
-		mem = alloc(sizeof(ASMJmpCondInst));
-		ASMJmpCondInst *asm_jmp_cond = new(mem) ASMJmpCondInst(ASMCondition::NOT_EQUAL,inst->label);
-		
-		mem = alloc(sizeof(ASMInstruction));
-		asm_inst = new(mem) ASMInstruction(ASMInstructionType::JMP_COND,asm_jmp_cond);
-		this->inst->push_back(asm_inst);
+			for (int def : mode.folded)
+			{
+				this->folded.insert(def);
+			}
 
+			this->address_modes[i] = mode;
+		}
 	}
 
 
-
-	void convert_copy_inst(TACCopyInst *inst)
+	static bool is_address_type(TACType type)
 	{
-		ASMOperand *asm_dst = convert_value(inst->dst);
-		ASMOperand *asm_src = convert_value(inst->src);
-		
-		void *mem = alloc(sizeof(ASMMovInst));
-		ASMMovInst *asm_mov = new(mem) ASMMovInst(asm_dst,asm_src);
-		asm_mov->add_type(asm_dst->data_type);
-		
-		mem = alloc(sizeof(ASMInstruction));
-		ASMInstruction *asm_inst = new(mem) ASMInstruction(ASMInstructionType::MOV,asm_mov);
-		this->inst->push_back(asm_inst);
-	
+		return type == TACType::I64 or type == TACType::U64 or type == TACType::PTR;
 	}
 
 
+	static bool fits_displacement(long int value)
+	{
+		return value > -2147483648L and value <= 2147483647L;
+	}
 
 
-
-	void convert_load_inst(TACLoadInst *inst)
+	void match_pointer(TACValue *pointer,TACValue *value,int root,ASMAddressMode &mode)
 	{
-		ASMOperand *asm_dst = convert_value(inst->dst);
-		ASMOperand *asm_src = convert_value(inst->src);
-
+		int def = get_foldable_def(pointer,root);
 
-		void *mem = alloc(sizeof(ASMRegister));
-		ASMRegister *asm_reg = new(mem) ASMRegister(ASMRegisterType::RAX,8);
-		
+		if (def == -1)
+		{
+			return;
+		}
 
-		mem = alloc(sizeof(ASMOperand));
-		ASMOperand *asm_tmp = new(mem) ASMOperand(ASMOperandType::REGISTER,asm_reg);
-		asm_tmp->add_type(ASMType::I64);
+		TACInstruction *inst = this->tac_inst->at(def);
 
+		if (inst->type == TACInstructionType::GET_ADDRESS)
+		{
+			// in place only when the access has the variable's own width
+			TACValue *var = ((TACGetAddressInst *)inst->instruction)->src;
 
+			if (value->type == TACValueType::VARIABLE and
+			    ((TACVariable *)value->value)->data_type != ((TACVariable *)var->value)->data_type)
+			{
+				return;
+			}
 
-		
-		mem = alloc(sizeof(ASMMovInst));
-		ASMMovInst *asm_mov = new(mem) ASMMovInst(asm_tmp,asm_src);
-		asm_mov->add_type(ASMType::I64);
+			mode.direct = var;
+			mode.folded.push_back(def);
+			this->folded_addresses++;
+			return;
+		}
 
+		if (inst->type == TACInstructionType::BINARY and is_stable(def,root) and
+		    match_binary((TACBinaryInst *)inst->instruction,root,true,mode))
+		{
+			mode.folded.push_back(def);
+			this->folded_addresses++;
+		}
+	}
 
-		mem = alloc(sizeof(ASMInstruction));
-		ASMInstruction *asm_inst = new(mem) ASMInstruction(ASMInstructionType::MOV,asm_mov);
-		this->inst->push_back(asm_inst);
 
+	// bin = base + index * scale + displacement, false leaves mode untouched
+	bool match_binary(TACBinaryInst *bin,int root,bool allow_index,ASMAddressMode &mode)
+	{
+		if (not is_address_type(bin->data_type))
+		{
+			return false;
+		}
 
+		long int value = 0;
 
+		if (bin->op == TACBinaryOperator::SUB)
+		{
+			if (not get_constant(bin->src2,&value) or not fits_displacement(mode.displacement - value))
+			{
+				return false;
+			}
 
+			mode.displacement -= value;
+			match_base(bin->src1,root,mode);
+			return true;
+		}
 
+		if (bin->op != TACBinaryOperator::ADD)
+		{
+			return false;
+		}
 
-		mem = alloc(sizeof(ASMStack));
-		ASMStack *stack = new(mem)ASMStack(8,"rax",0);
+		TACValue *base = bin->src1;
+		TACValue *index = bin->src2;
 
+		if (get_constant(base,&value))
+		{
+			std::swap(base,index);
+		}
 
-		mem = alloc(sizeof(ASMOperand));
-		ASMOperand *asm_tmp2 = new(mem) ASMOperand(ASMOperandType::STACK,stack);
-		asm_tmp->add_type(ASMType::I64);
+		if (get_constant(index,&value))
+		{
+			if (not fits_displacement(mode.displacement + value))
+			{
+				return false;
+			}
 
+			mode.displacement += value;
+			match_base(base,root,mode);
+			return true;
+		}
 
-		mem = alloc(sizeof(ASMMovInst));
-		asm_mov = new(mem) ASMMovInst(asm_dst,asm_tmp2);
-		asm_mov->add_type(asm_dst->data_type);
+		if (not allow_index)
+		{
+			return false;
+		}
 
-		
-		mem = alloc(sizeof(ASMInstruction));
-		asm_inst = new(mem) ASMInstruction(ASMInstructionType::MOV,asm_mov);
-		this->inst->push_back(asm_inst);
-	
-	}
+		int scale = 0;
 
+		if (match_scaled_index(base,root,&scale) != -1 and match_scaled_index(index,root,&scale) == -1)
+		{
+			std::swap(base,index);
+		}
 
+		int def = match_scaled_index(index,root,&scale);
 
+		if (def != -1)
+		{
+			mode.index = ((TACBinaryInst *)this->tac_inst->at(def)->instruction)->src1;
+			mode.scale = scale;
+			mode.folded.push_back(def);
 
+			long int factor = 0;
 
+			if (get_constant(mode.index,&factor))
+			{
+				mode.index = ((TACBinaryInst *)this->tac_inst->at(def)->instruction)->src2;
+			}
+		}
+		else
+		{
+			mode.index = index;
+			mode.scale = 1;
+		}
 
+		match_base(base,root,mode);
+		return true;
+	}
 
 
-	void convert_store_inst(TACStoreInst *inst)
+	void match_base(TACValue *value,int root,ASMAddressMode &mode)
 	{
-		ASMOperand *asm_dst = convert_value(inst->dst);
-		ASMOperand *asm_src = convert_value(inst->src);
+		int def = get_foldable_def(value,root);
 
+		if (def != -1 and this->tac_inst->at(def)->type == TACInstructionType::BINARY and is_stable(def,root) and
+		    match_binary((TACBinaryInst *)this->tac_inst->at(def)->instruction,root,mode.index == nullptr,mode))
+		{
+			mode.folded.push_back(def);
+			return;
+		}
 
-		void *mem = alloc(sizeof(ASMRegister));
-		ASMRegister *asm_reg = new(mem) ASMRegister(ASMRegisterType::RAX,8);
-		
+		mode.base = value;
+	}
 
-		mem = alloc(sizeof(ASMOperand));
-		ASMOperand *asm_tmp = new(mem) ASMOperand(ASMOperandType::REGISTER,asm_reg);
-		asm_tmp->add_type(ASMType::I64);
 
+	// index * 1/2/4/8 or index << 0..3 in a foldable temporary, its def or -1
+	int match_scaled_index(TACValue *value,int root,int *scale)
+	{
+		int def = get_foldable_def(value,root);
 
+		if (def == -1 or this->tac_inst->at(def)->type != TACInstructionType::BINARY or not is_stable(def,root))
+		{
+			return -1;
+		}
 
-		
-		mem = alloc(sizeof(ASMMovInst));
-		ASMMovInst *asm_mov = new(mem) ASMMovInst(asm_tmp,asm_dst);
-		asm_mov->add_type(ASMType::I64);
+		TACBinaryInst *bin = (TACBinaryInst *)this->tac_inst->at(def)->instruction;
+		long int factor = 0;
 
+		if (not is_address_type(bin->data_type))
+		{
+			return -1;
+		}
 
-		mem = alloc(sizeof(ASMInstruction));
-		ASMInstruction *asm_inst = new(mem) ASMInstruction(ASMInstructionType::MOV,asm_mov);
-		this->inst->push_back(asm_inst);
+		if (bin->op == TACBinaryOperator::MUL and (get_constant(bin->src2,&factor) or get_constant(bin->src1,&factor)))
+		{
+			if (factor == 1 or factor == 2 or factor == 4 or factor == 8)
+			{
+				*scale = factor;
+				return def;
+			}
+		}
 
+		if (bin->op == TACBinaryOperator::SHIFT_LEFT and get_constant(bin->src2,&factor) and factor >= 0 and factor <= 3)
+		{
+			*scale = 1 << factor;
+			return def;
+		}
 
+		return -1;
+	}
 
 
+	// instruction defining the single use temporary value before root, or -1
+	int get_foldable_def(TACValue *value,int root)
+	{
+		if (not TacCfg::is_temporary(value))
+		{
+			return -1;
+		}
 
+		int id = TacCfg::get_id(value);
+		auto def = this->def_index.find(id);
 
-		mem = alloc(sizeof(ASMStack));
-		ASMStack *stack = new(mem)ASMStack(8,"rax",0);
+		if (this->use_count[id] != 1 or def == this->def_index.end() or def->second < 0 or def->second >= root)
+		{
+			return -1;
+		}
+
+		return def->second;
+	}
+
+
+	// the operands read by def still hold the same values at root
+	bool is_stable(int def,int root)
+	{
+		std::vector<TACValue **> reads = TacCfg::get_use_slots(this->tac_inst->at(def));
+
+		for (int i = def + 1; i < root; i++)
+		{
+			TACInstruction *inst = this->tac_inst->at(i);
+
+			if (inst == nullptr)
+			{
+				continue;
+			}
+
+			if (inst->type == TACInstructionType::LABEL or TacCfg::is_jump(inst) or TacCfg::is_terminator(inst) or
+			    TacCfg::writes_memory(inst))
+			{
+				return false;
+			}
+
+			int id = TacCfg::get_id(TacCfg::get_def(inst));
+
+			for (TACValue **read : reads)
+			{
+				if (id != -1 and TacCfg::get_id(*read) == id)
+				{
+					return false;
+				}
+			}
+		}
+
+		return true;
+	}
+
+
+	// mov rax,base ; mov r11,index and the [rax + r11 * scale + displacement]
+	// operand, rax and r11 are never allocated
+	ASMOperand *make_address(ASMAddressMode &mode)
+	{
+		add_mov(make_register(ASMRegisterType::RAX,8,ASMType::I64),convert_value(mode.base));
 
+		void *mem = alloc(sizeof(ASMStack));
+		ASMStack *asm_stack = new(mem) ASMStack(8,"rax",-(int)mode.displacement);
+
+		if (mode.index != nullptr)
+		{
+			add_mov(make_register(ASMRegisterType::R11,8,ASMType::I64),convert_value(mode.index));
+			asm_stack->add_index("r11",mode.scale);
+		}
 
 		mem = alloc(sizeof(ASMOperand));
-		ASMOperand *asm_tmp2 = new(mem) ASMOperand(ASMOperandType::STACK,stack);
-		asm_tmp->add_type(ASMType::I64);
+		ASMOperand *asm_operand = new(mem) ASMOperand(ASMOperandType::STACK,asm_stack);
+		asm_operand->add_type(ASMType::I64);
+		return asm_operand;
+	}
 
 
-		mem = alloc(sizeof(ASMMovInst));
-		asm_mov = new(mem) ASMMovInst(asm_tmp2,asm_src);
-		asm_mov->add_type(asm_dst->data_type);
+	void add_lea(ASMOperand *dst,ASMOperand *src)
+	{
+		void *mem = alloc(sizeof(ASMLeaInst));
+		ASMLeaInst *asm_lea = new(mem) ASMLeaInst(dst,src);
+		asm_lea->add_type(dst->data_type);
+		add_instruction(ASMInstructionType::LEA,asm_lea);
+	}
 
-		std::cout << "store dst type : " << (int)asm_dst->type << std::endl;
 
-		
+	void convert_address_root(TACInstruction *inst,ASMAddressMode &mode)
+	{
+		switch (inst->type)
+		{
+			case TACInstructionType::LOAD:
+			{
+				TACLoadInst *load = (TACLoadInst *)inst->instruction;
+				ASMOperand *asm_dst = convert_value(load->dst);
+
+				add_mov(asm_dst,mode.direct != nullptr ? convert_value(mode.direct) : make_address(mode));
+				break;
+			}
+			case TACInstructionType::STORE:
+			{
+				TACStoreInst *store = (TACStoreInst *)inst->instruction;
+
+				if (mode.direct != nullptr)
+				{
+					add_mov(convert_value(mode.direct),convert_value(store->src));
+					break;
+				}
+
+				ASMOperand *asm_address = make_address(mode);
+
+				// FixUp may need r11 for the source, so the index goes into rax first
+				if (mode.index != nullptr)
+				{
+					add_lea(make_register(ASMRegisterType::RAX,8,ASMType::I64),asm_address);
+
+					void *mem = alloc(sizeof(ASMStack));
+					ASMStack *asm_stack = new(mem) ASMStack(8,"rax",0);
+
+					mem = alloc(sizeof(ASMOperand));
+					asm_address = new(mem) ASMOperand(ASMOperandType::STACK,asm_stack);
+				}
+
+				asm_address->add_type(convert_value(store->dst)->data_type);
+
+				void *mem = alloc(sizeof(ASMMovInst));
+				ASMMovInst *asm_mov = new(mem) ASMMovInst(asm_address,convert_value(store->src));
+				asm_mov->add_type(asm_address->data_type);
+				add_instruction(ASMInstructionType::MOV,asm_mov);
+				break;
+			}
+			case TACInstructionType::BINARY:
+			{
+				TACBinaryInst *bin = (TACBinaryInst *)inst->instruction;
+				add_lea(convert_value(bin->dst),make_address(mode));
+				break;
+			}
+			default:
+			{
+				DEBUG_PANIC("not an address root TAC TO INTEL");
+			}
+		}
+	}
+
+
+	// a comparison whose only use is the conditional jump right after it is
+	// selected as cmp + jcc, the 0/1 value is never materialised
+	bool convert_compare_and_branch(TACInstruction *inst,TACInstruction *next)
+	{
+		if (next == nullptr or inst->type != TACInstructionType::BINARY)
+		{
+			return false;
+		}
+
+		TACBinaryInst *compare = (TACBinaryInst *)inst->instruction;
+
+		if (not is_comparison(compare->op) or compare->dst->type != TACValueType::VARIABLE)
+		{
+			return false;
+		}
+
+		TACValue *value = nullptr;
+		int label = 0;
+		bool negate = false;
+
+		if (next->type == TACInstructionType::JMP_ZERO)
+		{
+			value = ((TACJmpIfZeroInst *)next->instruction)->value;
+			label = ((TACJmpIfZeroInst *)next->instruction)->label;
+			negate = true;
+		}
+		else if (next->type == TACInstructionType::JMP_NOT_ZERO)
+		{
+			value = ((TACJmpIfNotZeroInst *)next->instruction)->value;
+			label = ((TACJmpIfNotZeroInst *)next->instruction)->label;
+		}
+		else
+		{
+			return false;
+		}
+
+		TACVariable *var = (TACVariable *)compare->dst->value;
+
+		if (value->type != TACValueType::VARIABLE or ((TACVariable *)value->value)->id != var->id)
+		{
+			return false;
+		}
+
+		if (not var->is_temporary() or this->use_count[var->id] != 1)
+		{
+			return false;
+		}
+
+		ASMOperand *asm_src1 = convert_value(compare->src1);
+		ASMOperand *asm_src2 = convert_value(compare->src2);
+
+		void *mem = alloc(sizeof(ASMCmpInst));
+		ASMCmpInst *asm_cmp = new(mem) ASMCmpInst(asm_src1,asm_src2);
+
 		mem = alloc(sizeof(ASMInstruction));
-		asm_inst = new(mem) ASMInstruction(ASMInstructionType::MOV,asm_mov);
+		ASMInstruction *asm_inst = new(mem) ASMInstruction(ASMInstructionType::CMP,asm_cmp);
 		this->inst->push_back(asm_inst);
-	
+
+		ASMCondition condition = get_condition(compare->op,negate);
+
+		if (not is_signed(asm_src1->data_type))
+		{
+			condition = get_unsigned_condition(condition);
+		}
+
+		mem = alloc(sizeof(ASMJmpCondInst));
+		ASMJmpCondInst *asm_jmp_cond = new(mem) ASMJmpCondInst(condition,get_label_name(label));
+
+		mem = alloc(sizeof(ASMInstruction));
+		asm_inst = new(mem) ASMInstruction(ASMInstructionType::JMP_COND,asm_jmp_cond);
+		this->inst->push_back(asm_inst);
+
+		this->fused_branches++;
+		return true;
+	}
+
+
+	static bool is_comparison(TACBinaryOperator op)
+	{
+		switch (op)
+		{
+			case TACBinaryOperator::LESS:
+			case TACBinaryOperator::LESS_EQUAL:
+			case TACBinaryOperator::GREATER:
+			case TACBinaryOperator::GREATER_EQUAL:
+			case TACBinaryOperator::EQUAL:
+			case TACBinaryOperator::NOT_EQUAL:
+			{
+				return true;
+			}
+			default:
+			{
+				return false;
+			}
+		}
+	}
+
+
+	// signed condition under which op holds, or fails when negate is set
+	static ASMCondition get_condition(TACBinaryOperator op,bool negate)
+	{
+		switch (op)
+		{
+			case TACBinaryOperator::LESS:
+			{
+				return negate ? ASMCondition::GREATER_EQUAL : ASMCondition::LESS;
+			}
+			case TACBinaryOperator::LESS_EQUAL:
+			{
+				return negate ? ASMCondition::GREATER : ASMCondition::LESS_EQUAL;
+			}
+			case TACBinaryOperator::GREATER:
+			{
+				return negate ? ASMCondition::LESS_EQUAL : ASMCondition::GREATER;
+			}
+			case TACBinaryOperator::GREATER_EQUAL:
+			{
+				return negate ? ASMCondition::LESS : ASMCondition::GREATER_EQUAL;
+			}
+			case TACBinaryOperator::EQUAL:
+			{
+				return negate ? ASMCondition::NOT_EQUAL : ASMCondition::EQUAL;
+			}
+			case TACBinaryOperator::NOT_EQUAL:
+			{
+				return negate ? ASMCondition::EQUAL : ASMCondition::NOT_EQUAL;
+			}
+			default:
+			{
+				DEBUG_PANIC("not a comparison TAC TO INTEL");
+			}
+		}
+
+		return ASMCondition::EQUAL;
 	}
 
 
+	static ASMCondition get_unsigned_condition(ASMCondition condition)
+	{
+		switch(condition)
+		{
+			case ASMCondition::LESS:
+			{
+				return ASMCondition::BELOW;
+			}
+			case ASMCondition::LESS_EQUAL:
+			{
+				return ASMCondition::BELOW_EQUAL;
+			}
+			case ASMCondition::GREATER:
+			{
+				return ASMCondition::ABOVE;
+			}
+			case ASMCondition::GREATER_EQUAL:
+			{
+				return ASMCondition::ABOVE_EQUAL;
+			}
+			case ASMCondition::EQUAL:
+			case ASMCondition::NOT_EQUAL:
+			{
+				return condition;
+			}
+			default:
+			{
+				DEBUG_PANIC("unknown condition code TAC TO INTEL");
+			}
+		}
+
+		return condition;
+	}
+
 
-	void convert_get_address_inst(TACGetAddressInst *inst)
+	void convert_jmp_zero_inst(TACJmpIfZeroInst *inst)
 	{
-		ASMOperand *asm_dst = convert_value(inst->dst);
-		ASMOperand *asm_src = convert_value(inst->src);
+		ASMOperand *asm_value = convert_value(inst->value);
+
+		void *mem = alloc(sizeof(int));
+		int *int_value = new(mem) int;
+		*int_value = 0;
+
+		mem = alloc(sizeof(ASMImmediate));
+		ASMImmediate *asm_imm = new(mem) ASMImmediate(ASMImmediateType::I32,int_value);
 		
-		void *mem = alloc(sizeof(ASMLeaInst));
-		ASMLeaInst *asm_lea = new(mem) ASMLeaInst(asm_dst,asm_src);
-		asm_lea->add_type(asm_dst->data_type);
+		mem = alloc(sizeof(ASMOperand));
+		ASMOperand *asm_operand = new(mem) ASMOperand(ASMOperandType::IMMEDIATE,asm_imm);
+
+		mem = alloc(sizeof(ASMCmpInst));
+		ASMCmpInst *asm_cmp = new(mem) ASMCmpInst(asm_value,asm_operand);
+
+		mem = alloc(sizeof(ASMInstruction));
+		ASMInstruction *asm_inst = new(mem) ASMInstruction(ASMInstructionType::CMP,asm_cmp);
+		this->inst->push_back(asm_inst);
+
+
+		mem = alloc(sizeof(ASMJmpCondInst));
+		ASMJmpCondInst *asm_jmp_cond = new(mem) ASMJmpCondInst(ASMCondition::EQUAL,get_label_name(inst->label));
 		
 		mem = alloc(sizeof(ASMInstruction));
-		ASMInstruction *asm_inst = new(mem) ASMInstruction(ASMInstructionType::LEA,asm_lea);
+		asm_inst = new(mem) ASMInstruction(ASMInstructionType::JMP_COND,asm_jmp_cond);
 		this->inst->push_back(asm_inst);
+
 	}
 
 
+	void convert_jmp_not_zero_inst(TACJmpIfNotZeroInst *inst)
+	{
+		ASMOperand *asm_value = convert_value(inst->value);
+
+		void *mem = alloc(sizeof(int));
+		int *int_value = new(mem) int;
+		*int_value = 0;
 
-	void convert_sign_extend_inst(TACSignExtendInst *inst)
+		mem = alloc(sizeof(ASMImmediate));
+		ASMImmediate *asm_imm = new(mem) ASMImmediate(ASMImmediateType::I32,int_value);
+		
+		mem = alloc(sizeof(ASMOperand));
+		ASMOperand *asm_operand = new(mem) ASMOperand(ASMOperandType::IMMEDIATE,asm_imm);
+
+		mem = alloc(sizeof(ASMCmpInst));
+		ASMCmpInst *asm_cmp = new(mem) ASMCmpInst(asm_value,asm_operand);
+
+		mem = alloc(sizeof(ASMInstruction));
+		ASMInstruction *asm_inst = new(mem) ASMInstruction(ASMInstructionType::CMP,asm_cmp);
+		this->inst->push_back(asm_inst);
+
+
+		mem = alloc(sizeof(ASMJmpCondInst));
+		ASMJmpCondInst *asm_jmp_cond = new(mem) ASMJmpCondInst(ASMCondition::NOT_EQUAL,get_label_name(inst->label));
+		
+		mem = alloc(sizeof(ASMInstruction));
+		asm_inst = new(mem) ASMInstruction(ASMInstructionType::JMP_COND,asm_jmp_cond);
+		this->inst->push_back(asm_inst);
+
+	}
+
+
+
+	void convert_copy_inst(TACCopyInst *inst)
 	{
 		ASMOperand *asm_dst = convert_value(inst->dst);
 		ASMOperand *asm_src = convert_value(inst->src);
 		
-		void *mem = alloc(sizeof(ASMMovSxInst));
-		ASMMovSxInst *asm_mov = new(mem) ASMMovSxInst(asm_dst,asm_src);
+		void *mem = alloc(sizeof(ASMMovInst));
+		ASMMovInst *asm_mov = new(mem) ASMMovInst(asm_dst,asm_src);
 		asm_mov->add_type(asm_dst->data_type);
 		
 		mem = alloc(sizeof(ASMInstruction));
-		ASMInstruction *asm_inst = new(mem) ASMInstruction(ASMInstructionType::MOVSX,asm_mov);
+		ASMInstruction *asm_inst = new(mem) ASMInstruction(ASMInstructionType::MOV,asm_mov);
 		this->inst->push_back(asm_inst);
-		
+	
 	}
 
 
-	void convert_zero_extend_inst(TACZeroExtendInst *inst)
-	{
-		ASMOperand *asm_dst = convert_value(inst->dst);
-		ASMOperand *asm_src = convert_value(inst->src);
-		
-		void *mem = alloc(sizeof(ASMMovZeroExtendInst));
-		ASMMovZeroExtendInst *asm_mov = new(mem) ASMMovZeroExtendInst(asm_dst,asm_src);
-		asm_mov->add_type(asm_dst->data_type);
-		
-		mem = alloc(sizeof(ASMInstruction));
-		ASMInstruction *asm_inst = new(mem) ASMInstruction(ASMInstructionType::MOVZEROEXTEND,asm_mov);
-		this->inst->push_back(asm_inst);
-		
+
+
+
+	void convert_load_inst(TACLoadInst *inst)
+	{
+		ASMOperand *asm_dst = convert_value(inst->dst);
+		ASMOperand *asm_src = convert_value(inst->src);
+
+
+		void *mem = alloc(sizeof(ASMRegister));
+		ASMRegister *asm_reg = new(mem) ASMRegister(ASMRegisterType::RAX,8);
+		
+
+		mem = alloc(sizeof(ASMOperand));
+		ASMOperand *asm_tmp = new(mem) ASMOperand(ASMOperandType::REGISTER,asm_reg);
+		asm_tmp->add_type(ASMType::I64);
+
+
+
+		
+		mem = alloc(sizeof(ASMMovInst));
+		ASMMovInst *asm_mov = new(mem) ASMMovInst(asm_tmp,asm_src);
+		asm_mov->add_type(ASMType::I64);
+
+
+		mem = alloc(sizeof(ASMInstruction));
+		ASMInstruction *asm_inst = new(mem) ASMInstruction(ASMInstructionType::MOV,asm_mov);
+		this->inst->push_back(asm_inst);
+
+
+
+
+
+
+		mem = alloc(sizeof(ASMStack));
+		ASMStack *stack = new(mem)ASMStack(8,"rax",0);
+
+
+		mem = alloc(sizeof(ASMOperand));
+		ASMOperand *asm_tmp2 = new(mem) ASMOperand(ASMOperandType::STACK,stack);
+		asm_tmp->add_type(ASMType::I64);
+
+
+		mem = alloc(sizeof(ASMMovInst));
+		asm_mov = new(mem) ASMMovInst(asm_dst,asm_tmp2);
+		asm_mov->add_type(asm_dst->data_type);
+
+		
+		mem = alloc(sizeof(ASMInstruction));
+		asm_inst = new(mem) ASMInstruction(ASMInstructionType::MOV,asm_mov);
+		this->inst->push_back(asm_inst);
+	
+	}
+
+
+
+
+
+
+
+
+	void convert_store_inst(TACStoreInst *inst)
+	{
+		ASMOperand *asm_dst = convert_value(inst->dst);
+		ASMOperand *asm_src = convert_value(inst->src);
+
+
+		void *mem = alloc(sizeof(ASMRegister));
+		ASMRegister *asm_reg = new(mem) ASMRegister(ASMRegisterType::RAX,8);
+		
+
+		mem = alloc(sizeof(ASMOperand));
+		ASMOperand *asm_tmp = new(mem) ASMOperand(ASMOperandType::REGISTER,asm_reg);
+		asm_tmp->add_type(ASMType::I64);
+
+
+
+		
+		mem = alloc(sizeof(ASMMovInst));
+		ASMMovInst *asm_mov = new(mem) ASMMovInst(asm_tmp,asm_dst);
+		asm_mov->add_type(ASMType::I64);
+
+
+		mem = alloc(sizeof(ASMInstruction));
+		ASMInstruction *asm_inst = new(mem) ASMInstruction(ASMInstructionType::MOV,asm_mov);
+		this->inst->push_back(asm_inst);
+
+
+
+
+
+
+		mem = alloc(sizeof(ASMStack));
+		ASMStack *stack = new(mem)ASMStack(8,"rax",0);
+
+
+		mem = alloc(sizeof(ASMOperand));
+		ASMOperand *asm_tmp2 = new(mem) ASMOperand(ASMOperandType::STACK,stack);
+		asm_tmp->add_type(ASMType::I64);
+
+
+		mem = alloc(sizeof(ASMMovInst));
+		asm_mov = new(mem) ASMMovInst(asm_tmp2,asm_src);
+		asm_mov->add_type(asm_dst->data_type);
+
+		std::cout << "store dst type : " << (int)asm_dst->type << std::endl;
+
+		
+		mem = alloc(sizeof(ASMInstruction));
+		asm_inst = new(mem) ASMInstruction(ASMInstructionType::MOV,asm_mov);
+		this->inst->push_back(asm_inst);
+	
+	}
+
+
+
+	void convert_get_address_inst(TACGetAddressInst *inst)
+	{
+		ASMOperand *asm_dst = convert_value(inst->dst);
+		ASMOperand *asm_src = convert_value(inst->src);
+		
+		void *mem = alloc(sizeof(ASMLeaInst));
+		ASMLeaInst *asm_lea = new(mem) ASMLeaInst(asm_dst,asm_src);
+		asm_lea->add_type(asm_dst->data_type);
+		
+		mem = alloc(sizeof(ASMInstruction));
+		ASMInstruction *asm_inst = new(mem) ASMInstruction(ASMInstructionType::LEA,asm_lea);
+		this->inst->push_back(asm_inst);
+	}
+
+
+
+	void convert_sign_extend_inst(TACSignExtendInst *inst)
+	{
+		ASMOperand *asm_dst = convert_value(inst->dst);
+		ASMOperand *asm_src = convert_value(inst->src);
+		
+		void *mem = alloc(sizeof(ASMMovSxInst));
+		ASMMovSxInst *asm_mov = new(mem) ASMMovSxInst(asm_dst,asm_src);
+		asm_mov->add_type(asm_dst->data_type);
+		
+		mem = alloc(sizeof(ASMInstruction));
+		ASMInstruction *asm_inst = new(mem) ASMInstruction(ASMInstructionType::MOVSX,asm_mov);
+		this->inst->push_back(asm_inst);
+		
+	}
+
+
+	void convert_zero_extend_inst(TACZeroExtendInst *inst)
+	{
+		ASMOperand *asm_dst = convert_value(inst->dst);
+		ASMOperand *asm_src = convert_value(inst->src);
+		
+		void *mem = alloc(sizeof(ASMMovZeroExtendInst));
+		ASMMovZeroExtendInst *asm_mov = new(mem) ASMMovZeroExtendInst(asm_dst,asm_src);
+		asm_mov->add_type(asm_dst->data_type);
+		
+		mem = alloc(sizeof(ASMInstruction));
+		ASMInstruction *asm_inst = new(mem) ASMInstruction(ASMInstructionType::MOVZEROEXTEND,asm_mov);
+		this->inst->push_back(asm_inst);
+		
+	}
+
+
+	void convert_truncate_inst(TACTruncateInst *inst)
+	{
+		ASMOperand *asm_dst = convert_value(inst->dst);
+		ASMOperand *asm_src = convert_value(inst->src);
+		
+		void *mem = alloc(sizeof(ASMMovInst));
+		ASMMovInst *asm_mov = new(mem) ASMMovInst(asm_dst,asm_src);
+		asm_mov->add_type(asm_dst->data_type);
+		
+		mem = alloc(sizeof(ASMInstruction));
+		ASMInstruction *asm_inst = new(mem) ASMInstruction(ASMInstructionType::MOV,asm_mov);
+		this->inst->push_back(asm_inst);
+		
+	}
+
+
+
+	void convert_jmp_inst(TACJmpInst *inst)
+	{
+		void *mem = alloc(sizeof(ASMJmpInst));
+		ASMJmpInst *asm_jmp = new(mem) ASMJmpInst(get_label_name(inst->label));
+		
+		mem = alloc(sizeof(ASMInstruction));
+		ASMInstruction *asm_inst = new(mem) ASMInstruction(ASMInstructionType::JMP,asm_jmp);
+		this->inst->push_back(asm_inst);
+	}
+
+	void convert_return_inst(TACReturnInst *inst)
+	{
+		int size = 0;
+		
+		ASMType data_type;
+		switch(inst->data_type)
+		{
+			case TACType::I32:
+			{
+				data_type = ASMType::I32;
+				size = 4;
+				break;
+			}
+			case TACType::I64:
+			{
+				data_type = ASMType::I64;
+				size = 8;
+				break;
+			}
+			default:
+			{
+				DEBUG_PANIC("return unsupported data type ");
+				break;
+			}
+		}
+
+		void *mem = alloc(sizeof(ASMRegister));
+		ASMRegister *asm_reg = new(mem) ASMRegister(ASMRegisterType::RAX,size);
+
+		mem = alloc(sizeof(ASMOperand));
+		ASMOperand *asm_dst = new(mem) ASMOperand(ASMOperandType::REGISTER,asm_reg);
+		ASMOperand *asm_src = convert_value(inst->value);
+		
+		asm_dst->add_type(data_type);
+		
+		mem = alloc(sizeof(ASMMovInst));
+		ASMMovInst *asm_mov = new(mem) ASMMovInst(asm_dst,asm_src);
+		asm_mov->add_type(data_type);
+		
+		mem = alloc(sizeof(ASMInstruction));
+		ASMInstruction *asm_inst = new(mem) ASMInstruction(ASMInstructionType::MOV,asm_mov);
+		this->inst->push_back(asm_inst);
+		
+		
+	
+	
+		mem = alloc(sizeof(ASMRegister));
+		asm_reg = new(mem) ASMRegister(ASMRegisterType::RSP,8);
+		
+
+		mem = alloc(sizeof(ASMOperand));
+		asm_dst = new(mem) ASMOperand(ASMOperandType::REGISTER,asm_reg);
+		asm_dst->add_type(ASMType::I64);
+
+		mem = alloc(sizeof(ASMRegister));
+		asm_reg = new(mem) ASMRegister(ASMRegisterType::RBP,8);
+		
+
+		mem = alloc(sizeof(ASMOperand));
+		asm_src = new(mem) ASMOperand(ASMOperandType::REGISTER,asm_reg);
+		asm_src->add_type(ASMType::I64);
+
+		mem = alloc(sizeof(ASMMovInst));
+		asm_mov = new(mem) ASMMovInst(asm_dst,asm_src);
+		asm_mov->add_type(asm_dst->data_type);
+		
+		mem = alloc(sizeof(ASMInstruction));
+		asm_inst = new(mem) ASMInstruction(ASMInstructionType::MOV,asm_mov);
+		this->inst->push_back(asm_inst);
+		
+		
+		
+		mem = alloc(sizeof(ASMPopInst));
+		ASMPopInst *asm_pop = new(mem) ASMPopInst(asm_src);
+		
+		mem = alloc(sizeof(ASMInstruction));
+		asm_inst = new(mem) ASMInstruction(ASMInstructionType::POP,asm_pop);
+		this->inst->push_back(asm_inst);
+
+		
+		mem = alloc(sizeof(ASMRetInst));
+		ASMRetInst *asm_ret = new(mem) ASMRetInst();
+
+		mem = alloc(sizeof(ASMInstruction));
+		asm_inst = new(mem) ASMInstruction(ASMInstructionType::RET,asm_ret);
+		this->inst->push_back(asm_inst);
+	}
+
+
+
+	void convert_binary_normal(TACBinaryInst *inst)
+	{
+		ASMOperand *asm_dst = convert_value(inst->dst);
+		ASMOperand *asm_src1 = convert_value(inst->src1);
+		ASMOperand *asm_src2 = convert_value(inst->src2);
+		
+
+		void *mem = alloc(sizeof(ASMMovInst));
+		ASMMovInst *asm_mov = new(mem) ASMMovInst(asm_dst,asm_src1);
+		asm_mov->add_type(asm_dst->data_type);
+		
+		mem = alloc(sizeof(ASMInstruction));
+		ASMInstruction *asm_inst = new(mem) ASMInstruction(ASMInstructionType::MOV,asm_mov);
+		this->inst->push_back(asm_inst);
+
+		switch(inst->op)
+		{
+			case TACBinaryOperator::ADD:
+			{
+				void *mem = alloc(sizeof(ASMAddInst));
+				ASMAddInst *asm_add = new(mem) ASMAddInst(asm_dst,asm_src2);
+				asm_add->add_type(asm_dst->data_type);
+				
+				mem = alloc(sizeof(ASMInstruction));
+				ASMInstruction *asm_inst = new(mem) ASMInstruction(ASMInstructionType::ADD,asm_add);
+				this->inst->push_back(asm_inst);
+
+				break;
+			}
+			case TACBinaryOperator::SUB:
+			{
+				void *mem = alloc(sizeof(ASMSubInst));
+				ASMSubInst *asm_sub = new(mem) ASMSubInst(asm_dst,asm_src2);
+				asm_sub->add_type(asm_dst->data_type);
+				
+				mem = alloc(sizeof(ASMInstruction));
+				ASMInstruction *asm_inst = new(mem) ASMInstruction(ASMInstructionType::SUB,asm_sub);
+				this->inst->push_back(asm_inst);
+
+				break;
+			}
+			case TACBinaryOperator::BIT_AND:
+			{
+				void *mem = alloc(sizeof(ASMAndInst));
+				ASMAndInst *asm_and = new(mem) ASMAndInst(asm_dst,asm_src2);
+				asm_and->add_type(asm_dst->data_type);
+				add_instruction(ASMInstructionType::AND,asm_and);
+				break;
+			}
+			case TACBinaryOperator::BIT_OR:
+			{
+				void *mem = alloc(sizeof(ASMOrInst));
+				ASMOrInst *asm_or = new(mem) ASMOrInst(asm_dst,asm_src2);
+				asm_or->add_type(asm_dst->data_type);
+				add_instruction(ASMInstructionType::OR,asm_or);
+				break;
+			}
+			case TACBinaryOperator::BIT_XOR:
+			{
+				void *mem = alloc(sizeof(ASMXorInst));
+				ASMXorInst *asm_xor = new(mem) ASMXorInst(asm_dst,asm_src2);
+				asm_xor->add_type(asm_dst->data_type);
+				add_instruction(ASMInstructionType::XOR,asm_xor);
+				break;
+			}
+		}
+	}
+
+
+
+	void add_instruction(ASMInstructionType type,void *instruction)
+	{
+		void *mem = alloc(sizeof(ASMInstruction));
+		this->inst->push_back(new(mem) ASMInstruction(type,instruction));
+	}
+
+
+	int get_size(ASMType data_type)
+	{
+		return data_type == ASMType::I32 or data_type == ASMType::U32 ? 4 : 8;
+	}
+
+
+	ASMOperand *make_register(ASMRegisterType reg,int size,ASMType data_type)
+	{
+		void *mem = alloc(sizeof(ASMRegister));
+		ASMRegister *asm_reg = new(mem) ASMRegister(reg,size);
+
+		mem = alloc(sizeof(ASMOperand));
+		ASMOperand *asm_operand = new(mem) ASMOperand(ASMOperandType::REGISTER,asm_reg);
+		asm_operand->add_type(data_type);
+		return asm_operand;
+	}
+
+
+	ASMOperand *make_register(ASMRegisterType reg,ASMType data_type)
+	{
+		return make_register(reg,get_size(data_type),data_type);
+	}
+
+
+	ASMOperand *make_immediate(long int value,ASMType data_type)
+	{
+		ASMImmediate *asm_imm;
+
+		switch (data_type)
+		{
+			case ASMType::I32:
+			{
+				int *asm_value = new(alloc(sizeof(int))) int((int)value);
+				asm_imm = new(alloc(sizeof(ASMImmediate))) ASMImmediate(ASMImmediateType::I32,asm_value);
+				break;
+			}
+			case ASMType::U32:
+			{
+				unsigned int *asm_value = new(alloc(sizeof(unsigned int))) unsigned int((unsigned int)value);
+				asm_imm = new(alloc(sizeof(ASMImmediate))) ASMImmediate(ASMImmediateType::U32,asm_value);
+				break;
+			}
+			case ASMType::U64:
+			{
+				unsigned long int *asm_value = new(alloc(sizeof(unsigned long int))) unsigned long int((unsigned long int)value);
+				asm_imm = new(alloc(sizeof(ASMImmediate))) ASMImmediate(ASMImmediateType::U64,asm_value);
+				break;
+			}
+			default:
+			{
+				long int *asm_value = new(alloc(sizeof(long int))) long int(value);
+				asm_imm = new(alloc(sizeof(ASMImmediate))) ASMImmediate(ASMImmediateType::I64,asm_value);
+				break;
+			}
+		}
+
+		void *mem = alloc(sizeof(ASMOperand));
+		ASMOperand *asm_operand = new(mem) ASMOperand(ASMOperandType::IMMEDIATE,asm_imm);
+		asm_operand->add_type(data_type);
+		return asm_operand;
+	}
+
+
+	void add_mov(ASMOperand *dst,ASMOperand *src)
+	{
+		void *mem = alloc(sizeof(ASMMovInst));
+		ASMMovInst *asm_mov = new(mem) ASMMovInst(dst,src);
+		asm_mov->add_type(dst->data_type);
+		add_instruction(ASMInstructionType::MOV,asm_mov);
+	}
+
+
+	template <typename T>
+	void add_binary(ASMInstructionType type,ASMOperand *dst,ASMOperand *src)
+	{
+		void *mem = alloc(sizeof(T));
+		T *asm_binary = new(mem) T(dst,src);
+		asm_binary->add_type(dst->data_type);
+		add_instruction(type,asm_binary);
+	}
+
+
+	void add_shift(ASMInstructionType type,ASMOperand *dst,int count)
+	{
+		ASMOperand *asm_count = make_immediate(count,ASMType::I32);
+
+		switch (type)
+		{
+			case ASMInstructionType::SHL:
+			{
+				add_binary<ASMShlInst>(type,dst,asm_count);
+				break;
+			}
+			case ASMInstructionType::SAR:
+			{
+				add_binary<ASMSarInst>(type,dst,asm_count);
+				break;
+			}
+			default:
+			{
+				add_binary<ASMShrInst>(type,dst,asm_count);
+				break;
+			}
+		}
+	}
+
+
+	void add_wide(ASMInstructionType type,ASMOperand *src,bool is_signed)
+	{
+		if (type == ASMInstructionType::MUL)
+		{
+			void *mem = alloc(sizeof(ASMMulInst));
+			ASMMulInst *asm_mul = new(mem) ASMMulInst(src,is_signed);
+			asm_mul->add_type(src->data_type);
+			add_instruction(type,asm_mul);
+		}
+		else
+		{
+			void *mem = alloc(sizeof(ASMDivInst));
+			ASMDivInst *asm_div = new(mem) ASMDivInst(src,is_signed);
+			asm_div->add_type(src->data_type);
+			add_instruction(type,asm_div);
+		}
+	}
+
+
+	static bool get_constant(TACValue *value,long int *result)
+	{
+		if (value == nullptr or value->type != TACValueType::CONSTANT)
+		{
+			return false;
+		}
+
+		TACConstant *constant = (TACConstant *)value->value;
+
+		switch (constant->type)
+		{
+			case TACConstantType::I32:
+			{
+				*result = *(int *)constant->constant;
+				return true;
+			}
+			case TACConstantType::U32:
+			{
+				*result = *(unsigned int *)constant->constant;
+				return true;
+			}
+			case TACConstantType::I64:
+			case TACConstantType::U64:
+			{
+				*result = *(long int *)constant->constant;
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+
+	static bool fits_dword(long int value)
+	{
+		return value >= -2147483648L and value <= 2147483647L;
+	}
+
+
+	// k if value is 2^k, -1 otherwise
+	static int get_power_of_two(unsigned long int value)
+	{
+		if (value == 0 or (value & (value - 1)) != 0)
+		{
+			return -1;
+		}
+
+		return __builtin_ctzl(value);
+	}
+
+
+
+	void convert_binary_mul(TACBinaryInst *inst)
+	{
+		TACValue *src1 = inst->src1;
+		TACValue *src2 = inst->src2;
+		long int factor;
+
+		if (get_constant(src1,&factor) and not get_constant(src2,&factor))
+		{
+			std::swap(src1,src2);
+		}
+
+		ASMOperand *asm_dst = convert_value(inst->dst);
+		ASMType data_type = asm_dst->data_type;
+		add_mov(asm_dst,convert_value(src1));
+
+		if (not get_constant(src2,&factor))
+		{
+			add_binary<ASMImulInst>(ASMInstructionType::IMUL,asm_dst,convert_value(src2));
+			return;
+		}
+
+		if (get_size(data_type) == 4)
+		{
+			factor = (unsigned int)factor;
+		}
+
+		int shift = get_power_of_two(factor);
+
+		if (shift == 0)
+		{
+			return;
+		}
+
+		if (shift > 0)
+		{
+			add_shift(ASMInstructionType::SHL,asm_dst,shift);
+		}
+		else if (get_size(data_type) == 4 or fits_dword(factor))
+		{
+			add_binary<ASMImulInst>(ASMInstructionType::IMUL,asm_dst,make_immediate(factor,data_type));
+		}
+		else
+		{
+			ASMOperand *asm_rax = make_register(ASMRegisterType::RAX,data_type);
+			add_mov(asm_rax,make_immediate(factor,data_type));
+			add_binary<ASMImulInst>(ASMInstructionType::IMUL,asm_dst,asm_rax);
+		}
 	}
 
 
-	void convert_truncate_inst(TACTruncateInst *inst)
+
+	void convert_binary_shift(TACBinaryInst *inst)
 	{
 		ASMOperand *asm_dst = convert_value(inst->dst);
-		ASMOperand *asm_src = convert_value(inst->src);
-		
-		void *mem = alloc(sizeof(ASMMovInst));
-		ASMMovInst *asm_mov = new(mem) ASMMovInst(asm_dst,asm_src);
-		asm_mov->add_type(asm_dst->data_type);
-		
-		mem = alloc(sizeof(ASMInstruction));
-		ASMInstruction *asm_inst = new(mem) ASMInstruction(ASMInstructionType::MOV,asm_mov);
-		this->inst->push_back(asm_inst);
-		
-	}
+		ASMType data_type = asm_dst->data_type;
+		ASMInstructionType type = ASMInstructionType::SHL;
+		long int count;
 
+		if (inst->op == TACBinaryOperator::SHIFT_RIGHT)
+		{
+			type = is_signed(data_type) ? ASMInstructionType::SAR : ASMInstructionType::SHR;
+		}
 
+		if (get_constant(inst->src2,&count))
+		{
+			add_mov(asm_dst,convert_value(inst->src1));
+			add_shift(type,asm_dst,count & (get_size(data_type) * 8 - 1));
+			return;
+		}
 
-	void convert_jmp_inst(TACJmpInst *inst)
-	{
-		void *mem = alloc(sizeof(ASMJmpInst));
-		ASMJmpInst *asm_jmp = new(mem) ASMJmpInst(inst->label);
-		
-		mem = alloc(sizeof(ASMInstruction));
-		ASMInstruction *asm_inst = new(mem) ASMInstruction(ASMInstructionType::JMP,asm_jmp);
-		this->inst->push_back(asm_inst);
-	}
+		// a variable count goes through cl, loaded first so that neither
+		// operand can be given rcx
+		ASMOperand *asm_count = convert_value(inst->src2);
+		add_mov(make_register(ASMRegisterType::RCX,asm_count->data_type),asm_count);
+		add_mov(asm_dst,convert_value(inst->src1));
 
-	void convert_return_inst(TACReturnInst *inst)
-	{
-		int size = 0;
-		
-		ASMType data_type;
-		switch(inst->data_type)
+		ASMOperand *asm_cl = make_register(ASMRegisterType::RCX,1,ASMType::I32);
+
+		switch (type)
 		{
-			case TACType::I32:
+			case ASMInstructionType::SHL:
 			{
-				data_type = ASMType::I32;
-				size = 4;
+				add_binary<ASMShlInst>(type,asm_dst,asm_cl);
 				break;
 			}
-			case TACType::I64:
+			case ASMInstructionType::SAR:
 			{
-				data_type = ASMType::I64;
-				size = 8;
+				add_binary<ASMSarInst>(type,asm_dst,asm_cl);
 				break;
 			}
 			default:
 			{
-				DEBUG_PANIC("return unsupported data type ");
+				add_binary<ASMShrInst>(type,asm_dst,asm_cl);
 				break;
 			}
 		}
+	}
 
-		void *mem = alloc(sizeof(ASMRegister));
-		ASMRegister *asm_reg = new(mem) ASMRegister(ASMRegisterType::RAX,size);
-
-		mem = alloc(sizeof(ASMOperand));
-		ASMOperand *asm_dst = new(mem) ASMOperand(ASMOperandType::REGISTER,asm_reg);
-		ASMOperand *asm_src = convert_value(inst->value);
-		
-		asm_dst->add_type(data_type);
-		
-		mem = alloc(sizeof(ASMMovInst));
-		ASMMovInst *asm_mov = new(mem) ASMMovInst(asm_dst,asm_src);
-		asm_mov->add_type(data_type);
-		
-		mem = alloc(sizeof(ASMInstruction));
-		ASMInstruction *asm_inst = new(mem) ASMInstruction(ASMInstructionType::MOV,asm_mov);
-		this->inst->push_back(asm_inst);
-		
-		
-	
-	
-		mem = alloc(sizeof(ASMRegister));
-		asm_reg = new(mem) ASMRegister(ASMRegisterType::RSP,8);
-		
 
-		mem = alloc(sizeof(ASMOperand));
-		asm_dst = new(mem) ASMOperand(ASMOperandType::REGISTER,asm_reg);
-		asm_dst->add_type(ASMType::I64);
 
-		mem = alloc(sizeof(ASMRegister));
-		asm_reg = new(mem) ASMRegister(ASMRegisterType::RBP,8);
-		
+	/*
+	 * Division and remainder. A constant divisor is strength reduced,
+	 * anything else goes through rdx:rax : cdq/cqo + idiv for signed
+	 * operands, a cleared rdx + div for unsigned ones.
+	 */
+	void convert_binary_div(TACBinaryInst *inst)
+	{
+		ASMOperand *asm_dst = convert_value(inst->dst);
+		ASMType data_type = asm_dst->data_type;
+		bool is_mod = inst->op == TACBinaryOperator::MOD;
+		long int divisor;
 
-		mem = alloc(sizeof(ASMOperand));
-		asm_src = new(mem) ASMOperand(ASMOperandType::REGISTER,asm_reg);
-		asm_src->add_type(ASMType::I64);
+		if (get_constant(inst->src2,&divisor) and convert_div_by_constant(inst,asm_dst,divisor,is_mod))
+		{
+			return;
+		}
 
-		mem = alloc(sizeof(ASMMovInst));
-		asm_mov = new(mem) ASMMovInst(asm_dst,asm_src);
-		asm_mov->add_type(asm_dst->data_type);
-		
-		mem = alloc(sizeof(ASMInstruction));
-		asm_inst = new(mem) ASMInstruction(ASMInstructionType::MOV,asm_mov);
-		this->inst->push_back(asm_inst);
-		
-		
-		
-		mem = alloc(sizeof(ASMPopInst));
-		ASMPopInst *asm_pop = new(mem) ASMPopInst(asm_src);
-		
-		mem = alloc(sizeof(ASMInstruction));
-		asm_inst = new(mem) ASMInstruction(ASMInstructionType::POP,asm_pop);
-		this->inst->push_back(asm_inst);
+		ASMOperand *asm_rax = make_register(ASMRegisterType::RAX,data_type);
+		ASMOperand *asm_rdx = make_register(ASMRegisterType::RDX,data_type);
+		add_mov(asm_rax,convert_value(inst->src1));
 
-		
-		mem = alloc(sizeof(ASMRetInst));
-		ASMRetInst *asm_ret = new(mem) ASMRetInst();
+		if (is_signed(data_type))
+		{
+			void *mem = alloc(sizeof(ASMCdqInst));
+			ASMCdqInst *asm_cdq = new(mem) ASMCdqInst();
+			asm_cdq->add_type(data_type);
+			add_instruction(ASMInstructionType::CDQ,asm_cdq);
+		}
+		else
+		{
+			add_mov(asm_rdx,make_immediate(0,data_type));
+		}
 
-		mem = alloc(sizeof(ASMInstruction));
-		asm_inst = new(mem) ASMInstruction(ASMInstructionType::RET,asm_ret);
-		this->inst->push_back(asm_inst);
+		add_wide(ASMInstructionType::DIV,convert_value(inst->src2),is_signed(data_type));
+		add_mov(asm_dst,is_mod ? asm_rdx : asm_rax);
 	}
 
 
+	/*
+	 * Multiplier and shift for dividing by a constant with a multiply high
+	 * (Granlund and Montgomery, "Division by invariant integers using
+	 * multiplication"). The smallest p >= N is taken for which
+	 * m = ceil(2^p / d) is close enough to 2^p / d for every N bit
+	 * dividend. m can need N + 1 bits, add_dividend then says the high part
+	 * of the product needs a correction for the bit that did not fit.
+	 */
+	static void get_magic(unsigned long int divisor,int bits,bool is_signed,unsigned long int *multiplier,int *shift,bool *add_dividend)
+	{
+		unsigned __int128 m = 0;
+		int p = bits;
 
-	void convert_binary_normal(TACBinaryInst *inst)
+		for (; p < 2 * bits; p++)
+		{
+			unsigned __int128 power = (unsigned __int128)1 << p;
+			m = (power + divisor - 1) / divisor;
+			unsigned __int128 error = m * divisor - power;
+
+			if (error <= ((unsigned __int128)1 << (p - bits + (is_signed ? 1 : 0))))
+			{
+				break;
+			}
+		}
+
+		unsigned __int128 range = (unsigned __int128)1 << bits;
+
+		*shift = p - bits;
+
+		if (is_signed)
+		{
+			// read as a signed N bit number m is negative
+			*add_dividend = m >= (range >> 1);
+			*multiplier = (unsigned long int)m;
+		}
+		else
+		{
+			*add_dividend = m >= range;
+			*multiplier = (unsigned long int)(m - (*add_dividend ? range : 0));
+		}
+	}
+
+
+	bool convert_div_by_constant(TACBinaryInst *inst,ASMOperand *asm_dst,long int divisor,bool is_mod)
 	{
-		ASMOperand *asm_dst = convert_value(inst->dst);
-		ASMOperand *asm_src1 = convert_value(inst->src1);
-		ASMOperand *asm_src2 = convert_value(inst->src2);
-		
+		ASMType data_type = asm_dst->data_type;
+		int bits = get_size(data_type) * 8;
+		bool is_signed = this->is_signed(data_type);
 
-		void *mem = alloc(sizeof(ASMMovInst));
-		ASMMovInst *asm_mov = new(mem) ASMMovInst(asm_dst,asm_src1);
-		asm_mov->add_type(asm_dst->data_type);
-		
-		mem = alloc(sizeof(ASMInstruction));
-		ASMInstruction *asm_inst = new(mem) ASMInstruction(ASMInstructionType::MOV,asm_mov);
-		this->inst->push_back(asm_inst);
+		if (bits == 32)
+		{
+			divisor = is_signed ? (long int)(int)divisor : (long int)(unsigned int)divisor;
+		}
 
-		switch(inst->op)
+		long int min = bits == 32 ? -2147483648L : (long int)(1UL << 63);
+
+		// division by zero keeps its trap, the most negative divisor has no
+		// magnitude and an unsigned divisor with the top bit set has a
+		// multiplier wider than the search in get_magic
+		if (divisor == 0 or ((divisor & min) != 0 and (is_signed ? divisor == min : get_power_of_two(divisor) < 0)))
 		{
-			case TACBinaryOperator::ADD:
+			return false;
+		}
+
+		if (divisor == 1 or (is_signed and divisor == -1))
+		{
+			add_mov(asm_dst,is_mod ? make_immediate(0,data_type) : convert_value(inst->src1));
+
+			if (divisor == -1 and not is_mod)
 			{
-				void *mem = alloc(sizeof(ASMAddInst));
-				ASMAddInst *asm_add = new(mem) ASMAddInst(asm_dst,asm_src2);
-				asm_add->add_type(asm_dst->data_type);
-				
-				mem = alloc(sizeof(ASMInstruction));
-				ASMInstruction *asm_inst = new(mem) ASMInstruction(ASMInstructionType::ADD,asm_add);
-				this->inst->push_back(asm_inst);
+				void *mem = alloc(sizeof(ASMNegInst));
+				ASMNegInst *asm_neg = new(mem) ASMNegInst(asm_dst);
+				asm_neg->add_type(data_type);
+				add_instruction(ASMInstructionType::NEG,asm_neg);
+			}
+			return true;
+		}
 
-				break;
+		unsigned long int magnitude = is_signed and divisor < 0 ? -divisor : divisor;
+		int shift = get_power_of_two(magnitude);
+		ASMOperand *asm_rax = make_register(ASMRegisterType::RAX,data_type);
+		ASMOperand *asm_rdx = make_register(ASMRegisterType::RDX,data_type);
+
+		// the dividend stays in dst until the result replaces it
+		add_mov(asm_dst,convert_value(inst->src1));
+
+		if (shift > 0 and not is_signed)
+		{
+			if (not is_mod)
+			{
+				add_shift(ASMInstructionType::SHR,asm_dst,shift);
 			}
-			case TACBinaryOperator::SUB:
+			else if (fits_dword(magnitude - 1))
 			{
-				void *mem = alloc(sizeof(ASMSubInst));
-				ASMSubInst *asm_sub = new(mem) ASMSubInst(asm_dst,asm_src2);
-				asm_sub->add_type(asm_dst->data_type);
-				
-				mem = alloc(sizeof(ASMInstruction));
-				ASMInstruction *asm_inst = new(mem) ASMInstruction(ASMInstructionType::SUB,asm_sub);
-				this->inst->push_back(asm_inst);
+				add_binary<ASMAndInst>(ASMInstructionType::AND,asm_dst,make_immediate(magnitude - 1,data_type));
+			}
+			else
+			{
+				add_mov(asm_rax,make_immediate(magnitude - 1,data_type));
+				add_binary<ASMAndInst>(ASMInstructionType::AND,asm_dst,asm_rax);
+			}
+			return true;
+		}
 
-				break;
+		if (shift > 0)
+		{
+			// a negative dividend is biased by 2^k - 1 so the shift truncates towards zero
+			add_mov(asm_rax,asm_dst);
+			add_shift(ASMInstructionType::SAR,asm_rax,bits - 1);
+			add_shift(ASMInstructionType::SHR,asm_rax,bits - shift);
+			add_binary<ASMAddInst>(ASMInstructionType::ADD,asm_rax,asm_dst);
+			add_shift(ASMInstructionType::SAR,asm_rax,shift);
+
+			if (is_mod)
+			{
+				add_shift(ASMInstructionType::SHL,asm_rax,shift);
+				add_binary<ASMSubInst>(ASMInstructionType::SUB,asm_dst,asm_rax);
+				return true;
+			}
+
+			add_mov(asm_dst,asm_rax);
+
+			if (divisor < 0)
+			{
+				void *mem = alloc(sizeof(ASMNegInst));
+				ASMNegInst *asm_neg = new(mem) ASMNegInst(asm_dst);
+				asm_neg->add_type(data_type);
+				add_instruction(ASMInstructionType::NEG,asm_neg);
+			}
+			return true;
+		}
+
+		unsigned long int multiplier;
+		bool add_dividend;
+		get_magic(magnitude,bits,is_signed,&multiplier,&shift,&add_dividend);
+
+		// the quotient ends up in rdx, the high half of rdx:rax = m * n
+		add_mov(asm_rax,make_immediate(multiplier,data_type));
+		add_wide(ASMInstructionType::MUL,asm_dst,is_signed);
+
+		if (is_signed)
+		{
+			if (add_dividend)
+			{
+				add_binary<ASMAddInst>(ASMInstructionType::ADD,asm_rdx,asm_dst);
+			}
+
+			if (shift > 0)
+			{
+				add_shift(ASMInstructionType::SAR,asm_rdx,shift);
+			}
+
+			// + 1 for a negative quotient truncates it towards zero
+			add_mov(asm_rax,asm_rdx);
+			add_shift(ASMInstructionType::SHR,asm_rax,bits - 1);
+			add_binary<ASMAddInst>(ASMInstructionType::ADD,asm_rdx,asm_rax);
+
+			if (divisor < 0)
+			{
+				void *mem = alloc(sizeof(ASMNegInst));
+				ASMNegInst *asm_neg = new(mem) ASMNegInst(asm_rdx);
+				asm_neg->add_type(data_type);
+				add_instruction(ASMInstructionType::NEG,asm_neg);
+			}
+		}
+		else if (add_dividend)
+		{
+			// (((n - t) >> 1) + t) >> (s - 1) : n + t would overflow
+			add_mov(asm_rax,asm_dst);
+			add_binary<ASMSubInst>(ASMInstructionType::SUB,asm_rax,asm_rdx);
+			add_shift(ASMInstructionType::SHR,asm_rax,1);
+			add_binary<ASMAddInst>(ASMInstructionType::ADD,asm_rax,asm_rdx);
+
+			if (shift > 1)
+			{
+				add_shift(ASMInstructionType::SHR,asm_rax,shift - 1);
 			}
+
+			add_mov(asm_rdx,asm_rax);
+		}
+		else if (shift > 0)
+		{
+			add_shift(ASMInstructionType::SHR,asm_rdx,shift);
+		}
+
+		if (not is_mod)
+		{
+			add_mov(asm_dst,asm_rdx);
+			return true;
 		}
+
+		// n - q * d
+		if (fits_dword(divisor) or bits == 32)
+		{
+			add_binary<ASMImulInst>(ASMInstructionType::IMUL,asm_rdx,make_immediate(divisor,data_type));
+		}
+		else
+		{
+			add_mov(asm_rax,make_immediate(divisor,data_type));
+			add_binary<ASMImulInst>(ASMInstructionType::IMUL,asm_rdx,asm_rax);
+		}
+
+		add_binary<ASMSubInst>(ASMInstructionType::SUB,asm_dst,asm_rdx);
+		return true;
 	}
 	
 
@@ -1022,38 +2242,7 @@ public:
 
 		if(not is_signed(asm_src1->data_type))
 		{
-			switch(condition)
-			{
-				case ASMCondition::LESS:
-				{
-					condition = ASMCondition::BELOW;
-					break;
-				}
-				case ASMCondition::LESS_EQUAL:
-				{
-					condition = ASMCondition::BELOW_EQUAL;
-					break;
-				}
-				case ASMCondition::GREATER:
-				{
-					condition = ASMCondition::ABOVE;
-					break;
-				}
-				case ASMCondition::GREATER_EQUAL:
-				{
-					condition = ASMCondition::ABOVE_EQUAL;
-					break;
-				}
-				case ASMCondition::EQUAL:
-				case ASMCondition::NOT_EQUAL:
-				{
-					break;
-				}
-				default:
-				{
-					DEBUG_PANIC("unknown condition code TAC TO INTEL");
-				}
-			}
+			condition = get_unsigned_condition(condition);
 		}
 
 		mem = alloc(sizeof(ASMSetCondInst));
@@ -1092,28 +2281,38 @@ public:
 		{
 			case TACBinaryOperator::ADD:
 			case TACBinaryOperator::SUB:
+			case TACBinaryOperator::BIT_AND:
+			case TACBinaryOperator::BIT_OR:
+			case TACBinaryOperator::BIT_XOR:
 			{
 				convert_binary_normal(inst);
 				break;
 			}
-			case TACBinaryOperator::LESS:
+			case TACBinaryOperator::MUL:
 			{
-				convert_binary_logical(inst,ASMCondition::LESS);
+				convert_binary_mul(inst);
 				break;
 			}
-			case TACBinaryOperator::LESS_EQUAL:
+			case TACBinaryOperator::DIV:
+			case TACBinaryOperator::MOD:
 			{
-				convert_binary_logical(inst,ASMCondition::LESS_EQUAL);
+				convert_binary_div(inst);
 				break;
 			}
-			case TACBinaryOperator::GREATER:
+			case TACBinaryOperator::SHIFT_LEFT:
+			case TACBinaryOperator::SHIFT_RIGHT:
 			{
-				convert_binary_logical(inst,ASMCondition::GREATER);
+				convert_binary_shift(inst);
 				break;
 			}
+			case TACBinaryOperator::LESS:
+			case TACBinaryOperator::LESS_EQUAL:
+			case TACBinaryOperator::GREATER:
 			case TACBinaryOperator::GREATER_EQUAL:
+			case TACBinaryOperator::EQUAL:
+			case TACBinaryOperator::NOT_EQUAL:
 			{
-				convert_binary_logical(inst,ASMCondition::GREATER_EQUAL);
+				convert_binary_logical(inst,get_condition(inst->op,false));
 				break;
 			}
 			
@@ -1271,14 +2470,14 @@ public:
 					}
 					default:
 					{
-						std::cout << tac_var->ident + "   |=>  " <<  int(tac_var->data_type) << " type " <<std::endl;
+						std::cout << tac_var->get_name() + "   |=>  " <<  int(tac_var->data_type) << " type " <<std::endl;
 						DEBUG_PANIC("convert value unsupported data type ");
 						break;
 					}
 				}
 
 				void *mem = alloc(sizeof(ASMPseudo));
-				ASMPseudo *asm_pseudo = new(mem) ASMPseudo(tac_var->ident);
+				ASMPseudo *asm_pseudo = new(mem) ASMPseudo(tac_var->get_name());
 				asm_pseudo->add_type(data_type);
 
 				mem = alloc(sizeof(ASMOperand));
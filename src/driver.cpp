@@ -11,23 +11,66 @@
 #include "front_end/include/type_checking.hpp"
 #include "front_end/include/loop_labelling.hpp"
 
-/*
 #include "middle_end/JS/include/ast_to_js.hpp"
 
-#include "middle_end/C/include/ast_to_c.hpp"
 #include "middle_end/tac/include/ast_to_tac.hpp"
+#include "middle_end/tac/include/pass_manager.hpp"
 #include "back_end/x86_64/include/tac_to_intel64.hpp"
+#include "back_end/x86_64/include/regalloc.hpp"
 #include "back_end/x86_64/include/pseudo.hpp"
 #include "back_end/x86_64/include/fixup.hpp"
+#include "back_end/x86_64/include/peephole.hpp"
 
 #include "back_end/x86_64/include/codegen.hpp"
-*/
+#include "back_end/x86_64/include/elf64.hpp"
+
+#include "back_end/makeda/include/tac_to_makeda.hpp"
+#include "middle_end/makeda/makasm/include/superinstructions.hpp"
+#include "middle_end/makeda/makvm/include/makeda.hpp"
+
+#include "utils/include/argparse.hpp"
+
 
 int main(int argc,char *argv[])
 {
-	std::string file_name(argv[1]);
+	Argparser argparse("c4c","c4c compiler"," pass a file","1.0.0");
+	argparse.add_argument(Argument("n","native","emit x86_64 assembly through the tac pipeline instead of C"," help : --native",ArgumentType::FLAG));
+	argparse.add_argument(Argument("","inline-threshold","maximum callee cost (instructions + arguments) that gets inlined, 0 disables inlining"," help : --inline-threshold 40",ArgumentType::STRING));
+	argparse.add_argument(Argument("O","opt-level","tac optimisation level 0, 1 or 2 (default 2)"," help : -O2",ArgumentType::STRING));
+	argparse.add_argument(Argument("","passes","comma separated tac passes to run instead of the -O pipeline"," help : --passes=inline,licm,gvn",ArgumentType::STRING));
+	argparse.add_argument(Argument("","print-after","dump the tac after the named passes, all for every pass"," help : --print-after=gvn",ArgumentType::STRING));
+	argparse.add_argument(Argument("","no-regalloc","keep every value in a stack slot instead of allocating registers"," help : --no-regalloc",ArgumentType::FLAG));
+	argparse.add_argument(Argument("","frame-report","print the stack frame size and slot sharing of every function"," help : --frame-report",ArgumentType::FLAG));
+	argparse.add_argument(Argument("","omit-frame-pointer","leaf functions keep their slots in the red zone below rsp instead of setting up rbp"," help : --omit-frame-pointer",ArgumentType::FLAG));
+	argparse.add_argument(Argument("","no-peephole","skip the peephole pass over the generated assembly"," help : --no-peephole",ArgumentType::FLAG));
+	argparse.add_argument(Argument("c","emit-object","write a relocatable ELF64 object instead of nasm assembly"," help : --emit-object",ArgumentType::FLAG));
+	argparse.add_argument(Argument("","check-object","write both and compare the object with what nasm makes of the assembly"," help : --check-object",ArgumentType::FLAG));
+	argparse.add_argument(Argument("","run","lower the tac to makeda bytecode and run main in the vm, no assembler or linker involved"," help : --run",ArgumentType::FLAG));
+	argparse.add_argument(Argument("","jit","with --run, compile the bytecode to x86_64 instead of interpreting it"," help : --jit",ArgumentType::FLAG));
+	argparse.add_argument(Argument("","profile","with --run, write an opcode and branch profile to prefix.json, prefix.csv and prefix.folded"," help : --profile=prefix",ArgumentType::STRING));
+	argparse.add_argument(Argument("","time-passes","print time and instruction count change of every tac pass"," help : --time-passes",ArgumentType::FLAG));
+	argparse.parse(argc,argv);
+
+	if (argparse.positionals.empty())
+	{
+		DEBUG_PANIC("usage : driver [--native] [-O0|-O1|-O2] [--passes=list] [--print-after=list] [--time-passes] [--no-regalloc] [--frame-report] [--omit-frame-pointer] [--no-peephole] [--emit-object] [--check-object] [--run] [--jit] [--profile=prefix] [--inline-threshold n] file");
+	}
+
+	std::string file_name = argparse.positionals[0];
 	std::cout << " hello c4c compiler " << file_name << std::endl;
 
+	int inline_threshold = 40;
+	if (argparse.get_value_string("inline-threshold") != "")
+	{
+		inline_threshold = std::stoi(argparse.get_value_string("inline-threshold"));
+	}
+
+	int opt_level = 2;
+	if (argparse.get_value_string("opt-level") != "")
+	{
+		opt_level = std::stoi(argparse.get_value_string("opt-level"));
+	}
+
 	FileToString fs(file_name);
 	std::string file_contents = fs.read();
 	//DEBUG_PRINT(file_contents,"");
@@ -66,34 +109,155 @@ int main(int argc,char *argv[])
 
 	
 
-		TypeChecking type_check(file_name,resolve.program);
+		bool is_tac = argparse.get_flag("native") or argparse.get_flag("run");
+		TypeChecking type_check(file_name,resolve.program,is_tac);
 		DEBUG_PRINT("sanity check : ", " after resolve ");
 		
 		LoopLabelling loop_label(file_name,type_check.program,resolve.global_counter);
 
-		AstToC C(file_name,loop_label.program);
-		StringToFile(file_name.substr(0, file_name.length() - 3) + ".c",C.string);
-
-		/*
+		if (not is_tac)
+		{
+			OutputSink out(file_name.substr(0, file_name.length() - 3) + ".c");
+			AstToC C(file_name,loop_label.program,&out);
+			return 0;
+		}
 
 		AstToTac tac(file_name,loop_label.program,&arena,loop_label.global_counter,type_check.table);
 
 		DEBUG_PRINT("sanity check : ", " after ast to tac ");
+
+		PassManager passes(file_name,tac.program,&arena);
+		passes.inline_threshold = inline_threshold;
+		passes.add_pipeline(opt_level);
+
+		// --passes= runs no pass at all
+		if (argparse.is_given("passes"))
+		{
+			passes.set_passes(argparse.get_value_string("passes"));
+		}
+
+		passes.add_print_after(argparse.get_value_string("print-after"));
+		passes.run();
+
+		if (argparse.get_flag("time-passes"))
+		{
+			passes.print_report();
+		}
+
+		if (argparse.get_flag("run"))
+		{
+			TacToMakeda makeda(file_name,tac.program);
+
+			if (opt_level >= 1)
+			{
+				Superinstructions fuse(&makeda.program);
+				fuse.print_stats();
+			}
+
+			makeda.print_stats();
+
+			std::string profile_name = argparse.get_value_string("profile");
+			Profile profile;
+			Makeda vm(1 << 16,makeda.program,argparse.get_flag("jit") ? Dispatch::JIT : Dispatch::THREADED,true,profile_name != "" ? &profile : nullptr);
+
+			if (profile_name != "" and vm.trap != Trap::INVALID_PROGRAM)
+			{
+				profile.print_stats();
+				if (not profile.write(profile_name))
+				{
+					DEBUG_PANIC("makeda : cannot write the profile " + profile_name);
+				}
+			}
+
+			if (vm.trap == Trap::INVALID_PROGRAM)
+			{
+				DEBUG_PANIC("makeda : rejected, " + vm.error);
+			}
+			else if (vm.trap != Trap::OK)
+			{
+				DEBUG_PANIC("makeda : trap " + std::to_string((int)vm.trap));
+			}
+
+			// the jit only counts what it left to the interpreter
+			std::cout << "makeda : main returned " << vm.get_result() << " after " << vm.executed << (argparse.get_flag("jit") ? " interpreted" : "") << " instructions" << std::endl;
+			return (int)vm.get_result();
+		}
+
 		TacToIntel64 intel(file_name,tac.program,&arena);
 
 		DEBUG_PRINT("sanity check : ", " after tac to intel64");
-		Pseudo pseudo(file_name,intel.program,&arena,type_check.table);
+
+		if (opt_level >= 1)
+		{
+			intel.print_stats();
+		}
+
+		if (opt_level >= 1 and not argparse.get_flag("no-regalloc"))
+		{
+			RegAlloc regalloc(file_name,intel.program,&arena,type_check.table);
+			regalloc.print_stats();
+		}
+
+		Pseudo pseudo(file_name,intel.program,&arena,type_check.table,opt_level >= 1);
+
+		if (opt_level >= 1)
+		{
+			pseudo.print_stats();
+		}
+
+		if (argparse.get_flag("frame-report"))
+		{
+			pseudo.print_report();
+		}
+
 		DEBUG_PRINT("sanity check : ", " after replace pseudo");
-		FixUp fix(file_name,pseudo.program,&arena);
+		FixUp fix(file_name,pseudo.program,&arena,argparse.get_flag("omit-frame-pointer"));
+
+		if (argparse.get_flag("omit-frame-pointer"))
+		{
+			fix.print_stats();
+		}
 
 		DEBUG_PRINT("sanity check : ", " after fix inst");
-		Codegen gen(file_name,intel.program);
-		DEBUG_PRINT("sanity check : ", " after codegen");
-		StringToFile(file_name.substr(0, file_name.length() - 3) + ".asm",gen.string);
 
-		//DEBUG_PANIC("testing");
+		if (opt_level >= 1 and not argparse.get_flag("no-peephole"))
+		{
+			Peephole peephole(file_name,fix.program,&arena);
+			peephole.print_stats();
+		}
 
-		*/
-		
+		std::string base_name = file_name.substr(0, file_name.length() - 3);
+		bool emit_object = argparse.get_flag("emit-object") or argparse.get_flag("check-object");
+
+		if (not argparse.get_flag("emit-object") or argparse.get_flag("check-object"))
+		{
+			OutputSink out(base_name + ".asm");
+			Codegen gen(file_name,intel.program,&out);
+			DEBUG_PRINT("sanity check : ", " after codegen");
+		}
+
+		if (emit_object)
+		{
+			Encoder encoder(file_name,intel.program);
+			ELF64Writer elf(base_name + ".asm",&encoder);
+			{
+				OutputSink object(base_name + ".o");
+				object.write(elf.bytes);
+			}
+			DEBUG_PRINT("sanity check : ", " after object emission");
+
+			if (argparse.get_flag("check-object"))
+			{
+				ObjectCheck check(base_name + ".asm",elf.bytes);
+				check.print_stats();
+
+				if (not check.ok)
+				{
+					return 1;
+				}
+			}
+		}
+
+		//DEBUG_PANIC("testing");
 	}
 }
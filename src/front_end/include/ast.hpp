@@ -320,12 +320,13 @@ class ASTFunctionArgument
 public:
 	ASTType *type;
 	std::string ident;
+	std::string true_ident;
 	//ASTBox box;
 
 	ASTFunctionArgument(ASTType *type,std::string ident)
 	{
 		this->type = type;
-		this->ident = ident;
+		this->ident = this->true_ident = ident;
 	}
 };
 
@@ -761,6 +762,11 @@ enum class ASTBinaryOperator
 	OR,
 	EQUAL,
 	NOT_EQUAL,
+	BIT_AND,
+	BIT_OR,
+	BIT_XOR,
+	SHIFT_LEFT,
+	SHIFT_RIGHT,
 	None,
 };
 
@@ -1287,6 +1293,13 @@ enum class ASTPrecedence
 	EQUAL = 30,
 	NOT_EQUAL = 30,
 
+	SHIFT_LEFT = 40,
+	SHIFT_RIGHT = 40,
+
+	BIT_AND = 25,
+	BIT_XOR = 20,
+	BIT_OR = 15,
+
 	AND = 10,
 	OR = 5,
 	ASSIGN = 1,
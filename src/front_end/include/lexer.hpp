@@ -741,12 +741,16 @@ private:
 			 case '>':
 				if ( match_token('=',1))
 				    add_token_double(TokenType::TOKEN_GREATER_EQUAL,">=");
+				else if ( match_token('>',1))
+				    add_token_double(TokenType::TOKEN_RIGHT_SHIFT,">>");
 				else
 				    add_token_single(TokenType::TOKEN_GREATER,">");
 				break;
 			 case '<':
 				if ( match_token('=',1))
 				    add_token_double(TokenType::TOKEN_LESS_EQUAL,">=");
+				else if ( match_token('<',1))
+				    add_token_double(TokenType::TOKEN_LEFT_SHIFT,"<<");
 				else
 				    add_token_single(TokenType::TOKEN_LESS,">");
 				break;
@@ -774,6 +778,9 @@ private:
 				else
 				    add_token_single(TokenType::TOKEN_BITWISE_OR,"|");
 				break;
+			 case '^':
+				add_token_single(TokenType::TOKEN_BITWISE_XOR,"^");
+				break;
 			 default:
 				consume(); 
 		}
@@ -300,6 +300,30 @@ public:
 		{
 			return TokenType::TOKEN_BITWISE_AND;
 		}
+		else if (symbol == "|")
+		{
+			return TokenType::TOKEN_BITWISE_OR;
+		}
+		else if (symbol == "^")
+		{
+			return TokenType::TOKEN_BITWISE_XOR;
+		}
+		else if (symbol == "<<")
+		{
+			return TokenType::TOKEN_LEFT_SHIFT;
+		}
+		else if (symbol == ">>")
+		{
+			return TokenType::TOKEN_RIGHT_SHIFT;
+		}
+		else if (symbol == "/")
+		{
+			return TokenType::TOKEN_DIV;
+		}
+		else if (symbol == "%")
+		{
+			return TokenType::TOKEN_MOD;
+		}
 		else if (symbol == ":")
 		{
 			return TokenType::TOKEN_COLON;
@@ -1637,7 +1661,8 @@ public:
 
 	bool is_binary()
 	{
-		return is_token("-") or is_token("+") or is_token("*") or is_token("%") or is_token("/") or is_token("<") or is_token(">") or is_token("<=") or is_token(">=") or is_token("||") or is_token("&&")  or is_token("=")or is_token("==");
+		return is_token("-") or is_token("+") or is_token("*") or is_token("%") or is_token("/") or is_token("<") or is_token(">") or is_token("<=") or is_token(">=") or is_token("||") or is_token("&&")  or is_token("=")or is_token("==") or
+		       is_token("&") or is_token("|") or is_token("^") or is_token("<<") or is_token(">>");
 	}
 
 	/**
@@ -1752,6 +1777,31 @@ public:
 				return ASTBinaryOperator::EQUAL;
 				break;
 			}
+			case TokenType::TOKEN_BITWISE_AND:
+			{
+				return ASTBinaryOperator::BIT_AND;
+				break;
+			}
+			case TokenType::TOKEN_BITWISE_OR:
+			{
+				return ASTBinaryOperator::BIT_OR;
+				break;
+			}
+			case TokenType::TOKEN_BITWISE_XOR:
+			{
+				return ASTBinaryOperator::BIT_XOR;
+				break;
+			}
+			case TokenType::TOKEN_LEFT_SHIFT:
+			{
+				return ASTBinaryOperator::SHIFT_LEFT;
+				break;
+			}
+			case TokenType::TOKEN_RIGHT_SHIFT:
+			{
+				return ASTBinaryOperator::SHIFT_RIGHT;
+				break;
+			}
 		}
 
 		return ASTBinaryOperator::None;
@@ -1763,10 +1813,18 @@ public:
 
 	int get_precedence()
 	{
-		if ( is_token("+") or is_token("-"))
+		if ( is_token("*") or is_token("/") or is_token("%"))
+		{
+			return (int)ASTPrecedence::MUL;
+		}
+		else if ( is_token("+") or is_token("-"))
 		{
 			return (int)ASTPrecedence::ADD;
 		}
+		else if ( is_token("<<") or is_token(">>"))
+		{
+			return (int)ASTPrecedence::SHIFT_LEFT;
+		}
 		else if ( is_token("<") or is_token("<=") or is_token(">") or is_token(">="))
 		{
 			return (int)ASTPrecedence::LESS;
@@ -1775,6 +1833,18 @@ public:
 		{
 			return (int)ASTPrecedence::EQUAL;
 		}
+		else if ( is_token("&") )
+		{
+			return (int)ASTPrecedence::BIT_AND;
+		}
+		else if ( is_token("^") )
+		{
+			return (int)ASTPrecedence::BIT_XOR;
+		}
+		else if ( is_token("|") )
+		{
+			return (int)ASTPrecedence::BIT_OR;
+		}
 		else if ( is_token("&&") )
 		{
 			return (int)ASTPrecedence::AND;
@@ -22,6 +22,7 @@ class TypeFunction
 public:
     DataType return_type;
     int arg_count;
+    std::vector<DataType> arg_types;
 
     TypeFunction(DataType return_type,int arg_count)
     {
@@ -110,7 +111,7 @@ public:
         this->int_init = int_init;
     }
 
-    void add_int64_init(int int64_init)
+    void add_int64_init(long int int64_init)
     {
         this->int64_init = int64_init;
     }
@@ -195,12 +196,16 @@ public:
     int global_counter = 0;
     SymbolTable table;
 
-    TypeChecking(std::string file_name,ASTProgram *program)
+    // the C output does not need the types yet, the tac pipelines do
+    TypeChecking(std::string file_name,ASTProgram *program,bool enabled = false)
     {
         this->file_name = file_name;
         this->program = program;
 
-        return;
+        if (not enabled)
+        {
+            return;
+        }
         
         SymbolTable *symbol_table = &table;
 
@@ -232,7 +237,7 @@ public:
 			}
             case ASTDeclarationType::VARDECL:
 			{
-				//check_global_vardecl((ASTVarDecl *)decl->decl,symbol_table);
+				check_global_vardecl((ASTVarDecl *)decl->decl,symbol_table);
 				break;
 			}
 		}
@@ -240,169 +245,108 @@ public:
     }
 
 
-    /*
-
+    // globals are registered with their constant initializer, AstToTac emits them from the table
     void check_global_vardecl(ASTVarDecl *decl,SymbolTable *symbol_table)
     {
-        
+        DataType base_type;
+
         switch (decl->type->type)
         {
             case ASTDataType::I32:
             {
-                Symbol symbol(decl->ident,DataType::I32);
-                symbol.add_public(decl->is_public);
-                symbol.add_global(true);
-                symbol.add_init(false);
-
-                get_i32_init(decl->expr->expr);
-
-                if (decl->expr == nullptr)
-                {
-                    if (decl->is_extern)
-                    {
-                        symbol.add_init(false);
-                    }
-                    else
-                    {
-                        symbol.add_init(true);
-                        symbol.add_tentative(true);
-                        symbol.add_int_init(0);
-                    }
-                }
-                else if (decl->expr->type == ASTExpressionType::I32)
-                {
-                    symbol.add_init(true);
-                    symbol.add_tentative(false);
-                    symbol.add_int_init(get_i32_init(decl->expr->expr));
-                }
-                else
-                {
-                    fatal(" non-constant initializer used on local static variable");
-                }
-
-                bool is_public = not decl->is_static;
-
-                if(symbol_table->lookup(decl->ident))
-                {
-                    if(symbol_table->get_type(decl->ident) != DataType::I32)
-                    {
-                        fatal("function redeclared as a variable");
-                    }
-
-                    if (decl->is_extern)
-                    {
-                        is_public = symbol_table->get_global(decl->ident);
-                    }
-                    else if ( symbol_table->get_global(decl->ident) != is_public)
-                    {
-                        fatal(" variable linkage conflicts with previous declaration");
-                    }
-
-                    if (symbol_table->get(decl->ident).tentative == false )
-                    {
-                        if (symbol.tentative == false)
-                        {
-                            fatal(" conflicting file scope variable definitions ");
-                        }
-                        else
-                        {
-                            symbol.add_tentative(symbol_table->get(decl->ident).tentative);
-                            symbol.add_init(symbol_table->get(decl->ident).init);
-                            symbol.add_int_init(symbol_table->get(decl->ident).int_init);
-                        }
-                    }
-                    else if (symbol.tentative)
-                    {
-                        symbol.add_tentative(true);
-                    }
-                }
-
-                symbol_table->add(decl->ident,symbol);
-
-                decl->expr->add_data_type(DataType::I32);
+                base_type = DataType::I32;
                 break;
             }
             case ASTDataType::I64:
             {
-                Symbol symbol(decl->ident,DataType::I64);
-                symbol.add_public(decl->is_public);
-                symbol.add_global(true);
-                symbol.add_init(false);
-
-                get_i64_init(decl->expr->expr);
+                base_type = DataType::I64;
+                break;
+            }
+            case ASTDataType::U32:
+            {
+                base_type = DataType::U32;
+                break;
+            }
+            case ASTDataType::U64:
+            {
+                base_type = DataType::U64;
+                break;
+            }
+            default:
+            {
+                fatal(" unsupported type in global variable " + decl->ident);
+                break;
+            }
+        }
 
-                if (decl->expr == nullptr)
-                {
-                    if (decl->is_extern)
-                    {
-                        symbol.add_init(false);
-                    }
-                    else
-                    {
-                        symbol.add_init(true);
-                        symbol.add_tentative(true);
-                        symbol.add_int64_init(0);
-                    }
-                }
-                else if (decl->expr->type == ASTExpressionType::I32)
-                {
-                    symbol.add_init(true);
-                    symbol.add_tentative(false);
-                    symbol.add_int64_init(get_i64_init(decl->expr->expr));
-                }
-                else
-                {
-                    fatal(" non-constant initializer used on local static variable");
-                }
+        if (symbol_table->lookup(decl->ident))
+        {
+            fatal(" conflicting file scope variable definitions " + decl->ident);
+        }
 
-                bool is_public = not decl->is_static;
+        Symbol symbol(decl->ident,decl->type->ptr > 0 ? DataType::PTR : base_type,false);
+        symbol.add_pointer_type(decl->type->ptr > 0,base_type,decl->type->ptr);
+        symbol.add_public(decl->is_public);
+        symbol.add_global(true);
 
-                if(symbol_table->lookup(decl->ident))
-                {
-                    if(symbol_table->get_type(decl->ident) != DataType::I64)
-                    {
-                        fatal("function redeclared as a variable");
-                    }
+        if (decl->is_extern)
+        {
+            if (decl->init != nullptr)
+            {
+                fatal(" extern variable declared with an initializer is illegal");
+            }
 
-                    if (decl->is_extern)
-                    {
-                        is_public = symbol_table->get_global(decl->ident);
-                    }
-                    else if ( symbol_table->get_global(decl->ident) != is_public)
-                    {
-                        fatal(" variable linkage conflicts with previous declaration");
-                    }
+            symbol.add_init(false);
+        }
+        else if (decl->init == nullptr)
+        {
+            symbol.add_init(true);
+            symbol.add_tentative(true);
+            symbol.add_int_init(0);
+        }
+        else if (decl->init->type == ASTVarInitType::SINGLE)
+        {
+            ASTExpression *expr = ((ASTVarSingleInit *)decl->init->init)->expr;
+            check_expr(expr,symbol_table);
 
-                    if (symbol_table->get(decl->ident).tentative == false )
-                    {
-                        if (symbol.tentative == false)
-                        {
-                            fatal(" conflicting file scope variable definitions ");
-                        }
-                        else
-                        {
-                            symbol.add_tentative(symbol_table->get(decl->ident).tentative);
-                            symbol.add_init(symbol_table->get(decl->ident).init);
-                            symbol.add_int64_init(symbol_table->get(decl->ident).int64_init);
-                        }
-                    }
-                    else if (symbol.tentative)
-                    {
-                        symbol.add_tentative(true);
-                    }
-                }
+            symbol.add_init(true);
 
-                symbol_table->add(decl->ident,symbol);
-                decl->expr->add_data_type(DataType::I64);
-                break;
+            if (expr->type == ASTExpressionType::I32)
+            {
+                symbol.add_int_init(get_i32_init(expr->expr));
+                symbol.add_int64_init(get_i32_init(expr->expr));
+            }
+            else if (expr->type == ASTExpressionType::I64)
+            {
+                symbol.add_int_init(get_i64_init(expr->expr));
+                symbol.add_int64_init(get_i64_init(expr->expr));
+            }
+            else
+            {
+                fatal(" non-constant initializer used on global variable " + decl->ident);
             }
         }
-        
-        
+        else
+        {
+            fatal(" unsupported initializer on global variable " + decl->ident);
+        }
+
+        symbol_table->add(decl->ident,symbol);
     }
 
 
-    */
+    Symbol get_argument_symbol(ASTFunctionArgument *arg,DataType base_type)
+    {
+        if (arg->type->ptr == 0)
+        {
+            return Symbol(arg->ident,base_type);
+        }
+
+        Symbol symbol(arg->ident,DataType::PTR);
+        symbol.add_pointer_type(true,base_type,arg->type->ptr);
+        return symbol;
+    }
+
 
     void check_native(ASTNativeDecl *decl,SymbolTable *symbol_table)
     {
@@ -475,7 +419,8 @@ public:
                 }
             }
 
-            symbol_table->add(arg->ident,Symbol(arg->ident,arg_datatype));
+            symbol_table->add(arg->ident,get_argument_symbol(arg,arg_datatype));
+            symbol_table->table.at(decl->ident).val.arg_types.push_back(symbol_table->get_type(arg->ident));
 
         }
     }
@@ -544,7 +489,8 @@ public:
                 }
             }
 
-            symbol_table->add(arg->ident,Symbol(arg->ident,arg_datatype));
+            symbol_table->add(arg->ident,get_argument_symbol(arg,arg_datatype));
+            symbol_table->table.at(decl->ident).val.arg_types.push_back(symbol_table->get_type(arg->ident));
 
         }
 
@@ -603,7 +549,7 @@ public:
     }
 
 
-    int get_i64_init(void *expr)
+    long int get_i64_init(void *expr)
     {
         ASTI64Expr *i64_expr = (ASTI64Expr *)expr;
         return i64_expr->value; 
@@ -623,39 +569,33 @@ public:
             case ASTDataType::I32:
             {
                 base_type = DataType::I32;
-                DEBUG_PRINT(" vardecl =>  "," i32 ");
                 break;
             }
             case ASTDataType::I64:
             {
                 base_type = DataType::I64;
-                DEBUG_PRINT(" vardecl =>  "," i64 ");
                 break;
             }
             case ASTDataType::U32:
             {
                 base_type = DataType::U32;
-                DEBUG_PRINT(" vardecl =>  "," u32 ");
                 break;
             }
             case ASTDataType::U64:
             {
                 base_type = DataType::U64;
-                DEBUG_PRINT(" vardecl =>  "," u64 ");
                 break;
             }
             case ASTDataType::ENUM:
             {
                 base_type = DataType::ENUM;
                 agg_ident = decl->type->ident;
-                DEBUG_PRINT(" vardecl =>  "," u64 ");
                 break;
             }
             case ASTDataType::STRUCT:
             {
                 base_type = DataType::STRUCT;
                 agg_ident = decl->type->ident;
-                DEBUG_PRINT(" vardecl =>  "," u64 ");
                 break;
             }
             default:
@@ -670,8 +610,8 @@ public:
         if(decl->type->ptr > 0)
         {
             type = DataType::PTR;
+            is_ptr = true;
             ptr_no = decl->type->ptr;
-            printf(" ptr_no  =>   %d\n",ptr_no);
         }
         else
         {
@@ -744,6 +684,7 @@ public:
                         if(decl->init->type == ASTVarInitType::SINGLE)
                         {
                             check_expr(((ASTVarSingleInit *)decl->init->init)->expr,symbol_table);
+                            check_widening(((ASTVarSingleInit *)decl->init->init)->expr,type);
                         }
                         else if(decl->init->type == ASTVarInitType::STRUCT)
                         {
@@ -809,13 +750,16 @@ public:
 
                 else
                 {
-                    symbol_table->add(decl->ident,Symbol(decl->ident,DataType::I64,true));
+                    Symbol symbol(decl->ident,type,true);
+                    symbol.add_pointer_type(is_ptr,base_type,ptr_no);
+                    symbol_table->add(decl->ident,symbol);
 
                     if (decl->init != nullptr)
                     {
                         if(decl->init->type == ASTVarInitType::SINGLE)
                         {
                             check_expr(((ASTVarSingleInit *)decl->init->init)->expr,symbol_table);
+                            check_widening(((ASTVarSingleInit *)decl->init->init)->expr,type);
                         }
                         else if(decl->init->type == ASTVarInitType::STRUCT)
                         {
@@ -881,13 +825,16 @@ public:
 
                 else
                 {
-                    symbol_table->add(decl->ident,Symbol(decl->ident,DataType::U32,true));
+                    Symbol symbol(decl->ident,type,true);
+                    symbol.add_pointer_type(is_ptr,base_type,ptr_no);
+                    symbol_table->add(decl->ident,symbol);
 
                     if (decl->init != nullptr)
                     {
                         if(decl->init->type == ASTVarInitType::SINGLE)
                         {
                             check_expr(((ASTVarSingleInit *)decl->init->init)->expr,symbol_table);
+                            check_widening(((ASTVarSingleInit *)decl->init->init)->expr,type);
                         }
                         else if(decl->init->type == ASTVarInitType::STRUCT)
                         {
@@ -953,13 +900,16 @@ public:
 
                 else
                 {
-                    symbol_table->add(decl->ident,Symbol(decl->ident,DataType::U64,true));
+                    Symbol symbol(decl->ident,type,true);
+                    symbol.add_pointer_type(is_ptr,base_type,ptr_no);
+                    symbol_table->add(decl->ident,symbol);
 
                     if (decl->init != nullptr)
                     {
                         if(decl->init->type == ASTVarInitType::SINGLE)
                         {
                             check_expr(((ASTVarSingleInit *)decl->init->init)->expr,symbol_table);
+                            check_widening(((ASTVarSingleInit *)decl->init->init)->expr,type);
                         }
                         else if(decl->init->type == ASTVarInitType::STRUCT)
                         {
@@ -1030,9 +980,10 @@ public:
     {
         check_expr(stmt->expr,symbol_table);
 
+        widen_literal(stmt->expr,return_type);
+
         if(stmt->expr->data_type != return_type)
         {
-            std::cout << "  return type  "  << (int)return_type  << "  : stmt->expr->data_type  "  << (int)stmt->expr->data_type << std::endl;
             fatal("returned value data type conflicts with the function's data type");
         }
     }
@@ -1083,7 +1034,6 @@ public:
                     }
                     case ASTDataType::I64:
                     {
-                        DEBUG_PANIC("the fuckery");
                         cast_expr->add_data_type(DataType::I64);
                         break;
                     }
@@ -1094,7 +1044,6 @@ public:
                     }
                     case ASTDataType::U64:
                     {
-                        DEBUG_PANIC("the fuckery");
                         cast_expr->add_data_type(DataType::U64);
                         break;
                     }
@@ -1139,6 +1088,8 @@ public:
                     }
                     case DataType::I64:
                     {
+                        widen_literal(assign_expr->rhs,DataType::I64);
+
                         if(assign_expr->rhs->data_type == DataType::I32)
                         {
                             if(assign_expr->rhs->type == ASTExpressionType::I32)
@@ -1297,8 +1248,13 @@ public:
                 ASTVariableExpr *var_expr = (ASTVariableExpr *)expr->expr;
                 //fatal(" fatal  -> " + var_expr->ident);
                 std::string name = var_expr->ident;
+
+                if (not symbol_table->lookup(name))
+                {
+                    fatal("undeclared variable " + name);
+                }
                 
-                if (symbol_table->lookup(name)  and not is_data_type(symbol_table->get_type(name)) )
+                if (not is_data_type(symbol_table->get_type(name)))
                 {
                     fatal("function used as variable");    
                 }
@@ -1307,8 +1263,6 @@ public:
                 var_expr->add_data_type(symbol_table->get_type(name));
                 var_expr->add_pointer_type(symbol_table->get_pointer_type(name).is_ptr,symbol_table->get_pointer_type(name).base_type,symbol_table->get_pointer_type(name).ptr_no);
 
-                printf("var expr ptr_no [%s] : %d\n",name.c_str(),symbol_table->get_pointer_type(name).ptr_no);
-
                 expr->add_data_type(var_expr->data_type);
                 expr->add_pointer_type(symbol_table->get_pointer_type(name).is_ptr,symbol_table->get_pointer_type(name).base_type,symbol_table->get_pointer_type(name).ptr_no);
                 break;
@@ -1350,7 +1304,6 @@ public:
                 {
                     case DataType::PTR:
                     {
-                        DEBUG_PRINT("pointer read","--------------------");
                         if(read->expr->ptr_type.ptr_no > 1)
                         {
                             //fatal("double pointer");
@@ -1373,23 +1326,18 @@ public:
 
                 expr->add_data_type(read->data_type);
                 expr->add_pointer_type(read->ptr_type.is_ptr,read->ptr_type.base_type,read->ptr_type.ptr_no);
-
-                std::cout << " read ptr : " << (int)expr->data_type << std::endl;
-
-
-
                 break;
             }
             case ASTExpressionType::PTR_WRITE:
             {
                 ASTPtrWriteExpr *write = (ASTPtrWriteExpr *)expr->expr;
                 check_expr(write->expr,symbol_table);
+                check_expr(write->data,symbol_table);
 
                 switch (write->expr->data_type)
                 {
                     case DataType::PTR:
                     {
-                        DEBUG_PRINT("pointer read","--------------------");
                         if(write->expr->ptr_type.ptr_no > 1)
                         {
                             //fatal("double pointer 66");
@@ -1412,10 +1360,6 @@ public:
 
                 expr->add_data_type(write->data_type);
                 expr->add_pointer_type(write->ptr_type.is_ptr,write->ptr_type.base_type,write->ptr_type.ptr_no);
-
-                std::cout << " write ptr : " << (int)expr->data_type << std::endl;
-
-
                 break;
             }
             case ASTExpressionType::FUNCTION_CALL:
@@ -1428,28 +1372,29 @@ public:
 
                 if(fn_expr->base->type == ASTExpressionType::VARIABLE)
                 {
-                    name = ((ASTVariableExpr *)fn_expr->base)->ident;
+                    name = ((ASTVariableExpr *)fn_expr->base->expr)->ident;
                 }
                 else if(fn_expr->base->type == ASTExpressionType::STRUCT_ACCESS)
                 {
                     //check_expr(fn_expr->base,symbol_table);
-                    name = ((ASTStructAccessExpr *)fn_expr->base)->member;
+                    name = ((ASTStructAccessExpr *)fn_expr->base->expr)->member;
                 }
                 else if(fn_expr->base->type == ASTExpressionType::STRUCT_PTR_ACCESS)
                 {
                     //check_expr(fn_expr->base,symbol_table);
-                    name = ((ASTStructPtrAccessExpr *)fn_expr->base)->member;
+                    name = ((ASTStructPtrAccessExpr *)fn_expr->base->expr)->member;
                 }
 
-                std::cout << "name : " << name << std::endl;
+                if (not symbol_table->lookup(name))
+                {
+                    fatal("call to undeclared function " + name);
+                }
 
                 DataType t_type = symbol_table->get_type(name);
                 TypeFunction f_type = symbol_table->get_val(name);
                 fn_expr->add_data_type(f_type.return_type);
                 expr->add_data_type(f_type.return_type);
 
-                std::cout << "t_type   :  " << (int)t_type << std::endl;
-
                 if (t_type == DataType::I32 or t_type == DataType::I64)
                 {
                     fatal(" variable used as function name ");
@@ -1461,14 +1406,20 @@ public:
                 }
 
 
-                for (ASTExpression *arg : fn_expr->args)
+                for (u64 i = 0; i < fn_expr->args.size(); i++)
                 {
+                    ASTExpression *arg = fn_expr->args[i];
                     if (arg == nullptr)
                     {
                         continue;
                     }
 
                     check_expr(arg,symbol_table);
+
+                    if (i < f_type.arg_types.size())
+                    {
+                        check_widening(arg,f_type.arg_types[i]);
+                    }
                 }
 
                 break;
@@ -1521,6 +1472,11 @@ public:
                             case ASTBinaryOperator::MUL:
                             case ASTBinaryOperator::DIV:
                             case ASTBinaryOperator::MOD:
+                            case ASTBinaryOperator::BIT_AND:
+                            case ASTBinaryOperator::BIT_OR:
+                            case ASTBinaryOperator::BIT_XOR:
+                            case ASTBinaryOperator::SHIFT_LEFT:
+                            case ASTBinaryOperator::SHIFT_RIGHT:
                             {
                                 switch (binary_expr->lhs->data_type)
                                 {
@@ -1538,6 +1494,8 @@ public:
                                     }
                                     case DataType::I64:
                                     {
+                                        widen_literal(binary_expr->rhs,DataType::I64);
+
                                         if(binary_expr->rhs->data_type == DataType::I32)
                                         {
                                             if(binary_expr->rhs->type == ASTExpressionType::I32)
@@ -1646,7 +1604,6 @@ public:
                                     }
                                     default:
                                     {
-                                        std::cout << "   TYPE   :  "  << (int)binary_expr->lhs->data_type << std::endl;
                                         fatal("binary expr case : unsupported datatype encountered");
                                         break;
                                     }
@@ -1676,6 +1633,50 @@ public:
         }
     }
 
+    // an i32 literal, negated or not, used where an i64 is expected becomes an i64 literal
+    void widen_literal(ASTExpression *expr,DataType type)
+    {
+        if (type != DataType::I64 or expr->data_type != DataType::I32)
+        {
+            return;
+        }
+
+        if (expr->type == ASTExpressionType::I32)
+        {
+            expr->type = ASTExpressionType::I64;
+            ((ASTI32Expr *)expr->expr)->add_data_type(DataType::I64);
+            expr->add_data_type(DataType::I64);
+        }
+        else if (expr->type == ASTExpressionType::UNARY)
+        {
+            ASTUnaryExpr *unary_expr = (ASTUnaryExpr *)expr->expr;
+
+            if (unary_expr->op == ASTUnaryOperator::NEGATE and unary_expr->rhs->type == ASTExpressionType::I32)
+            {
+                widen_literal(unary_expr->rhs,type);
+                unary_expr->add_data_type(DataType::I64);
+                expr->add_data_type(DataType::I64);
+            }
+        }
+    }
+
+
+    // arguments and initializers follow the assignment rules, an i32 only widens as a literal
+    void check_widening(ASTExpression *expr,DataType type)
+    {
+        widen_literal(expr,type);
+
+        if (type == DataType::I64 and expr->data_type == DataType::I32)
+        {
+            fatal(" i32 used with an i64 => perform cast for this to compile");
+        }
+        else if (type == DataType::I32 and expr->data_type == DataType::I64)
+        {
+            fatal(" i64 used with an i32 => perform cast for this to compile");
+        }
+    }
+
+
     void check_pointer_type_match(ASTExpression *lhs,ASTExpression *rhs)
     {
         if(lhs->data_type == DataType::PTR)
@@ -2,6 +2,7 @@
 #define C4C_AST_TO_C_H
 
 #include "../../../front_end/include/ast.hpp"
+#include "../../../utils/include/output_sink.hpp"
 #include <string>
 #include <vector>
 
@@ -11,18 +12,24 @@ class AstToC
 public:
     std::string file_name;
     ASTProgram *program;
-    std::string string;
+    OutputSink *out;
 
 
-	void write_body(std::string string)
+	void write_body(const std::string &string)
 	{
-		this->string += string;
+		this->out->write(string);
 	}
 
-    AstToC(std::string file_name,ASTProgram *program)
+	void write_tabs(int depth)
+	{
+		this->out->write_tabs(depth);
+	}
+
+    AstToC(std::string file_name,ASTProgram *program,OutputSink *out)
     {
         this->file_name = file_name;
         this->program = program;
+        this->out = out;
 
         for (ASTDeclaration *decl : this->program->decls)
 		{
@@ -67,20 +74,33 @@ public:
 				convert_native_decl((ASTNativeDecl *)decl->decl);
 				break;
 			}
+			case ASTDeclarationType::VARDECL:
+			{
+				convert_global_vardecl((ASTVarDecl *)decl->decl);
+				break;
+			}
 			default:
 			{
 				DEBUG_PRINT("here "," null tac_decl");
 			}
-			/*
-			case ASTDeclarationType::VARDECL:
-			{
-				TACFunction *tac_vardecl = convert_global_vardecl((ASTVarDecl *)decl->decl);
-				tac_decl = new(mem) TACDeclaration(TACDeclarationType::VARDECL,tac_vardecl);
-				break;
-			}*/
 		}
 	}
 
+
+	void convert_global_vardecl(ASTVarDecl *decl)
+	{
+		if(decl->is_extern)
+		{
+			write_body("extern ");
+		}
+		else if(decl->is_static)
+		{
+			write_body("static ");
+		}
+
+		convert_vardecl_stmt(decl,0);
+	}
+
 	void convert_enum_decl(ASTEnumDecl *decl)
 	{
 		write_body("enum " + decl->ident + "\n{\n");
@@ -312,7 +332,7 @@ public:
 				data_type += "*";
 			}
 
-			write_body(data_type + arg->ident);
+			write_body(data_type + arg->true_ident);
 
 			if(i++ + 1 >= arg_length)
 			{
@@ -577,7 +597,7 @@ public:
 				data_type += "*";
 			}
 
-			write_body(data_type + arg->ident);
+			write_body(data_type + arg->true_ident);
 
 			if(i++ + 1 >= arg_length)
 			{
@@ -594,54 +614,56 @@ public:
 
 
 
-	void convert_block_stmt(ASTBlockStmt *block,std::string tab="")
+	void convert_block_stmt(ASTBlockStmt *block,int depth = 0)
 	{
-		write_body(tab + "{\n");
+		write_tabs(depth);
+		write_body("{\n");
 		for (ASTStatement *stmt : block->stmts)
 		{
-			convert_stmt(stmt,tab + "\t");
+			convert_stmt(stmt,depth + 1);
 		}
-		write_body(tab + "}\n");
+		write_tabs(depth);
+		write_body("}\n");
 	}
 
 
-	void convert_stmt(ASTStatement *stmt,std::string tab)
+	void convert_stmt(ASTStatement *stmt,int depth)
 	{
 		switch(stmt->type)
 		{
 			case ASTStatementType::RETURN:
 			{
-				convert_return_stmt((ASTReturnStmt *)stmt->stmt,tab);
+				convert_return_stmt((ASTReturnStmt *)stmt->stmt,depth);
 				break;
 			}
 			case ASTStatementType::IF:
 			{
-				convert_if_stmt((ASTIfStmt *)stmt->stmt,tab);
+				convert_if_stmt((ASTIfStmt *)stmt->stmt,depth);
 				break;
 			}
 			case ASTStatementType::WHILE:
 			{
-				convert_while_stmt((ASTWhileStmt *)stmt->stmt,tab);
+				convert_while_stmt((ASTWhileStmt *)stmt->stmt,depth);
 				break;
 			}
 			case ASTStatementType::BREAK:
 			{
-				convert_break_stmt((ASTBreakStmt *)stmt->stmt,tab);
+				convert_break_stmt((ASTBreakStmt *)stmt->stmt,depth);
 				break;
 			}
 			case ASTStatementType::CONTINUE:
 			{
-				convert_continue_stmt((ASTContinueStmt *)stmt->stmt,tab);
+				convert_continue_stmt((ASTContinueStmt *)stmt->stmt,depth);
 				break;
 			}
 			case ASTStatementType::VARDECL:
 			{
-				convert_vardecl_stmt((ASTVarDecl *)stmt->stmt,tab);
+				convert_vardecl_stmt((ASTVarDecl *)stmt->stmt,depth);
 				break;
 			}
 			case ASTStatementType::EXPR:
 			{
-				write_body(tab);
+				write_tabs(depth);
 				convert_expr((ASTExpression *)stmt->stmt);
 				write_body(";\n");
 				break;
@@ -651,35 +673,35 @@ public:
 
 
 
-	void convert_break_stmt(ASTBreakStmt *stmt,std::string tab)
+	void convert_break_stmt(ASTBreakStmt *stmt,int depth)
 	{
-		write_body(tab);
+		write_tabs(depth);
 		write_body("break;\n");
 	}
 
-	void convert_continue_stmt(ASTContinueStmt *stmt,std::string tab)
+	void convert_continue_stmt(ASTContinueStmt *stmt,int depth)
 	{
-		write_body(tab);
+		write_tabs(depth);
 		write_body("continue;\n");
 	}
 
-	void convert_while_stmt(ASTWhileStmt *stmt,std::string tab)
+	void convert_while_stmt(ASTWhileStmt *stmt,int depth)
 	{
-		write_body(tab);
+		write_tabs(depth);
 		write_body("while (");
 		convert_expr(stmt->expr);
 		write_body(")\n");
-		convert_block_stmt(stmt->block,tab);
+		convert_block_stmt(stmt->block,depth);
 	}
 
 
-	void convert_if_stmt(ASTIfStmt *stmt,std::string tab)
+	void convert_if_stmt(ASTIfStmt *stmt,int depth)
 	{
-		write_body(tab);
+		write_tabs(depth);
 		write_body("if(");
 		convert_expr(stmt->expr);
 		write_body(")\n");
-		convert_block_stmt(stmt->block,tab);
+		convert_block_stmt(stmt->block,depth);
 
 		for (ASTIfElifBlock *elif_block : stmt->elif_blocks)
 		{
@@ -691,21 +713,21 @@ public:
 			write_body("else if(");
 			convert_expr(elif_block->expr);
 			write_body(")\n");
-			convert_block_stmt(elif_block->block,tab );
+			convert_block_stmt(elif_block->block,depth);
 		}
 
 		if(stmt->else_block != nullptr)
 		{
 			write_body("else\n");
-			convert_block_stmt(stmt->else_block->block,tab);
+			convert_block_stmt(stmt->else_block->block,depth);
 		}
 	}
 
 
 
-	void convert_vardecl_stmt(ASTVarDecl *stmt,std::string tab)
+	void convert_vardecl_stmt(ASTVarDecl *stmt,int depth)
 	{
-		write_body(tab);
+		write_tabs(depth);
 		std::string data_type;
 
 		switch(stmt->type->type)
@@ -769,23 +791,26 @@ public:
 		}
 
 		std::string new_line;
-		write_body(data_type + stmt->true_ident + " = ");
+		write_body(data_type + stmt->true_ident);
 
-		if(stmt->init->type == ASTVarInitType::SINGLE)
+		if(stmt->init != nullptr and stmt->init->type == ASTVarInitType::SINGLE)
 		{
+			write_body(" = ");
 			convert_expr(((ASTVarSingleInit *)stmt->init->init)->expr);
 		}
-		else if(stmt->init->type == ASTVarInitType::STRUCT)
+		else if(stmt->init != nullptr and stmt->init->type == ASTVarInitType::STRUCT)
 		{
 			ASTVarStructMember map = ((ASTVarStructInit *)stmt->init->init)->members;
-			write_body("(struct " + ((ASTVarStructInit *)stmt->init->init)->ident + "){\n");
+			write_body(" = (struct " + ((ASTVarStructInit *)stmt->init->init)->ident + "){\n");
 			for (auto it = map.table.begin(); it != map.table.end(); ++it)
 			{
-				write_body(tab + "\t." + it->first + " = ");
+				write_tabs(depth + 1);
+				write_body("." + it->first + " = ");
 				convert_expr(it->second);
 				write_body(",\n");  
 			}
-			write_body(tab + "}");
+			write_tabs(depth);
+			write_body("}");
 			new_line = "\n";
 		}
 
@@ -795,9 +820,9 @@ public:
 
 
 
-	void convert_return_stmt(ASTReturnStmt *stmt,std::string tab)
+	void convert_return_stmt(ASTReturnStmt *stmt,int depth)
 	{
-		write_body(tab);
+		write_tabs(depth);
 		write_body("return ");
 		convert_expr(stmt->expr);
 		write_body(";\n");
@@ -1170,7 +1195,7 @@ public:
 		}
 
 		write_body("(" + data_type + ")");
-		convert_expr(cast_expr->rhs);
+		convert_operand(cast_expr->rhs);
 	}
 	
 
@@ -1178,9 +1203,24 @@ public:
 	{
 		ASTBinaryExpr *bin_expr = (ASTBinaryExpr *)expr;
 
-		convert_expr(bin_expr->lhs);
+		convert_operand(bin_expr->lhs);
 		convert_binop(bin_expr->op);
-		convert_expr(bin_expr->rhs);
+		convert_operand(bin_expr->rhs);
+	}
+
+
+	// the AST keeps no parentheses, nested binary expressions get them back
+	void convert_operand(ASTExpression *expr)
+	{
+		if (expr->type != ASTExpressionType::BINARY)
+		{
+			convert_expr(expr);
+			return;
+		}
+
+		write_body("(");
+		convert_expr(expr);
+		write_body(")");
 	}
 
 
@@ -1261,6 +1301,46 @@ public:
 				write_body(" || ");
 				break;
 			}
+			case ASTBinaryOperator::MUL:
+			{
+				write_body(" * ");
+				break;
+			}
+			case ASTBinaryOperator::DIV:
+			{
+				write_body(" / ");
+				break;
+			}
+			case ASTBinaryOperator::MOD:
+			{
+				write_body(" % ");
+				break;
+			}
+			case ASTBinaryOperator::BIT_AND:
+			{
+				write_body(" & ");
+				break;
+			}
+			case ASTBinaryOperator::BIT_OR:
+			{
+				write_body(" | ");
+				break;
+			}
+			case ASTBinaryOperator::BIT_XOR:
+			{
+				write_body(" ^ ");
+				break;
+			}
+			case ASTBinaryOperator::SHIFT_LEFT:
+			{
+				write_body(" << ");
+				break;
+			}
+			case ASTBinaryOperator::SHIFT_RIGHT:
+			{
+				write_body(" >> ");
+				break;
+			}
 			case ASTBinaryOperator::EQUAL:
 			{
 				write_body(" == ");
@@ -2,6 +2,7 @@
 #define C4C_AST_TO_JS_H
 
 #include "../../../front_end/include/ast.hpp"
+#include "../../../utils/include/output_sink.hpp"
 #include <string>
 #include <vector>
 
@@ -11,18 +12,24 @@ class AstToJS
 public:
     std::string file_name;
     ASTProgram *program;
-    std::string string;
+    OutputSink *out;
 
 
-	void write_body(std::string string)
+	void write_body(const std::string &string)
 	{
-		this->string += string;
+		this->out->write(string);
 	}
 
-    AstToJS(std::string file_name,ASTProgram *program)
+	void write_tabs(int depth)
+	{
+		this->out->write_tabs(depth);
+	}
+
+    AstToJS(std::string file_name,ASTProgram *program,OutputSink *out)
     {
         this->file_name = file_name;
         this->program = program;
+        this->out = out;
 
         for (ASTDeclaration *decl : this->program->decls)
 		{
@@ -94,55 +101,54 @@ public:
 
 
 
-	void convert_block_stmt(ASTBlockStmt *block,std::string tab="")
+	void convert_block_stmt(ASTBlockStmt *block,int depth = 0)
 	{
-		tab += "\t";
 		write_body("{\n");
 		for (ASTStatement *stmt : block->stmts)
 		{
-			convert_stmt(stmt,tab);
+			convert_stmt(stmt,depth + 1);
 		}
 		write_body("}\n");
 	}
 
 
-	void convert_stmt(ASTStatement *stmt,std::string tab)
+	void convert_stmt(ASTStatement *stmt,int depth)
 	{
 		switch(stmt->type)
 		{
 			case ASTStatementType::RETURN:
 			{
-				convert_return_stmt((ASTReturnStmt *)stmt->stmt,tab);
+				convert_return_stmt((ASTReturnStmt *)stmt->stmt,depth);
 				break;
 			}
 			case ASTStatementType::IF:
 			{
-				convert_if_stmt((ASTIfStmt *)stmt->stmt,tab);
+				convert_if_stmt((ASTIfStmt *)stmt->stmt,depth);
 				break;
 			}
 			case ASTStatementType::WHILE:
 			{
-				convert_while_stmt((ASTWhileStmt *)stmt->stmt,tab);
+				convert_while_stmt((ASTWhileStmt *)stmt->stmt,depth);
 				break;
 			}
 			case ASTStatementType::BREAK:
 			{
-				convert_break_stmt((ASTBreakStmt *)stmt->stmt,tab);
+				convert_break_stmt((ASTBreakStmt *)stmt->stmt,depth);
 				break;
 			}
 			case ASTStatementType::CONTINUE:
 			{
-				convert_continue_stmt((ASTContinueStmt *)stmt->stmt,tab);
+				convert_continue_stmt((ASTContinueStmt *)stmt->stmt,depth);
 				break;
 			}
 			case ASTStatementType::VARDECL:
 			{
-				convert_vardecl_stmt((ASTVarDecl *)stmt->stmt,tab);
+				convert_vardecl_stmt((ASTVarDecl *)stmt->stmt,depth);
 				break;
 			}
 			case ASTStatementType::EXPR:
 			{
-				write_body(tab);
+				write_tabs(depth);
 				convert_expr((ASTExpression *)stmt->stmt);
 				write_body(";\n");
 				break;
@@ -152,35 +158,35 @@ public:
 
 
 
-	void convert_break_stmt(ASTBreakStmt *stmt,std::string tab)
+	void convert_break_stmt(ASTBreakStmt *stmt,int depth)
 	{
-		write_body(tab);
+		write_tabs(depth);
 		write_body("break;\n");
 	}
 
-	void convert_continue_stmt(ASTContinueStmt *stmt,std::string tab)
+	void convert_continue_stmt(ASTContinueStmt *stmt,int depth)
 	{
-		write_body(tab);
+		write_tabs(depth);
 		write_body("continue;\n");
 	}
 
-	void convert_while_stmt(ASTWhileStmt *stmt,std::string tab)
+	void convert_while_stmt(ASTWhileStmt *stmt,int depth)
 	{
-		write_body(tab);
+		write_tabs(depth);
 		write_body("while (");
 		convert_expr(stmt->expr);
 		write_body(")\n");
-		convert_block_stmt(stmt->block,tab + "\t");
+		convert_block_stmt(stmt->block,depth + 1);
 	}
 
 
-	void convert_if_stmt(ASTIfStmt *stmt,std::string tab)
+	void convert_if_stmt(ASTIfStmt *stmt,int depth)
 	{
-		write_body(tab);
+		write_tabs(depth);
 		write_body("if(");
 		convert_expr(stmt->expr);
 		write_body(")\n");
-		convert_block_stmt(stmt->block,tab + "\t");
+		convert_block_stmt(stmt->block,depth + 1);
 
 		for (ASTIfElifBlock *elif_block : stmt->elif_blocks)
 		{
@@ -192,31 +198,37 @@ public:
 			write_body("else if(");
 			convert_expr(elif_block->expr);
 			write_body(")\n");
-			convert_block_stmt(elif_block->block,tab + "\t");
+			convert_block_stmt(elif_block->block,depth + 1);
 		}
 
 		if(stmt->else_block != nullptr)
 		{
 			write_body("else\n");
-			convert_block_stmt(stmt->else_block->block,tab + "\t");
+			convert_block_stmt(stmt->else_block->block,depth + 1);
 		}
 	}
 
 
 
-	void convert_vardecl_stmt(ASTVarDecl *stmt,std::string tab)
+	void convert_vardecl_stmt(ASTVarDecl *stmt,int depth)
 	{
-		write_body(tab);
-		write_body("let " + stmt->ident + " = ");
-		convert_expr(stmt->expr);
+		write_tabs(depth);
+		write_body("let " + stmt->ident);
+
+		if(stmt->init != nullptr and stmt->init->type == ASTVarInitType::SINGLE)
+		{
+			write_body(" = ");
+			convert_expr(((ASTVarSingleInit *)stmt->init->init)->expr);
+		}
+
 		write_body(";\n");
 	}
 
 
 
-	void convert_return_stmt(ASTReturnStmt *stmt,std::string tab)
+	void convert_return_stmt(ASTReturnStmt *stmt,int depth)
 	{
-		write_body(tab);
+		write_tabs(depth);
 		write_body("return ");
 		convert_expr(stmt->expr);
 		write_body(";\n");
@@ -335,7 +347,8 @@ public:
 	{
 		ASTFunctionCallExpr *fn_expr = (ASTFunctionCallExpr *)expr;
 
-		write_body(fn_expr->ident + "(");
+		convert_expr(fn_expr->base);
+		write_body("(");
 
 		int arg_length = fn_expr->args.size();
 		int i = 0;
@@ -425,9 +438,24 @@ public:
 	{
 		ASTBinaryExpr *bin_expr = (ASTBinaryExpr *)expr;
 
-		convert_expr(bin_expr->lhs);
+		convert_operand(bin_expr->lhs);
 		convert_binop(bin_expr->op);
-		convert_expr(bin_expr->rhs);
+		convert_operand(bin_expr->rhs);
+	}
+
+
+	// the AST keeps no parentheses, nested binary expressions get them back
+	void convert_operand(ASTExpression *expr)
+	{
+		if (expr->type != ASTExpressionType::BINARY)
+		{
+			convert_expr(expr);
+			return;
+		}
+
+		write_body("(");
+		convert_expr(expr);
+		write_body(")");
 	}
 
 
@@ -508,6 +536,46 @@ public:
 				write_body(" || ");
 				break;
 			}
+			case ASTBinaryOperator::MUL:
+			{
+				write_body(" * ");
+				break;
+			}
+			case ASTBinaryOperator::DIV:
+			{
+				write_body(" / ");
+				break;
+			}
+			case ASTBinaryOperator::MOD:
+			{
+				write_body(" % ");
+				break;
+			}
+			case ASTBinaryOperator::BIT_AND:
+			{
+				write_body(" & ");
+				break;
+			}
+			case ASTBinaryOperator::BIT_OR:
+			{
+				write_body(" | ");
+				break;
+			}
+			case ASTBinaryOperator::BIT_XOR:
+			{
+				write_body(" ^ ");
+				break;
+			}
+			case ASTBinaryOperator::SHIFT_LEFT:
+			{
+				write_body(" << ");
+				break;
+			}
+			case ASTBinaryOperator::SHIFT_RIGHT:
+			{
+				write_body(" >> ");
+				break;
+			}
 		}
 	}
 
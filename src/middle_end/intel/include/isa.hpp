@@ -1,11 +1,15 @@
-#ifndef C4_MAKASM_ISA_H
-#define C4_MAKASM_ISA_H
+#ifndef C4_INTEL_ISA_H
+#define C4_INTEL_ISA_H
 
 
 
 
 #include "../../../utils/include/utils.hpp"
 
+// the register vm names its classes like the stack vm, so it has a namespace of its own
+namespace intel
+{
+
 enum class OperandType
 {
     REGISTER,
@@ -35,7 +39,19 @@ enum class InstructionType
     POP,
     MOV,
     ADD,
+    SUB,
+    MUL,
+    DIV,
+    MOD,
+    EQ,
+    NE,
+    L,
+    LE,
+    G,
+    GE,
     JMP,
+    JT,
+    JF,
     PRINT,
 };
 
@@ -51,6 +67,14 @@ enum class RegisterGp
     RSI,
     RBP,
     RSP,
+    R8,
+    R9,
+    R10,
+    R11,
+    R12,
+    R13,
+    R14,
+    R15,
     BAD,
 };
 
@@ -85,7 +109,7 @@ public:
     Stack(int size)
     {
         this->stack_size = size;
-        this->stack = (i64 *)malloc(sizeof(i64));
+        this->stack = (i64 *)malloc(sizeof(i64) * size);
         this->stack_pointer = 0;
     }
 
@@ -131,7 +155,11 @@ enum class Trap
     OVERFLOW,
     UNDERFLOW,
     DIVISION_BY_ZERO,
+    INVALID_PROGRAM,
+    DIVISION_OVERFLOW,
 };
 
+}
+
 
 #endif
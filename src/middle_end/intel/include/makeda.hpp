@@ -104,6 +104,7 @@ enum class Trap
     OVERFLOW,
     UNDERFLOW,
     DIVISION_BY_ZERO,
+    DIVISION_OVERFLOW,
 };
 
 class Makeda
@@ -349,6 +350,10 @@ public:
         {
             return Trap::DIVISION_BY_ZERO;
         }
+        else if(this->stack.get_first() == -1 and this->stack.get_second() == INT64_MIN)
+        {
+            return Trap::DIVISION_OVERFLOW;
+        }
 
 
         i64 value = this->stack.get_second() / this->stack.get_first();
@@ -374,6 +379,10 @@ public:
         {
             return Trap::DIVISION_BY_ZERO;
         }
+        else if(this->stack.get_first() == -1 and this->stack.get_second() == INT64_MIN)
+        {
+            return Trap::DIVISION_OVERFLOW;
+        }
 
 
         i64 value = this->stack.get_second() % this->stack.get_first();
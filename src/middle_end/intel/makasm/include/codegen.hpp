@@ -1,9 +1,12 @@
-#ifndef C4_MAKASM_H
-#define C4_MAKASM_H
+#ifndef C4_INTEL_MAKASM_H
+#define C4_INTEL_MAKASM_H
 
 #include "lexer.hpp"
 #include "../../include/isa.hpp"
 
+namespace intel
+{
+
 
 class Codegen
 {
@@ -28,8 +31,6 @@ public:
         {
             gen_makasm();
         }
-
-        write_program_to_file(this->program);
     }
 
 
@@ -125,6 +126,38 @@ public:
 		{
 			return TokenType::TOKEN_JMP;
 		}
+        else if (keyword == "jt")
+		{
+			return TokenType::TOKEN_JT;
+		}
+        else if (keyword == "jf")
+		{
+			return TokenType::TOKEN_JF;
+		}
+        else if (keyword == "eq")
+		{
+			return TokenType::TOKEN_EQ;
+		}
+        else if (keyword == "ne")
+		{
+			return TokenType::TOKEN_NE;
+		}
+        else if (keyword == "l")
+		{
+			return TokenType::TOKEN_L;
+		}
+        else if (keyword == "le")
+		{
+			return TokenType::TOKEN_LE;
+		}
+        else if (keyword == "g")
+		{
+			return TokenType::TOKEN_G;
+		}
+        else if (keyword == "ge")
+		{
+			return TokenType::TOKEN_GE;
+		}
         else if (keyword == "print")
 		{
 			return TokenType::TOKEN_PRINT;
@@ -188,18 +221,70 @@ public:
         {
             gen_push();
         }
+        else if(is_token("pop"))
+        {
+            gen_pop();
+        }
         else if(is_token("mov"))
         {
             gen_mov();
         }
         else if(is_token("add"))
         {
-            gen_add();
+            gen_binary(InstructionType::ADD);
+        }
+        else if(is_token("sub"))
+        {
+            gen_binary(InstructionType::SUB);
+        }
+        else if(is_token("mul"))
+        {
+            gen_binary(InstructionType::MUL);
+        }
+        else if(is_token("div"))
+        {
+            gen_binary(InstructionType::DIV);
+        }
+        else if(is_token("mod"))
+        {
+            gen_binary(InstructionType::MOD);
+        }
+        else if(is_token("eq"))
+        {
+            gen_binary(InstructionType::EQ);
+        }
+        else if(is_token("ne"))
+        {
+            gen_binary(InstructionType::NE);
+        }
+        else if(is_token("l"))
+        {
+            gen_binary(InstructionType::L);
+        }
+        else if(is_token("le"))
+        {
+            gen_binary(InstructionType::LE);
+        }
+        else if(is_token("g"))
+        {
+            gen_binary(InstructionType::G);
+        }
+        else if(is_token("ge"))
+        {
+            gen_binary(InstructionType::GE);
         }
         else if(is_token("jmp"))
         {
             gen_jmp();
         }
+        else if(is_token("jt"))
+        {
+            gen_jump_if(InstructionType::JT);
+        }
+        else if(is_token("jf"))
+        {
+            gen_jump_if(InstructionType::JF);
+        }
         else if(is_token("print"))
         {
             gen_print();
@@ -215,209 +300,194 @@ public:
     }
 
 
-    void gen_jmp()
+    RegisterGp get_register(std::string reg)
     {
-        consume();
-        Tokens token = consume();  
-
-        if(token.type != TokenType::TOKEN_LITERAL_INT)
+        static const char *names[] =
         {
-            fatal("expected an integer after jmp");
-        }
-
-        Operand operand(OperandType::IMMEDIATE,std::stol(token.string));
-
-        Instruction inst(InstructionType::JMP,operand,operand);
-        this->program.add_instruction(inst);
-    }
+            "rax","rbx","rcx","rdx","rdi","rsi","rbp","rsp",
+            "r8","r9","r10","r11","r12","r13","r14","r15",
+        };
 
-
-    void gen_push()
-    {
-        consume();
-        Tokens token = consume();  
-
-        if(token.type != TokenType::TOKEN_LITERAL_INT)
+        for(int i = 0; i < (int)RegisterGp::BAD; i++)
         {
-            fatal("expected an integer after push");
+            if(reg == names[i])
+            {
+                return (RegisterGp)i;
+            }
         }
 
-        
-
-
-        Operand operand(OperandType::REGISTER,std::stol(token.string));
-
-        Instruction inst(InstructionType::PUSH,operand,operand);
-        this->program.add_instruction(inst);
+        return RegisterGp::BAD;
     }
 
 
+    /**
+     * Parses a register, an integer or a memory slot written as [integer].
+     */
 
-    void gen_mov()
+    Operand gen_operand()
     {
-        consume();
-        Tokens dst = consume();
-        Tokens comma = consume();
-        if(comma.type != TokenType::TOKEN_COMMA)
+        if(is_at_end())
         {
-            //fatal("expected a huh comma after register");
+            fatal("expected an operand");
         }
 
-        Tokens src = consume();
-        std::string reg = dst.string;
-
-        RegisterGp dst_reg = RegisterGp::BAD;
+        Tokens token = consume();
 
-        if (reg == "rax")
+        if(token.type == TokenType::TOKEN_IDENT)
         {
-            dst_reg = RegisterGp::RAX;
-        }
-        else if (reg == "rbx")
-        {
-            dst_reg = RegisterGp::RBX;
-        }
-        else if (reg == "rcx")
-        {
-            dst_reg = RegisterGp::RCX;
+            RegisterGp reg = get_register(token.string);
+            if(reg == RegisterGp::BAD)
+            {
+                fatal("unknown register : " + token.string);
+            }
+
+            return Operand(OperandType::REGISTER,(i64)reg);
         }
-        else if (reg == "rdx")
+        else if(token.type == TokenType::TOKEN_LITERAL_INT)
         {
-            dst_reg = RegisterGp::RDX;
+            return Operand(OperandType::IMMEDIATE,std::stol(token.string));
         }
-        else if (reg == "rdi")
+        else if(token.type == TokenType::TOKEN_LEFT_BRACKET)
         {
-            dst_reg = RegisterGp::RDI;
+            Tokens address = consume();
+            if(address.type != TokenType::TOKEN_LITERAL_INT)
+            {
+                fatal("expected an integer address inside []");
+            }
+
+            if(consume().type != TokenType::TOKEN_RIGHT_BRACKET)
+            {
+                fatal("expected ] after the address");
+            }
+
+            return Operand(OperandType::MEMORY,std::stol(address.string));
         }
-        else if (reg == "rsi")
+
+        fatal("expected a register, an integer or [address] : " + token.string);
+        return Operand();
+    }
+
+
+    void expect_comma()
+    {
+        if(is_at_end() or consume().type != TokenType::TOKEN_COMMA)
         {
-            dst_reg = RegisterGp::RSI;
+            fatal("expected a comma between operands");
         }
-        else if (reg == "rbp")
+    }
+
+
+    Operand gen_register()
+    {
+        Operand operand = gen_operand();
+        if(operand.type != OperandType::REGISTER)
         {
-            dst_reg = RegisterGp::RBP;
+            fatal("expected a register");
         }
-        else if (reg == "rsp")
+
+        return operand;
+    }
+
+
+    Operand gen_target()
+    {
+        Operand operand = gen_operand();
+        if(operand.type != OperandType::IMMEDIATE)
         {
-            dst_reg = RegisterGp::RSP;
+            fatal("expected an instruction index as the jump target");
         }
 
-        i64 src_value = std::stol(src.string);
+        return operand;
+    }
 
-        Operand operand1(OperandType::REGISTER,(i64)dst_reg);
-        Operand operand2(OperandType::IMMEDIATE,(i64)src_value);
 
+    void gen_push()
+    {
+        consume();
+        Operand src = gen_operand();
 
-        Instruction inst(InstructionType::MOV,operand1,operand2);
+        Instruction inst(InstructionType::PUSH,src,src);
         this->program.add_instruction(inst);
     }
 
 
-
-
-    void gen_add()
+    void gen_pop()
     {
         consume();
-        Tokens dst = consume();
-        Tokens comma = consume();
-        if(comma.type != TokenType::TOKEN_COMMA)
-        {
-            fatal("expected a comma after register");
-        }
+        Operand dst = gen_register();
 
-        Tokens src = consume();
-        std::string reg = dst.string;
+        Instruction inst(InstructionType::POP,dst,dst);
+        this->program.add_instruction(inst);
+    }
 
-        RegisterGp dst_reg = RegisterGp::BAD;
 
-        if (reg == "rax")
-        {
-            dst_reg = RegisterGp::RAX;
-        }
-        else if (reg == "rbx")
-        {
-            dst_reg = RegisterGp::RBX;
-        }
-        else if (reg == "rcx")
-        {
-            dst_reg = RegisterGp::RCX;
-        }
-        else if (reg == "rdx")
-        {
-            dst_reg = RegisterGp::RDX;
-        }
-        else if (reg == "rdi")
-        {
-            dst_reg = RegisterGp::RDI;
-        }
-        else if (reg == "rsi")
-        {
-            dst_reg = RegisterGp::RSI;
-        }
-        else if (reg == "rbp")
+    void gen_mov()
+    {
+        consume();
+        Operand dst = gen_operand();
+        expect_comma();
+        Operand src = gen_operand();
+
+        if(dst.type == OperandType::IMMEDIATE)
         {
-            dst_reg = RegisterGp::RBP;
+            fatal("mov destination must be a register or memory");
         }
-        else if (reg == "rsp")
+
+        if(dst.type == OperandType::MEMORY and src.type == OperandType::MEMORY)
         {
-            dst_reg = RegisterGp::RSP;
+            fatal("mov cannot copy memory to memory");
         }
 
-        i64 src_value = std::stol(src.string);
+        Instruction inst(InstructionType::MOV,dst,src);
+        this->program.add_instruction(inst);
+    }
+
 
-        Operand operand1(OperandType::REGISTER,(i64)dst_reg);
-        Operand operand2(OperandType::IMMEDIATE,(i64)src_value);
+    /**
+     * Two operand arithmetic and compares, the destination is always a
+     * register, a compare leaves 1 or 0 in it.
+     */
 
+    void gen_binary(InstructionType type)
+    {
+        consume();
+        Operand dst = gen_register();
+        expect_comma();
+        Operand src = gen_operand();
 
-        Instruction inst(InstructionType::ADD,operand1,operand2);
+        Instruction inst(type,dst,src);
         this->program.add_instruction(inst);
     }
 
-    void gen_print()
+
+    void gen_jmp()
     {
         consume();
-        Tokens dst = consume();
+        Operand target = gen_target();
 
-        std::string reg = dst.string;
+        Instruction inst(InstructionType::JMP,target,target);
+        this->program.add_instruction(inst);
+    }
 
-        RegisterGp dst_reg = RegisterGp::BAD;
 
-        if (reg == "rax")
-        {
-            dst_reg = RegisterGp::RAX;
-        }
-        else if (reg == "rbx")
-        {
-            dst_reg = RegisterGp::RBX;
-        }
-        else if (reg == "rcx")
-        {
-            dst_reg = RegisterGp::RCX;
-        }
-        else if (reg == "rdx")
-        {
-            dst_reg = RegisterGp::RDX;
-        }
-        else if (reg == "rdi")
-        {
-            dst_reg = RegisterGp::RDI;
-        }
-        else if (reg == "rsi")
-        {
-            dst_reg = RegisterGp::RSI;
-        }
-        else if (reg == "rbp")
-        {
-            dst_reg = RegisterGp::RBP;
-        }
-        else if (reg == "rsp")
-        {
-            dst_reg = RegisterGp::RSP;
-        }
+    void gen_jump_if(InstructionType type)
+    {
+        consume();
+        Operand condition = gen_register();
+        expect_comma();
+        Operand target = gen_target();
 
+        Instruction inst(type,condition,target);
+        this->program.add_instruction(inst);
+    }
 
-        Operand operand1(OperandType::REGISTER,(i64)dst_reg);
 
-        Instruction inst(InstructionType::PRINT,operand1,operand1);
+    void gen_print()
+    {
+        consume();
+        Operand src = gen_operand();
+
+        Instruction inst(InstructionType::PRINT,src,src);
         this->program.add_instruction(inst);
     }
 
@@ -441,6 +511,7 @@ public:
 
 };
 
+}
 
 
 #endif
\ No newline at end of file
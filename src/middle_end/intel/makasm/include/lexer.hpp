@@ -18,11 +18,14 @@
 
 
 
-#ifndef C4C_LEXER_H
-#define C4C_LEXER_H
+#ifndef C4_INTEL_LEXER_H
+#define C4_INTEL_LEXER_H
 
 #include "token.hpp"
 
+namespace intel
+{
+
 class Lexer
 {
 	std::string file_name;
@@ -395,14 +398,45 @@ private:
 		{
 			add_token(TokenType::TOKEN_JMP,buf);
 		}
-		
+		else if (match_keyword(buf,"jt"))
+		{
+			add_token(TokenType::TOKEN_JT,buf);
+		}
+		else if (match_keyword(buf,"jf"))
+		{
+			add_token(TokenType::TOKEN_JF,buf);
+		}
+		else if (match_keyword(buf,"eq"))
+		{
+			add_token(TokenType::TOKEN_EQ,buf);
+		}
+		else if (match_keyword(buf,"ne"))
+		{
+			add_token(TokenType::TOKEN_NE,buf);
+		}
+		else if (match_keyword(buf,"l"))
+		{
+			add_token(TokenType::TOKEN_L,buf);
+		}
+		else if (match_keyword(buf,"le"))
+		{
+			add_token(TokenType::TOKEN_LE,buf);
+		}
+		else if (match_keyword(buf,"g"))
+		{
+			add_token(TokenType::TOKEN_G,buf);
+		}
+		else if (match_keyword(buf,"ge"))
+		{
+			add_token(TokenType::TOKEN_GE,buf);
+		}
 		else if (match_keyword(buf,"print"))
 		{
 			add_token(TokenType::TOKEN_PRINT,buf);
 		}
 		else
 		{
-			//add_token(TokenType::TOKEN_IDENT,buf);
+			add_token(TokenType::TOKEN_IDENT,buf);
 		}
 	}
 
@@ -581,6 +615,12 @@ private:
 			 case ',':
 				add_token_single(TokenType::TOKEN_COMMA);
 				break;
+			 case '[':
+				add_token_single(TokenType::TOKEN_LEFT_BRACKET);
+				break;
+			 case ']':
+				add_token_single(TokenType::TOKEN_RIGHT_BRACKET);
+				break;
 			 case '\t':
 				update_col(4);
 				consume();
@@ -630,6 +670,9 @@ public:
 
 };
 
+}
+
+
 #endif
 
 
@@ -1,14 +1,11 @@
-#ifndef C4_MAKASM_LEXER_H
-#define C4_MAKASM_LEXER_H
-
-
-
-
-#ifndef C4C_TOKENS_H
-#define C4C_TOKENS_H
+#ifndef C4_INTEL_TOKENS_H
+#define C4_INTEL_TOKENS_H
 
 #include "../../../../utils/include/utils.hpp"
 
+namespace intel
+{
+
 
 
 enum class TokenType
@@ -54,6 +51,8 @@ enum class TokenType
 */
 
     TOKEN_COMMA,
+    TOKEN_LEFT_BRACKET,
+    TOKEN_RIGHT_BRACKET,
 
 
 //  LITERALS
@@ -70,8 +69,19 @@ enum class TokenType
     TOKEN_PRINT,
 
     TOKEN_JMP,
+    TOKEN_JT,
+    TOKEN_JF,
 
     TOKEN_MOV,
+
+    TOKEN_EQ,
+    TOKEN_NE,
+    TOKEN_L,
+    TOKEN_LE,
+    TOKEN_G,
+    TOKEN_GE,
+
+    TOKEN_IDENT,
     
     TOKEN_EOF,
 
@@ -104,11 +114,7 @@ public:
 
 };
 
-#endif
-
-
-
-
+}
 
 
 #endif
\ No newline at end of file
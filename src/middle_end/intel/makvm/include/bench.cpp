@@ -0,0 +1,99 @@
+// stack vs register vm benchmark, runs the same computation written for
+// both machines and reports dispatches and time side by side.
+//
+//    g++ -O2 -o vmbench src/middle_end/intel/makvm/include/bench.cpp
+//    ./vmbench tests/bench/makeda/loops.masm tests/bench/intel/loops.masm ...
+//
+// arguments come in pairs, the stack program first.
+//
+
+#include <chrono>
+#include "../../../makeda/makvm/include/makeda.hpp"
+#include "../../../makeda/makasm/include/codegen.hpp"
+#include "makeda.hpp"
+#include "../../makasm/include/codegen.hpp"
+
+
+// a directory or an unreadable file would run as an empty program
+std::string read_program(std::string name)
+{
+    std::ifstream file(name);
+    std::stringstream buf;
+
+    if(not (file and buf << file.rdbuf()))
+    {
+        DEBUG_PANIC("vmbench : cannot read " + name);
+    }
+
+    return buf.str();
+}
+
+
+template <typename T>
+double bench(T run,std::string name,std::string mode,u64 *dispatches)
+{
+    auto start = std::chrono::steady_clock::now();
+    u64 executed = run();
+    auto end = std::chrono::steady_clock::now();
+
+    *dispatches = executed;
+
+    double seconds = std::chrono::duration<double>(end - start).count();
+
+    std::cout << name << " : " << mode << " " << executed << " dispatches in "
+              << seconds << " s, " << executed / seconds / 1e6 << " M dispatches/sec" << std::endl;
+
+    return seconds;
+}
+
+
+int main(int argc,char **argv)
+{
+    if(argc < 3 or argc % 2 == 0)
+    {
+        DEBUG_PANIC("usage : vmbench stack.masm register.masm [stack.masm register.masm ...]");
+    }
+
+    for(int i = 1; i + 1 < argc; i += 2)
+    {
+        std::string stack_name(argv[i]);
+        std::string register_name(argv[i + 1]);
+
+        Lexer stack_lexer(stack_name,read_program(stack_name));
+        std::vector<Tokens> stack_tokens = stack_lexer.scan_tokens();
+        Codegen plain(stack_name,stack_tokens,false);
+        Codegen fused(stack_name,stack_tokens,true);
+
+        intel::Lexer register_lexer(register_name,read_program(register_name));
+        intel::Codegen registers(register_name,register_lexer.scan_tokens());
+
+        u64 stack_count = 0;
+        u64 fused_count = 0;
+        u64 register_count = 0;
+
+        double stack_time = bench([&]()
+        {
+            return Makeda(1024,plain.program,Dispatch::THREADED).executed;
+        },stack_name,"stack          ",&stack_count);
+
+        double fused_time = bench([&]()
+        {
+            return Makeda(1024,fused.program,Dispatch::THREADED).executed;
+        },stack_name,"stack fused    ",&fused_count);
+
+        double register_time = bench([&]()
+        {
+            return intel::Intel(1024,1024,registers.program,intel::Dispatch::THREADED).executed;
+        },register_name,"register       ",&register_count);
+
+        double register_switch_time = bench([&]()
+        {
+            return intel::Intel(1024,1024,registers.program,intel::Dispatch::SWITCH).executed;
+        },register_name,"register switch",&register_count);
+
+        std::cout << register_name << " : register vm runs " << (double)register_count / stack_count * 100 << "% of the stack dispatches ("
+                  << (double)register_count / fused_count * 100 << "% of fused), speedup " << stack_time / register_time << "x over stack, "
+                  << fused_time / register_time << "x over fused stack, threaded " << register_switch_time / register_time
+                  << "x over switch" << std::endl;
+    }
+}
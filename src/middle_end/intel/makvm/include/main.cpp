@@ -15,9 +15,19 @@ int main(int argc,char **argv)
 
     //std::string file_source = "push 50\npush 10\npush 10\nprint\nadd\nprint\nmul\nprint\n";
     
-    Lexer lexer(file_name,file_source);
-    Codegen codegen(file_name,lexer.scan_tokens());
-    
-    Intel intel(64);
+    intel::Lexer lexer(file_name,file_source);
+    intel::Codegen codegen(file_name,lexer.scan_tokens());
+    codegen.write_program_to_file(codegen.program);
+
+    intel::Intel intel(64);
+
+    if(intel.trap == intel::Trap::INVALID_PROGRAM)
+    {
+        DEBUG_PANIC("intel : rejected, " + intel.error);
+    }
+    else if(intel.trap != intel::Trap::OK)
+    {
+        DEBUG_PANIC("intel : trap " + std::to_string((int)intel.trap));
+    }
     
 }
\ No newline at end of file
@@ -3,14 +3,59 @@
 
 #include "../../include/isa.hpp"
 
+#if defined(__GNUC__)
+#define INTEL_THREADED 1
+#else
+#define INTEL_THREADED 0
+#endif
+
+#define INTEL_HALT ((int)InstructionType::PRINT + 1)
+
+namespace intel
+{
+
+
+enum class Dispatch
+{
+    SWITCH,
+    THREADED,
+};
+
+
+/**
+ * An instruction after decoding, register and memory operands are turned
+ * into pointers into the register file or the memory segment and an
+ * immediate source points at the instruction's own immediate, so every
+ * form of an opcode runs the same handler.
+ */
+
+class DecodedInstruction
+{
+public:
+    int opcode;
+    const void *handler;
+    i64 *dst;
+    i64 *src;
+    i64 immediate;
+    i64 target;
+    Operand operand;
+};
+
+
 class Intel
 {
     Stack stack;
     Program program;
-    i64 GpRegisters[8] = {0};
+    std::vector<i64> memory;
+    std::vector<DecodedInstruction> code;
 public:
+    i64 GpRegisters[(int)RegisterGp::BAD] = {0};
+
+    Trap trap = Trap::OK;
+    u64 executed = 0;
+    std::string error;
 
-    Intel(int size):stack(size)
+    Intel(int size):stack(size),memory(size,0)
     {
         read_program_to_memory("test.m");
         //test_inst(&this->program);
@@ -18,6 +63,13 @@ public:
     }
 
 
+    Intel(i64 stack_size,i64 memory_size,Program program,Dispatch dispatch):stack(stack_size),memory(memory_size,0)
+    {
+        this->program = program;
+        run(dispatch);
+    }
+
+
     void test_inst(Program *program)
     {
         /**
@@ -90,218 +142,332 @@ public:
     
 
 
-    void run()
+    void run(Dispatch dispatch = Dispatch::THREADED)
     {
-        for (this->program.ip = 0; this->program.ip < this->program.instructions.size() ; this->program.ip)
+        if(not decode())
         {
-            Instruction *inst = &program.instructions[this->program.ip];
-            switch(inst->type)
-            {
-                case InstructionType::PUSH:
-                {
-                    push(inst);
-                    break;
-                }
-                case InstructionType::POP:
-                {
-                    pop(inst);
-                    break;
-                }
-                case InstructionType::ADD:
-                {
-                    add(inst);
-                    break;
-                }
-                case InstructionType::MOV:
-                {
-                    mov(inst);
-                    break;
-                }
-                case InstructionType::JMP:
-                {
-                    jmp(inst);
-                    break;
-                }
-                case InstructionType::PRINT:
-                {
-                    print(inst);
-                    break;
-                }
-            }
+            this->trap = Trap::INVALID_PROGRAM;
+            return;
         }
-    }
 
-    bool check_underflow()
-    {
-        if(this->stack.stack_pointer < 0)
+        if(dispatch == Dispatch::THREADED and INTEL_THREADED)
         {
-            return true;
+            run_threaded();
         }
-
-        return false;
-    }
-
-
-    bool check_overflow()
-    {
-        if(this->stack.stack_pointer >= this->stack.stack_size)
+        else
         {
-            return true;
+            run_switch();
         }
-
-        return false;
     }
 
 
-    bool check_is_zero(i64 value)
+    bool reject(i64 ip,std::string error)
     {
-        return value == 0;
+        this->error = "instruction " + std::to_string(ip) + " : " + error;
+        return false;
     }
 
 
-
-
-
-    Trap push(Instruction *inst)
+    bool decode_operand(i64 ip,Operand &operand,DecodedInstruction *decoded,i64 **pointer)
     {
-        if(check_overflow())
+        switch(operand.type)
         {
-            return Trap::OVERFLOW;
-        }
+            case OperandType::REGISTER:
+            {
+                if(operand.value < 0 or operand.value >= (i64)RegisterGp::BAD)
+                {
+                    return reject(ip,"bad register");
+                }
 
-        i64 value = 0;
+                *pointer = &this->GpRegisters[operand.value];
+                return true;
+            }
+            case OperandType::MEMORY:
+            {
+                if(operand.value < 0 or operand.value >= (i64)this->memory.size())
+                {
+                    return reject(ip,"address " + std::to_string(operand.value) + " is outside memory");
+                }
 
-        switch(inst->operand1.type)
-        {
-            case OperandType::REGISTER:
+                *pointer = &this->memory[operand.value];
+                return true;
+            }
+            case OperandType::IMMEDIATE:
             {
-                value = this->GpRegisters[inst->operand1.value];
+                decoded->immediate = operand.value;
+                *pointer = &decoded->immediate;
+                return true;
             }
         }
 
-        this->stack.push(value);
-        this->stack.adjust_stack_pointer(1);
-        this->program.ip++;
-
-        return Trap::OK;
+        return reject(ip,"bad operand");
     }
 
 
-    Trap pop(Instruction *inst)
+    /**
+     * Resolves every operand once before the program runs, the loops then
+     * only dereference. A jump to the end of the program goes to the halt
+     * entry appended there, one outside the program is rejected like the
+     * stack vm's verifier does. handlers is null for the switch loop.
+     */
+
+    bool decode(const void *const *handlers = nullptr)
     {
-        if(check_underflow())
-        {
-            return Trap::UNDERFLOW;
-        }
+        i64 size = this->program.instructions.size();
 
-        switch(inst->operand1.type)
+        // operands may point into the vector, it must not grow after this
+        this->code.assign(size + 1,DecodedInstruction{});
+
+        for(i64 ip = 0; ip < size; ip++)
         {
-            case OperandType::REGISTER:
+            Instruction &inst = this->program.instructions[ip];
+            DecodedInstruction *decoded = &this->code[ip];
+
+            if((int)inst.type < 0 or (int)inst.type >= INTEL_HALT)
             {
-                this->GpRegisters[inst->operand1.value] = this->stack.get_first();
+                return reject(ip,"unknown opcode " + std::to_string((int)inst.type));
             }
-        }
-
-        this->stack.adjust_stack_pointer(-1);
-        this->program.ip++;
 
-        return Trap::OK;
-    }
-
-
-    Trap mov(Instruction *inst)
-    {   
+            decoded->opcode = (int)inst.type;
+            decoded->operand = inst.operand1;
 
-        switch(inst->operand1.type)
-        {
-            case OperandType::REGISTER:
+            switch(inst.type)
             {
-                switch(inst->operand2.type)
+                case InstructionType::JMP:
+                {
+                    decoded->target = inst.operand1.value;
+                    break;
+                }
+                case InstructionType::JT:
+                case InstructionType::JF:
                 {
-                    case OperandType::REGISTER:
+                    decoded->target = inst.operand2.value;
+                    if(not decode_operand(ip,inst.operand1,decoded,&decoded->src))
                     {
-                        this->GpRegisters[inst->operand1.value] = this->GpRegisters[inst->operand2.value];
-                        break;
+                        return false;
                     }
-                    case OperandType::IMMEDIATE:
+                    break;
+                }
+                case InstructionType::PUSH:
+                case InstructionType::PRINT:
+                {
+                    if(not decode_operand(ip,inst.operand1,decoded,&decoded->src))
                     {
-                        this->GpRegisters[inst->operand1.value] = inst->operand2.value;
-                        break;
+                        return false;
                     }
+                    break;
+                }
+                case InstructionType::POP:
+                {
+                    if(inst.operand1.type != OperandType::REGISTER)
+                    {
+                        return reject(ip,"pop needs a register");
+                    }
+
+                    if(not decode_operand(ip,inst.operand1,decoded,&decoded->dst))
+                    {
+                        return false;
+                    }
+                    break;
+                }
+                default:
+                {
+                    if(inst.operand1.type == OperandType::IMMEDIATE or
+                       (inst.operand1.type == OperandType::MEMORY and inst.type != InstructionType::MOV))
+                    {
+                        return reject(ip,"destination must be a register");
+                    }
+
+                    if(not decode_operand(ip,inst.operand1,decoded,&decoded->dst) or
+                       not decode_operand(ip,inst.operand2,decoded,&decoded->src))
+                    {
+                        return false;
+                    }
+                    break;
                 }
-                break;
+            }
+
+            if(decoded->target < 0 or decoded->target > size)
+            {
+                return reject(ip,"jump target " + std::to_string(decoded->target) + " is outside the program");
             }
         }
 
-        this->program.ip++;
-        return Trap::OK;
-    }
+        this->code[size].opcode = INTEL_HALT;
 
+        if(handlers != nullptr)
+        {
+            for(DecodedInstruction &decoded : this->code)
+            {
+                decoded.handler = handlers[decoded.opcode];
+            }
+        }
 
+        return true;
+    }
 
-    Trap add(Instruction *inst)
-    {   
 
-        switch(inst->operand1.type)
+#define INTEL_BINARY(op) \
+        *ip->dst = *ip->dst op *ip->src; \
+        ip++
+#define INTEL_DIVIDE(op) \
+        if(*ip->src == 0) { trap = Trap::DIVISION_BY_ZERO; goto halt; } \
+        if(*ip->src == -1 and *ip->dst == INT64_MIN) { trap = Trap::DIVISION_OVERFLOW; goto halt; } \
+        *ip->dst = *ip->dst op *ip->src; \
+        ip++
+#define INTEL_PUSH() \
+        if(sp >= limit) { trap = Trap::OVERFLOW; goto halt; } \
+        stack[sp++] = *ip->src; \
+        ip++
+#define INTEL_POP() \
+        if(sp < 1) { trap = Trap::UNDERFLOW; goto halt; } \
+        *ip->dst = stack[--sp]; \
+        ip++
+#define INTEL_JUMP_IF(condition) \
+        ip = (*ip->src != 0) == condition ? code + ip->target : ip + 1
+
+
+    void run_switch()
+    {
+        DecodedInstruction *code = this->code.data();
+        DecodedInstruction *ip = code;
+        i64 *stack = this->stack.stack;
+        i64 sp = this->stack.stack_pointer;
+        i64 limit = this->stack.stack_size;
+        u64 executed = 0;
+        Trap trap = Trap::OK;
+
+        for(;; executed++)
         {
-            case OperandType::REGISTER:
+            switch(ip->opcode)
             {
-                switch(inst->operand2.type)
-                {
-                    case OperandType::REGISTER:
-                    {
-                        this->GpRegisters[inst->operand1.value] = this->GpRegisters[inst->operand1.value] + this->GpRegisters[inst->operand2.value];
-                        break;
-                    }
-                    case OperandType::IMMEDIATE:
-                    {
-                        this->GpRegisters[inst->operand1.value] = this->GpRegisters[inst->operand1.value] + inst->operand2.value;
-                        break;
-                    }
-                }
-                break;
+                case (int)InstructionType::PUSH:  INTEL_PUSH(); break;
+                case (int)InstructionType::POP:   INTEL_POP(); break;
+                case (int)InstructionType::MOV:   *ip->dst = *ip->src; ip++; break;
+                case (int)InstructionType::ADD:   INTEL_BINARY(+); break;
+                case (int)InstructionType::SUB:   INTEL_BINARY(-); break;
+                case (int)InstructionType::MUL:   INTEL_BINARY(*); break;
+                case (int)InstructionType::DIV:   INTEL_DIVIDE(/); break;
+                case (int)InstructionType::MOD:   INTEL_DIVIDE(%); break;
+                case (int)InstructionType::EQ:    INTEL_BINARY(==); break;
+                case (int)InstructionType::NE:    INTEL_BINARY(!=); break;
+                case (int)InstructionType::L:     INTEL_BINARY(<); break;
+                case (int)InstructionType::LE:    INTEL_BINARY(<=); break;
+                case (int)InstructionType::G:     INTEL_BINARY(>); break;
+                case (int)InstructionType::GE:    INTEL_BINARY(>=); break;
+                case (int)InstructionType::JMP:   ip = code + ip->target; break;
+                case (int)InstructionType::JT:    INTEL_JUMP_IF(true); break;
+                case (int)InstructionType::JF:    INTEL_JUMP_IF(false); break;
+                case (int)InstructionType::PRINT: print(ip); ip++; break;
+                default: goto halt;
             }
         }
 
-        this->program.ip++;
-        return Trap::OK;
+    halt:
+        this->stack.stack_pointer = sp;
+        this->program.ip = ip - code;
+        this->executed += executed;
+        this->trap = trap;
     }
 
 
+    /**
+     * Same loop with direct threading, each handler jumps straight to the
+     * handler of the next instruction.
+     */
 
-    Trap jmp(Instruction *inst)
+    void run_threaded()
     {
-        this->program.ip = inst->operand1.value;
-        return Trap::OK;
+#if INTEL_THREADED
+        static const void *const handlers[] =
+        {
+            &&op_push,
+            &&op_pop,
+            &&op_mov,
+            &&op_add,
+            &&op_sub,
+            &&op_mul,
+            &&op_div,
+            &&op_mod,
+            &&op_eq,
+            &&op_ne,
+            &&op_l,
+            &&op_le,
+            &&op_g,
+            &&op_ge,
+            &&op_jmp,
+            &&op_jt,
+            &&op_jf,
+            &&op_print,
+            &&halt,
+        };
+
+        decode(handlers);
+
+        DecodedInstruction *code = this->code.data();
+        DecodedInstruction *ip = code;
+        i64 *stack = this->stack.stack;
+        i64 sp = this->stack.stack_pointer;
+        i64 limit = this->stack.stack_size;
+        u64 executed = 0;
+        Trap trap = Trap::OK;
+
+#define INTEL_NEXT() executed++; goto *ip->handler
+
+        goto *ip->handler;
+
+    op_push:  INTEL_PUSH(); INTEL_NEXT();
+    op_pop:   INTEL_POP(); INTEL_NEXT();
+    op_mov:   *ip->dst = *ip->src; ip++; INTEL_NEXT();
+    op_add:   INTEL_BINARY(+); INTEL_NEXT();
+    op_sub:   INTEL_BINARY(-); INTEL_NEXT();
+    op_mul:   INTEL_BINARY(*); INTEL_NEXT();
+    op_div:   INTEL_DIVIDE(/); INTEL_NEXT();
+    op_mod:   INTEL_DIVIDE(%); INTEL_NEXT();
+    op_eq:    INTEL_BINARY(==); INTEL_NEXT();
+    op_ne:    INTEL_BINARY(!=); INTEL_NEXT();
+    op_l:     INTEL_BINARY(<); INTEL_NEXT();
+    op_le:    INTEL_BINARY(<=); INTEL_NEXT();
+    op_g:     INTEL_BINARY(>); INTEL_NEXT();
+    op_ge:    INTEL_BINARY(>=); INTEL_NEXT();
+    op_jmp:   ip = code + ip->target; INTEL_NEXT();
+    op_jt:    INTEL_JUMP_IF(true); INTEL_NEXT();
+    op_jf:    INTEL_JUMP_IF(false); INTEL_NEXT();
+    op_print: print(ip); ip++; INTEL_NEXT();
+
+#undef INTEL_NEXT
+
+    halt:
+        this->stack.stack_pointer = sp;
+        this->program.ip = ip - code;
+        this->executed += executed;
+        this->trap = trap;
+#else
+        run_switch();
+#endif
     }
 
-    
-    Trap print(Instruction *inst)
+
+#undef INTEL_JUMP_IF
+#undef INTEL_POP
+#undef INTEL_PUSH
+#undef INTEL_DIVIDE
+#undef INTEL_BINARY
+
+
+    void print(DecodedInstruction *inst)
     {
-        
-        i64 value = 0;
         std::string is_reg = "value:\n\t";
 
-        switch(inst->operand1.type)
+        if(inst->operand.type == OperandType::REGISTER)
         {
-            case OperandType::REGISTER:
-            {
-                is_reg = get_gp_register((RegisterGp)inst->operand1.value) + ":\n\t";
-                value = this->GpRegisters[inst->operand1.value];
-                break;
-            }
-            case OperandType::IMMEDIATE:
-            {
-                value = this->GpRegisters[inst->operand1.value];
-                break;
-            }
+            is_reg = get_gp_register((RegisterGp)inst->operand.value) + ":\n\t";
         }
 
-        std::cout << is_reg << value << std::endl;
-        this->program.ip++;
-        return Trap::OK;
+        std::cout << is_reg << *inst->src << std::endl;
     }
 
+
     std::string get_gp_register(RegisterGp reg)
     {
         switch(reg)
@@ -346,6 +512,46 @@ public:
                 return "rsp";
                 break;
             }
+            case RegisterGp::R8:
+            {
+                return "r8";
+                break;
+            }
+            case RegisterGp::R9:
+            {
+                return "r9";
+                break;
+            }
+            case RegisterGp::R10:
+            {
+                return "r10";
+                break;
+            }
+            case RegisterGp::R11:
+            {
+                return "r11";
+                break;
+            }
+            case RegisterGp::R12:
+            {
+                return "r12";
+                break;
+            }
+            case RegisterGp::R13:
+            {
+                return "r13";
+                break;
+            }
+            case RegisterGp::R14:
+            {
+                return "r14";
+                break;
+            }
+            case RegisterGp::R15:
+            {
+                return "r15";
+                break;
+            }
             default:
             {
                 return "bad register";
@@ -358,6 +564,7 @@ public:
 
 };
 
+}
 
 
 #endif
\ No newline at end of file
@@ -0,0 +1,374 @@
+#ifndef C4_MAKEDA_BYTECODE_H
+#define C4_MAKEDA_BYTECODE_H
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include "isa.hpp"
+
+
+/**
+ * Makeda bytecode container, every section is a flat array of fixed width
+ * little endian records so a mapped file can be executed in place.
+ *
+ *      header        BytecodeHeader
+ *      constants     i64[constant_count]
+ *      symbols       BytecodeSymbol[symbol_count]
+ *      strings       char[string_size], symbol names
+ *      instructions  PackedInstruction[instruction_count]
+ *
+ * PUSH and PUSH_ADD/SUB/MUL keep their value in the constant pool and store
+ * its index in operand, the fused compare and jumps do the same with
+ * immediate and keep the jump target in operand.
+ */
+
+#define MAKEDA_MAGIC    0x41444b4d      // "MKDA"
+#define MAKEDA_VERSION  1
+
+
+class BytecodeHeader
+{
+public:
+    u32 magic;
+    u16 version;
+    u16 header_size;
+    u64 entry;
+    u64 constant_offset;
+    u64 constant_count;
+    u64 symbol_offset;
+    u64 symbol_count;
+    u64 string_offset;
+    u64 string_size;
+    u64 instruction_offset;
+    u64 instruction_count;
+};
+
+
+class BytecodeSymbol
+{
+public:
+    u32 name_offset;
+    u32 name_length;
+    u64 value;
+};
+
+
+class PackedInstruction
+{
+public:
+    u32 opcode;
+    u32 operand;
+    u32 immediate;
+};
+
+
+static_assert(sizeof(BytecodeHeader) == 80,"makeda : BytecodeHeader has padding");
+static_assert(sizeof(BytecodeSymbol) == 16,"makeda : BytecodeSymbol has padding");
+static_assert(sizeof(PackedInstruction) == 12,"makeda : PackedInstruction has padding");
+
+
+inline bool is_constant_operand(InstructionType type)
+{
+    return type == InstructionType::PUSH or type == InstructionType::PUSH_ADD or
+           type == InstructionType::PUSH_SUB or type == InstructionType::PUSH_MUL;
+}
+
+
+inline bool is_constant_immediate(InstructionType type)
+{
+    return type == InstructionType::PUSH_L_JF or type == InstructionType::PUSH_G_JF or
+           type == InstructionType::PUSH_EQ_JT or type == InstructionType::DUP_PUSH_L_JF or
+           type == InstructionType::DUP_PUSH_G_JF or type == InstructionType::DUP_PUSH_EQ_JT;
+}
+
+
+/**
+ * Encodes an assembled program into a container, constants are pooled
+ * so a repeated value is stored once.
+ */
+
+class BytecodeWriter
+{
+public:
+    std::vector<u8> buffer;
+
+    std::vector<i64> constants;
+    std::unordered_map<i64,u32> constant_index;
+
+    BytecodeWriter(Program *program)
+    {
+        std::vector<PackedInstruction> instructions;
+        std::string strings;
+        std::vector<BytecodeSymbol> symbols;
+
+        for(Instruction &inst : program->instructions)
+        {
+            PackedInstruction packed;
+            packed.opcode = (u32)inst.type;
+            packed.operand = is_constant_operand(inst.type) ? get_constant(inst.operand) : (u32)inst.operand;
+            packed.immediate = is_constant_immediate(inst.type) ? get_constant(inst.immediate) : (u32)inst.immediate;
+            instructions.push_back(packed);
+        }
+
+        for(ProgramSymbol &symbol : program->symbols)
+        {
+            BytecodeSymbol packed;
+            packed.name_offset = strings.size();
+            packed.name_length = symbol.name.size();
+            packed.value = symbol.value;
+            symbols.push_back(packed);
+            strings += symbol.name;
+        }
+
+        BytecodeHeader header = {};
+        header.magic = MAKEDA_MAGIC;
+        header.version = MAKEDA_VERSION;
+        header.header_size = sizeof(BytecodeHeader);
+        header.entry = program->entry;
+
+        header.constant_offset = sizeof(BytecodeHeader);
+        header.constant_count = this->constants.size();
+        header.symbol_offset = header.constant_offset + this->constants.size() * sizeof(i64);
+        header.symbol_count = symbols.size();
+        header.string_offset = header.symbol_offset + symbols.size() * sizeof(BytecodeSymbol);
+        header.string_size = strings.size();
+        header.instruction_offset = align(header.string_offset + strings.size());
+        header.instruction_count = instructions.size();
+
+        this->buffer.assign(header.instruction_offset + instructions.size() * sizeof(PackedInstruction),0);
+
+        u8 *base = this->buffer.data();
+        memcpy(base,&header,sizeof(BytecodeHeader));
+        memcpy(base + header.constant_offset,this->constants.data(),this->constants.size() * sizeof(i64));
+        memcpy(base + header.symbol_offset,symbols.data(),symbols.size() * sizeof(BytecodeSymbol));
+        memcpy(base + header.string_offset,strings.data(),strings.size());
+        memcpy(base + header.instruction_offset,instructions.data(),instructions.size() * sizeof(PackedInstruction));
+    }
+
+
+    u64 align(u64 offset)
+    {
+        return (offset + 7) & ~(u64)7;
+    }
+
+
+    u32 get_constant(i64 value)
+    {
+        auto it = this->constant_index.find(value);
+        if(it != this->constant_index.end())
+        {
+            return it->second;
+        }
+
+        u32 index = this->constants.size();
+        this->constants.push_back(value);
+        this->constant_index[value] = index;
+        return index;
+    }
+
+
+    bool write(std::string name)
+    {
+        FILE *fout = fopen(name.c_str(),"wb");
+        if(fout == NULL)
+        {
+            return false;
+        }
+
+        bool ok = fwrite(this->buffer.data(),1,this->buffer.size(),fout) == this->buffer.size();
+        fclose(fout);
+        return ok;
+    }
+};
+
+
+/**
+ * A read only view of a container, either mapped from a file or borrowed
+ * from a writer's buffer. load and view check that every section lies
+ * inside the image and that every constant index is in the pool.
+ */
+
+class Bytecode
+{
+public:
+    const u8 *base = nullptr;
+    u64 size = 0;
+    bool mapped = false;
+
+    const BytecodeHeader *header = nullptr;
+    const i64 *constants = nullptr;
+    const BytecodeSymbol *symbols = nullptr;
+    const char *strings = nullptr;
+    const PackedInstruction *instructions = nullptr;
+    u64 instruction_count = 0;
+
+    std::string error;
+
+    Bytecode() = default;
+    Bytecode(const Bytecode &) = delete;
+    Bytecode &operator=(const Bytecode &) = delete;
+
+    ~Bytecode()
+    {
+        unload();
+    }
+
+
+    void unload()
+    {
+        if(this->mapped)
+        {
+            munmap((void *)this->base,this->size);
+        }
+
+        this->base = nullptr;
+        this->size = 0;
+        this->mapped = false;
+    }
+
+
+    bool load(std::string name)
+    {
+        unload();
+
+        int fd = open(name.c_str(),O_RDONLY);
+        if(fd < 0)
+        {
+            return fail("cannot open " + name);
+        }
+
+        struct stat st;
+        if(fstat(fd,&st) != 0 or st.st_size == 0)
+        {
+            close(fd);
+            return fail(name + " is empty");
+        }
+
+        void *address = mmap(NULL,st.st_size,PROT_READ,MAP_PRIVATE,fd,0);
+        close(fd);
+
+        if(address == MAP_FAILED)
+        {
+            return fail("cannot map " + name);
+        }
+
+        this->mapped = true;
+        return view((const u8 *)address,st.st_size);
+    }
+
+
+    bool view(const u8 *base,u64 size)
+    {
+        if(not this->mapped)
+        {
+            unload();
+        }
+
+        this->base = base;
+        this->size = size;
+
+        if(size < sizeof(BytecodeHeader))
+        {
+            return fail("truncated header");
+        }
+
+        this->header = (const BytecodeHeader *)base;
+
+        if(this->header->magic != MAKEDA_MAGIC)
+        {
+            return fail("not a makeda bytecode file");
+        }
+
+        if(this->header->version != MAKEDA_VERSION or this->header->header_size != sizeof(BytecodeHeader))
+        {
+            return fail("unsupported bytecode version " + std::to_string(this->header->version));
+        }
+
+        if(not is_section(this->header->constant_offset,this->header->constant_count,sizeof(i64),alignof(i64)) or
+           not is_section(this->header->symbol_offset,this->header->symbol_count,sizeof(BytecodeSymbol),alignof(BytecodeSymbol)) or
+           not is_section(this->header->string_offset,this->header->string_size,1,1) or
+           not is_section(this->header->instruction_offset,this->header->instruction_count,sizeof(PackedInstruction),alignof(PackedInstruction)))
+        {
+            return fail("section outside the file");
+        }
+
+        this->constants = (const i64 *)(base + this->header->constant_offset);
+        this->symbols = (const BytecodeSymbol *)(base + this->header->symbol_offset);
+        this->strings = (const char *)(base + this->header->string_offset);
+        this->instructions = (const PackedInstruction *)(base + this->header->instruction_offset);
+        this->instruction_count = this->header->instruction_count;
+
+        if(this->header->entry > this->instruction_count)
+        {
+            return fail("entry point outside the program");
+        }
+
+        for(u64 i = 0; i < this->header->symbol_count; i++)
+        {
+            if((u64)this->symbols[i].name_offset + this->symbols[i].name_length > this->header->string_size)
+            {
+                return fail("symbol name outside the string table");
+            }
+        }
+
+        for(u64 i = 0; i < this->instruction_count; i++)
+        {
+            InstructionType type = get_type(i);
+            const PackedInstruction &inst = this->instructions[i];
+
+            if((is_constant_operand(type) and inst.operand >= this->header->constant_count) or
+               (is_constant_immediate(type) and inst.immediate >= this->header->constant_count))
+            {
+                return fail("instruction " + std::to_string(i) + " uses a constant outside the pool");
+            }
+        }
+
+        return true;
+    }
+
+
+    bool fail(std::string error)
+    {
+        this->error = error;
+        return false;
+    }
+
+
+    bool is_section(u64 offset,u64 count,u64 width,u64 alignment)
+    {
+        if(offset % alignment != 0 or offset > this->size)
+        {
+            return false;
+        }
+
+        return count <= (this->size - offset) / width;
+    }
+
+
+    InstructionType get_type(u64 ip) const
+    {
+        return (InstructionType)this->instructions[ip].opcode;
+    }
+
+
+    i64 get_operand(u64 ip) const
+    {
+        const PackedInstruction &inst = this->instructions[ip];
+        return is_constant_operand(get_type(ip)) ? this->constants[inst.operand] : (i64)inst.operand;
+    }
+
+
+    i64 get_immediate(u64 ip) const
+    {
+        const PackedInstruction &inst = this->instructions[ip];
+        return is_constant_immediate(get_type(ip)) ? this->constants[inst.immediate] : (i64)inst.immediate;
+    }
+
+
+    std::string get_symbol_name(u64 index) const
+    {
+        return std::string(this->strings + this->symbols[index].name_offset,this->symbols[index].name_length);
+    }
+};
+
+
+#endif
@@ -4,6 +4,8 @@
 
 
 
+#include <sys/mman.h>
+#include <unistd.h>
 #include "../../../utils/include/utils.hpp"
 
 enum class OperandType
@@ -39,8 +41,50 @@ enum class InstructionType
     G,
     GE,
     PRINT,
+
+    // superinstructions emitted by the makasm peephole
+    PUSH_ADD,
+    PUSH_SUB,
+    PUSH_MUL,
+    PUSH_L_JF,
+    PUSH_G_JF,
+    PUSH_EQ_JT,
+    DUP_PUSH_L_JF,
+    DUP_PUSH_G_JF,
+    DUP_PUSH_EQ_JT,
+
+    // instructions the tac lowering needs, locals are 8 byte slots in the
+    // current frame, LOAD and STORE take byte addresses into vm memory
+    NEG,
+    NOT,
+    AND,
+    OR,
+    XOR,
+    SHL,
+    SHR,
+    SHRU,
+    DIVU,
+    MODU,
+    LU,
+    LEU,
+    GU,
+    GEU,
+    SEXT32,
+    ZEXT32,
+    JZ,
+    JNZ,
+    LOAD_LOCAL,
+    STORE_LOCAL,
+    ADDR_LOCAL,
+    LOAD,
+    STORE,
+    ENTER,
+    CALL,
+    RET,
 };
 
+#define MAKEDA_OPCODES ((u32)InstructionType::RET + 1)
+
 
 
 class Instruction
@@ -48,17 +92,122 @@ class Instruction
 public:
     InstructionType type;
     i64 operand;
+    i64 immediate;
 
-    Instruction(InstructionType type,i64 operand)
+    Instruction(InstructionType type,i64 operand,i64 immediate = 0)
     {
         this->type = type;
         this->operand = operand;
+        this->immediate = immediate;
     }
 
     Instruction() = default;
 };
 
 
+inline bool is_jump(InstructionType type)
+{
+    switch(type)
+    {
+        case InstructionType::JMP:
+        case InstructionType::JT:
+        case InstructionType::JF:
+        case InstructionType::PUSH_L_JF:
+        case InstructionType::PUSH_G_JF:
+        case InstructionType::PUSH_EQ_JT:
+        case InstructionType::DUP_PUSH_L_JF:
+        case InstructionType::DUP_PUSH_G_JF:
+        case InstructionType::DUP_PUSH_EQ_JT:
+        case InstructionType::JZ:
+        case InstructionType::JNZ:
+        {
+            return true;
+        }
+        default:
+        {
+            return false;
+        }
+    }
+}
+
+
+// jumps and calls, the instructions whose operand is an instruction index
+inline bool has_target(InstructionType type)
+{
+    return is_jump(type) or type == InstructionType::CALL;
+}
+
+
+// lower case mnemonics for reports, the same spelling makasm uses
+inline const char *get_name(InstructionType type)
+{
+    static const char *const names[] =
+    {
+        "push",
+        "pop",
+        "dup",
+        "add",
+        "sub",
+        "mul",
+        "div",
+        "mod",
+        "jt",
+        "jf",
+        "jmp",
+        "eq",
+        "ne",
+        "l",
+        "le",
+        "g",
+        "ge",
+        "print",
+        "push_add",
+        "push_sub",
+        "push_mul",
+        "push_l_jf",
+        "push_g_jf",
+        "push_eq_jt",
+        "dup_push_l_jf",
+        "dup_push_g_jf",
+        "dup_push_eq_jt",
+        "neg",
+        "not",
+        "and",
+        "or",
+        "xor",
+        "shl",
+        "shr",
+        "shru",
+        "divu",
+        "modu",
+        "lu",
+        "leu",
+        "gu",
+        "geu",
+        "sext32",
+        "zext32",
+        "jz",
+        "jnz",
+        "load_local",
+        "store_local",
+        "addr_local",
+        "load",
+        "store",
+        "enter",
+        "call",
+        "ret",
+    };
+
+    return (u32)type < MAKEDA_OPCODES ? names[(int)type] : "invalid";
+}
+
+
+/**
+ * The operand stack lives in its own mapping with an inaccessible guard
+ * page on either side. The usable slots end exactly at the upper guard so
+ * a push past stack_size faults instead of needing a compare.
+ */
+
 class Stack
 {
 public:
@@ -66,13 +215,46 @@ public:
     i64 *stack;
     i64 stack_size;
 
-    Stack(int size)
+    u8 *mapping;
+    u64 mapping_size;
+
+    Stack(i64 size)
     {
+        u64 page = sysconf(_SC_PAGESIZE);
+        u64 bytes = ((size * sizeof(i64)) + page - 1) / page * page;
+
+        this->mapping_size = bytes + 2 * page;
+        this->mapping = (u8 *)mmap(NULL,this->mapping_size,PROT_NONE,MAP_PRIVATE | MAP_ANONYMOUS,-1,0);
+
+        if(this->mapping == MAP_FAILED or mprotect(this->mapping + page,bytes,PROT_READ | PROT_WRITE) != 0)
+        {
+            DEBUG_PANIC("makeda : cannot map a stack of " + std::to_string(size) + " slots");
+        }
+
         this->stack_size = size;
-        this->stack = (i64 *)malloc(sizeof(i64));
+        this->stack = (i64 *)(this->mapping + page + bytes) - size;
         this->stack_pointer = 0;
     }
 
+    Stack(const Stack &) = delete;
+    Stack &operator=(const Stack &) = delete;
+
+    ~Stack()
+    {
+        munmap(this->mapping,this->mapping_size);
+    }
+
+    bool is_guard(void *address)
+    {
+        u8 *byte = (u8 *)address;
+        return byte >= this->mapping and byte < this->mapping + this->mapping_size;
+    }
+
+    bool is_overflow(void *address)
+    {
+        return (i64 *)address >= this->stack + this->stack_size;
+    }
+
     void push(i64 value)
     {
         this->stack[this->stack_pointer] = value;
@@ -96,10 +278,20 @@ public:
 };
 
 
+class ProgramSymbol
+{
+public:
+    std::string name;
+    i64 value;
+};
+
+
 class Program
 {
 public:
     std::vector<Instruction> instructions;
+    std::vector<ProgramSymbol> symbols;
+    i64 entry = 0;
     i64 ip = 0;
     
     void add_instruction(Instruction instruction)
@@ -115,7 +307,17 @@ enum class Trap
     OVERFLOW,
     UNDERFLOW,
     DIVISION_BY_ZERO,
+    INVALID_PROGRAM,
+    BAD_ADDRESS,
+    DIVISION_OVERFLOW,
 };
 
 
+// the quotient of INT64_MIN / -1 does not fit, idiv faults on it like on a zero divisor
+inline bool is_division_overflow(i64 dividend,i64 divisor)
+{
+    return divisor == -1 and dividend == INT64_MIN;
+}
+
+
 #endif
@@ -0,0 +1,143 @@
+// makasm throughput benchmark, generates a .masm program of the given
+// number of lines and times the lexer, both codegen passes, the
+// superinstruction pass and the bytecode writer on it.
+//
+//    g++ -O2 -o asmbench src/middle_end/makeda/makasm/include/bench.cpp
+//    ./asmbench /tmp/million.masm 1000000 [--numeric]
+//
+// the program is a chain of blocks joined by labels, --numeric writes the
+// same program with resolved jump targets and no labels or constants.
+//
+
+#include <chrono>
+#include "codegen.hpp"
+#include "../../include/bytecode.hpp"
+#include "../../../../utils/include/file_to_string.hpp"
+
+
+/**
+ * Every block is 13 lines and 11 instructions, both paths through it
+ * leave the stack empty so the whole file verifies and runs.
+ */
+
+i64 generate(std::string name,i64 lines,bool numeric)
+{
+    std::ofstream out(name);
+    if(not out)
+    {
+        DEBUG_PANIC("asmbench : cannot write " + name);
+    }
+
+    i64 blocks = std::max<i64>(1,(lines - 4) / 13);
+
+    if(not numeric)
+    {
+        out << "; generated by asmbench, " << blocks << " blocks\n";
+        out << "const LIMIT 1000\n";
+    }
+
+    for(i64 i = 0; i < blocks; i++)
+    {
+        i64 base = i * 11;
+        std::string skip = numeric ? std::to_string(base + 10) : "c" + std::to_string(i);
+        std::string next = numeric ? std::to_string(base + 11) : "b" + std::to_string(i + 1);
+
+        if(not numeric)
+        {
+            out << "b" << i << ":\n";
+        }
+
+        out << "push " << i << "\n";
+        out << "push " << (numeric ? "1000" : "LIMIT") << "\n";
+        out << "add\n";
+        out << "push 7\n";
+        out << "mod\n";
+        out << "push 3\n";
+        out << "l\n";
+        out << "jf " << skip << "\n";
+        out << "pop\n";
+        out << "jmp " << next << "\n";
+
+        if(not numeric)
+        {
+            out << "c" << i << ":\n";
+        }
+
+        out << "pop\n";
+    }
+
+    if(not numeric)
+    {
+        out << "b" << blocks << ":\n";
+    }
+
+    out << "print\n";
+
+    return blocks;
+}
+
+
+template <typename T>
+double measure(T run)
+{
+    auto start = std::chrono::steady_clock::now();
+    run();
+    auto end = std::chrono::steady_clock::now();
+
+    return std::chrono::duration<double>(end - start).count();
+}
+
+
+int main(int argc,char **argv)
+{
+    if(argc < 3)
+    {
+        DEBUG_PANIC("usage : asmbench out.masm lines [--numeric]");
+    }
+
+    std::string name(argv[1]);
+    i64 lines = std::stol(argv[2]);
+    bool numeric = argc > 3 and std::string(argv[3]) == "--numeric";
+
+    i64 blocks = generate(name,lines,numeric);
+
+    FileToString fs(name);
+    std::string source = fs.read();
+    i64 line_count = std::count(source.begin(),source.end(),'\n');
+
+    std::vector<Tokens> tokens;
+    double lex_time = measure([&]()
+    {
+        Lexer lexer(name,source);
+        tokens = lexer.scan_tokens();
+    });
+
+    u64 token_count = tokens.size();
+    Program program;
+    double codegen_time = measure([&]()
+    {
+        Codegen codegen(name,std::move(tokens),false);
+        program = std::move(codegen.program);
+    });
+
+    double fuse_time = measure([&]()
+    {
+        Superinstructions superinstructions(&program);
+    });
+
+    u64 bytes = 0;
+    double write_time = measure([&]()
+    {
+        BytecodeWriter writer(&program);
+        bytes = writer.buffer.size();
+    });
+
+    double total = lex_time + codegen_time + fuse_time + write_time;
+
+    std::cout << name << " : " << line_count << " lines, " << blocks << " blocks, " << token_count << " tokens, "
+              << source.size() / 1e6 << " MB" << std::endl;
+    std::cout << name << " : lex " << lex_time << " s, codegen " << codegen_time << " s, fuse " << fuse_time
+              << " s, write " << write_time << " s" << std::endl;
+    std::cout << name << " : " << program.instructions.size() << " instructions, " << bytes << " bytes of bytecode, "
+              << line_count / total / 1e6 << " M lines/sec, " << source.size() / total / 1e6 << " MB/sec" << std::endl;
+}
@@ -1,9 +1,28 @@
 #ifndef C4_MAKASM_H
 #define C4_MAKASM_H
 
+#include <unordered_map>
+#include <filesystem>
 #include "lexer.hpp"
+#include "superinstructions.hpp"
 #include "../../include/isa.hpp"
-
+#include "../../../../utils/include/file_to_string.hpp"
+
+
+/**
+ * Two pass assembler. Included files are spliced into the token stream
+ * first, the first pass then records every label with the index of the
+ * instruction behind it and every named constant, and the second pass
+ * emits the instructions with jump targets and operands resolved.
+ *
+ *      include "lib.masm"      paths are relative to the including file
+ *      const N 10              N can be used wherever an integer can
+ *      loop:                   jmp loop, jt loop and jf loop jump here
+ *      ; comment               runs to the end of the line
+ *
+ * Labels and constants share one namespace across all included files,
+ * labels are kept as symbols in the bytecode.
+ */
 
 class Codegen
 {
@@ -16,20 +35,203 @@ public:
 
     Program program;
 
-    Codegen(std::string name,std::vector<Tokens> tokens)
+    std::unordered_map<std::string,i64> labels;
+    std::unordered_map<std::string,i64> constants;
+    std::vector<std::string> include_chain;
+
+    Codegen(std::string name,std::vector<Tokens> tokens,bool fuse = true)
     {
         this->name = name;
-        this->tokens = tokens;
+        this->tokens = std::move(tokens);
+
+        expand_includes();
 
-		this->tokens_length = tokens.size();
+		this->tokens_length = this->tokens.size();
 		this->index = 0;
 
+        collect_symbols();
+
         while (not is_at_end())
         {
             gen_makasm();
         }
 
-        write_program_to_file(this->program);
+        if(fuse)
+        {
+            Superinstructions superinstructions(&this->program);
+        }
+    }
+
+
+    /**
+     * Replaces every include directive by the tokens of the file it
+     * names, included files are expanded the same way. A file that
+     * includes itself through any chain is an error, the chain holds
+     * normalized paths so ./a.masm and a.masm are the same file.
+     */
+
+    void expand_includes()
+    {
+        bool found = false;
+        for(Tokens &token : this->tokens)
+        {
+            if(token.type == TokenType::TOKEN_INCLUDE)
+            {
+                found = true;
+                break;
+            }
+        }
+
+        if(not found)
+        {
+            return;
+        }
+
+        std::vector<Tokens> expanded;
+        splice(this->name,&this->tokens,&expanded);
+        this->tokens = std::move(expanded);
+    }
+
+
+    void splice(std::string file_name,std::vector<Tokens> *tokens,std::vector<Tokens> *expanded)
+    {
+        this->include_chain.push_back(get_normalized(file_name));
+
+        for(u64 i = 0; i < tokens->size(); i++)
+        {
+            Tokens &token = (*tokens)[i];
+
+            if(token.type != TokenType::TOKEN_INCLUDE)
+            {
+                expanded->push_back(std::move(token));
+                continue;
+            }
+
+            if(i + 1 >= tokens->size() or (*tokens)[i + 1].type != TokenType::TOKEN_LITERAL_STRING)
+            {
+                fatal(file_name + " : expected a file name in quotes after include");
+            }
+
+            std::string path = get_directory(file_name) + (*tokens)[++i].string;
+
+            std::string normalized = get_normalized(path);
+
+            for(std::string &active : this->include_chain)
+            {
+                if(active == normalized)
+                {
+                    fatal(file_name + " : " + path + " includes itself");
+                }
+            }
+
+            if(not std::ifstream(path))
+            {
+                fatal(file_name + " : cannot include " + path);
+            }
+
+            FileToString fs(path);
+            Lexer lexer(path,fs.read());
+            std::vector<Tokens> included = lexer.scan_tokens();
+
+            // the included eof would end the program early
+            included.pop_back();
+            splice(path,&included,expanded);
+        }
+
+        this->include_chain.pop_back();
+    }
+
+
+    std::string get_normalized(std::string file_name)
+    {
+        std::error_code error;
+        std::filesystem::path normalized = std::filesystem::weakly_canonical(file_name,error);
+        return error ? file_name : normalized.string();
+    }
+
+
+    std::string get_directory(std::string file_name)
+    {
+        u64 slash = file_name.find_last_of('/');
+        return slash == std::string::npos ? "" : file_name.substr(0,slash + 1);
+    }
+
+
+    bool is_instruction(TokenType type)
+    {
+        return ((int)type >= (int)TokenType::TOKEN_MUL and (int)type <= (int)TokenType::TOKEN_SUB) or
+               ((int)type >= (int)TokenType::TOKEN_PUSH and (int)type <= (int)TokenType::TOKEN_JF);
+    }
+
+
+    void define(std::string name,i64 value,bool is_label)
+    {
+        if(this->labels.count(name) or this->constants.count(name))
+        {
+            fatal("makasm : " + name + " is defined twice");
+        }
+
+        if(is_label)
+        {
+            this->labels[name] = value;
+            this->program.symbols.push_back(ProgramSymbol{name,value});
+        }
+        else
+        {
+            this->constants[name] = value;
+        }
+    }
+
+
+    /**
+     * First pass, every instruction keyword is one instruction so a label
+     * is the number of keywords before it. A constant takes an integer or
+     * a constant defined above it.
+     */
+
+    void collect_symbols()
+    {
+        i64 count = 0;
+
+        for(int i = 0; i < this->tokens_length; i++)
+        {
+            Tokens &token = this->tokens[i];
+
+            if(is_instruction(token.type))
+            {
+                count++;
+            }
+            else if(token.type == TokenType::TOKEN_IDENT and is_token_type(TokenType::TOKEN_COLON,i + 1))
+            {
+                define(token.string,count,true);
+                i++;
+            }
+            else if(token.type == TokenType::TOKEN_CONST)
+            {
+                if(not is_token_type(TokenType::TOKEN_IDENT,i + 1))
+                {
+                    fatal("makasm : expected a name after const");
+                }
+
+                std::string name = this->tokens[i + 1].string;
+                Tokens *value = peek(i + 2);
+
+                if(value != nullptr and value->type == TokenType::TOKEN_LITERAL_INT)
+                {
+                    define(name,std::stol(value->string),false);
+                }
+                else if(value != nullptr and value->type == TokenType::TOKEN_IDENT and this->constants.count(value->string))
+                {
+                    define(name,this->constants[value->string],false);
+                }
+                else
+                {
+                    fatal("makasm : expected an integer or a constant after const " + name);
+                }
+
+                i += 2;
+            }
+        }
     }
 
 
@@ -58,7 +260,7 @@ public:
 	 * Consumes and returns the current token, advancing the parser cursor.
 	 */
 
-	Tokens consume()
+	Tokens &consume()
 	{
 		return this->tokens[this->index++];
 	}
@@ -117,6 +319,10 @@ public:
 		{
 			return TokenType::TOKEN_POP;
 		}
+        else if (keyword == "dup")
+		{
+			return TokenType::TOKEN_DUP;
+		}
         else if (keyword == "jmp")
 		{
 			return TokenType::TOKEN_JMP;
@@ -212,96 +418,104 @@ public:
 
     void gen_makasm()
     {
-        if(is_token("push"))
-        {
-            gen_push();
-        }
-        else if(is_token("pop"))
+        switch(peek()->type)
         {
-            gen_pop();
+            case TokenType::TOKEN_PUSH:     gen_push(); break;
+            case TokenType::TOKEN_POP:      gen_pop(); break;
+            case TokenType::TOKEN_DUP:      gen_dup(); break;
+            case TokenType::TOKEN_ADD:      gen_add(); break;
+            case TokenType::TOKEN_SUB:      gen_sub(); break;
+            case TokenType::TOKEN_MUL:      gen_mul(); break;
+            case TokenType::TOKEN_DIV:      gen_div(); break;
+            case TokenType::TOKEN_MOD:      gen_mod(); break;
+            case TokenType::TOKEN_JMP:      gen_jmp(); break;
+            case TokenType::TOKEN_L:        gen_l(); break;
+            case TokenType::TOKEN_LE:       gen_le(); break;
+            case TokenType::TOKEN_G:        gen_g(); break;
+            case TokenType::TOKEN_GE:       gen_ge(); break;
+            case TokenType::TOKEN_EQ:       gen_eq(); break;
+            case TokenType::TOKEN_NE:       gen_ne(); break;
+            case TokenType::TOKEN_JT:       gen_jt(); break;
+            case TokenType::TOKEN_JF:       gen_jf(); break;
+            case TokenType::TOKEN_PRINT:    gen_print(); break;
+            case TokenType::TOKEN_IDENT:    gen_label(); break;
+            case TokenType::TOKEN_CONST:    gen_const(); break;
+            case TokenType::TOKEN_EOF:      consume(); break;
+            default:
+            {
+                fatal("illegal instruction  : " + (*(peek())).string);
+            }
         }
-        else if(is_token("add"))
-        {
-            gen_add();
-        }
-        else if(is_token("sub"))
-        {
-            gen_sub();
-        }
-        else if(is_token("mul"))
-        {
-            gen_mul();
-        }
-        else if(is_token("div"))
-        {
-            gen_div();
-        }
-        else if(is_token("mod"))
-        {
-            gen_mod();
-        }
-        else if(is_token("jmp"))
-        {
-            gen_jmp();
-        }
-        else if(is_token("l"))
-        {
-            gen_l();
-        }
-        else if(is_token("le"))
-        {
-            gen_le();
-        }
-        else if(is_token("g"))
-        {
-            gen_g();
-        }
-        else if(is_token("ge"))
-        {
-            gen_ge();
-        }
-        else if(is_token("eq"))
-        {
-            gen_eq();
-        }
-        else if(is_token("ne"))
-        {
-            gen_ne();
-        }
-        else if(is_token("jt"))
-        {
-            gen_jt();
-        }
-        else if(is_token("jf"))
+    }
+
+
+    // labels were numbered in the first pass, here they are only checked
+    void gen_label()
+    {
+        Tokens &token = consume();
+
+        if(not is_token_type(TokenType::TOKEN_COLON))
         {
-            gen_jf();
+            fatal("illegal instruction  : " + token.string);
         }
-        else if(is_token("print"))
+
+        consume();
+    }
+
+
+    void gen_const()
+    {
+        consume();
+        consume();
+        consume();
+    }
+
+
+    /**
+     * Reads the operand of a jump or a push, an integer or the name of a
+     * label or a constant.
+     */
+
+    i64 get_operand(std::string mnemonic)
+    {
+        if(is_at_end())
         {
-            gen_print();
+            fatal("expected an integer or a name after " + mnemonic);
         }
-        else if(is_token("eof"))
+
+        Tokens &token = consume();
+
+        if(token.type == TokenType::TOKEN_LITERAL_INT)
         {
-            consume();
+            return std::stol(token.string);
         }
-        else
+        else if(token.type == TokenType::TOKEN_IDENT)
         {
-            fatal("illegal instruction  : " + (*(peek())).string);
+            auto constant = this->constants.find(token.string);
+            if(constant != this->constants.end())
+            {
+                return constant->second;
+            }
+
+            auto label = this->labels.find(token.string);
+            if(label != this->labels.end())
+            {
+                return label->second;
+            }
+
+            fatal("undefined name " + token.string + " after " + mnemonic);
         }
+
+        fatal("expected an integer or a name after " + mnemonic);
+        return 0;
     }
 
 
     void gen_jmp()
     {
         consume();
-        Tokens token = consume();  
 
-        if(token.type != TokenType::TOKEN_LITERAL_INT)
-        {
-            fatal("expected an integer after jmp");
-        }
-
-        Instruction inst(InstructionType::JMP,std::stol(token.string));
+        Instruction inst(InstructionType::JMP,get_operand("jmp"));
         this->program.add_instruction(inst);
     }
 
@@ -309,14 +523,8 @@ public:
     void gen_jt()
     {
         consume();
-        Tokens token = consume();  
-
-        if(token.type != TokenType::TOKEN_LITERAL_INT)
-        {
-            fatal("expected an integer after jt");
-        }
 
-        Instruction inst(InstructionType::JT,std::stol(token.string));
+        Instruction inst(InstructionType::JT,get_operand("jt"));
         this->program.add_instruction(inst);
     }
 
@@ -324,14 +532,8 @@ public:
     void gen_jf()
     {
         consume();
-        Tokens token = consume();  
-
-        if(token.type != TokenType::TOKEN_LITERAL_INT)
-        {
-            fatal("expected an integer after jf");
-        }
 
-        Instruction inst(InstructionType::JF,std::stol(token.string));
+        Instruction inst(InstructionType::JF,get_operand("jf"));
         this->program.add_instruction(inst);
     }
 
@@ -339,14 +541,8 @@ public:
     void gen_push()
     {
         consume();
-        Tokens token = consume();  
 
-        if(token.type != TokenType::TOKEN_LITERAL_INT)
-        {
-            fatal("expected an integer after push");
-        }
-
-        Instruction inst(InstructionType::PUSH,std::stol(token.string));
+        Instruction inst(InstructionType::PUSH,get_operand("push"));
         this->program.add_instruction(inst);
     }
 
@@ -359,6 +555,15 @@ public:
     }
 
 
+    void gen_dup()
+    {
+        consume();
+
+        Instruction inst(InstructionType::DUP,0);
+        this->program.add_instruction(inst);
+    }
+
+
     void gen_add()
     {
         consume();
@@ -467,24 +672,6 @@ public:
         this->program.add_instruction(inst);
     }
 
-
-    void write_program_to_file(Program program)
-    {
-        FILE *fout = fopen("test.m","w");
-
-        if(fout == NULL)
-        {
-            return;
-        }
-
-        for (Instruction inst : program.instructions)
-        {
-            fwrite(&inst,1,sizeof(Instruction),fout);
-        }
-
-        fclose(fout);
-    }
-
 };
 
 
@@ -201,6 +201,11 @@ private:
 	{
 		std::string buf;
 
+		if (match_token('-'))
+		{
+			buf += consume();
+		}
+
 		while ( is_digit())
 		{
 			buf += consume();
@@ -328,7 +333,7 @@ private:
 		}
 
 		update_col(buf.length());
-		add_keywords(buf);
+		add_keywords(std::move(buf));
 	}
 
 	/**
@@ -341,7 +346,7 @@ private:
 	 * it returns true if both strings are equal, false otherwise.
 	 */
 
-	inline bool match_keyword(std::string val1,std::string val2)
+	inline bool match_keyword(const std::string &val1,const char *val2)
 	{
 		return val1 == val2;
 	}
@@ -387,6 +392,10 @@ private:
 		{
 			add_token(TokenType::TOKEN_POP,buf);
 		}
+		else if (match_keyword(buf,"dup"))
+		{
+			add_token(TokenType::TOKEN_DUP,buf);
+		}
 		else if (match_keyword(buf,"jmp"))
 		{
 			add_token(TokenType::TOKEN_JMP,buf);
@@ -427,9 +436,17 @@ private:
 		{
 			add_token(TokenType::TOKEN_PRINT,buf);
 		}
+		else if (match_keyword(buf,"const"))
+		{
+			add_token(TokenType::TOKEN_CONST,buf);
+		}
+		else if (match_keyword(buf,"include"))
+		{
+			add_token(TokenType::TOKEN_INCLUDE,buf);
+		}
 		else
 		{
-			//add_token(TokenType::TOKEN_IDENT,buf);
+			add_token(TokenType::TOKEN_IDENT,buf);
 		}
 	}
 
@@ -515,7 +532,7 @@ private:
 
 	inline void add_token(TokenType type, std::string string = "")
 	{
-		this->tokens.push_back(Tokens(type,string,this->start,this->end,this->row,this->col,this->line));
+		this->tokens.push_back(Tokens(type,std::move(string),this->start,this->end,this->row,this->col,this->line));
 	}
 
 	/**
@@ -608,6 +625,28 @@ private:
 			 case ',':
 				add_token_single(TokenType::TOKEN_COMMA);
 				break;
+			 case ':':
+				add_token_single(TokenType::TOKEN_COLON);
+				break;
+			 case '-':
+				if (is_digit(1))
+				{
+					make_number();
+				}
+				else
+				{
+					update_col(1);
+					consume();
+				}
+				break;
+			 case ';':
+				/* comments run to the end of the line */
+				while (not at_end() and not match_token('\n'))
+				{
+					update_col(1);
+					consume();
+				}
+				break;
 			 case '\t':
 				update_col(4);
 				consume();
@@ -652,7 +691,7 @@ public:
 		}
 
 		add_token(TokenType::TOKEN_EOF,"eof");
-		return this->tokens;
+		return std::move(this->tokens);
 	}
 
 };
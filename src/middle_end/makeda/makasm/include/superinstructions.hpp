@@ -0,0 +1,210 @@
+#ifndef C4_MAKASM_SUPERINSTRUCTIONS_H
+#define C4_MAKASM_SUPERINSTRUCTIONS_H
+
+#include "../../include/isa.hpp"
+
+
+/**
+ * Peephole pass over an assembled program that replaces common sequences
+ * by a single fused instruction, each one costs the vm one dispatch instead
+ * of two to four.
+ *
+ *      push k; add|sub|mul          ->  PUSH_ADD|PUSH_SUB|PUSH_MUL k
+ *      push k; l|g; jf t            ->  PUSH_L_JF|PUSH_G_JF t,k
+ *      push k; eq; jt t             ->  PUSH_EQ_JT t,k
+ *      dup; push k; l|g; jf t       ->  DUP_PUSH_L_JF|DUP_PUSH_G_JF t,k
+ *      dup; push k; eq; jt t        ->  DUP_PUSH_EQ_JT t,k
+ *
+ * Jump and call targets are instruction indices, so a sequence is never
+ * fused over a target and every target is renumbered afterwards.
+ */
+
+class Superinstructions
+{
+public:
+    Program *program;
+    i64 fused = 0;
+    i64 removed = 0;
+
+    std::vector<bool> is_target;
+    std::vector<i64> new_index;
+
+    Superinstructions(Program *program)
+    {
+        this->program = program;
+        find_targets();
+        fuse();
+    }
+
+
+    void find_targets()
+    {
+        i64 size = this->program->instructions.size();
+        this->is_target.assign(size + 1,false);
+
+        for(Instruction &inst : this->program->instructions)
+        {
+            if(has_target(inst.type) and inst.operand >= 0 and inst.operand <= size)
+            {
+                this->is_target[inst.operand] = true;
+            }
+        }
+    }
+
+
+    /**
+     * Checks that the instructions at ip match the types in the pattern
+     * and that no instruction after the first is jumped to.
+     */
+
+    bool match(i64 ip,std::vector<InstructionType> pattern)
+    {
+        std::vector<Instruction> &instructions = this->program->instructions;
+
+        if(ip + (i64)pattern.size() > (i64)instructions.size())
+        {
+            return false;
+        }
+
+        for(u64 i = 0; i < pattern.size(); i++)
+        {
+            if(instructions[ip + i].type != pattern[i])
+            {
+                return false;
+            }
+
+            if(i > 0 and this->is_target[ip + i])
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+
+    /**
+     * Tries to fuse the sequence starting at ip, returns the number of
+     * instructions consumed, 0 when nothing matched.
+     */
+
+    int fuse_at(i64 ip,Instruction *fused)
+    {
+        std::vector<Instruction> &instructions = this->program->instructions;
+        const InstructionType DUP = InstructionType::DUP;
+        const InstructionType PUSH = InstructionType::PUSH;
+
+        struct Branch
+        {
+            InstructionType compare;
+            InstructionType jump;
+            InstructionType push_fused;
+            InstructionType dup_fused;
+        };
+
+        static const Branch branches[] =
+        {
+            {InstructionType::L,  InstructionType::JF, InstructionType::PUSH_L_JF,  InstructionType::DUP_PUSH_L_JF},
+            {InstructionType::G,  InstructionType::JF, InstructionType::PUSH_G_JF,  InstructionType::DUP_PUSH_G_JF},
+            {InstructionType::EQ, InstructionType::JT, InstructionType::PUSH_EQ_JT, InstructionType::DUP_PUSH_EQ_JT},
+        };
+
+        for(const Branch &branch : branches)
+        {
+            if(match(ip,{DUP,PUSH,branch.compare,branch.jump}))
+            {
+                *fused = Instruction(branch.dup_fused,instructions[ip + 3].operand,instructions[ip + 1].operand);
+                return 4;
+            }
+
+            if(match(ip,{PUSH,branch.compare,branch.jump}))
+            {
+                *fused = Instruction(branch.push_fused,instructions[ip + 2].operand,instructions[ip].operand);
+                return 3;
+            }
+        }
+
+        static const InstructionType arithmetic[][2] =
+        {
+            {InstructionType::ADD, InstructionType::PUSH_ADD},
+            {InstructionType::SUB, InstructionType::PUSH_SUB},
+            {InstructionType::MUL, InstructionType::PUSH_MUL},
+        };
+
+        for(const InstructionType *pair : arithmetic)
+        {
+            if(match(ip,{PUSH,pair[0]}))
+            {
+                *fused = Instruction(pair[1],instructions[ip].operand);
+                return 2;
+            }
+        }
+
+        return 0;
+    }
+
+
+    void fuse()
+    {
+        std::vector<Instruction> &instructions = this->program->instructions;
+        std::vector<Instruction> output;
+        i64 size = instructions.size();
+
+        this->new_index.assign(size + 1,0);
+
+        for(i64 ip = 0; ip < size;)
+        {
+            Instruction fused;
+            int count = fuse_at(ip,&fused);
+
+            this->new_index[ip] = output.size();
+
+            if(count == 0)
+            {
+                output.push_back(instructions[ip]);
+                ip++;
+                continue;
+            }
+
+            output.push_back(fused);
+            this->fused++;
+            this->removed += count - 1;
+            ip += count;
+        }
+
+        this->new_index[size] = output.size();
+
+        for(Instruction &inst : output)
+        {
+            if(has_target(inst.type) and inst.operand >= 0 and inst.operand <= size)
+            {
+                inst.operand = this->new_index[inst.operand];
+            }
+        }
+
+        if(this->program->entry >= 0 and this->program->entry <= size)
+        {
+            this->program->entry = this->new_index[this->program->entry];
+        }
+
+        for(ProgramSymbol &symbol : this->program->symbols)
+        {
+            if(symbol.value >= 0 and symbol.value <= size)
+            {
+                symbol.value = this->new_index[symbol.value];
+            }
+        }
+
+        instructions = output;
+    }
+
+
+    void print_stats()
+    {
+        std::cout << "makasm : " << this->fused << " superinstructions, " << this->removed << " instructions removed" << std::endl;
+    }
+
+};
+
+
+#endif
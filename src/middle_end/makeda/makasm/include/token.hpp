@@ -54,6 +54,7 @@ enum class TokenType
 */
 
     TOKEN_COMMA,
+    TOKEN_COLON,
 
 
 //  LITERALS
@@ -67,6 +68,7 @@ enum class TokenType
 
     TOKEN_PUSH,
     TOKEN_POP,
+    TOKEN_DUP,
     TOKEN_PRINT,
 
     TOKEN_JMP,
@@ -80,6 +82,13 @@ enum class TokenType
 
     TOKEN_JT,
     TOKEN_JF,
+
+//  DIRECTIVES
+
+    TOKEN_CONST,
+    TOKEN_INCLUDE,
+
+    TOKEN_IDENT,
     
     TOKEN_EOF,
 
@@ -102,7 +111,7 @@ public:
 	Tokens(TokenType type,std::string string,int start,int end,int row,int col,int line = 0)
 	{
 		this->type = type;
-		this->string = string;
+		this->string = std::move(string);
 		this->start = start;
 		this->end = end;
 		this->line = line;
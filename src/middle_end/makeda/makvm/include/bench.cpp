@@ -0,0 +1,73 @@
+// makeda dispatch benchmark, runs every program with and without
+// superinstructions under the switch and the threaded interpreter and
+// reports dispatches per second. The jit only counts the instructions it
+// hands back to the interpreter, it is compared by time.
+//
+//    g++ -O2 -o makbench src/middle_end/makeda/makvm/include/bench.cpp
+//    ./makbench tests/bench/makeda/*.masm
+//
+
+#include <chrono>
+#include "makeda.hpp"
+#include "../../makasm/include/codegen.hpp"
+#include "../../../../utils/include/file_to_string.hpp"
+
+
+double bench(Program program,Dispatch dispatch,std::string name,std::string mode)
+{
+    auto start = std::chrono::steady_clock::now();
+    Makeda makeda(1024,program,dispatch);
+    auto end = std::chrono::steady_clock::now();
+
+    double seconds = std::chrono::duration<double>(end - start).count();
+    double rate = makeda.executed / seconds;
+
+    if(makeda.trap != Trap::OK)
+    {
+        std::cout << name << " : " << mode << " trap " << (int)makeda.trap << std::endl;
+    }
+
+    std::cout << name << " : " << mode << " " << makeda.executed << " dispatches in "
+              << seconds << " s, " << rate / 1e6 << " M dispatches/sec"
+              << (makeda.verified ? "" : " (unverified)") << std::endl;
+
+    return seconds;
+}
+
+
+int main(int argc,char **argv)
+{
+    for(int i = 1; i < argc; i++)
+    {
+        std::string file_name(argv[i]);
+
+        FileToString fs(file_name);
+        std::string file_source = fs.read();
+
+        Lexer lexer(file_name,file_source);
+        std::vector<Tokens> tokens = lexer.scan_tokens();
+
+        Codegen plain(file_name,tokens,false);
+        Codegen fused(file_name,tokens,true);
+
+        double switch_time = bench(plain.program,Dispatch::SWITCH,file_name,"switch        ");
+        double fused_switch_time = bench(fused.program,Dispatch::SWITCH,file_name,"switch fused  ");
+        std::cout << file_name << " : superinstructions speed up switch " << switch_time / fused_switch_time << "x" << std::endl;
+
+        if(MAKEDA_THREADED)
+        {
+            double threaded_time = bench(plain.program,Dispatch::THREADED,file_name,"threaded      ");
+            double fused_threaded_time = bench(fused.program,Dispatch::THREADED,file_name,"threaded fused");
+            std::cout << file_name << " : threaded speeds up switch " << switch_time / threaded_time << "x, "
+                      << "superinstructions speed up threaded " << threaded_time / fused_threaded_time << "x" << std::endl;
+
+            if(MAKEDA_JIT)
+            {
+                double jit_time = bench(plain.program,Dispatch::JIT,file_name,"jit           ");
+                double fused_jit_time = bench(fused.program,Dispatch::JIT,file_name,"jit fused     ");
+                std::cout << file_name << " : jit speeds up threaded " << threaded_time / jit_time << "x, "
+                          << "fused " << fused_threaded_time / fused_jit_time << "x" << std::endl;
+            }
+        }
+    }
+}
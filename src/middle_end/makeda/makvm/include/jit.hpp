@@ -0,0 +1,653 @@
+#ifndef C4_MAKEDA_JIT_H
+#define C4_MAKEDA_JIT_H
+
+#include <stddef.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "../../include/bytecode.hpp"
+#include "verifier.hpp"
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define MAKEDA_JIT 1
+#else
+#define MAKEDA_JIT 0
+#endif
+
+
+/**
+ * Baseline template jit for verified makeda programs on x86_64. Every
+ * instruction is translated by copying the machine code template of its
+ * type into an executable mapping and patching the immediates and branch
+ * displacements, there is no register allocation across instructions.
+ *
+ * The top of the operand stack is kept in rax, the slots below it stay in
+ * vm memory as the interpreter lays them out:
+ *
+ *      rbx     address of the top slot, the empty slot at depth 0
+ *      rax     top of stack, dead at depth 0
+ *      r12     vm memory
+ *      r13     vm memory + fp, the current frame
+ *      r14     fp
+ *      r15     JitContext
+ *
+ * The depth the verifier found for each instruction picks the template
+ * variant, a push at depth 0 does not spill and a pop down to depth 0
+ * does not refill, so nothing below the stack is ever touched.
+ *
+ * Instructions without a template, and the ones that would trap, leave
+ * through a side exit that writes the stack back and returns the ip to
+ * the caller, which runs that instruction in the interpreter and enters
+ * the code again at the next one.
+ */
+
+class JitContext
+{
+public:
+    i64 *stack;
+    i64 *rbx;
+    i64 rax;
+    const u8 *target;
+    u8 *memory;
+    u8 *frame;
+    i64 fp;
+    i64 top;
+    i64 ip;
+    i64 sp;
+};
+
+
+#define MAKEDA_JIT_OFFSET(field) ((u8)offsetof(JitContext,field))
+
+
+class Jit
+{
+public:
+    const Bytecode *bytecode;
+    Verifier *verifier;
+    i64 memory_size;
+
+    std::vector<u8> buffer;
+    std::vector<i64> offsets;
+    u8 *code = nullptr;
+    u64 code_size = 0;
+    bool compiled = false;
+
+    i64 compiled_count = 0;
+    i64 exit_count = 0;
+
+    // rel32 displacements waiting for the offset of an instruction
+    std::vector<std::pair<i64,i64>> branches;
+
+    class ColdExit
+    {
+    public:
+        i64 ip;
+        i64 depth;
+        std::vector<i64> patches;
+    };
+
+    std::vector<ColdExit> cold;
+    i64 exit_offset = 0;
+
+    Jit(const Bytecode *bytecode,Verifier *verifier,i64 memory_size)
+    {
+        this->bytecode = bytecode;
+        this->verifier = verifier;
+        this->memory_size = memory_size;
+
+#if MAKEDA_JIT
+        if(verifier->verified)
+        {
+            compile();
+        }
+#endif
+    }
+
+    Jit(const Jit &) = delete;
+    Jit &operator=(const Jit &) = delete;
+
+    ~Jit()
+    {
+        if(this->code != nullptr)
+        {
+            munmap(this->code,this->code_size);
+        }
+    }
+
+
+    void print_stats()
+    {
+        std::cout << "makeda jit : " << this->compiled_count << " instructions compiled, " << this->exit_count
+                  << " side exits, " << this->buffer.size() << " bytes of code" << std::endl;
+    }
+
+
+    const u8 *get_entry(i64 ip)
+    {
+        return this->code + this->offsets[ip];
+    }
+
+
+    void run(JitContext *context)
+    {
+        ((void (*)(JitContext *))this->code)(context);
+    }
+
+
+    void emit(std::initializer_list<u8> bytes)
+    {
+        this->buffer.insert(this->buffer.end(),bytes);
+    }
+
+
+    void emit_u32(u32 value)
+    {
+        for(int i = 0; i < 4; i++)
+        {
+            this->buffer.push_back((value >> (8 * i)) & 0xff);
+        }
+    }
+
+
+    void emit_u64(u64 value)
+    {
+        for(int i = 0; i < 8; i++)
+        {
+            this->buffer.push_back((value >> (8 * i)) & 0xff);
+        }
+    }
+
+
+    void patch_u32(i64 at,u32 value)
+    {
+        for(int i = 0; i < 4; i++)
+        {
+            this->buffer[at + i] = (value >> (8 * i)) & 0xff;
+        }
+    }
+
+
+    // the templates only differ in their opcode bytes and the patched fields
+
+    void spill()            { emit({0x48,0x89,0x03, 0x48,0x8d,0x5b,0x08}); }     // mov [rbx],rax; lea rbx,[rbx+8]
+    void refill()           { emit({0x48,0x8d,0x5b,0xf8, 0x48,0x8b,0x03}); }     // lea rbx,[rbx-8]; mov rax,[rbx]
+    void pop_second()       { emit({0x48,0x89,0xc1}); refill(); }                // mov rcx,rax, rax = second
+    void load_immediate()   { emit({0x48,0xb9}); }                               // mov rcx,imm64
+    void set_flag(u8 cc)    { emit({0x0f,cc,0xc0, 0x0f,0xb6,0xc0}); }           // setcc al; movzx eax,al
+
+
+    // spill before a push, the empty slot at depth 0 stays empty
+    void push_slot(i64 depth)
+    {
+        if(depth >= 1)
+        {
+            spill();
+        }
+    }
+
+
+    // drop the top, refill from memory only when something is left
+    void drop(i64 depth)
+    {
+        if(depth >= 2)
+        {
+            refill();
+        }
+    }
+
+
+    void jump(u8 opcode,i64 target)
+    {
+        if(opcode == 0xe9)
+        {
+            emit({0xe9});
+        }
+        else
+        {
+            emit({0x0f,opcode});
+        }
+
+        this->branches.push_back({(i64)this->buffer.size(),target});
+        emit_u32(0);
+    }
+
+
+    // a conditional exit to the interpreter with the state of instruction ip
+    void exit_if(u8 opcode,i64 ip,i64 depth)
+    {
+        emit({0x0f,opcode});
+        add_cold(ip,depth,this->buffer.size());
+        emit_u32(0);
+    }
+
+
+    void add_cold(i64 ip,i64 depth,i64 patch)
+    {
+        for(ColdExit &exit : this->cold)
+        {
+            if(exit.ip == ip and exit.depth == depth)
+            {
+                exit.patches.push_back(patch);
+                return;
+            }
+        }
+
+        this->cold.push_back(ColdExit{ip,depth,{patch}});
+    }
+
+
+    // writes the top back, stores the ip and leaves through the shared epilogue
+    void side_exit(i64 ip,i64 depth)
+    {
+        push_slot(depth);
+        emit({0x49,0xc7,0x47,MAKEDA_JIT_OFFSET(ip)});
+        emit_u32((u32)ip);
+        emit({0xe9});
+        emit_u32((u32)(this->exit_offset - ((i64)this->buffer.size() + 4)));
+    }
+
+
+    void prologue()
+    {
+        emit({0x53, 0x55, 0x41,0x54, 0x41,0x55, 0x41,0x56, 0x41,0x57});     // push rbx rbp r12-r15
+        emit({0x49,0x89,0xff});                                             // mov r15,rdi
+        emit({0x49,0x8b,0x5f,MAKEDA_JIT_OFFSET(rbx)});
+        emit({0x49,0x8b,0x47,MAKEDA_JIT_OFFSET(rax)});
+        emit({0x4d,0x8b,0x67,MAKEDA_JIT_OFFSET(memory)});
+        emit({0x4d,0x8b,0x6f,MAKEDA_JIT_OFFSET(frame)});
+        emit({0x4d,0x8b,0x77,MAKEDA_JIT_OFFSET(fp)});
+        emit({0x41,0xff,0x67,MAKEDA_JIT_OFFSET(target)});                   // jmp [r15+target]
+
+        // rbx points one past the top after a side exit, sp = (rbx - stack) / 8
+        this->exit_offset = this->buffer.size();
+        emit({0x49,0x2b,0x5f,MAKEDA_JIT_OFFSET(stack)});
+        emit({0x48,0xc1,0xfb,0x03});
+        emit({0x49,0x89,0x5f,MAKEDA_JIT_OFFSET(sp)});
+        emit({0x41,0x5f, 0x41,0x5e, 0x41,0x5d, 0x41,0x5c, 0x5d, 0x5b, 0xc3});
+    }
+
+
+    /**
+     * Emits the template of one instruction, false when the type has none
+     * and the instruction has to leave for the interpreter.
+     */
+
+    bool compile_instruction(i64 ip,i64 depth)
+    {
+        InstructionType type = this->bytecode->get_type(ip);
+        i64 operand = this->bytecode->get_operand(ip);
+        i64 immediate = this->bytecode->get_immediate(ip);
+        i64 local = operand * (i64)sizeof(i64);
+
+        struct Binary
+        {
+            InstructionType type;
+            std::initializer_list<u8> bytes;
+        };
+
+        static const Binary binaries[] =
+        {
+            {InstructionType::ADD,  {0x48,0x01,0xc8}},          // add rax,rcx
+            {InstructionType::SUB,  {0x48,0x29,0xc8}},          // sub rax,rcx
+            {InstructionType::MUL,  {0x48,0x0f,0xaf,0xc1}},     // imul rax,rcx
+            {InstructionType::AND,  {0x48,0x21,0xc8}},
+            {InstructionType::OR,   {0x48,0x09,0xc8}},
+            {InstructionType::XOR,  {0x48,0x31,0xc8}},
+            {InstructionType::SHL,  {0x48,0xd3,0xe0}},          // shl rax,cl
+            {InstructionType::SHR,  {0x48,0xd3,0xf8}},          // sar rax,cl
+            {InstructionType::SHRU, {0x48,0xd3,0xe8}},          // shr rax,cl
+        };
+
+        // setcc for the compares, cmp rax,rcx puts the second operand first
+        static const std::pair<InstructionType,u8> compares[] =
+        {
+            {InstructionType::EQ,  0x94},
+            {InstructionType::NE,  0x95},
+            {InstructionType::L,   0x9c},
+            {InstructionType::LE,  0x9e},
+            {InstructionType::G,   0x9f},
+            {InstructionType::GE,  0x9d},
+            {InstructionType::LU,  0x92},
+            {InstructionType::LEU, 0x96},
+            {InstructionType::GU,  0x97},
+            {InstructionType::GEU, 0x93},
+        };
+
+        for(const Binary &binary : binaries)
+        {
+            if(binary.type == type)
+            {
+                pop_second();
+                emit(binary.bytes);
+                return true;
+            }
+        }
+
+        for(const auto &compare : compares)
+        {
+            if(compare.first == type)
+            {
+                pop_second();
+                emit({0x48,0x39,0xc8});
+                set_flag(compare.second);
+                return true;
+            }
+        }
+
+        switch(type)
+        {
+            case InstructionType::PUSH:
+            {
+                push_slot(depth);
+                emit({0x48,0xb8});                              // mov rax,imm64
+                emit_u64(operand);
+                return true;
+            }
+            case InstructionType::POP:
+            {
+                drop(depth);
+                return true;
+            }
+            case InstructionType::DUP:
+            {
+                spill();
+                return true;
+            }
+            case InstructionType::DIV:
+            case InstructionType::MOD:
+            case InstructionType::DIVU:
+            case InstructionType::MODU:
+            {
+                // a zero divisor traps in the interpreter, and so can -1 when it is signed
+                emit({0x48,0x85,0xc0});                         // test rax,rax
+                exit_if(0x84,ip,depth);
+
+                if(type == InstructionType::DIV or type == InstructionType::MOD)
+                {
+                    emit({0x48,0x83,0xf8,0xff});                // cmp rax,-1
+                    exit_if(0x84,ip,depth);
+                }
+
+                pop_second();
+
+                if(type == InstructionType::DIV or type == InstructionType::MOD)
+                {
+                    emit({0x48,0x99, 0x48,0xf7,0xf9});          // cqo; idiv rcx
+                }
+                else
+                {
+                    emit({0x31,0xd2, 0x48,0xf7,0xf1});          // xor edx,edx; div rcx
+                }
+
+                if(type == InstructionType::MOD or type == InstructionType::MODU)
+                {
+                    emit({0x48,0x89,0xd0});                     // mov rax,rdx
+                }
+                return true;
+            }
+            case InstructionType::NEG:      emit({0x48,0xf7,0xd8}); return true;
+            case InstructionType::NOT:      emit({0x48,0xf7,0xd0}); return true;
+            case InstructionType::SEXT32:   emit({0x48,0x63,0xc0}); return true;      // movsxd rax,eax
+            case InstructionType::ZEXT32:   emit({0x89,0xc0}); return true;           // mov eax,eax
+            case InstructionType::JMP:
+            {
+                jump(0xe9,operand);
+                return true;
+            }
+            case InstructionType::JT:
+            case InstructionType::JF:
+            {
+                emit({0x48,0x85,0xc0});
+                jump(type == InstructionType::JT ? 0x85 : 0x84,operand);
+                return true;
+            }
+            case InstructionType::JZ:
+            case InstructionType::JNZ:
+            {
+                // lea and mov keep the flags of the test for the jump
+                emit({0x48,0x85,0xc0});
+                drop(depth);
+                jump(type == InstructionType::JNZ ? 0x85 : 0x84,operand);
+                return true;
+            }
+            case InstructionType::PUSH_ADD:
+            case InstructionType::PUSH_SUB:
+            case InstructionType::PUSH_MUL:
+            {
+                load_immediate();
+                emit_u64(operand);
+                emit(type == InstructionType::PUSH_ADD ? std::initializer_list<u8>{0x48,0x01,0xc8} :
+                     type == InstructionType::PUSH_SUB ? std::initializer_list<u8>{0x48,0x29,0xc8} :
+                                                         std::initializer_list<u8>{0x48,0x0f,0xaf,0xc1});
+                return true;
+            }
+            case InstructionType::PUSH_L_JF:
+            case InstructionType::PUSH_G_JF:
+            case InstructionType::PUSH_EQ_JT:
+            case InstructionType::DUP_PUSH_L_JF:
+            case InstructionType::DUP_PUSH_G_JF:
+            case InstructionType::DUP_PUSH_EQ_JT:
+            {
+                if(type == InstructionType::DUP_PUSH_L_JF or type == InstructionType::DUP_PUSH_G_JF or
+                   type == InstructionType::DUP_PUSH_EQ_JT)
+                {
+                    spill();
+                }
+
+                load_immediate();
+                emit_u64(immediate);
+                emit({0x48,0x39,0xc8});                         // cmp rax,rcx
+
+                // setcc and movzx leave the flags alone
+                if(type == InstructionType::PUSH_L_JF or type == InstructionType::DUP_PUSH_L_JF)
+                {
+                    set_flag(0x9c);
+                    jump(0x8d,operand);                         // jge
+                }
+                else if(type == InstructionType::PUSH_G_JF or type == InstructionType::DUP_PUSH_G_JF)
+                {
+                    set_flag(0x9f);
+                    jump(0x8e,operand);                         // jle
+                }
+                else
+                {
+                    set_flag(0x94);
+                    jump(0x84,operand);                         // je
+                }
+                return true;
+            }
+            case InstructionType::LOAD_LOCAL:
+            {
+                push_slot(depth);
+                emit({0x49,0x8b,0x85});                         // mov rax,[r13+disp32]
+                emit_u32((u32)local);
+                return true;
+            }
+            case InstructionType::STORE_LOCAL:
+            {
+                emit({0x49,0x89,0x85});                         // mov [r13+disp32],rax
+                emit_u32((u32)local);
+                drop(depth);
+                return true;
+            }
+            case InstructionType::ADDR_LOCAL:
+            {
+                push_slot(depth);
+                emit({0x49,0x8d,0x86});                         // lea rax,[r14+disp32]
+                emit_u32((u32)local);
+                return true;
+            }
+            case InstructionType::ENTER:
+            {
+                emit({0x49,0x8d,0x8e});                         // lea rcx,[r14+disp32]
+                emit_u32((u32)local);
+                emit({0x48,0x81,0xf9});                         // cmp rcx,imm32
+                emit_u32((u32)this->memory_size);
+                exit_if(0x8f,ip,depth);
+                emit({0x49,0x89,0x4f,MAKEDA_JIT_OFFSET(top)});
+                return true;
+            }
+            case InstructionType::LOAD:
+            {
+                // null, out of range and unaligned addresses trap in the interpreter
+                emit({0x48,0x83,0xf8,0x08});                    // cmp rax,8
+                exit_if(0x8c,ip,depth);
+                emit({0x48,0x3d});                              // cmp rax,imm32
+                emit_u32((u32)(this->memory_size - 8));
+                exit_if(0x8f,ip,depth);
+                emit({0xa8,0x07});                              // test al,7
+                exit_if(0x85,ip,depth);
+                emit({0x49,0x8b,0x04,0x04});                    // mov rax,[r12+rax]
+                return true;
+            }
+            case InstructionType::STORE:
+            {
+                emit({0x48,0x8b,0x4b,0xf8});                    // mov rcx,[rbx-8]
+                emit({0x48,0x83,0xf9,0x08});
+                exit_if(0x8c,ip,depth);
+                emit({0x48,0x81,0xf9});
+                emit_u32((u32)(this->memory_size - 8));
+                exit_if(0x8f,ip,depth);
+                emit({0xf6,0xc1,0x07});                         // test cl,7
+                exit_if(0x85,ip,depth);
+                emit({0x49,0x89,0x04,0x0c});                    // mov [r12+rcx],rax
+
+                if(depth >= 3)
+                {
+                    emit({0x48,0x8d,0x5b,0xf0, 0x48,0x8b,0x03});
+                }
+                else
+                {
+                    emit({0x48,0x8d,0x5b,0xf8});
+                }
+                return true;
+            }
+            default:
+            {
+                return false;
+            }
+        }
+    }
+
+
+    /**
+     * A jump to the end of the program halts, it goes to a cold exit with
+     * the depth the jump leaves behind.
+     */
+
+    void patch_branches()
+    {
+        i64 size = this->bytecode->instruction_count;
+
+        for(auto &branch : this->branches)
+        {
+            if(branch.second >= size)
+            {
+                continue;
+            }
+
+            patch_u32(branch.first,(u32)(this->offsets[branch.second] - (branch.first + 4)));
+        }
+    }
+
+
+    void compile()
+    {
+        i64 size = this->bytecode->instruction_count;
+        this->offsets.assign(size + 1,0);
+
+        prologue();
+
+        for(i64 ip = 0; ip < size; ip++)
+        {
+            this->offsets[ip] = this->buffer.size();
+            i64 depth = this->verifier->depth[ip];
+            u64 first_branch = this->branches.size();
+
+            if(depth < 0)
+            {
+                // never reached, the interpreter reports it if it ever is
+                side_exit(ip,0);
+                continue;
+            }
+
+            if(compile_instruction(ip,depth))
+            {
+                this->compiled_count++;
+            }
+            else
+            {
+                side_exit(ip,depth);
+                this->exit_count++;
+                continue;
+            }
+
+            i64 pops = 0;
+            i64 pushes = 0;
+            this->verifier->get_effect(ip,&pops,&pushes);
+            i64 next = depth - pops + pushes;
+
+            for(u64 i = first_branch; i < this->branches.size(); i++)
+            {
+                if(this->branches[i].second >= size)
+                {
+                    add_cold(size,next,this->branches[i].first);
+                }
+            }
+
+            // falling off the end halts as well
+            if(ip == size - 1 and type_falls_through(this->bytecode->get_type(ip)))
+            {
+                side_exit(size,next);
+            }
+        }
+
+        this->offsets[size] = this->buffer.size();
+
+        for(ColdExit &exit : this->cold)
+        {
+            i64 at = this->buffer.size();
+            side_exit(exit.ip,exit.depth);
+
+            for(i64 patch : exit.patches)
+            {
+                patch_u32(patch,(u32)(at - (patch + 4)));
+            }
+        }
+
+        patch_branches();
+
+        u64 page = sysconf(_SC_PAGESIZE);
+        this->code_size = (this->buffer.size() + page - 1) / page * page;
+
+        void *address = mmap(NULL,this->code_size,PROT_READ | PROT_WRITE,MAP_PRIVATE | MAP_ANONYMOUS,-1,0);
+        if(address == MAP_FAILED)
+        {
+            this->code = nullptr;
+            return;
+        }
+
+        this->code = (u8 *)address;
+        memcpy(this->code,this->buffer.data(),this->buffer.size());
+
+        if(mprotect(this->code,this->code_size,PROT_READ | PROT_EXEC) != 0)
+        {
+            munmap(this->code,this->code_size);
+            this->code = nullptr;
+            return;
+        }
+
+        this->compiled = true;
+    }
+
+
+    static bool type_falls_through(InstructionType type)
+    {
+        return type != InstructionType::JMP and type != InstructionType::RET;
+    }
+
+};
+
+
+#endif
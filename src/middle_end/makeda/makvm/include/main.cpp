@@ -4,15 +4,90 @@
 
 int main(int argc,char **argv)
 {
-    std::string file_name(argv[1]);
-
-    FileToString fs(file_name);
-	std::string file_source = fs.read();
-
-    //std::string file_source = "push 50\npush 10\npush 10\nprint\nadd\nprint\nmul\nprint\n";
-    
-    Lexer lexer(file_name,file_source);
-    Codegen codegen(file_name,lexer.scan_tokens());
-    Makeda makeda(64);
-    
-}
\ No newline at end of file
+    std::string file_name;
+    std::string output = "test.m";
+    i64 stack_size = 64;
+    bool verify = true;
+    Dispatch dispatch = Dispatch::THREADED;
+    std::string profile_name;
+
+    for(int i = 1; i < argc; i++)
+    {
+        std::string arg(argv[i]);
+
+        if(arg == "--stack" and i + 1 < argc)
+        {
+            stack_size = std::stol(argv[++i]);
+        }
+        else if(arg == "--no-verify")
+        {
+            verify = false;
+        }
+        else if(arg == "--jit")
+        {
+            dispatch = Dispatch::JIT;
+        }
+        else if(arg == "--profile" and i + 1 < argc)
+        {
+            profile_name = argv[++i];
+        }
+        else if(arg == "-o" and i + 1 < argc)
+        {
+            output = argv[++i];
+        }
+        else
+        {
+            file_name = arg;
+        }
+    }
+
+    if(file_name.empty() or stack_size <= 0)
+    {
+        DEBUG_PANIC("usage : makvm [--stack slots] [--no-verify] [--jit] [--profile prefix] [-o out.m] file.masm|file.m");
+    }
+
+    // an assembled file is mapped and run as is
+    bool is_bytecode = file_name.size() > 2 and file_name.compare(file_name.size() - 2,2,".m") == 0;
+
+    if(not is_bytecode)
+    {
+        FileToString fs(file_name);
+        std::string file_source = fs.read();
+
+        //std::string file_source = "push 50\npush 10\npush 10\nprint\nadd\nprint\nmul\nprint\n";
+
+        Lexer lexer(file_name,file_source);
+        Codegen codegen(file_name,lexer.scan_tokens());
+
+        BytecodeWriter writer(&codegen.program);
+        if(not writer.write(output))
+        {
+            DEBUG_PANIC("makasm : cannot write " + output);
+        }
+
+        file_name = output;
+    }
+
+    Profile profile;
+    Makeda makeda(stack_size,file_name,verify,dispatch,profile_name.empty() ? nullptr : &profile);
+
+    // written for trapped runs too, that is when the profile helps most
+    if(not profile_name.empty() and makeda.trap != Trap::INVALID_PROGRAM)
+    {
+        profile.print_stats();
+        if(not profile.write(profile_name))
+        {
+            DEBUG_PANIC("makeda : cannot write the profile " + profile_name);
+        }
+    }
+
+    if(makeda.trap == Trap::INVALID_PROGRAM)
+    {
+        DEBUG_PANIC("makeda : rejected, " + makeda.error);
+    }
+    else if(makeda.trap != Trap::OK)
+    {
+        DEBUG_PANIC("makeda : trap " + std::to_string((int)makeda.trap));
+    }
+
+}
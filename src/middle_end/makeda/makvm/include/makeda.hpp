@@ -1,18 +1,146 @@
 #ifndef C4_MAKEDA_H
 #define C4_MAKEDA_H
 
+#include <signal.h>
+#include <setjmp.h>
 #include "../../include/isa.hpp"
+#include "../../include/bytecode.hpp"
+#include "verifier.hpp"
+#include "jit.hpp"
+#include "profile.hpp"
+
+#if defined(__GNUC__)
+#define MAKEDA_THREADED 1
+#else
+#define MAKEDA_THREADED 0
+#endif
+
+
+enum class Dispatch
+{
+    SWITCH,
+    THREADED,
+    JIT,
+};
+
+
+#define MAKEDA_MEMORY_SIZE  (1 << 20)       // bytes for globals and frames
+#define MAKEDA_CALL_DEPTH   (1 << 16)
+
+
+/**
+ * A pre-decoded instruction for the threaded interpreter, the opcode
+ * is replaced by the address of its handler inside run_threaded.
+ */
+
+class ThreadedInstruction
+{
+public:
+    const void *handler;
+    i64 operand;
+    i64 immediate;
+};
+
+
+/**
+ * Saved by CALL and restored by RET, fp and top are byte addresses of
+ * the caller's frame in vm memory.
+ */
+
+class CallFrame
+{
+public:
+    i64 ip;
+    i64 fp;
+    i64 top;
+};
+
+
+/**
+ * Faults on the stack guard pages are turned back into traps, the handler
+ * unwinds to the run that owns the faulting stack.
+ */
+
+static Stack *makeda_fault_stack = nullptr;
+static void *makeda_fault_address = nullptr;
+static sigjmp_buf makeda_fault_jump;
+
+static void makeda_fault_handler(int,siginfo_t *info,void *)
+{
+    if(makeda_fault_stack != nullptr and makeda_fault_stack->is_guard(info->si_addr))
+    {
+        makeda_fault_address = info->si_addr;
+        siglongjmp(makeda_fault_jump,1);
+    }
+
+    struct sigaction action = {};
+    action.sa_handler = SIG_DFL;
+    sigaction(SIGSEGV,&action,NULL);
+    raise(SIGSEGV);
+}
+
 
 class Makeda
 {
     Stack stack;
-    Program program;
+    Bytecode bytecode;
+    std::vector<u8> image;
+    std::vector<ThreadedInstruction> code;
+    std::vector<i64> memory;
+    std::vector<CallFrame> frames;
+    i64 ip = 0;
+    i64 fp = 0;
+    i64 top = 0;
 public:
+    Trap trap = Trap::OK;
+    u64 executed = 0;
+    bool verify = true;
+    bool verified = false;
+    i64 max_depth = 0;
+    std::string error;
+    Profile *profile = nullptr;
+
+    Makeda(i64 size,std::string name,bool verify = true,Dispatch dispatch = Dispatch::THREADED,Profile *profile = nullptr):stack(size)
+    {
+        this->verify = verify;
+        this->profile = profile;
+        this->memory.assign(MAKEDA_MEMORY_SIZE / sizeof(i64),0);
+
+        if(not this->bytecode.load(name))
+        {
+            this->trap = Trap::INVALID_PROGRAM;
+            this->error = this->bytecode.error;
+            return;
+        }
+
+        run(dispatch);
+    }
+
+
+    Makeda(i64 size,Program program,Dispatch dispatch,bool verify = true,Profile *profile = nullptr):stack(size)
+    {
+        this->verify = verify;
+        this->profile = profile;
+        this->memory.assign(MAKEDA_MEMORY_SIZE / sizeof(i64),0);
+
+        BytecodeWriter writer(&program);
+        this->image = std::move(writer.buffer);
+
+        if(not this->bytecode.view(this->image.data(),this->image.size()))
+        {
+            this->trap = Trap::INVALID_PROGRAM;
+            this->error = this->bytecode.error;
+            return;
+        }
+
+        run(dispatch);
+    }
+
 
-    Makeda(int size):stack(size)
+    // the value a program halts with, main's return value for lowered tac
+    i64 get_result()
     {
-        read_program_to_memory("test.m");
-        run();
+        return this->stack.stack_pointer > 0 ? this->stack.get_first() : 0;
     }
 
 
@@ -33,150 +161,966 @@ public:
 
 
 
-    void write_program_to_file(Program program)
+    /**
+     * A profile is only collected by the interpreters, the jit runs the
+     * profiled threaded loop instead. Both loops are instantiated with and
+     * without profiling so the plain dispatch does not test for it.
+     */
+
+    void run(Dispatch dispatch = Dispatch::THREADED)
     {
-        FILE *fout = fopen("test.m","w");
+        if(this->profile != nullptr)
+        {
+            this->profile->begin(&this->bytecode);
+        }
 
-        if(fout == NULL)
+        if(this->verify)
         {
-            return;
+            Verifier verifier(&this->bytecode,this->stack.stack_size);
+
+            if(not verifier.verified)
+            {
+                this->trap = Trap::INVALID_PROGRAM;
+                this->error = "instruction " + std::to_string(verifier.error_ip) + " : " + verifier.error;
+                return;
+            }
+
+            this->verified = true;
+            this->max_depth = verifier.max_depth;
+
+            if(dispatch == Dispatch::JIT and MAKEDA_JIT and this->profile == nullptr)
+            {
+                run_jit(&verifier);
+                return;
+            }
+        }
+
+        // the jit needs the depths of a verified program, the threaded loop is next best
+        if(dispatch != Dispatch::SWITCH and MAKEDA_THREADED)
+        {
+            if(this->verified and this->profile == nullptr)
+            {
+                run_threaded<false,false>();
+            }
+            else if(this->verified)
+            {
+                run_threaded<false,true>();
+            }
+            else if(this->profile == nullptr)
+            {
+                run_threaded<true,false>();
+            }
+            else
+            {
+                run_threaded<true,true>();
+            }
+        }
+        else if(this->profile == nullptr)
+        {
+            run_switch<false>();
+        }
+        else
+        {
+            run_switch<true>();
+        }
+    }
+
+
+    template <bool profiled>
+    void run_switch()
+    {
+        Trap trap = Trap::OK;
+        i64 size = this->bytecode.instruction_count;
+
+        for (this->ip = this->bytecode.header->entry; this->ip >= 0 and this->ip < size and trap == Trap::OK; this->executed++)
+        {
+            if(profiled)
+            {
+                this->profile->step(this->ip);
+            }
+
+            trap = step();
         }
 
-        for (Instruction inst : program.instructions)
+        if(trap != Trap::OK)
         {
-            fwrite(&inst,1,sizeof(Instruction),fout);
+            this->executed--;
         }
 
-        fclose(fout);
+        this->trap = trap;
     }
 
 
+    // runs the instruction at ip through the switch handlers
+    Trap step()
+    {
+        InstructionType type = this->bytecode.get_type(this->ip);
+        i64 operand = this->bytecode.get_operand(this->ip);
 
-    void read_program_to_memory(std::string name)
+        switch(type)
+        {
+            case InstructionType::PUSH:
+            {
+                return push(operand);
+            }
+            case InstructionType::POP:
+            {
+                return pop();
+            }
+            case InstructionType::DUP:
+            {
+                return dup();
+            }
+            case InstructionType::ADD:
+            {
+                return add();
+            }
+            case InstructionType::SUB:
+            {
+                return sub();
+            }
+            case InstructionType::MUL:
+            {
+                return mul();
+            }
+            case InstructionType::DIV:
+            {
+                return div();
+            }
+            case InstructionType::MOD:
+            {
+                return mod();
+            }
+            case InstructionType::PRINT:
+            {
+                return print();
+            }
+            case InstructionType::JMP:
+            {
+                return jmp(operand);
+            }
+            case InstructionType::L:
+            {
+                return less();
+            }
+            case InstructionType::LE:
+            {
+                return less_equal();
+            }
+            case InstructionType::G:
+            {
+                return greater();
+            }
+            case InstructionType::GE:
+            {
+                return greater_equal();
+            }
+            case InstructionType::EQ:
+            {
+                return equal();
+            }
+            case InstructionType::NE:
+            {
+                return not_equal();
+            }
+            case InstructionType::JT:
+            {
+                return jmp_true(operand);
+            }
+            case InstructionType::JF:
+            {
+                return jmp_false(operand);
+            }
+            default:
+            {
+                return (u32)type >= (u32)InstructionType::NEG ? extended(type) : fused(type);
+            }
+        }
+    }
+
+
+    void install_fault_handler()
     {
-        FILE *fin = fopen(name.c_str(),"r");
-        if(fin == NULL)
+        static bool installed = false;
+        if(not installed)
         {
+            struct sigaction action = {};
+            action.sa_sigaction = makeda_fault_handler;
+            action.sa_flags = SA_SIGINFO;
+            sigemptyset(&action.sa_mask);
+            sigaction(SIGSEGV,&action,NULL);
+            installed = true;
+        }
+    }
+
+
+    // a guard page was hit, the counters of the run are lost
+    void fault()
+    {
+        makeda_fault_stack = nullptr;
+        this->frames.clear();
+        this->trap = this->stack.is_overflow(makeda_fault_address) ? Trap::OVERFLOW : Trap::UNDERFLOW;
+    }
+
+
+    /**
+     * Runs a verified program in jitted code. The compiled code returns
+     * at every instruction it has no template for, and before any that
+     * would trap, the interpreter steps over that one instruction and the
+     * code is entered again behind it. Only those steps are counted in
+     * executed. Calls, returns and print always go through the
+     * interpreter, so fp only changes between two entries.
+     */
+
+    void run_jit(Verifier *verifier)
+    {
+#if MAKEDA_JIT
+        Jit jit(&this->bytecode,verifier,this->memory.size() * sizeof(i64));
+
+        if(not jit.compiled)
+        {
+            run_threaded<false,false>();
             return;
         }
 
-        i64 size = 0;
+        install_fault_handler();
 
-        fseek(fin,0,SEEK_END);
-        size = ftell(fin);
-        fseek(fin,0,SEEK_SET);
+        makeda_fault_stack = &this->stack;
+        if(sigsetjmp(makeda_fault_jump,1))
+        {
+            fault();
+            return;
+        }
 
+        i64 size = this->bytecode.instruction_count;
+        i64 *stack = this->stack.stack;
+        Trap trap = Trap::OK;
 
-        Instruction inst;
-        i64 count = size / sizeof(Instruction);
+        JitContext context = {};
+        context.stack = stack;
+        context.memory = (u8 *)this->memory.data();
 
-        for(int i = 0; i < count; i++)
+        for(this->ip = this->bytecode.header->entry; this->ip >= 0 and this->ip < size and trap == Trap::OK; )
         {
-            fread(&inst,1,sizeof(Instruction),fin);
-            this->program.add_instruction(inst);
+            i64 sp = this->stack.stack_pointer;
+            i64 depth = verifier->depth[this->ip];
+
+            // rax caches the top slot whenever the function has one
+            context.rbx = stack + sp - (depth >= 1);
+            context.rax = depth >= 1 ? stack[sp - 1] : 0;
+            context.target = jit.get_entry(this->ip);
+            context.frame = context.memory + this->fp;
+            context.fp = this->fp;
+            context.top = this->top;
+
+            jit.run(&context);
+
+            this->ip = context.ip;
+            this->top = context.top;
+            this->stack.stack_pointer = context.sp;
+
+            if(this->ip >= size)
+            {
+                break;
+            }
+
+            trap = step();
+            if(trap == Trap::OK)
+            {
+                this->executed++;
+            }
         }
 
-        fclose(fin);
-        
+        this->trap = trap;
+        makeda_fault_stack = nullptr;
+#else
+        run_threaded<false,false>();
+#endif
     }
 
-    
 
+    /**
+     * Translates the loaded program into threaded code. Every opcode is
+     * replaced by its handler address from the table and every jump target
+     * outside the program is sent to the halt handler appended at the end.
+     */
 
-    void run()
+    void decode(const void *const *handlers,const void *halt,const void *invalid)
     {
-        for (this->program.ip = 0; this->program.ip < this->program.instructions.size() ; this->program.ip)
+        i64 size = this->bytecode.instruction_count;
+
+        this->code.clear();
+        this->code.reserve(size + 1);
+
+        for(i64 ip = 0; ip < size; ip++)
         {
-            Instruction inst = program.instructions[this->program.ip];
-            switch(inst.type)
+            InstructionType type = this->bytecode.get_type(ip);
+
+            ThreadedInstruction threaded;
+            threaded.handler = (u32)type < MAKEDA_OPCODES ? handlers[(int)type] : invalid;
+            threaded.operand = this->bytecode.get_operand(ip);
+            threaded.immediate = this->bytecode.get_immediate(ip);
+
+            if(has_target(type) and (threaded.operand < 0 or threaded.operand > size))
             {
-                case InstructionType::PUSH:
-                {
-                    push(inst.operand);
-                    break;
-                }
-                case InstructionType::POP:
-                {
-                    pop();
-                    break;
-                }
-                case InstructionType::ADD:
+                threaded.operand = size;
+            }
+
+            this->code.push_back(threaded);
+        }
+
+        this->code.push_back(ThreadedInstruction{halt,0,0});
+    }
+
+
+    /**
+     * Direct threaded interpreter, each handler jumps straight to the
+     * handler of the next instruction. The stack pointer and the
+     * instruction pointer live in locals for the whole run and are
+     * written back when the program halts or traps. Underflow is only
+     * checked for programs that were not verified, overflow is caught by
+     * the guard page, after which the counters are lost.
+     */
+
+    template <bool checked,bool profiled>
+    void run_threaded()
+    {
+#if MAKEDA_THREADED
+        install_fault_handler();
+
+        makeda_fault_stack = &this->stack;
+        if(sigsetjmp(makeda_fault_jump,1))
+        {
+            fault();
+            return;
+        }
+
+        static const void *const handlers[] =
+        {
+            &&op_push,
+            &&op_pop,
+            &&op_dup,
+            &&op_add,
+            &&op_sub,
+            &&op_mul,
+            &&op_div,
+            &&op_mod,
+            &&op_jt,
+            &&op_jf,
+            &&op_jmp,
+            &&op_eq,
+            &&op_ne,
+            &&op_l,
+            &&op_le,
+            &&op_g,
+            &&op_ge,
+            &&op_print,
+            &&op_push_add,
+            &&op_push_sub,
+            &&op_push_mul,
+            &&op_push_l_jf,
+            &&op_push_g_jf,
+            &&op_push_eq_jt,
+            &&op_dup_push_l_jf,
+            &&op_dup_push_g_jf,
+            &&op_dup_push_eq_jt,
+            &&op_neg,
+            &&op_not,
+            &&op_and,
+            &&op_or,
+            &&op_xor,
+            &&op_shl,
+            &&op_shr,
+            &&op_shru,
+            &&op_divu,
+            &&op_modu,
+            &&op_lu,
+            &&op_leu,
+            &&op_gu,
+            &&op_geu,
+            &&op_sext32,
+            &&op_zext32,
+            &&op_jz,
+            &&op_jnz,
+            &&op_load_local,
+            &&op_store_local,
+            &&op_addr_local,
+            &&op_load,
+            &&op_store,
+            &&op_enter,
+            &&op_call,
+            &&op_ret,
+        };
+
+        decode(handlers,&&op_halt,&&op_invalid);
+
+        ThreadedInstruction *code = this->code.data();
+        ThreadedInstruction *ip = code + this->bytecode.header->entry;
+        i64 *stack = this->stack.stack;
+        i64 sp = this->stack.stack_pointer;
+        u8 *memory = (u8 *)this->memory.data();
+        i64 memory_size = this->memory.size() * sizeof(i64);
+        i64 fp = this->fp;
+        i64 top = this->top;
+        CallFrame *frames = this->frames.data();
+        i64 depth = this->frames.size();
+        u64 executed = 0;
+        Trap trap = Trap::OK;
+        Profile *profile = this->profile;
+
+        this->frames.resize(MAKEDA_CALL_DEPTH);
+        frames = this->frames.data();
+
+#define MAKEDA_NEXT() executed++; if(profiled) { profile->step(ip - code); } goto *ip->handler
+#define MAKEDA_TRAP(x) trap = (x); goto op_halt
+#define MAKEDA_BINARY(op) \
+        if(checked and sp < 2) { MAKEDA_TRAP(Trap::UNDERFLOW); } \
+        stack[sp - 2] = stack[sp - 2] op stack[sp - 1]; \
+        sp--; \
+        ip++; \
+        MAKEDA_NEXT()
+#define MAKEDA_DIVIDE(op) \
+        if(checked and sp < 2) { MAKEDA_TRAP(Trap::UNDERFLOW); } \
+        if(stack[sp - 1] == 0) { MAKEDA_TRAP(Trap::DIVISION_BY_ZERO); } \
+        if(is_division_overflow(stack[sp - 2],stack[sp - 1])) { MAKEDA_TRAP(Trap::DIVISION_OVERFLOW); } \
+        stack[sp - 2] = stack[sp - 2] op stack[sp - 1]; \
+        sp--; \
+        ip++; \
+        MAKEDA_NEXT()
+#define MAKEDA_IMMEDIATE(op) \
+        if(checked and sp < 1) { MAKEDA_TRAP(Trap::UNDERFLOW); } \
+        stack[sp - 1] = stack[sp - 1] op ip->operand; \
+        ip++; \
+        MAKEDA_NEXT()
+#define MAKEDA_COMPARE_JUMP(op,taken) \
+        if(checked and sp < 1) { MAKEDA_TRAP(Trap::UNDERFLOW); } \
+        stack[sp - 1] = stack[sp - 1] op ip->immediate; \
+        ip = stack[sp - 1] == taken ? code + ip->operand : ip + 1; \
+        MAKEDA_NEXT()
+#define MAKEDA_OPERATION(value) \
+        if(checked and sp < 2) { MAKEDA_TRAP(Trap::UNDERFLOW); } \
+        stack[sp - 2] = (value); \
+        sp--; \
+        ip++; \
+        MAKEDA_NEXT()
+#define MAKEDA_DIVIDE_UNSIGNED(op) \
+        if(checked and sp < 2) { MAKEDA_TRAP(Trap::UNDERFLOW); } \
+        if(stack[sp - 1] == 0) { MAKEDA_TRAP(Trap::DIVISION_BY_ZERO); } \
+        stack[sp - 2] = (i64)((u64)stack[sp - 2] op (u64)stack[sp - 1]); \
+        sp--; \
+        ip++; \
+        MAKEDA_NEXT()
+#define MAKEDA_UNARY(value) \
+        if(checked and sp < 1) { MAKEDA_TRAP(Trap::UNDERFLOW); } \
+        stack[sp - 1] = (value); \
+        ip++; \
+        MAKEDA_NEXT()
+#define MAKEDA_LOCAL (fp + (ip->operand << 3))
+#define MAKEDA_IS_ADDRESS(address) ((address) >= 8 and (address) <= memory_size - 8 and ((address) & 7) == 0)
+#define MAKEDA_DUP_COMPARE_JUMP(op,taken) \
+        if(checked and sp < 1) { MAKEDA_TRAP(Trap::UNDERFLOW); } \
+        stack[sp] = stack[sp - 1] op ip->immediate; \
+        sp++; \
+        ip = stack[sp - 1] == taken ? code + ip->operand : ip + 1; \
+        MAKEDA_NEXT()
+
+        if(profiled)
+        {
+            profile->step(ip - code);
+        }
+
+        goto *ip->handler;
+
+    op_push:
+        stack[sp++] = ip->operand;
+        ip++;
+        MAKEDA_NEXT();
+
+    op_pop:
+        if(checked and sp < 1) { MAKEDA_TRAP(Trap::UNDERFLOW); }
+        sp--;
+        ip++;
+        MAKEDA_NEXT();
+
+    op_dup:
+        if(checked and sp < 1) { MAKEDA_TRAP(Trap::UNDERFLOW); }
+        stack[sp] = stack[sp - 1];
+        sp++;
+        ip++;
+        MAKEDA_NEXT();
+
+    op_add: MAKEDA_BINARY(+);
+    op_sub: MAKEDA_BINARY(-);
+    op_mul: MAKEDA_BINARY(*);
+    op_div: MAKEDA_DIVIDE(/);
+    op_mod: MAKEDA_DIVIDE(%);
+    op_eq:  MAKEDA_BINARY(==);
+    op_ne:  MAKEDA_BINARY(!=);
+    op_l:   MAKEDA_BINARY(<);
+    op_le:  MAKEDA_BINARY(<=);
+    op_g:   MAKEDA_BINARY(>);
+    op_ge:  MAKEDA_BINARY(>=);
+
+    op_jmp:
+        ip = code + ip->operand;
+        MAKEDA_NEXT();
+
+    op_jt:
+        if(checked and sp < 1) { MAKEDA_TRAP(Trap::UNDERFLOW); }
+        ip = stack[sp - 1] ? code + ip->operand : ip + 1;
+        MAKEDA_NEXT();
+
+    op_jf:
+        if(checked and sp < 1) { MAKEDA_TRAP(Trap::UNDERFLOW); }
+        ip = stack[sp - 1] ? ip + 1 : code + ip->operand;
+        MAKEDA_NEXT();
+
+    op_print:
+        this->stack.stack_pointer = sp;
+        print();
+        ip++;
+        MAKEDA_NEXT();
+
+    op_push_add:        MAKEDA_IMMEDIATE(+);
+    op_push_sub:        MAKEDA_IMMEDIATE(-);
+    op_push_mul:        MAKEDA_IMMEDIATE(*);
+    op_push_l_jf:       MAKEDA_COMPARE_JUMP(<,0);
+    op_push_g_jf:       MAKEDA_COMPARE_JUMP(>,0);
+    op_push_eq_jt:      MAKEDA_COMPARE_JUMP(==,1);
+    op_dup_push_l_jf:   MAKEDA_DUP_COMPARE_JUMP(<,0);
+    op_dup_push_g_jf:   MAKEDA_DUP_COMPARE_JUMP(>,0);
+    op_dup_push_eq_jt:  MAKEDA_DUP_COMPARE_JUMP(==,1);
+
+    op_neg:     MAKEDA_UNARY(-stack[sp - 1]);
+    op_not:     MAKEDA_UNARY(~stack[sp - 1]);
+    op_sext32:  MAKEDA_UNARY((i64)(i32)stack[sp - 1]);
+    op_zext32:  MAKEDA_UNARY((i64)(u32)stack[sp - 1]);
+    op_and:     MAKEDA_BINARY(&);
+    op_or:      MAKEDA_BINARY(|);
+    op_xor:     MAKEDA_BINARY(^);
+    op_shl:     MAKEDA_OPERATION((i64)((u64)stack[sp - 2] << (stack[sp - 1] & 63)));
+    op_shr:     MAKEDA_OPERATION(stack[sp - 2] >> (stack[sp - 1] & 63));
+    op_shru:    MAKEDA_OPERATION((i64)((u64)stack[sp - 2] >> (stack[sp - 1] & 63)));
+    op_divu:    MAKEDA_DIVIDE_UNSIGNED(/);
+    op_modu:    MAKEDA_DIVIDE_UNSIGNED(%);
+    op_lu:      MAKEDA_OPERATION((u64)stack[sp - 2] < (u64)stack[sp - 1]);
+    op_leu:     MAKEDA_OPERATION((u64)stack[sp - 2] <= (u64)stack[sp - 1]);
+    op_gu:      MAKEDA_OPERATION((u64)stack[sp - 2] > (u64)stack[sp - 1]);
+    op_geu:     MAKEDA_OPERATION((u64)stack[sp - 2] >= (u64)stack[sp - 1]);
+
+    op_jz:
+        if(checked and sp < 1) { MAKEDA_TRAP(Trap::UNDERFLOW); }
+        sp--;
+        ip = stack[sp] ? ip + 1 : code + ip->operand;
+        MAKEDA_NEXT();
+
+    op_jnz:
+        if(checked and sp < 1) { MAKEDA_TRAP(Trap::UNDERFLOW); }
+        sp--;
+        ip = stack[sp] ? code + ip->operand : ip + 1;
+        MAKEDA_NEXT();
+
+    op_load_local:
+        if(checked and MAKEDA_LOCAL >= top) { MAKEDA_TRAP(Trap::BAD_ADDRESS); }
+        stack[sp++] = *(i64 *)(memory + MAKEDA_LOCAL);
+        ip++;
+        MAKEDA_NEXT();
+
+    op_store_local:
+        if(checked and sp < 1) { MAKEDA_TRAP(Trap::UNDERFLOW); }
+        if(checked and MAKEDA_LOCAL >= top) { MAKEDA_TRAP(Trap::BAD_ADDRESS); }
+        *(i64 *)(memory + MAKEDA_LOCAL) = stack[--sp];
+        ip++;
+        MAKEDA_NEXT();
+
+    op_addr_local:
+        stack[sp++] = MAKEDA_LOCAL;
+        ip++;
+        MAKEDA_NEXT();
+
+    op_load:
+        if(checked and sp < 1) { MAKEDA_TRAP(Trap::UNDERFLOW); }
+        if(not MAKEDA_IS_ADDRESS(stack[sp - 1])) { MAKEDA_TRAP(Trap::BAD_ADDRESS); }
+        stack[sp - 1] = *(i64 *)(memory + stack[sp - 1]);
+        ip++;
+        MAKEDA_NEXT();
+
+    op_store:
+        if(checked and sp < 2) { MAKEDA_TRAP(Trap::UNDERFLOW); }
+        if(not MAKEDA_IS_ADDRESS(stack[sp - 2])) { MAKEDA_TRAP(Trap::BAD_ADDRESS); }
+        *(i64 *)(memory + stack[sp - 2]) = stack[sp - 1];
+        sp -= 2;
+        ip++;
+        MAKEDA_NEXT();
+
+    op_enter:
+        top = MAKEDA_LOCAL;
+        if(top > memory_size) { MAKEDA_TRAP(Trap::OVERFLOW); }
+        ip++;
+        MAKEDA_NEXT();
+
+    op_call:
+        if(checked and sp < ip->immediate) { MAKEDA_TRAP(Trap::UNDERFLOW); }
+        if(depth == MAKEDA_CALL_DEPTH or top + (ip->immediate << 3) > memory_size) { MAKEDA_TRAP(Trap::OVERFLOW); }
+        frames[depth++] = CallFrame{ip + 1 - code,fp,top};
+        fp = top;
+        top = fp + (ip->immediate << 3);
+        sp -= ip->immediate;
+        memcpy(memory + fp,stack + sp,ip->immediate << 3);
+        ip = code + ip->operand;
+        MAKEDA_NEXT();
+
+    op_ret:
+        if(checked and sp < 1) { MAKEDA_TRAP(Trap::UNDERFLOW); }
+        if(depth == 0) { executed++; goto op_halt; }
+        depth--;
+        ip = code + frames[depth].ip;
+        fp = frames[depth].fp;
+        top = frames[depth].top;
+        MAKEDA_NEXT();
+
+    op_invalid:
+        MAKEDA_TRAP(Trap::INVALID_PROGRAM);
+
+#undef MAKEDA_IS_ADDRESS
+#undef MAKEDA_LOCAL
+#undef MAKEDA_UNARY
+#undef MAKEDA_DIVIDE_UNSIGNED
+#undef MAKEDA_OPERATION
+#undef MAKEDA_DUP_COMPARE_JUMP
+#undef MAKEDA_COMPARE_JUMP
+#undef MAKEDA_IMMEDIATE
+#undef MAKEDA_DIVIDE
+#undef MAKEDA_BINARY
+#undef MAKEDA_TRAP
+#undef MAKEDA_NEXT
+
+    op_halt:
+        this->stack.stack_pointer = sp;
+        this->ip = ip - code;
+        this->fp = fp;
+        this->top = top;
+        this->frames.resize(depth);
+        this->executed += executed;
+        this->trap = trap;
+        makeda_fault_stack = nullptr;
+#else
+        run_switch<profiled>();
+#endif
+    }
+
+
+    /**
+     * Superinstructions in the switch interpreter, the fused sequence is
+     * replayed through the plain handlers and the jump is taken relative
+     * to the fused instruction.
+     */
+
+    Trap fused(InstructionType type)
+    {
+        i64 ip = this->ip;
+        i64 operand = this->bytecode.get_operand(ip);
+        i64 immediate = this->bytecode.get_immediate(ip);
+        Trap trap = Trap::OK;
+
+        if((u32)type < (u32)InstructionType::PUSH_ADD or (u32)type > (u32)InstructionType::DUP_PUSH_EQ_JT)
+        {
+            return Trap::INVALID_PROGRAM;
+        }
+
+        switch(type)
+        {
+            case InstructionType::PUSH_ADD:
+            case InstructionType::PUSH_SUB:
+            case InstructionType::PUSH_MUL:
+            {
+                trap = push(operand);
+                if(trap == Trap::OK)
                 {
-                    add();
-                    break;
+                    trap = type == InstructionType::PUSH_ADD ? add() : type == InstructionType::PUSH_SUB ? sub() : mul();
                 }
-                case InstructionType::SUB:
+                this->ip = ip + 1;
+                return trap;
+            }
+            case InstructionType::DUP_PUSH_L_JF:
+            case InstructionType::DUP_PUSH_G_JF:
+            case InstructionType::DUP_PUSH_EQ_JT:
+            {
+                trap = dup();
+                break;
+            }
+            default:
+            {
+                break;
+            }
+        }
+
+        if(trap == Trap::OK)
+        {
+            trap = push(immediate);
+        }
+
+        if(trap == Trap::OK)
+        {
+            switch(type)
+            {
+                case InstructionType::PUSH_L_JF:
+                case InstructionType::DUP_PUSH_L_JF:
                 {
-                    sub();
+                    trap = less();
                     break;
                 }
-                case InstructionType::MUL:
+                case InstructionType::PUSH_G_JF:
+                case InstructionType::DUP_PUSH_G_JF:
                 {
-                    mul();
+                    trap = greater();
                     break;
                 }
-                case InstructionType::DIV:
+                default:
                 {
-                    div();
+                    trap = equal();
                     break;
                 }
-                case InstructionType::PRINT:
+            }
+        }
+
+        if(trap != Trap::OK)
+        {
+            this->ip = ip;
+            return trap;
+        }
+
+        bool taken = this->stack.get_first() != 0;
+        if(type == InstructionType::PUSH_L_JF or type == InstructionType::PUSH_G_JF or
+           type == InstructionType::DUP_PUSH_L_JF or type == InstructionType::DUP_PUSH_G_JF)
+        {
+            taken = not taken;
+        }
+
+        this->ip = taken ? operand : ip + 1;
+        return Trap::OK;
+    }
+
+
+    /**
+     * The instructions added for lowered tac in the switch interpreter,
+     * every memory access is bounds checked whether verified or not.
+     */
+
+    Trap extended(InstructionType type)
+    {
+        i64 operand = this->bytecode.get_operand(this->ip);
+        i64 immediate = this->bytecode.get_immediate(this->ip);
+        i64 local = this->fp + operand * (i64)sizeof(i64);
+        i64 pops = 0;
+
+        switch(type)
+        {
+            case InstructionType::NEG:
+            case InstructionType::NOT:
+            case InstructionType::SEXT32:
+            case InstructionType::ZEXT32:
+            case InstructionType::JZ:
+            case InstructionType::JNZ:
+            case InstructionType::STORE_LOCAL:
+            case InstructionType::LOAD:
+            case InstructionType::RET:
+            {
+                pops = 1;
+                break;
+            }
+            case InstructionType::LOAD_LOCAL:
+            case InstructionType::ADDR_LOCAL:
+            case InstructionType::ENTER:
+            {
+                break;
+            }
+            case InstructionType::CALL:
+            {
+                pops = immediate;
+                break;
+            }
+            default:
+            {
+                if((u32)type >= MAKEDA_OPCODES)
                 {
-                    print();
-                    break;
+                    return Trap::INVALID_PROGRAM;
                 }
-                case InstructionType::JMP:
+
+                pops = 2;
+                break;
+            }
+        }
+
+        if(check_underflow(pops))
+        {
+            return Trap::UNDERFLOW;
+        }
+
+        i64 *stack = this->stack.stack;
+        i64 &sp = this->stack.stack_pointer;
+        i64 a = pops >= 2 ? this->stack.get_second() : 0;
+        i64 b = pops >= 1 ? this->stack.get_first() : 0;
+
+        switch(type)
+        {
+            case InstructionType::NEG:      stack[sp - 1] = -b; break;
+            case InstructionType::NOT:      stack[sp - 1] = ~b; break;
+            case InstructionType::SEXT32:   stack[sp - 1] = (i64)(i32)b; break;
+            case InstructionType::ZEXT32:   stack[sp - 1] = (i64)(u32)b; break;
+            case InstructionType::AND:      stack[sp - 2] = a & b; break;
+            case InstructionType::OR:       stack[sp - 2] = a | b; break;
+            case InstructionType::XOR:      stack[sp - 2] = a ^ b; break;
+            case InstructionType::SHL:      stack[sp - 2] = (i64)((u64)a << (b & 63)); break;
+            case InstructionType::SHR:      stack[sp - 2] = a >> (b & 63); break;
+            case InstructionType::SHRU:     stack[sp - 2] = (i64)((u64)a >> (b & 63)); break;
+            case InstructionType::LU:       stack[sp - 2] = (u64)a < (u64)b; break;
+            case InstructionType::LEU:      stack[sp - 2] = (u64)a <= (u64)b; break;
+            case InstructionType::GU:       stack[sp - 2] = (u64)a > (u64)b; break;
+            case InstructionType::GEU:      stack[sp - 2] = (u64)a >= (u64)b; break;
+            case InstructionType::DIVU:
+            case InstructionType::MODU:
+            {
+                if(check_is_zero(b))
                 {
-                    jmp(inst.operand);
-                    break;
+                    return Trap::DIVISION_BY_ZERO;
                 }
-                case InstructionType::L:
+
+                stack[sp - 2] = type == InstructionType::DIVU ? (i64)((u64)a / (u64)b) : (i64)((u64)a % (u64)b);
+                break;
+            }
+            case InstructionType::JZ:
+            case InstructionType::JNZ:
+            {
+                sp--;
+                this->ip = (b != 0) == (type == InstructionType::JNZ) ? operand : this->ip + 1;
+                return Trap::OK;
+            }
+            case InstructionType::LOAD_LOCAL:
+            case InstructionType::ADDR_LOCAL:
+            {
+                if(check_overflow())
                 {
-                    less();
-                    break;
+                    return Trap::OVERFLOW;
                 }
-                case InstructionType::LE:
+
+                if(type == InstructionType::LOAD_LOCAL and local >= this->top)
                 {
-                    less_equal();
-                    break;
+                    return Trap::BAD_ADDRESS;
                 }
-                case InstructionType::G:
+
+                stack[sp++] = type == InstructionType::LOAD_LOCAL ? *get_address(local) : local;
+                break;
+            }
+            case InstructionType::STORE_LOCAL:
+            {
+                if(local >= this->top)
                 {
-                    greater();
-                    break;
+                    return Trap::BAD_ADDRESS;
                 }
-                case InstructionType::GE:
+
+                *get_address(local) = b;
+                sp--;
+                break;
+            }
+            case InstructionType::LOAD:
+            {
+                if(not is_address(b))
                 {
-                    greater_equal();
-                    break;
+                    return Trap::BAD_ADDRESS;
                 }
-                case InstructionType::EQ:
+
+                stack[sp - 1] = *get_address(b);
+                break;
+            }
+            case InstructionType::STORE:
+            {
+                if(not is_address(a))
                 {
-                    equal();
-                    break;
+                    return Trap::BAD_ADDRESS;
                 }
-                case InstructionType::NE:
+
+                *get_address(a) = b;
+                break;
+            }
+            case InstructionType::ENTER:
+            {
+                if(local > (i64)(this->memory.size() * sizeof(i64)))
                 {
-                    not_equal();
-                    break;
+                    return Trap::OVERFLOW;
                 }
-                case InstructionType::JT:
+
+                this->top = local;
+                break;
+            }
+            case InstructionType::CALL:
+            {
+                i64 bytes = immediate * sizeof(i64);
+                if(this->frames.size() == MAKEDA_CALL_DEPTH or this->top + bytes > (i64)(this->memory.size() * sizeof(i64)))
                 {
-                    jmp_true(inst.operand);
-                    break;
+                    return Trap::OVERFLOW;
                 }
-                case InstructionType::JF:
+
+                this->frames.push_back(CallFrame{this->ip + 1,this->fp,this->top});
+                this->fp = this->top;
+                this->top = this->fp + bytes;
+                sp -= immediate;
+                memcpy(get_address(this->fp),stack + sp,bytes);
+                this->ip = operand;
+                return Trap::OK;
+            }
+            case InstructionType::RET:
+            {
+                if(this->frames.empty())
                 {
-                    jmp_false(inst.operand);
-                    break;
+                    this->ip = this->bytecode.instruction_count;
+                    return Trap::OK;
                 }
+
+                CallFrame frame = this->frames.back();
+                this->frames.pop_back();
+                this->ip = frame.ip;
+                this->fp = frame.fp;
+                this->top = frame.top;
+                return Trap::OK;
             }
+            default:
+            {
+                break;
+            }
+        }
+
+        if(type == InstructionType::STORE)
+        {
+            sp -= 2;
         }
+        else if(pops == 2)
+        {
+            sp--;
+        }
+
+        this->ip++;
+
+        return Trap::OK;
+    }
+
+
+    // the first cell is never mapped to anything, address 0 stays null
+    bool is_address(i64 address)
+    {
+        return address >= (i64)sizeof(i64) and address <= (i64)((this->memory.size() - 1) * sizeof(i64)) and address % sizeof(i64) == 0;
     }
 
-    bool check_underflow()
+
+    i64 *get_address(i64 address)
     {
-        if(this->stack.stack_pointer < 0)
+        return (i64 *)((u8 *)this->memory.data() + address);
+    }
+
+
+    bool check_underflow(i64 count)
+    {
+        if(this->stack.stack_pointer < count)
         {
             return true;
         }
@@ -211,7 +1155,7 @@ public:
 
         this->stack.push(value);
         this->stack.adjust_stack_pointer(1);
-        this->program.ip++;
+        this->ip++;
 
         return Trap::OK;
     }
@@ -219,21 +1163,21 @@ public:
 
     Trap pop()
     {
-        if(check_underflow())
+        if(check_underflow(1))
         {
             return Trap::UNDERFLOW;
         }
 
         this->stack.adjust_stack_pointer(-1);
-        this->program.ip++;
+        this->ip++;
 
         return Trap::OK;
     }
 
 
-    Trap add()
+    Trap dup()
     {
-        if(check_underflow())
+        if(check_underflow(1))
         {
             return Trap::UNDERFLOW;
         }
@@ -242,12 +1186,27 @@ public:
             return Trap::OVERFLOW;
         }
 
+        this->stack.push(this->stack.get_first());
+        this->stack.adjust_stack_pointer(1);
+        this->ip++;
+
+        return Trap::OK;
+    }
+
+
+    Trap add()
+    {
+        if(check_underflow(2))
+        {
+            return Trap::UNDERFLOW;
+        }
+
         
         i64 value = this->stack.get_second() + this->stack.get_first();
         this->stack.adjust_stack_pointer(-2);
         this->stack.push(value);
         this->stack.adjust_stack_pointer(1);
-        this->program.ip++;
+        this->ip++;
 
         return Trap::OK;
     }
@@ -256,20 +1215,16 @@ public:
 
     Trap sub()
     {
-        if(check_underflow())
+        if(check_underflow(2))
         {
             return Trap::UNDERFLOW;
         }
-        else if(check_overflow())
-        {
-            return Trap::OVERFLOW;
-        }
 
         i64 value = this->stack.get_second() - this->stack.get_first();
         this->stack.adjust_stack_pointer(-2);
         this->stack.push(value);
         this->stack.adjust_stack_pointer(1);
-        this->program.ip++;
+        this->ip++;
 
         return Trap::OK;
     }
@@ -278,20 +1233,16 @@ public:
 
     Trap mul()
     {
-        if(check_underflow())
+        if(check_underflow(2))
         {
             return Trap::UNDERFLOW;
         }
-        else if(check_overflow())
-        {
-            return Trap::OVERFLOW;
-        }
 
         i64 value = this->stack.get_second() * this->stack.get_first();
         this->stack.adjust_stack_pointer(-2);
         this->stack.push(value);
         this->stack.adjust_stack_pointer(1);
-        this->program.ip++;
+        this->ip++;
 
         return Trap::OK;
     }
@@ -300,25 +1251,25 @@ public:
 
     Trap div()
     {
-        if(check_underflow())
+        if(check_underflow(2))
         {
             return Trap::UNDERFLOW;
         }
-        else if(check_overflow())
-        {
-            return Trap::OVERFLOW;
-        }
         else if(check_is_zero(this->stack.get_first()))
         {
             return Trap::DIVISION_BY_ZERO;
         }
+        else if(is_division_overflow(this->stack.get_second(),this->stack.get_first()))
+        {
+            return Trap::DIVISION_OVERFLOW;
+        }
 
 
         i64 value = this->stack.get_second() / this->stack.get_first();
         this->stack.adjust_stack_pointer(-2);
         this->stack.push(value);
         this->stack.adjust_stack_pointer(1);
-        this->program.ip++;
+        this->ip++;
 
         return Trap::OK;
     }
@@ -326,25 +1277,25 @@ public:
 
     Trap mod()
     {
-        if(check_underflow())
+        if(check_underflow(2))
         {
             return Trap::UNDERFLOW;
         }
-        else if(check_overflow())
-        {
-            return Trap::OVERFLOW;
-        }
         else if(check_is_zero(this->stack.get_first()))
         {
             return Trap::DIVISION_BY_ZERO;
         }
+        else if(is_division_overflow(this->stack.get_second(),this->stack.get_first()))
+        {
+            return Trap::DIVISION_OVERFLOW;
+        }
 
 
         i64 value = this->stack.get_second() % this->stack.get_first();
         this->stack.adjust_stack_pointer(-2);
         this->stack.push(value);
         this->stack.adjust_stack_pointer(1);
-        this->program.ip++;
+        this->ip++;
 
         return Trap::OK;
     }
@@ -352,7 +1303,7 @@ public:
 
     Trap print()
     {
-        if(check_underflow())
+        if(check_underflow(0))
         {
             return Trap::UNDERFLOW;
         }
@@ -365,32 +1316,32 @@ public:
         }
 
 
-        this->program.ip++;
+        this->ip++;
         return Trap::OK;
     }
 
 
     Trap jmp(i64 value)
     {
-        this->program.ip = value;
+        this->ip = value;
         return Trap::OK;
     }
 
     
     Trap jmp_true(i64 value)
     {
-        if(check_underflow())
+        if(check_underflow(1))
         {
             return Trap::UNDERFLOW;
         }
         
         if(this->stack.get_first())
         {
-            this->program.ip = value;
+            this->ip = value;
             return Trap::OK;
         }
 
-        this->program.ip++;
+        this->ip++;
         return Trap::OK;
     }
 
@@ -398,39 +1349,35 @@ public:
 
     Trap jmp_false(i64 value)
     {
-        if(check_underflow())
+        if(check_underflow(1))
         {
             return Trap::UNDERFLOW;
         }
         
         if(not this->stack.get_first())
         {
-            this->program.ip = value;
+            this->ip = value;
             return Trap::OK;
         }
 
-        this->program.ip++;
+        this->ip++;
         return Trap::OK;
     }
 
 
     Trap less()
     {
-        if(check_underflow())
+        if(check_underflow(2))
         {
             return Trap::UNDERFLOW;
         }
-        else if(check_overflow())
-        {
-            return Trap::OVERFLOW;
-        }
 
         
         i64 value = this->stack.get_second() < this->stack.get_first();
         this->stack.adjust_stack_pointer(-2);
         this->stack.push(value);
         this->stack.adjust_stack_pointer(1);
-        this->program.ip++;
+        this->ip++;
 
         return Trap::OK;
     }
@@ -438,21 +1385,17 @@ public:
 
     Trap less_equal()
     {
-        if(check_underflow())
+        if(check_underflow(2))
         {
             return Trap::UNDERFLOW;
         }
-        else if(check_overflow())
-        {
-            return Trap::OVERFLOW;
-        }
 
         
         i64 value = this->stack.get_second() <= this->stack.get_first();
         this->stack.adjust_stack_pointer(-2);
         this->stack.push(value);
         this->stack.adjust_stack_pointer(1);
-        this->program.ip++;
+        this->ip++;
 
         return Trap::OK;
     }
@@ -461,21 +1404,17 @@ public:
 
     Trap greater()
     {
-        if(check_underflow())
+        if(check_underflow(2))
         {
             return Trap::UNDERFLOW;
         }
-        else if(check_overflow())
-        {
-            return Trap::OVERFLOW;
-        }
 
         
         i64 value = this->stack.get_second() > this->stack.get_first();
         this->stack.adjust_stack_pointer(-2);
         this->stack.push(value);
         this->stack.adjust_stack_pointer(1);
-        this->program.ip++;
+        this->ip++;
 
         return Trap::OK;
     }
@@ -484,21 +1423,17 @@ public:
 
     Trap greater_equal()
     {
-        if(check_underflow())
+        if(check_underflow(2))
         {
             return Trap::UNDERFLOW;
         }
-        else if(check_overflow())
-        {
-            return Trap::OVERFLOW;
-        }
 
         
         i64 value = this->stack.get_second() >= this->stack.get_first();
         this->stack.adjust_stack_pointer(-2);
         this->stack.push(value);
         this->stack.adjust_stack_pointer(1);
-        this->program.ip++;
+        this->ip++;
 
         return Trap::OK;
     }
@@ -507,21 +1442,17 @@ public:
 
     Trap equal()
     {
-        if(check_underflow())
+        if(check_underflow(2))
         {
             return Trap::UNDERFLOW;
         }
-        else if(check_overflow())
-        {
-            return Trap::OVERFLOW;
-        }
 
         
         i64 value = this->stack.get_second() == this->stack.get_first();
         this->stack.adjust_stack_pointer(-2);
         this->stack.push(value);
         this->stack.adjust_stack_pointer(1);
-        this->program.ip++;
+        this->ip++;
 
         return Trap::OK;
     }
@@ -530,21 +1461,17 @@ public:
 
     Trap not_equal()
     {
-        if(check_underflow())
+        if(check_underflow(2))
         {
             return Trap::UNDERFLOW;
         }
-        else if(check_overflow())
-        {
-            return Trap::OVERFLOW;
-        }
 
         
         i64 value = this->stack.get_second() != this->stack.get_first();
         this->stack.adjust_stack_pointer(-2);
         this->stack.push(value);
         this->stack.adjust_stack_pointer(1);
-        this->program.ip++;
+        this->ip++;
 
         return Trap::OK;
     }
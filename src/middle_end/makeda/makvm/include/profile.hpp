@@ -0,0 +1,318 @@
+#ifndef C4_MAKEDA_PROFILE_H
+#define C4_MAKEDA_PROFILE_H
+
+#include <map>
+#include <fstream>
+#include <algorithm>
+#include "../../include/bytecode.hpp"
+
+
+/**
+ * Execution profile of one makeda run. The interpreter reports every
+ * instruction it dispatches, everything else is derived from the
+ * sequence: hits per address, taken and not taken counts of each
+ * branch, which opcode follows which, and a call tree that is written
+ * as folded stacks for flamegraph.pl. Opcode counts are summed from the
+ * address hits when a report is written.
+ */
+
+class ProfileNode
+{
+public:
+    i64 function;
+    i64 parent;
+    u64 count;
+    std::map<i64,i64> children;
+};
+
+
+class Profile
+{
+public:
+    const Bytecode *bytecode = nullptr;
+    i64 size = 0;
+
+    std::vector<u64> hits;
+    std::vector<u64> taken;
+    std::vector<u64> not_taken;
+    std::vector<u64> pairs;
+    std::vector<ProfileNode> nodes;
+    i64 node = 0;
+    i64 last = -1;
+    u64 executed = 0;
+
+    void begin(const Bytecode *bytecode)
+    {
+        this->bytecode = bytecode;
+        this->size = bytecode->instruction_count;
+        this->hits.assign(this->size,0);
+        this->taken.assign(this->size,0);
+        this->not_taken.assign(this->size,0);
+        this->pairs.assign(MAKEDA_OPCODES * MAKEDA_OPCODES,0);
+        this->nodes.clear();
+        this->nodes.push_back(ProfileNode{(i64)bytecode->header->entry,-1,0,{}});
+        this->node = 0;
+        this->last = -1;
+        this->executed = 0;
+    }
+
+
+    // called with the address of every instruction the interpreter dispatches
+    void step(i64 next)
+    {
+        if(this->last >= 0)
+        {
+            InstructionType type = this->bytecode->get_type(this->last);
+
+            if(is_jump(type))
+            {
+                if(next == this->last + 1)
+                {
+                    this->not_taken[this->last]++;
+                }
+                else
+                {
+                    this->taken[this->last]++;
+                }
+            }
+            else if(type == InstructionType::CALL)
+            {
+                this->node = get_child(this->node,next);
+            }
+            else if(type == InstructionType::RET and this->nodes[this->node].parent >= 0)
+            {
+                this->node = this->nodes[this->node].parent;
+            }
+
+            if(next >= 0 and next < this->size)
+            {
+                this->pairs[(u32)type * MAKEDA_OPCODES + (u32)this->bytecode->get_type(next)]++;
+            }
+        }
+
+        if(next >= 0 and next < this->size)
+        {
+            this->hits[next]++;
+            this->nodes[this->node].count++;
+            this->executed++;
+        }
+
+        this->last = next;
+    }
+
+
+    i64 get_child(i64 parent,i64 function)
+    {
+        auto found = this->nodes[parent].children.find(function);
+        if(found != this->nodes[parent].children.end())
+        {
+            return found->second;
+        }
+
+        i64 child = this->nodes.size();
+        this->nodes.push_back(ProfileNode{function,parent,0,{}});
+        this->nodes[parent].children[function] = child;
+        return child;
+    }
+
+
+    // a function is named by the symbol at its first instruction
+    std::string get_function_name(i64 ip)
+    {
+        for(u64 i = 0; i < this->bytecode->header->symbol_count; i++)
+        {
+            if((i64)this->bytecode->symbols[i].value == ip)
+            {
+                return this->bytecode->get_symbol_name(i);
+            }
+        }
+
+        return ip == (i64)this->bytecode->header->entry ? "entry" : "@" + std::to_string(ip);
+    }
+
+
+    std::vector<u64> get_opcode_counts()
+    {
+        std::vector<u64> counts(MAKEDA_OPCODES,0);
+
+        for(i64 ip = 0; ip < this->size; ip++)
+        {
+            counts[(u32)this->bytecode->get_type(ip)] += this->hits[ip];
+        }
+
+        return counts;
+    }
+
+
+    // opcode pairs as (count, first * MAKEDA_OPCODES + second), most frequent first
+    std::vector<std::pair<u64,u64>> get_sorted_pairs()
+    {
+        std::vector<std::pair<u64,u64>> sorted;
+
+        for(u64 i = 0; i < this->pairs.size(); i++)
+        {
+            if(this->pairs[i] != 0)
+            {
+                sorted.push_back({this->pairs[i],i});
+            }
+        }
+
+        std::sort(sorted.begin(),sorted.end(),[](const std::pair<u64,u64> &a,const std::pair<u64,u64> &b)
+        {
+            return a.first != b.first ? a.first > b.first : a.second < b.second;
+        });
+
+        return sorted;
+    }
+
+
+    void print_stats()
+    {
+        std::vector<std::pair<u64,u64>> sorted = get_sorted_pairs();
+
+        std::cout << "makeda profile : " << this->executed << " instructions, " << sorted.size() << " opcode pairs" << std::endl;
+
+        for(u64 i = 0; i < sorted.size() and i < 5; i++)
+        {
+            std::cout << "    " << get_name((InstructionType)(sorted[i].second / MAKEDA_OPCODES)) << " "
+                      << get_name((InstructionType)(sorted[i].second % MAKEDA_OPCODES)) << " : " << sorted[i].first << std::endl;
+        }
+    }
+
+
+    bool write_json(std::string name)
+    {
+        std::ofstream out(name);
+        if(not out)
+        {
+            return false;
+        }
+
+        std::vector<u64> counts = get_opcode_counts();
+
+        out << "{\n  \"executed\": " << this->executed << ",\n  \"opcodes\": {";
+
+        const char *separator = "\n";
+        for(u32 type = 0; type < MAKEDA_OPCODES; type++)
+        {
+            if(counts[type] != 0)
+            {
+                out << separator << "    \"" << get_name((InstructionType)type) << "\": " << counts[type];
+                separator = ",\n";
+            }
+        }
+
+        out << "\n  },\n  \"instructions\": [";
+
+        separator = "\n";
+        for(i64 ip = 0; ip < this->size; ip++)
+        {
+            if(this->hits[ip] != 0)
+            {
+                out << separator << "    {\"ip\": " << ip << ", \"opcode\": \"" << get_name(this->bytecode->get_type(ip))
+                    << "\", \"hits\": " << this->hits[ip] << "}";
+                separator = ",\n";
+            }
+        }
+
+        out << "\n  ],\n  \"branches\": [";
+
+        separator = "\n";
+        for(i64 ip = 0; ip < this->size; ip++)
+        {
+            InstructionType type = this->bytecode->get_type(ip);
+            if(is_jump(type) and this->hits[ip] != 0)
+            {
+                out << separator << "    {\"ip\": " << ip << ", \"opcode\": \"" << get_name(type) << "\", \"target\": "
+                    << this->bytecode->get_operand(ip) << ", \"taken\": " << this->taken[ip]
+                    << ", \"not_taken\": " << this->not_taken[ip] << "}";
+                separator = ",\n";
+            }
+        }
+
+        out << "\n  ],\n  \"pairs\": [";
+
+        separator = "\n";
+        for(std::pair<u64,u64> &pair : get_sorted_pairs())
+        {
+            out << separator << "    {\"first\": \"" << get_name((InstructionType)(pair.second / MAKEDA_OPCODES))
+                << "\", \"second\": \"" << get_name((InstructionType)(pair.second % MAKEDA_OPCODES))
+                << "\", \"count\": " << pair.first << "}";
+            separator = ",\n";
+        }
+
+        out << "\n  ]\n}\n";
+
+        return (bool)out;
+    }
+
+
+    // one row per instruction, branches fill the last two columns
+    bool write_csv(std::string name)
+    {
+        std::ofstream out(name);
+        if(not out)
+        {
+            return false;
+        }
+
+        out << "ip,opcode,operand,hits,taken,not_taken\n";
+
+        for(i64 ip = 0; ip < this->size; ip++)
+        {
+            InstructionType type = this->bytecode->get_type(ip);
+            out << ip << "," << get_name(type) << "," << this->bytecode->get_operand(ip) << "," << this->hits[ip] << ",";
+
+            if(is_jump(type))
+            {
+                out << this->taken[ip] << "," << this->not_taken[ip];
+            }
+            else
+            {
+                out << ",";
+            }
+
+            out << "\n";
+        }
+
+        return (bool)out;
+    }
+
+
+    // "entry;main;fib 1234", the instructions run in each call stack
+    bool write_folded(std::string name)
+    {
+        std::ofstream out(name);
+        if(not out)
+        {
+            return false;
+        }
+
+        std::vector<std::string> stacks(this->nodes.size());
+
+        for(u64 i = 0; i < this->nodes.size(); i++)
+        {
+            // a child is always created after its parent
+            std::string function = get_function_name(this->nodes[i].function);
+            stacks[i] = this->nodes[i].parent < 0 ? function : stacks[this->nodes[i].parent] + ";" + function;
+
+            if(this->nodes[i].count != 0)
+            {
+                out << stacks[i] << " " << this->nodes[i].count << "\n";
+            }
+        }
+
+        return (bool)out;
+    }
+
+
+    // writes prefix.json, prefix.csv and prefix.folded
+    bool write(std::string prefix)
+    {
+        return write_json(prefix + ".json") and write_csv(prefix + ".csv") and write_folded(prefix + ".folded");
+    }
+
+};
+
+
+#endif
@@ -0,0 +1,323 @@
+#ifndef C4_MAKEDA_VERIFIER_H
+#define C4_MAKEDA_VERIFIER_H
+
+#include "../../include/bytecode.hpp"
+
+
+/**
+ * Load time verifier for makeda programs. It follows every JMP/JT/JF
+ * edge from the entry and records the stack depth before each
+ * instruction. A program is rejected when it has an unknown opcode,
+ * a jump outside the program, an instruction that can underflow,
+ * a join reached with two different depths, or a depth larger than
+ * the stack. Programs that pass can run without per-op checks,
+ * division by zero and INT64_MIN / -1 are the only traps left at
+ * runtime.
+ *
+ * Every CALL target is walked as a function of its own starting at
+ * depth 0, a call pops its arguments and leaves the return value and
+ * RET must find exactly that value. The frame size set by ENTER is
+ * followed the same way as the depth so a local outside the frame is
+ * rejected too, memory behind LOAD/STORE is still checked at runtime.
+ */
+
+class Verifier
+{
+public:
+    const Bytecode *bytecode;
+    i64 stack_size;
+
+    std::vector<i64> depth;
+    std::vector<i64> frame;
+    i64 max_depth = 0;
+    bool verified = false;
+
+    std::string error;
+    i64 error_ip = -1;
+
+    Verifier(const Bytecode *bytecode,i64 stack_size)
+    {
+        this->bytecode = bytecode;
+        this->stack_size = stack_size;
+        this->verified = verify();
+    }
+
+
+    bool reject(i64 ip,std::string error)
+    {
+        this->error_ip = ip;
+        this->error = error;
+        return false;
+    }
+
+
+    /**
+     * Returns the number of slots an instruction reads and the number
+     * it leaves behind, false for an opcode outside the isa.
+     */
+
+    bool get_effect(i64 ip,i64 *pops,i64 *pushes)
+    {
+        InstructionType type = this->bytecode->get_type(ip);
+
+        switch(type)
+        {
+            case InstructionType::PUSH:
+            {
+                *pops = 0;
+                *pushes = 1;
+                return true;
+            }
+            case InstructionType::POP:
+            {
+                *pops = 1;
+                *pushes = 0;
+                return true;
+            }
+            case InstructionType::DUP:
+            case InstructionType::DUP_PUSH_L_JF:
+            case InstructionType::DUP_PUSH_G_JF:
+            case InstructionType::DUP_PUSH_EQ_JT:
+            {
+                *pops = 1;
+                *pushes = 2;
+                return true;
+            }
+            case InstructionType::JT:
+            case InstructionType::JF:
+            case InstructionType::PUSH_ADD:
+            case InstructionType::PUSH_SUB:
+            case InstructionType::PUSH_MUL:
+            case InstructionType::PUSH_L_JF:
+            case InstructionType::PUSH_G_JF:
+            case InstructionType::PUSH_EQ_JT:
+            {
+                *pops = 1;
+                *pushes = 1;
+                return true;
+            }
+            case InstructionType::JMP:
+            case InstructionType::PRINT:
+            case InstructionType::ENTER:
+            {
+                *pops = 0;
+                *pushes = 0;
+                return true;
+            }
+            case InstructionType::NEG:
+            case InstructionType::NOT:
+            case InstructionType::SEXT32:
+            case InstructionType::ZEXT32:
+            case InstructionType::LOAD:
+            {
+                *pops = 1;
+                *pushes = 1;
+                return true;
+            }
+            case InstructionType::JZ:
+            case InstructionType::JNZ:
+            case InstructionType::STORE_LOCAL:
+            case InstructionType::RET:
+            {
+                *pops = 1;
+                *pushes = 0;
+                return true;
+            }
+            case InstructionType::LOAD_LOCAL:
+            case InstructionType::ADDR_LOCAL:
+            {
+                *pops = 0;
+                *pushes = 1;
+                return true;
+            }
+            case InstructionType::STORE:
+            {
+                *pops = 2;
+                *pushes = 0;
+                return true;
+            }
+            case InstructionType::CALL:
+            {
+                *pops = this->bytecode->get_immediate(ip);
+                *pushes = 1;
+                return true;
+            }
+            case InstructionType::ADD:
+            case InstructionType::SUB:
+            case InstructionType::MUL:
+            case InstructionType::DIV:
+            case InstructionType::MOD:
+            case InstructionType::EQ:
+            case InstructionType::NE:
+            case InstructionType::L:
+            case InstructionType::LE:
+            case InstructionType::G:
+            case InstructionType::GE:
+            case InstructionType::AND:
+            case InstructionType::OR:
+            case InstructionType::XOR:
+            case InstructionType::SHL:
+            case InstructionType::SHR:
+            case InstructionType::SHRU:
+            case InstructionType::DIVU:
+            case InstructionType::MODU:
+            case InstructionType::LU:
+            case InstructionType::LEU:
+            case InstructionType::GU:
+            case InstructionType::GEU:
+            {
+                *pops = 2;
+                *pushes = 1;
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+
+    bool is_local(InstructionType type)
+    {
+        return type == InstructionType::LOAD_LOCAL or type == InstructionType::STORE_LOCAL or
+               type == InstructionType::ADDR_LOCAL;
+    }
+
+
+    /**
+     * Records the depth and frame size a path arrives with, a root is
+     * the entry or the start of a called function.
+     */
+
+    bool arrive(i64 target,i64 depth,i64 frame,std::vector<i64> *worklist)
+    {
+        if(target >= (i64)this->depth.size())
+        {
+            return true;
+        }
+
+        if(this->depth[target] == -1)
+        {
+            this->depth[target] = depth;
+            this->frame[target] = frame;
+            worklist->push_back(target);
+            return true;
+        }
+
+        if(this->depth[target] != depth)
+        {
+            return reject(target,"stack depth " + std::to_string(this->depth[target]) + " and " + std::to_string(depth) + " meet here");
+        }
+
+        if(this->frame[target] != frame)
+        {
+            return reject(target,"frame size " + std::to_string(this->frame[target]) + " and " + std::to_string(frame) + " meet here");
+        }
+
+        return true;
+    }
+
+
+    bool verify()
+    {
+        i64 size = this->bytecode->instruction_count;
+        i64 entry = this->bytecode->header->entry;
+        std::vector<i64> worklist;
+
+        this->depth.assign(size,-1);
+        this->frame.assign(size,0);
+        this->max_depth = 0;
+
+        for(i64 ip = 0; ip < size; ip++)
+        {
+            InstructionType type = this->bytecode->get_type(ip);
+            i64 operand = this->bytecode->get_operand(ip);
+            i64 pops = 0;
+            i64 pushes = 0;
+
+            if(not get_effect(ip,&pops,&pushes))
+            {
+                return reject(ip,"unknown opcode " + std::to_string((int)type));
+            }
+
+            // a jump to the end of the program halts
+            if(is_jump(type) and (operand < 0 or operand > size))
+            {
+                return reject(ip,"jump target " + std::to_string(operand) + " is outside the program");
+            }
+
+            if(type == InstructionType::CALL and (operand < 0 or operand >= size))
+            {
+                return reject(ip,"call target " + std::to_string(operand) + " is outside the program");
+            }
+        }
+
+        if(not arrive(entry,0,0,&worklist))
+        {
+            return false;
+        }
+
+        while(not worklist.empty())
+        {
+            i64 ip = worklist.back();
+            worklist.pop_back();
+
+            InstructionType type = this->bytecode->get_type(ip);
+            i64 operand = this->bytecode->get_operand(ip);
+            i64 pops = 0;
+            i64 pushes = 0;
+            get_effect(ip,&pops,&pushes);
+
+            i64 current = this->depth[ip];
+            i64 frame = this->frame[ip];
+            if(current < pops)
+            {
+                return reject(ip,"stack underflow");
+            }
+
+            if(type == InstructionType::RET and current != 1)
+            {
+                return reject(ip,"ret with " + std::to_string(current) + " values on the stack");
+            }
+
+            if(is_local(type) and operand >= frame)
+            {
+                return reject(ip,"local " + std::to_string(operand) + " is outside a frame of " + std::to_string(frame));
+            }
+
+            if(type == InstructionType::ENTER)
+            {
+                frame = operand;
+            }
+
+            i64 next = current - pops + pushes;
+            if(next > this->stack_size)
+            {
+                return reject(ip,"stack depth " + std::to_string(next) + " exceeds the stack size");
+            }
+
+            this->max_depth = std::max(this->max_depth,next);
+
+            if(type != InstructionType::JMP and type != InstructionType::RET and not arrive(ip + 1,next,frame,&worklist))
+            {
+                return false;
+            }
+
+            if(is_jump(type) and not arrive(operand,next,frame,&worklist))
+            {
+                return false;
+            }
+
+            // a called function starts on an empty stack without a frame
+            if(type == InstructionType::CALL and not arrive(operand,0,0,&worklist))
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+};
+
+
+#endif
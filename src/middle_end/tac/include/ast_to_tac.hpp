@@ -3,6 +3,7 @@
 
 
 #include "tac.hpp"
+#include <map>
 
 
 class AstToTac
@@ -14,9 +15,9 @@ public:
 	std::string string;
 	std::vector<TACInstruction *> *inst = nullptr;
 	Arena *arena = nullptr;
-	std::string global_ident;
-	std::string global_label;
 	int global_counter = 0;
+	std::map<std::string,int> variable_ids;
+	std::map<std::string,int> loop_labels;
 
 	SymbolTable *symbols;
 	SymbolTable symbol_table;
@@ -26,8 +27,6 @@ public:
 		this->file_name = file_name;
 		this->ast_program = ast_program;
 		this->arena = arena;
-		this->global_ident = "c4_tmp";
-		this->global_label = "__c4_label";
 		this->global_counter = global_counter;
 
 		void *mem = alloc(sizeof(TACProgram));
@@ -62,28 +61,28 @@ public:
             Symbol symbol = it->second;
 			TACGlobalVariable *tac_vardecl = nullptr;
 
-			if (symbol.tentative)
+			if (symbol.tentative or symbol.init)
 			{
 				void *mem = alloc(sizeof(TACGlobalVariable));
-				tac_vardecl = new(mem) TACGlobalVariable(symbol.global,symbol.name);
+				tac_vardecl = new(mem) TACGlobalVariable(symbol.is_public,get_variable_id(symbol.name),symbol.name);
 
-				mem = alloc(sizeof(int));
-				int *data = new(mem)int;
-				*data = 0;
-
-				tac_vardecl->add_data(TACType::I32,data);
-			}
-			else if (symbol.init)
-			{
-				void *mem = alloc(sizeof(TACGlobalVariable));
-				tac_vardecl = new(mem) TACGlobalVariable(symbol.global,symbol.name);
-				
-				mem = alloc(sizeof(int));
-				int *data = new(mem)int;
-				*data = symbol.int_init;
+				// tentative definitions have a zero int_init
+				if (symbol.type == DataType::I64 or symbol.type == DataType::U64 or symbol.type == DataType::PTR)
+				{
+					mem = alloc(sizeof(long int));
+					long int *data = new(mem)long int;
+					*data = symbol.int64_init;
 
-				tac_vardecl->add_data(TACType::I32,data);
+					tac_vardecl->add_data(TACType::I64,data);
+				}
+				else
+				{
+					mem = alloc(sizeof(int));
+					int *data = new(mem)int;
+					*data = symbol.int_init;
 
+					tac_vardecl->add_data(TACType::I32,data);
+				}
 			}
 			else
 			{
@@ -192,7 +191,7 @@ public:
 				}
 			}
 
-			TACArgument tac_arg(arg->ident,data_type);
+			TACArgument tac_arg(get_variable_id(arg->ident),arg->ident,data_type);
 
 			tac_fn->add_argument(tac_arg);
 		}
@@ -259,7 +258,7 @@ public:
 
 	void convert_break_stmt(ASTBreakStmt *stmt)
 	{
-		std::string break_label_name = "break" + stmt->label;
+		int break_label_name = get_loop_label("break" + stmt->label);
 
 	
 		void *mem = alloc(sizeof(TACJmpInst));
@@ -272,7 +271,7 @@ public:
 
 	void convert_continue_stmt(ASTContinueStmt *stmt)
 	{
-		std::string continue_label_name = "continue" + stmt->label;
+		int continue_label_name = get_loop_label("continue" + stmt->label);
 
 	
 		void *mem = alloc(sizeof(TACJmpInst));
@@ -286,7 +285,7 @@ public:
 
 	void convert_while_stmt(ASTWhileStmt *stmt)
 	{
-		std::string continue_label_name = "continue" + stmt->label;
+		int continue_label_name = get_loop_label("continue" + stmt->label);
 
 		void *mem = alloc(sizeof(TACLabelInst));
 		TACLabelInst *tac_label = new(mem) TACLabelInst(continue_label_name);
@@ -294,16 +293,10 @@ public:
 		mem = alloc(sizeof(TACInstruction));
 		this->inst->push_back(new(mem) TACInstruction(TACInstructionType::LABEL,tac_label));
 
-		std::string break_label_name = "break" + stmt->label;
+		int break_label_name = get_loop_label("break" + stmt->label);
 
 
-		TACValue *tac_expr = convert_expr(stmt->expr);
-		
-		mem = alloc(sizeof(TACJmpIfZeroInst));
-		TACJmpIfZeroInst *tac_jz = new(mem) TACJmpIfZeroInst(tac_expr,break_label_name);
-
-		mem = alloc(sizeof(TACInstruction));
-		this->inst->push_back(new(mem) TACInstruction(TACInstructionType::JMP_ZERO,tac_jz));
+		convert_jump_if_false(stmt->expr,break_label_name);
 
 		convert_block_stmt(stmt->block);
 
@@ -326,21 +319,15 @@ public:
 
 	void convert_if_stmt(ASTIfStmt *stmt)
 	{
-		std::string end_label_name = make_label();
-		std::string label_name = make_label();
-		
-		TACValue *tac_expr = convert_expr(stmt->expr);
+		int end_label_name = make_label();
+		int label_name = make_label();
 		
-		void *mem = alloc(sizeof(TACJmpIfZeroInst));
-		TACJmpIfZeroInst *tac_jz = new(mem) TACJmpIfZeroInst(tac_expr,label_name);
-
-		mem = alloc(sizeof(TACInstruction));
-		this->inst->push_back(new(mem) TACInstruction(TACInstructionType::JMP_ZERO,tac_jz));
+		convert_jump_if_false(stmt->expr,label_name);
 
 		convert_block_stmt(stmt->block);
 
 
-		mem = alloc(sizeof(TACJmpInst));
+		void *mem = alloc(sizeof(TACJmpInst));
 		TACJmpInst *tac_jmp = new(mem) TACJmpInst(end_label_name);
 
 		mem = alloc(sizeof(TACInstruction));
@@ -361,20 +348,14 @@ public:
                 continue;
             }
 
-			tac_expr = convert_expr(elif_block->expr);
-
 			label_name = make_label();
 			
-			void *mem = alloc(sizeof(TACJmpIfZeroInst));
-			TACJmpIfZeroInst *tac_jz = new(mem) TACJmpIfZeroInst(tac_expr,label_name);
-
-			mem = alloc(sizeof(TACInstruction));
-			this->inst->push_back(new(mem) TACInstruction(TACInstructionType::JMP_ZERO,tac_jz));
+			convert_jump_if_false(elif_block->expr,label_name);
 
 			convert_block_stmt(elif_block->block);
 
 
-			mem = alloc(sizeof(TACJmpInst));
+			void *mem = alloc(sizeof(TACJmpInst));
 			TACJmpInst *tac_jmp = new(mem) TACJmpInst(end_label_name);
 
 			mem = alloc(sizeof(TACInstruction));
@@ -441,10 +422,15 @@ public:
 			data_type = TACType::I64;
 		}
 
-		TACValue *tac_src = convert_expr(stmt->expr);
+		if (stmt->init->type != ASTVarInitType::SINGLE)
+		{
+			DEBUG_PANIC("struct initialisers are not supported in tac ");
+		}
+
+		TACValue *tac_src = convert_expr(((ASTVarSingleInit *)stmt->init->init)->expr);
 
 		void *mem = alloc(sizeof(TACVariable));
-		TACVariable *tac_var = new(mem) TACVariable(stmt->ident);
+		TACVariable *tac_var = new(mem) TACVariable(get_variable_id(stmt->ident),stmt->ident);
 		tac_var->add_type(data_type);
 
 		mem = alloc(sizeof(TACValue));
@@ -579,20 +565,27 @@ public:
 			}
 		}
 
-		std::string tac_dst_ident = make_tmp2(expr_type);
+		if (fn_expr->base->type != ASTExpressionType::VARIABLE)
+		{
+			DEBUG_PANIC("method calls are not supported in tac ");
+		}
+
+		std::string fn_ident = ((ASTVariableExpr *)fn_expr->base->expr)->ident;
+
+		int tac_dst_id = make_tmp();
 
 		void *mem = alloc(sizeof(TACVariable));
-		TACVariable *tac_var = new(mem) TACVariable(tac_dst_ident);
+		TACVariable *tac_var = new(mem) TACVariable(tac_dst_id);
 		tac_var->add_type(data_type);
 
-		std::cout << " ident : " << tac_dst_ident << "   type  => "  << (int)data_type <<std::endl;
+		std::cout << " ident : " << tac_dst_id << "   type  => "  << (int)data_type <<std::endl;
 
 		mem = alloc(sizeof(TACValue));
 		TACValue *tac_dst = new(mem)TACValue(TACValueType::VARIABLE,tac_var);\
 		tac_dst->add_type(data_type);
 
 		mem = alloc(sizeof(TACFunctionCallInst));
-		TACFunctionCallInst *tac_fn = new(mem) TACFunctionCallInst(fn_expr->ident,tac_dst);
+		TACFunctionCallInst *tac_fn = new(mem) TACFunctionCallInst(fn_ident,tac_dst);
 		tac_fn->add_type(data_type);
 
 
@@ -619,10 +612,10 @@ public:
 		dst_type = TACType::I64;
 
 
-		std::string tac_dst_ident = make_tmp2(expr_type);
+		int tac_dst_id = make_tmp();
 
 		void *mem = alloc(sizeof(TACVariable));
-		TACVariable *tac_var = new(mem) TACVariable(tac_dst_ident);
+		TACVariable *tac_var = new(mem) TACVariable(tac_dst_id);
 		tac_var->add_type(dst_type);
 
 		mem = alloc(sizeof(TACValue));
@@ -654,10 +647,10 @@ public:
 		dst_type = TACType::I64;
 
 
-		std::string tac_dst_ident = make_tmp2(expr_type);
+		int tac_dst_id = make_tmp();
 
 		void *mem = alloc(sizeof(TACVariable));
-		TACVariable *tac_var = new(mem) TACVariable(tac_dst_ident);
+		TACVariable *tac_var = new(mem) TACVariable(tac_dst_id);
 		tac_var->add_type(dst_type);
 
 		mem = alloc(sizeof(TACValue));
@@ -773,7 +766,7 @@ public:
 
 
 		void *mem = alloc(sizeof(TACVariable));
-		TACVariable *tac_var = new(mem) TACVariable(var_expr->ident);
+		TACVariable *tac_var = new(mem) TACVariable(get_variable_id(var_expr->ident),var_expr->ident);
 		tac_var->add_type(data_type);
 
 		mem = alloc(sizeof(TACValue));
@@ -907,10 +900,10 @@ public:
 			return tac_result;
 		}
 
-		std::string tac_dst_ident = make_tmp2(expr_type);
+		int tac_dst_id = make_tmp();
 
 		void *mem = alloc(sizeof(TACVariable));
-		TACVariable *tac_var = new(mem) TACVariable(tac_dst_ident);
+		TACVariable *tac_var = new(mem) TACVariable(tac_dst_id);
 		tac_var->add_type(data_type);
 
 		mem = alloc(sizeof(TACValue));
@@ -1019,35 +1012,114 @@ public:
 		return tac_dst;
 	}
 
-	TACValue *convert_binary_and(void *expr,DataType expr_type)
+	// conditions are lowered straight to branches so that && and || never
+	// materialise a 0/1 and every leaf comparison sits right before its
+	// jump, where instruction selection can fuse it into cmp + jcc
+	void convert_logical_jump_if_false(void *expr,int label_ident)
 	{
-		std::string false_label_ident = make_label();
+		ASTBinaryExpr *bin_expr = (ASTBinaryExpr *)expr;
+
+		if (bin_expr->op == ASTBinaryOperator::AND)
+		{
+			convert_jump_if_false(bin_expr->lhs,label_ident);
+			convert_jump_if_false(bin_expr->rhs,label_ident);
+		}
+		else
+		{
+			int true_label_ident = make_label();
+
+			convert_jump_if_true(bin_expr->lhs,true_label_ident);
+			convert_jump_if_false(bin_expr->rhs,label_ident);
+
+			void *mem = alloc(sizeof(TACLabelInst));
+			TACLabelInst *tac_label = new(mem) TACLabelInst(true_label_ident);
+
+			mem = alloc(sizeof(TACInstruction));
+			this->inst->push_back(new(mem) TACInstruction(TACInstructionType::LABEL,tac_label));
+		}
+	}
+
+	void convert_jump_if_false(ASTExpression *expr,int label_ident)
+	{
+		if (is_logical_expr(expr))
+		{
+			convert_logical_jump_if_false(expr->expr,label_ident);
+			return;
+		}
+
+		TACValue *tac_expr = convert_expr(expr);
 
-		
-		TACValue *tac_src1 = convert_expr(((ASTBinaryExpr *)expr)->lhs);
-		
 		void *mem = alloc(sizeof(TACJmpIfZeroInst));
-		TACJmpIfZeroInst *tac_jz = new(mem) TACJmpIfZeroInst(tac_src1,false_label_ident);
+		TACJmpIfZeroInst *tac_jz = new(mem) TACJmpIfZeroInst(tac_expr,label_ident);
 
 		mem = alloc(sizeof(TACInstruction));
 		this->inst->push_back(new(mem) TACInstruction(TACInstructionType::JMP_ZERO,tac_jz));
+	}
 
+	void convert_logical_jump_if_true(void *expr,int label_ident)
+	{
+		ASTBinaryExpr *bin_expr = (ASTBinaryExpr *)expr;
 
+		if (bin_expr->op == ASTBinaryOperator::OR)
+		{
+			convert_jump_if_true(bin_expr->lhs,label_ident);
+			convert_jump_if_true(bin_expr->rhs,label_ident);
+		}
+		else
+		{
+			int false_label_ident = make_label();
 
-		TACValue *tac_src2 = convert_expr(((ASTBinaryExpr *)expr)->rhs);
-		
-		mem = alloc(sizeof(TACJmpIfZeroInst));
-		tac_jz = new(mem) TACJmpIfZeroInst(tac_src2,false_label_ident);
+			convert_jump_if_false(bin_expr->lhs,false_label_ident);
+			convert_jump_if_true(bin_expr->rhs,label_ident);
+
+			void *mem = alloc(sizeof(TACLabelInst));
+			TACLabelInst *tac_label = new(mem) TACLabelInst(false_label_ident);
+
+			mem = alloc(sizeof(TACInstruction));
+			this->inst->push_back(new(mem) TACInstruction(TACInstructionType::LABEL,tac_label));
+		}
+	}
+
+	void convert_jump_if_true(ASTExpression *expr,int label_ident)
+	{
+		if (is_logical_expr(expr))
+		{
+			convert_logical_jump_if_true(expr->expr,label_ident);
+			return;
+		}
+
+		TACValue *tac_expr = convert_expr(expr);
+
+		void *mem = alloc(sizeof(TACJmpIfNotZeroInst));
+		TACJmpIfNotZeroInst *tac_jnz = new(mem) TACJmpIfNotZeroInst(tac_expr,label_ident);
 
 		mem = alloc(sizeof(TACInstruction));
-		this->inst->push_back(new(mem) TACInstruction(TACInstructionType::JMP_ZERO,tac_jz));
+		this->inst->push_back(new(mem) TACInstruction(TACInstructionType::JMP_NOT_ZERO,tac_jnz));
+	}
+
+	static bool is_logical_expr(ASTExpression *expr)
+	{
+		if (expr->type != ASTExpressionType::BINARY)
+		{
+			return false;
+		}
 
+		ASTBinaryOperator op = ((ASTBinaryExpr *)expr->expr)->op;
+		return op == ASTBinaryOperator::AND or op == ASTBinaryOperator::OR;
+	}
 
+	TACValue *convert_binary_and(void *expr,DataType expr_type)
+	{
+		int false_label_ident = make_label();
 
-		std::string tac_dst_ident = make_tmp2(expr_type);
+		convert_logical_jump_if_false(expr,false_label_ident);
 
-		mem = alloc(sizeof(TACVariable));
-		TACVariable *tac_var = new(mem) TACVariable(tac_dst_ident);
+
+
+		int tac_dst_id = make_tmp();
+
+		void *mem = alloc(sizeof(TACVariable));
+		TACVariable *tac_var = new(mem) TACVariable(tac_dst_id);
 
 		mem = alloc(sizeof(TACValue));
 		TACValue *tac_dst = new(mem)TACValue(TACValueType::VARIABLE,tac_var);
@@ -1072,7 +1144,7 @@ public:
 
 
 		
-		std::string end_label_ident = make_label();
+		int end_label_ident = make_label();
 
 
 		mem = alloc(sizeof(TACJmpInst));
@@ -1120,33 +1192,16 @@ public:
 
 	TACValue *convert_binary_or(void *expr,DataType expr_type)
 	{
-		std::string false_label_ident = make_label();
+		int false_label_ident = make_label();
 
-		
-		TACValue *tac_src1 = convert_expr(((ASTBinaryExpr *)expr)->lhs);
-		
-		void *mem = alloc(sizeof(TACJmpIfNotZeroInst));
-		TACJmpIfNotZeroInst *tac_jz = new(mem) TACJmpIfNotZeroInst(tac_src1,false_label_ident);
+		convert_logical_jump_if_true(expr,false_label_ident);
 
-		mem = alloc(sizeof(TACInstruction));
-		this->inst->push_back(new(mem) TACInstruction(TACInstructionType::JMP_NOT_ZERO,tac_jz));
 
 
+		int tac_dst_id = make_tmp();
 
-		TACValue *tac_src2 = convert_expr(((ASTBinaryExpr *)expr)->rhs);
-		
-		mem = alloc(sizeof(TACJmpIfNotZeroInst));
-		tac_jz = new(mem) TACJmpIfNotZeroInst(tac_src2,false_label_ident);
-
-		mem = alloc(sizeof(TACInstruction));
-		this->inst->push_back(new(mem) TACInstruction(TACInstructionType::JMP_NOT_ZERO,tac_jz));
-
-
-
-		std::string tac_dst_ident = make_tmp2(expr_type);
-
-		mem = alloc(sizeof(TACVariable));
-		TACVariable *tac_var = new(mem) TACVariable(tac_dst_ident);
+		void *mem = alloc(sizeof(TACVariable));
+		TACVariable *tac_var = new(mem) TACVariable(tac_dst_id);
 
 		mem = alloc(sizeof(TACValue));
 		TACValue *tac_dst = new(mem)TACValue(TACValueType::VARIABLE,tac_var);
@@ -1171,7 +1226,7 @@ public:
 
 
 		
-		std::string end_label_ident = make_label();
+		int end_label_ident = make_label();
 
 
 		mem = alloc(sizeof(TACJmpInst));
@@ -1256,10 +1311,10 @@ public:
 		}
 
 
-		std::string tac_dst_ident = make_tmp2(expr_type);
+		int tac_dst_id = make_tmp();
 
 		void *mem = alloc(sizeof(TACVariable));
-		TACVariable *tac_var = new(mem) TACVariable(tac_dst_ident);
+		TACVariable *tac_var = new(mem) TACVariable(tac_dst_id);
 		tac_var->add_type(dst_type);
 
 		mem = alloc(sizeof(TACValue));
@@ -1283,10 +1338,10 @@ public:
 	{
 		TACValue *tac_src = convert_expr(((ASTUnaryExpr *)expr)->rhs);
 
-		std::string tac_dst_ident = make_tmp2(expr_type);
+		int tac_dst_id = make_tmp();
 
 		void *mem = alloc(sizeof(TACVariable));
-		TACVariable *tac_var = new(mem) TACVariable(tac_dst_ident);
+		TACVariable *tac_var = new(mem) TACVariable(tac_dst_id);
 		tac_var->add_type(tac_src->data_type);
 
 		mem = alloc(sizeof(TACValue));
@@ -1433,6 +1488,21 @@ public:
 	{
 		switch (op)
 		{
+			case ASTBinaryOperator::MUL:
+			{
+				return TACBinaryOperator::MUL;
+				break;
+			}
+			case ASTBinaryOperator::DIV:
+			{
+				return TACBinaryOperator::DIV;
+				break;
+			}
+			case ASTBinaryOperator::MOD:
+			{
+				return TACBinaryOperator::MOD;
+				break;
+			}
 			case ASTBinaryOperator::ADD:
 			{
 				return TACBinaryOperator::ADD;
@@ -1478,32 +1548,81 @@ public:
 				return TACBinaryOperator::EQUAL;
 				break;
 			}
+			case ASTBinaryOperator::NOT_EQUAL:
+			{
+				return TACBinaryOperator::NOT_EQUAL;
+				break;
+			}
+			case ASTBinaryOperator::BIT_AND:
+			{
+				return TACBinaryOperator::BIT_AND;
+				break;
+			}
+			case ASTBinaryOperator::BIT_OR:
+			{
+				return TACBinaryOperator::BIT_OR;
+				break;
+			}
+			case ASTBinaryOperator::BIT_XOR:
+			{
+				return TACBinaryOperator::BIT_XOR;
+				break;
+			}
+			case ASTBinaryOperator::SHIFT_LEFT:
+			{
+				return TACBinaryOperator::SHIFT_LEFT;
+				break;
+			}
+			case ASTBinaryOperator::SHIFT_RIGHT:
+			{
+				return TACBinaryOperator::SHIFT_RIGHT;
+				break;
+			}
 		}
 
 		return TACBinaryOperator::None;
 	}
 
 
-	std::string make_tmp(std::string base = "")
+	int make_tmp()
 	{
-		std::string name = this->global_ident + "." + std::to_string(this->global_counter++);
-		return name;
+		return this->program->make_variable_id();
 	}
 
-	std::string make_tmp2(DataType type,std::string base="")
+	int make_label()
 	{
-		std::string name = make_tmp(base);
-		Symbol symbol(name,type,true);
-		symbol.add_global(false);
-		symbol.add_public(false);
-		this->symbols->add(name,symbol);
+		return this->program->make_label_id();
+	}
 
-		return name;
+	// named variables get one id per program, globals and locals alike
+	int get_variable_id(std::string ident)
+	{
+		auto it = this->variable_ids.find(ident);
+
+		if (it != this->variable_ids.end())
+		{
+			return it->second;
+		}
+
+		int id = this->program->make_variable_id();
+		this->variable_ids[ident] = id;
+		return id;
 	}
 
-	std::string make_label(std::string base = "")
+	// loop labels come from LoopLabelling as names, break/continue of the
+	// same loop must agree on the id
+	int get_loop_label(std::string name)
 	{
-		return this->global_label + "." + std::to_string(this->global_counter++) ; 
+		auto it = this->loop_labels.find(name);
+
+		if (it != this->loop_labels.end())
+		{
+			return it->second;
+		}
+
+		int id = this->program->make_label_id();
+		this->loop_labels[name] = id;
+		return id;
 	}
 
 };
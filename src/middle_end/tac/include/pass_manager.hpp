@@ -0,0 +1,227 @@
+#ifndef C4C_PASS_MANAGER_H
+#define C4C_PASS_MANAGER_H
+
+#include "tac.hpp"
+#include "tac_inline.hpp"
+#include "tac_licm.hpp"
+#include "tac_gvn.hpp"
+#include "tac_printer.hpp"
+#include <chrono>
+#include <iomanip>
+#include <set>
+
+
+/*
+ * Runs the TAC optimisation passes in order.
+ *
+ *     -O0   no passes
+ *     -O1   gvn
+ *     -O2   inline,licm,gvn
+ *
+ * `--passes=a,b,c` replaces the pipeline, `--print-after=a,b` dumps the
+ * program after the named passes (`all` after every one). Every pass is
+ * timed and its instruction count delta recorded for print_report(). An
+ * inline threshold of 0 turns the inline pass into a no-op.
+ */
+
+class PassRecord
+{
+public:
+	std::string name;
+	double ms;
+	int before;
+	int after;
+
+	PassRecord(std::string name,double ms,int before,int after)
+	{
+		this->name = name;
+		this->ms = ms;
+		this->before = before;
+		this->after = after;
+	}
+};
+
+
+class PassManager
+{
+public:
+	std::string file_name;
+	TACProgram *program;
+	Arena *arena;
+	int inline_threshold = 40;
+
+	std::vector<std::string> passes;
+	std::set<std::string> print_after;
+	std::vector<PassRecord> records;
+
+	PassManager(std::string file_name,TACProgram *program,Arena *arena)
+	{
+		this->file_name = file_name;
+		this->program = program;
+		this->arena = arena;
+	}
+
+
+	static bool is_pass(std::string name)
+	{
+		return name == "inline" or name == "licm" or name == "gvn";
+	}
+
+
+	void add_pipeline(int level)
+	{
+		this->passes.clear();
+
+		if (level >= 2)
+		{
+			this->passes.push_back("inline");
+			this->passes.push_back("licm");
+		}
+
+		if (level >= 1)
+		{
+			this->passes.push_back("gvn");
+		}
+	}
+
+
+	std::vector<std::string> split(std::string list)
+	{
+		std::vector<std::string> names;
+		std::string name;
+
+		for (char c : list + ",")
+		{
+			if (c != ',')
+			{
+				name += c;
+				continue;
+			}
+
+			if (name != "")
+			{
+				names.push_back(name);
+			}
+
+			name = "";
+		}
+
+		return names;
+	}
+
+
+	void set_passes(std::string list)
+	{
+		this->passes.clear();
+
+		for (std::string name : split(list))
+		{
+			if (not is_pass(name))
+			{
+				DEBUG_PANIC("pass manager : unknown pass " + name);
+			}
+
+			this->passes.push_back(name);
+		}
+	}
+
+
+	void add_print_after(std::string list)
+	{
+		for (std::string name : split(list))
+		{
+			if (name != "all" and not is_pass(name))
+			{
+				DEBUG_PANIC("pass manager : unknown pass " + name);
+			}
+
+			this->print_after.insert(name);
+		}
+	}
+
+
+	int count_instructions()
+	{
+		int count = 0;
+
+		for (TACDeclaration *decl : this->program->decls)
+		{
+			if (decl != nullptr and decl->type == TACDeclarationType::FUNCTION)
+			{
+				count += ((TACFunction *)decl->decl)->instructions.size();
+			}
+		}
+
+		return count;
+	}
+
+
+	void run()
+	{
+		for (std::string name : this->passes)
+		{
+			int before = count_instructions();
+			auto start = std::chrono::steady_clock::now();
+
+			run_pass(name);
+
+			auto end = std::chrono::steady_clock::now();
+			double ms = std::chrono::duration<double,std::milli>(end - start).count();
+
+			this->records.push_back(PassRecord(name,ms,before,count_instructions()));
+
+			if (this->print_after.count(name) or this->print_after.count("all"))
+			{
+				TacPrinter printer(this->file_name,this->program);
+				std::cout << "; tac after " << name << "\n" << printer.string;
+			}
+		}
+	}
+
+
+	void run_pass(std::string name)
+	{
+		if (name == "inline")
+		{
+			if (this->inline_threshold <= 0)
+			{
+				return;
+			}
+
+			TacInline inliner(this->file_name,this->program,this->arena,this->inline_threshold);
+			inliner.print_stats();
+		}
+		else if (name == "licm")
+		{
+			TacLicm licm(this->file_name,this->program,this->arena);
+			licm.print_stats();
+		}
+		else if (name == "gvn")
+		{
+			TacGvn gvn(this->file_name,this->program,this->arena);
+			gvn.print_stats();
+		}
+		else
+		{
+			DEBUG_PANIC("pass manager : unknown pass " + name);
+		}
+	}
+
+
+	void print_report()
+	{
+		std::cout << std::left << std::setw(12) << "pass" << std::right << std::setw(12) << "time (ms)"
+		          << std::setw(10) << "before" << std::setw(10) << "after" << std::setw(10) << "delta" << std::endl;
+
+		for (PassRecord &record : this->records)
+		{
+			std::cout << std::left << std::setw(12) << record.name << std::right
+			          << std::setw(12) << std::fixed << std::setprecision(3) << record.ms
+			          << std::setw(10) << record.before << std::setw(10) << record.after
+			          << std::setw(10) << std::showpos << (record.after - record.before) << std::noshowpos << std::endl;
+		}
+	}
+};
+
+
+#endif
@@ -24,18 +24,42 @@ enum class TACType
 
 
 
+/*
+ * Variables and labels are dense integer ids, handed out by the program so
+ * passes that create new ones don't collide. Names are only made up when
+ * the program is printed or lowered to assembly.
+ */
+
 class TACProgram
 {
 public:
 	std::vector<TACDeclaration *> decls;
+	int variable_counter = 0;
+	int label_counter = 0;
 
 	void add_decl(TACDeclaration *decl)
 	{
 		this->decls.push_back(decl);
 	}
+
+	int make_variable_id()
+	{
+		return this->variable_counter++;
+	}
+
+	int make_label_id()
+	{
+		return this->label_counter++;
+	}
 };
 
 
+inline std::string get_label_name(int label)
+{
+	return "__c4_label." + std::to_string(label);
+}
+
+
 enum class TACDeclarationType
 {
 	FUNCTION,
@@ -59,11 +83,13 @@ public:
 class TACArgument
 {
 public:
+	int id;
 	std::string ident;
 	TACType type;
 
-	TACArgument(std::string ident,TACType type)
+	TACArgument(int id,std::string ident,TACType type)
 	{
+		this->id = id;
 		this->ident = ident;
 		this->type = type;
 	}
@@ -99,13 +125,15 @@ class TACGlobalVariable
 {
 public:
 	bool is_public;
+	int id;
 	std::string ident;
 	TACType data_type;
 	void *data;
 	
 
-	TACGlobalVariable(bool is_public,std::string ident)
+	TACGlobalVariable(bool is_public,int id,std::string ident)
 	{
+		this->id = id;
 		this->ident = ident;
 		this->is_public = is_public;
 	}
@@ -318,6 +346,12 @@ enum class TACBinaryOperator
 	AND,
 	OR,
 	EQUAL,
+	NOT_EQUAL,
+	BIT_AND,
+	BIT_OR,
+	BIT_XOR,
+	SHIFT_LEFT,
+	SHIFT_RIGHT,
 	None,
 };
 
@@ -437,8 +471,8 @@ public:
 class TACJmpInst
 {
 public:
-	std::string label;
-	TACJmpInst(std::string label)
+	int label;
+	TACJmpInst(int label)
 	{
 		this->label = label;
 	}
@@ -448,8 +482,8 @@ public:
 class TACLabelInst
 {
 public:
-	std::string label;
-	TACLabelInst(std::string label)
+	int label;
+	TACLabelInst(int label)
 	{
 		this->label = label;
 	}
@@ -461,7 +495,7 @@ class TACJmpIfZeroInst
 {
 public:
 	TACValue *value;
-	std::string label;
+	int label;
 	TACType data_type;
 
 	void add_type(TACType data_type)
@@ -469,7 +503,7 @@ public:
 		this->data_type = data_type;
 	}
 
-	TACJmpIfZeroInst(TACValue *value,std::string label)
+	TACJmpIfZeroInst(TACValue *value,int label)
 	{
 		this->value = value;
 		this->label = label;
@@ -481,7 +515,7 @@ class TACJmpIfNotZeroInst
 {
 public:
 	TACValue *value;
-	std::string label;
+	int label;
 	TACType data_type;
 
 	void add_type(TACType data_type)
@@ -489,7 +523,7 @@ public:
 		this->data_type = data_type;
 	}
 	
-	TACJmpIfNotZeroInst(TACValue *value,std::string label)
+	TACJmpIfNotZeroInst(TACValue *value,int label)
 	{
 		this->value = value;
 		this->label = label;
@@ -546,9 +580,11 @@ public:
 };
 
 
+// temporaries have an id and no ident
 class TACVariable
 {
 public:
+	int id;
 	std::string ident;
 	TACType data_type;
 
@@ -557,10 +593,26 @@ public:
 		this->data_type = data_type;
 	}
 
-	TACVariable(std::string ident)
+	TACVariable(int id)
 	{
+		this->id = id;
+	}
+
+	TACVariable(int id,std::string ident)
+	{
+		this->id = id;
 		this->ident = ident;
 	}
+
+	bool is_temporary()
+	{
+		return this->ident.empty();
+	}
+
+	std::string get_name()
+	{
+		return is_temporary() ? "c4_tmp." + std::to_string(this->id) : this->ident;
+	}
 };
 
 
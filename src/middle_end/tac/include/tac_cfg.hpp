@@ -0,0 +1,450 @@
+#ifndef C4C_TAC_CFG_H
+#define C4C_TAC_CFG_H
+
+#include "tac.hpp"
+#include <map>
+#include <set>
+
+
+/*
+ * Control flow graph over the instructions of one TACFunction.
+ *
+ * Blocks are index ranges [start,end) into fn->instructions, a block starts
+ * at the first instruction, at every label and after every jump or return.
+ * The graph is a snapshot : passes that add or remove instructions build a
+ * new TacCfg afterwards.
+ */
+
+class TACBlock
+{
+public:
+	int id;
+	int start;
+	int end;
+	std::vector<int> succs;
+	std::vector<int> preds;
+	int idom = -1;
+	std::vector<int> children;
+
+	TACBlock(int id,int start)
+	{
+		this->id = id;
+		this->start = start;
+		this->end = start;
+	}
+};
+
+
+class TacCfg
+{
+public:
+	TACFunction *fn;
+	std::vector<TACBlock> blocks;
+	std::vector<int> block_of;
+	std::vector<int> rpo;
+	std::vector<int> rpo_index;
+	std::map<int,int> label_block;
+	std::set<int> address_taken;
+
+	TacCfg(TACFunction *fn)
+	{
+		this->fn = fn;
+
+		build_blocks();
+		build_edges();
+		build_dominators();
+	}
+
+
+	static bool is_terminator(TACInstruction *inst)
+	{
+		return inst->type == TACInstructionType::JMP or inst->type == TACInstructionType::RETURN;
+	}
+
+
+	static bool is_jump(TACInstruction *inst)
+	{
+		return inst->type == TACInstructionType::JMP or inst->type == TACInstructionType::JMP_ZERO or
+		       inst->type == TACInstructionType::JMP_NOT_ZERO;
+	}
+
+
+	static int get_jump_label(TACInstruction *inst)
+	{
+		switch (inst->type)
+		{
+			case TACInstructionType::JMP:
+			{
+				return ((TACJmpInst *)inst->instruction)->label;
+			}
+			case TACInstructionType::JMP_ZERO:
+			{
+				return ((TACJmpIfZeroInst *)inst->instruction)->label;
+			}
+			case TACInstructionType::JMP_NOT_ZERO:
+			{
+				return ((TACJmpIfNotZeroInst *)inst->instruction)->label;
+			}
+			default:
+			{
+				return -1;
+			}
+		}
+	}
+
+
+	// variable id of value, -1 for constants
+	static int get_id(TACValue *value)
+	{
+		if (value == nullptr or value->type != TACValueType::VARIABLE)
+		{
+			return -1;
+		}
+
+		return ((TACVariable *)value->value)->id;
+	}
+
+
+	static bool is_temporary(TACValue *value)
+	{
+		return value != nullptr and value->type == TACValueType::VARIABLE and ((TACVariable *)value->value)->is_temporary();
+	}
+
+
+	static TACValue *get_def(TACInstruction *inst)
+	{
+		switch (inst->type)
+		{
+			case TACInstructionType::UNARY:
+			{
+				return ((TACUnaryInst *)inst->instruction)->dst;
+			}
+			case TACInstructionType::BINARY:
+			{
+				return ((TACBinaryInst *)inst->instruction)->dst;
+			}
+			case TACInstructionType::COPY:
+			{
+				return ((TACCopyInst *)inst->instruction)->dst;
+			}
+			case TACInstructionType::FUNCTION_CALL:
+			{
+				return ((TACFunctionCallInst *)inst->instruction)->dst;
+			}
+			case TACInstructionType::SIGN_EXTEND:
+			{
+				return ((TACSignExtendInst *)inst->instruction)->dst;
+			}
+			case TACInstructionType::TRUNCATE:
+			{
+				return ((TACTruncateInst *)inst->instruction)->dst;
+			}
+			case TACInstructionType::ZERO_EXTEND:
+			{
+				return ((TACZeroExtendInst *)inst->instruction)->dst;
+			}
+			case TACInstructionType::GET_ADDRESS:
+			{
+				return ((TACGetAddressInst *)inst->instruction)->dst;
+			}
+			case TACInstructionType::LOAD:
+			{
+				return ((TACLoadInst *)inst->instruction)->dst;
+			}
+			default:
+			{
+				return nullptr;
+			}
+		}
+	}
+
+
+	// operands that are read by the instruction, as slots so passes can
+	// rewrite them in place. the source of a GET_ADDRESS is not a read.
+	static std::vector<TACValue **> get_use_slots(TACInstruction *inst)
+	{
+		std::vector<TACValue **> slots;
+
+		switch (inst->type)
+		{
+			case TACInstructionType::RETURN:
+			{
+				slots.push_back(&((TACReturnInst *)inst->instruction)->value);
+				break;
+			}
+			case TACInstructionType::UNARY:
+			{
+				slots.push_back(&((TACUnaryInst *)inst->instruction)->src);
+				break;
+			}
+			case TACInstructionType::BINARY:
+			{
+				slots.push_back(&((TACBinaryInst *)inst->instruction)->src1);
+				slots.push_back(&((TACBinaryInst *)inst->instruction)->src2);
+				break;
+			}
+			case TACInstructionType::JMP_ZERO:
+			{
+				slots.push_back(&((TACJmpIfZeroInst *)inst->instruction)->value);
+				break;
+			}
+			case TACInstructionType::JMP_NOT_ZERO:
+			{
+				slots.push_back(&((TACJmpIfNotZeroInst *)inst->instruction)->value);
+				break;
+			}
+			case TACInstructionType::COPY:
+			{
+				slots.push_back(&((TACCopyInst *)inst->instruction)->src);
+				break;
+			}
+			case TACInstructionType::FUNCTION_CALL:
+			{
+				for (TACValue *&arg : ((TACFunctionCallInst *)inst->instruction)->arguments)
+				{
+					slots.push_back(&arg);
+				}
+				break;
+			}
+			case TACInstructionType::SIGN_EXTEND:
+			{
+				slots.push_back(&((TACSignExtendInst *)inst->instruction)->src);
+				break;
+			}
+			case TACInstructionType::TRUNCATE:
+			{
+				slots.push_back(&((TACTruncateInst *)inst->instruction)->src);
+				break;
+			}
+			case TACInstructionType::ZERO_EXTEND:
+			{
+				slots.push_back(&((TACZeroExtendInst *)inst->instruction)->src);
+				break;
+			}
+			case TACInstructionType::LOAD:
+			{
+				slots.push_back(&((TACLoadInst *)inst->instruction)->src);
+				break;
+			}
+			case TACInstructionType::STORE:
+			{
+				slots.push_back(&((TACStoreInst *)inst->instruction)->dst);
+				slots.push_back(&((TACStoreInst *)inst->instruction)->src);
+				break;
+			}
+			default:
+			{
+				break;
+			}
+		}
+
+		return slots;
+	}
+
+
+	// true for instructions that may write memory other than their dst
+	static bool writes_memory(TACInstruction *inst)
+	{
+		return inst->type == TACInstructionType::STORE or inst->type == TACInstructionType::FUNCTION_CALL;
+	}
+
+
+	bool dominates(int a,int b)
+	{
+		if (this->blocks[b].idom == -1 and b != 0)
+		{
+			// unreachable blocks are dominated by nothing
+			return false;
+		}
+
+		while (b != a)
+		{
+			if (b == 0)
+			{
+				return false;
+			}
+
+			b = this->blocks[b].idom;
+		}
+
+		return true;
+	}
+
+
+	bool is_reachable(int block)
+	{
+		return block == 0 or this->blocks[block].idom != -1;
+	}
+
+
+	void build_blocks()
+	{
+		std::vector<TACInstruction *> &insts = this->fn->instructions;
+		this->block_of.assign(insts.size(),-1);
+
+		for (size_t i = 0; i < insts.size(); i++)
+		{
+			TACInstruction *inst = insts[i];
+
+			bool leader = i == 0 or inst->type == TACInstructionType::LABEL or
+			              is_jump(insts[i - 1]) or insts[i - 1]->type == TACInstructionType::RETURN;
+
+			if (leader)
+			{
+				this->blocks.push_back(TACBlock(this->blocks.size(),i));
+			}
+
+			this->blocks.back().end = i + 1;
+			this->block_of[i] = this->blocks.back().id;
+
+			if (inst->type == TACInstructionType::LABEL)
+			{
+				this->label_block[((TACLabelInst *)inst->instruction)->label] = this->blocks.back().id;
+			}
+			else if (inst->type == TACInstructionType::GET_ADDRESS)
+			{
+				this->address_taken.insert(get_id(((TACGetAddressInst *)inst->instruction)->src));
+			}
+		}
+	}
+
+
+	void add_edge(int from,int to)
+	{
+		this->blocks[from].succs.push_back(to);
+		this->blocks[to].preds.push_back(from);
+	}
+
+
+	void build_edges()
+	{
+		for (TACBlock &block : this->blocks)
+		{
+			TACInstruction *last = this->fn->instructions[block.end - 1];
+
+			if (is_jump(last))
+			{
+				auto it = this->label_block.find(get_jump_label(last));
+
+				if (it == this->label_block.end())
+				{
+					DEBUG_PANIC("tac cfg : jump to unknown label " + get_label_name(get_jump_label(last)));
+				}
+
+				add_edge(block.id,it->second);
+			}
+
+			if (not is_terminator(last) and (size_t)block.id + 1 < this->blocks.size())
+			{
+				add_edge(block.id,block.id + 1);
+			}
+		}
+	}
+
+
+	void build_dominators()
+	{
+		if (this->blocks.empty())
+		{
+			return;
+		}
+
+		std::vector<bool> visited(this->blocks.size(),false);
+		std::vector<int> postorder;
+		std::vector<std::pair<int,int>> stack;
+
+		stack.push_back({0,0});
+		visited[0] = true;
+
+		while (not stack.empty())
+		{
+			int block = stack.back().first;
+			size_t next = stack.back().second;
+
+			if (next < this->blocks[block].succs.size())
+			{
+				stack.back().second++;
+				int succ = this->blocks[block].succs[next];
+
+				if (not visited[succ])
+				{
+					visited[succ] = true;
+					stack.push_back({succ,0});
+				}
+				continue;
+			}
+
+			postorder.push_back(block);
+			stack.pop_back();
+		}
+
+		this->rpo.assign(postorder.rbegin(),postorder.rend());
+		this->rpo_index.assign(this->blocks.size(),-1);
+
+		for (size_t i = 0; i < this->rpo.size(); i++)
+		{
+			this->rpo_index[this->rpo[i]] = i;
+		}
+
+		// Cooper, Harvey and Kennedy, "A Simple, Fast Dominance Algorithm"
+		this->blocks[0].idom = 0;
+		bool changed = true;
+
+		while (changed)
+		{
+			changed = false;
+
+			for (size_t i = 1; i < this->rpo.size(); i++)
+			{
+				int block = this->rpo[i];
+				int new_idom = -1;
+
+				for (int pred : this->blocks[block].preds)
+				{
+					if (this->blocks[pred].idom == -1)
+					{
+						continue;
+					}
+
+					new_idom = new_idom == -1 ? pred : intersect(pred,new_idom);
+				}
+
+				if (new_idom != this->blocks[block].idom)
+				{
+					this->blocks[block].idom = new_idom;
+					changed = true;
+				}
+			}
+		}
+
+		this->blocks[0].idom = -1;
+
+		for (size_t i = 1; i < this->rpo.size(); i++)
+		{
+			int block = this->rpo[i];
+			this->blocks[this->blocks[block].idom].children.push_back(block);
+		}
+	}
+
+
+	int intersect(int a,int b)
+	{
+		while (a != b)
+		{
+			while (this->rpo_index[a] > this->rpo_index[b])
+			{
+				a = a == 0 ? 0 : this->blocks[a].idom;
+			}
+
+			while (this->rpo_index[b] > this->rpo_index[a])
+			{
+				b = b == 0 ? 0 : this->blocks[b].idom;
+			}
+		}
+
+		return a;
+	}
+};
+
+
+#endif
@@ -0,0 +1,601 @@
+#ifndef C4C_TAC_GVN_H
+#define C4C_TAC_GVN_H
+
+#include "tac.hpp"
+#include "tac_cfg.hpp"
+#include <map>
+#include <set>
+
+
+/*
+ * Global value numbering over the dominator tree.
+ *
+ * Every pure instruction is keyed by its operator and operands. When a key
+ * is already available the instruction becomes a copy of the value that
+ * holds it, and uses of the copy are rewritten to that value when both are
+ * defined once.
+ *
+ * An expression is visible to the blocks its block dominates only if its
+ * operands and result are stable : defined at most once in the function and
+ * not global or address taken. Everything else is numbered inside its block
+ * and forgotten when one of its operands is written.
+ *
+ * Loads are always block local. A store through a pointer known to come
+ * from `&x` only forgets loads of x and of unknown pointers, any other
+ * store or call forgets every load. The stored value is remembered so a
+ * following load of the same pointer is replaced by it.
+ */
+
+class GVNEntry
+{
+public:
+	TACValue *holder;
+	std::set<int> depends;
+	bool is_load = false;
+	int target = -1;
+
+	GVNEntry()
+	{
+		this->holder = nullptr;
+	}
+
+	GVNEntry(TACValue *holder)
+	{
+		this->holder = holder;
+	}
+};
+
+
+class TacGvn
+{
+public:
+	std::string file_name;
+	TACProgram *program;
+	Arena *arena;
+
+	int expressions_replaced = 0;
+	int loads_replaced = 0;
+	int copies_propagated = 0;
+
+	std::set<int> globals;
+
+	TACFunction *fn;
+	TacCfg *cfg;
+	std::map<int,int> def_count;
+	std::map<int,int> points_to;
+	std::map<std::string,GVNEntry> global_table;
+	std::vector<std::pair<std::string,GVNEntry>> scope;
+	std::map<std::string,GVNEntry> local_table;
+	std::map<int,TACValue *> substitute;
+
+	TacGvn(std::string file_name,TACProgram *program,Arena *arena)
+	{
+		this->file_name = file_name;
+		this->program = program;
+		this->arena = arena;
+
+		for (TACDeclaration *decl : this->program->decls)
+		{
+			if (decl != nullptr and decl->type == TACDeclarationType::VARDECL)
+			{
+				this->globals.insert(((TACGlobalVariable *)decl->decl)->id);
+			}
+		}
+
+		for (TACDeclaration *decl : this->program->decls)
+		{
+			if (decl == nullptr or decl->type != TACDeclarationType::FUNCTION)
+			{
+				continue;
+			}
+
+			number_function((TACFunction *)decl->decl);
+		}
+	}
+
+
+	void *alloc(int size)
+	{
+		return this->arena->alloc(size);
+	}
+
+
+	void print_stats()
+	{
+		std::cout << "gvn : " << this->expressions_replaced << " expressions replaced, "
+		          << this->loads_replaced << " loads replaced, "
+		          << this->copies_propagated << " copies propagated" << std::endl;
+	}
+
+
+	void number_function(TACFunction *fn)
+	{
+		if (fn->instructions.empty())
+		{
+			return;
+		}
+
+		TacCfg cfg(fn);
+
+		this->fn = fn;
+		this->cfg = &cfg;
+		this->def_count.clear();
+		this->points_to.clear();
+		this->global_table.clear();
+		this->scope.clear();
+		this->substitute.clear();
+
+		for (TACInstruction *inst : fn->instructions)
+		{
+			int id = TacCfg::get_id(TacCfg::get_def(inst));
+
+			if (id != -1)
+			{
+				this->def_count[id]++;
+			}
+		}
+
+		for (TACInstruction *inst : fn->instructions)
+		{
+			if (inst->type != TACInstructionType::GET_ADDRESS)
+			{
+				continue;
+			}
+
+			TACGetAddressInst *get_address = (TACGetAddressInst *)inst->instruction;
+			int dst = TacCfg::get_id(get_address->dst);
+
+			if (is_stable(dst))
+			{
+				this->points_to[dst] = TacCfg::get_id(get_address->src);
+			}
+		}
+
+		number_block(0);
+		propagate_copies();
+
+		this->cfg = nullptr;
+	}
+
+
+	bool is_memory(int id)
+	{
+		return this->globals.find(id) != this->globals.end() or
+		       this->cfg->address_taken.find(id) != this->cfg->address_taken.end();
+	}
+
+
+	bool is_stable(int id)
+	{
+		if (is_memory(id))
+		{
+			return false;
+		}
+
+		auto it = this->def_count.find(id);
+		return it == this->def_count.end() or it->second <= 1;
+	}
+
+
+	bool is_stable(TACValue *value)
+	{
+		return value->type == TACValueType::CONSTANT or is_stable(TacCfg::get_id(value));
+	}
+
+
+	std::string value_key(TACValue *value)
+	{
+		if (value->type == TACValueType::VARIABLE)
+		{
+			return "%" + std::to_string(TacCfg::get_id(value));
+		}
+
+		TACConstant *constant = (TACConstant *)value->value;
+
+		switch (constant->type)
+		{
+			case TACConstantType::I32:
+			{
+				return "#i32:" + std::to_string(*(int *)constant->constant);
+			}
+			case TACConstantType::U32:
+			{
+				return "#u32:" + std::to_string(*(unsigned int *)constant->constant);
+			}
+			case TACConstantType::I64:
+			{
+				return "#i64:" + std::to_string(*(long *)constant->constant);
+			}
+			case TACConstantType::U64:
+			{
+				return "#u64:" + std::to_string(*(unsigned long *)constant->constant);
+			}
+		}
+
+		return "#?";
+	}
+
+
+	bool is_commutative(TACBinaryOperator op)
+	{
+		return op == TACBinaryOperator::ADD or op == TACBinaryOperator::MUL or op == TACBinaryOperator::EQUAL or
+		       op == TACBinaryOperator::NOT_EQUAL or op == TACBinaryOperator::BIT_AND or op == TACBinaryOperator::BIT_OR or op == TACBinaryOperator::BIT_XOR;
+	}
+
+
+	// key of the value computed by inst, empty when it is not numbered
+	std::string expression_key(TACInstruction *inst)
+	{
+		switch (inst->type)
+		{
+			case TACInstructionType::UNARY:
+			{
+				TACUnaryInst *unary = (TACUnaryInst *)inst->instruction;
+				return "u" + std::to_string((int)unary->op) + ":" + std::to_string((int)unary->data_type) + " " + value_key(unary->src);
+			}
+			case TACInstructionType::BINARY:
+			{
+				TACBinaryInst *binary = (TACBinaryInst *)inst->instruction;
+				std::string left = value_key(binary->src1);
+				std::string right = value_key(binary->src2);
+
+				if (is_commutative(binary->op) and right < left)
+				{
+					std::swap(left,right);
+				}
+
+				return "b" + std::to_string((int)binary->op) + ":" + std::to_string((int)binary->data_type) + " " + left + " " + right;
+			}
+			case TACInstructionType::SIGN_EXTEND:
+			{
+				TACSignExtendInst *extend = (TACSignExtendInst *)inst->instruction;
+				return "sx:" + std::to_string((int)extend->data_type) + " " + value_key(extend->src);
+			}
+			case TACInstructionType::ZERO_EXTEND:
+			{
+				TACZeroExtendInst *extend = (TACZeroExtendInst *)inst->instruction;
+				return "zx:" + std::to_string((int)extend->data_type) + " " + value_key(extend->src);
+			}
+			case TACInstructionType::TRUNCATE:
+			{
+				TACTruncateInst *truncate = (TACTruncateInst *)inst->instruction;
+				return "tr:" + std::to_string((int)truncate->data_type) + " " + value_key(truncate->src);
+			}
+			case TACInstructionType::GET_ADDRESS:
+			{
+				return "&" + value_key(((TACGetAddressInst *)inst->instruction)->src);
+			}
+			case TACInstructionType::LOAD:
+			{
+				TACLoadInst *load = (TACLoadInst *)inst->instruction;
+				return load_key(load->src,load->data_type);
+			}
+			default:
+			{
+				return "";
+			}
+		}
+	}
+
+
+	std::string load_key(TACValue *ptr,TACType data_type)
+	{
+		return "ld:" + std::to_string((int)data_type) + " " + value_key(ptr);
+	}
+
+
+	// variable ptr points to when known, -1 otherwise
+	int get_target(TACValue *ptr)
+	{
+		auto it = this->points_to.find(TacCfg::get_id(ptr));
+		return it == this->points_to.end() ? -1 : it->second;
+	}
+
+
+	GVNEntry *lookup(std::string key)
+	{
+		auto it = this->local_table.find(key);
+
+		if (it != this->local_table.end())
+		{
+			return &it->second;
+		}
+
+		it = this->global_table.find(key);
+		return it == this->global_table.end() ? nullptr : &it->second;
+	}
+
+
+	void insert_global(std::string key,GVNEntry entry)
+	{
+		auto it = this->global_table.find(key);
+
+		if (it != this->global_table.end())
+		{
+			return;
+		}
+
+		this->scope.push_back({key,entry});
+		this->global_table[key] = entry;
+	}
+
+
+	// forget the block local values that read or are held in id
+	void kill_variable(int id)
+	{
+		for (auto it = this->local_table.begin(); it != this->local_table.end();)
+		{
+			if (it->second.depends.find(id) != it->second.depends.end())
+			{
+				it = this->local_table.erase(it);
+			}
+			else
+			{
+				++it;
+			}
+		}
+	}
+
+
+	// forget loads that may read target, every load when target is -1
+	void kill_memory(int target)
+	{
+		for (auto it = this->local_table.begin(); it != this->local_table.end();)
+		{
+			bool reads_target = it->second.is_load and (target == -1 or it->second.target == -1 or it->second.target == target);
+			bool reads_memory = false;
+
+			for (int id : it->second.depends)
+			{
+				if ((target == -1 and is_memory(id)) or id == target)
+				{
+					reads_memory = true;
+					break;
+				}
+			}
+
+			if (reads_target or reads_memory)
+			{
+				it = this->local_table.erase(it);
+			}
+			else
+			{
+				++it;
+			}
+		}
+	}
+
+
+	void number_block(int block_id)
+	{
+		size_t scope_size = this->scope.size();
+		this->local_table.clear();
+
+		TACBlock &block = this->cfg->blocks[block_id];
+
+		for (int i = block.start; i < block.end; i++)
+		{
+			number_instruction(this->fn->instructions[i]);
+		}
+
+		this->local_table.clear();
+
+		for (int child : this->cfg->blocks[block_id].children)
+		{
+			number_block(child);
+		}
+
+		while (this->scope.size() > scope_size)
+		{
+			this->global_table.erase(this->scope.back().first);
+			this->scope.pop_back();
+		}
+	}
+
+
+	void number_instruction(TACInstruction *inst)
+	{
+		for (TACValue **slot : TacCfg::get_use_slots(inst))
+		{
+			*slot = resolve(*slot);
+		}
+
+		if (inst->type == TACInstructionType::STORE)
+		{
+			TACStoreInst *store = (TACStoreInst *)inst->instruction;
+			int target = get_target(store->dst);
+
+			kill_memory(target);
+
+			if (target != -1)
+			{
+				kill_variable(target);
+			}
+
+			// the stored value is what a load of the same pointer sees next
+			GVNEntry entry(store->src);
+			entry.is_load = true;
+			entry.target = target;
+			entry.depends.insert(TacCfg::get_id(store->dst));
+			entry.depends.insert(TacCfg::get_id(store->src));
+			entry.depends.erase(-1);
+			this->local_table[load_key(store->dst,store->data_type)] = entry;
+			return;
+		}
+
+		if (inst->type == TACInstructionType::FUNCTION_CALL)
+		{
+			kill_memory(-1);
+		}
+
+		TACValue *dst = TacCfg::get_def(inst);
+
+		if (dst == nullptr)
+		{
+			return;
+		}
+
+		int dst_id = TacCfg::get_id(dst);
+		std::string key = expression_key(inst);
+
+		if (key != "")
+		{
+			GVNEntry *entry = lookup(key);
+
+			if (entry != nullptr)
+			{
+				replace_with_copy(inst,dst,entry->holder);
+				key = "";
+			}
+		}
+
+		kill_variable(dst_id);
+
+		if (is_memory(dst_id))
+		{
+			kill_memory(dst_id);
+		}
+
+		if (key == "" or is_memory(dst_id))
+		{
+			return;
+		}
+
+		std::vector<TACValue **> slots = TacCfg::get_use_slots(inst);
+		GVNEntry entry(dst);
+		entry.depends.insert(dst_id);
+		bool stable = is_stable(dst_id);
+
+		for (TACValue **slot : slots)
+		{
+			int id = TacCfg::get_id(*slot);
+
+			if (id == dst_id)
+			{
+				// `i = i + 1` does not compute `i + 1` for the new i
+				return;
+			}
+
+			if (id != -1)
+			{
+				entry.depends.insert(id);
+			}
+
+			stable = stable and is_stable(*slot);
+		}
+
+		if (inst->type == TACInstructionType::LOAD)
+		{
+			entry.is_load = true;
+			entry.target = get_target(((TACLoadInst *)inst->instruction)->src);
+			this->local_table[key] = entry;
+		}
+		else if (stable)
+		{
+			insert_global(key,entry);
+		}
+		else
+		{
+			this->local_table[key] = entry;
+		}
+	}
+
+
+	void replace_with_copy(TACInstruction *inst,TACValue *dst,TACValue *holder)
+	{
+		TACType data_type = dst->data_type;
+
+		if (inst->type == TACInstructionType::LOAD)
+		{
+			data_type = ((TACLoadInst *)inst->instruction)->data_type;
+			this->loads_replaced++;
+		}
+		else
+		{
+			this->expressions_replaced++;
+		}
+
+		void *mem = alloc(sizeof(TACCopyInst));
+		TACCopyInst *tac_copy = new(mem) TACCopyInst(dst,holder);
+		tac_copy->add_type(data_type);
+
+		inst->type = TACInstructionType::COPY;
+		inst->instruction = tac_copy;
+
+		int dst_id = TacCfg::get_id(dst);
+
+		if (is_stable(dst_id) and is_stable(holder))
+		{
+			this->substitute[dst_id] = holder;
+		}
+	}
+
+
+	TACValue *resolve(TACValue *value)
+	{
+		int id = TacCfg::get_id(value);
+
+		while (id != -1)
+		{
+			auto it = this->substitute.find(id);
+
+			if (it == this->substitute.end())
+			{
+				break;
+			}
+
+			value = it->second;
+			id = TacCfg::get_id(value);
+		}
+
+		return value;
+	}
+
+
+	// the copies left behind by numbering are dead once every use reads
+	// the original value, drop them
+	void propagate_copies()
+	{
+		if (this->substitute.empty())
+		{
+			return;
+		}
+
+		std::set<int> used;
+
+		for (TACInstruction *inst : this->fn->instructions)
+		{
+			for (TACValue **slot : TacCfg::get_use_slots(inst))
+			{
+				*slot = resolve(*slot);
+				used.insert(TacCfg::get_id(*slot));
+			}
+
+			if (inst->type == TACInstructionType::GET_ADDRESS)
+			{
+				used.insert(TacCfg::get_id(((TACGetAddressInst *)inst->instruction)->src));
+			}
+		}
+
+		std::vector<TACInstruction *> instructions;
+
+		for (TACInstruction *inst : this->fn->instructions)
+		{
+			int dst = TacCfg::get_id(TacCfg::get_def(inst));
+
+			if (inst->type == TACInstructionType::COPY and this->substitute.find(dst) != this->substitute.end() and
+			    used.find(dst) == used.end())
+			{
+				this->copies_propagated++;
+				continue;
+			}
+
+			instructions.push_back(inst);
+		}
+
+		this->fn->instructions = instructions;
+	}
+};
+
+
+#endif
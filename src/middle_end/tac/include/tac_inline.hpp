@@ -0,0 +1,504 @@
+#ifndef C4C_TAC_INLINE_H
+#define C4C_TAC_INLINE_H
+
+#include "tac.hpp"
+#include <map>
+#include <set>
+
+
+/*
+ * Inlines small functions into their callers.
+ *
+ * A call is replaced by a copy of the callee's instructions when the callee
+ * is defined in this program, is not recursive and its cost (instructions
+ * plus arguments) is at most `threshold`. Every local variable and label of
+ * the callee gets a fresh id per call site, arguments become copies into the
+ * renamed parameters and each return becomes a copy into the call's dst
+ * followed by a jump to the end of the inlined body.
+ *
+ * Public functions and `main` keep their out of line definition, private
+ * functions that have no calls left after inlining are dropped.
+ */
+
+class TacInline
+{
+public:
+	std::string file_name;
+	TACProgram *program;
+	Arena *arena;
+	int threshold;
+
+	int calls_total = 0;
+	int calls_inlined = 0;
+	int functions_removed = 0;
+
+	std::map<std::string,TACFunction *> functions;
+	std::set<int> globals;
+	std::map<int,int> variable_map;
+	std::map<int,int> label_map;
+
+	TacInline(std::string file_name,TACProgram *program,Arena *arena,int threshold)
+	{
+		this->file_name = file_name;
+		this->program = program;
+		this->arena = arena;
+		this->threshold = threshold;
+
+		for (TACDeclaration *decl : this->program->decls)
+		{
+			if (decl == nullptr)
+			{
+				continue;
+			}
+
+			if (decl->type == TACDeclarationType::FUNCTION)
+			{
+				TACFunction *fn = (TACFunction *)decl->decl;
+				this->functions[fn->ident] = fn;
+			}
+			else if (decl->type == TACDeclarationType::VARDECL)
+			{
+				this->globals.insert(((TACGlobalVariable *)decl->decl)->id);
+			}
+		}
+
+		for (TACDeclaration *decl : this->program->decls)
+		{
+			if (decl == nullptr or decl->type != TACDeclarationType::FUNCTION)
+			{
+				continue;
+			}
+
+			inline_function((TACFunction *)decl->decl);
+		}
+
+		remove_dead_functions();
+	}
+
+
+	void *alloc(int size)
+	{
+		return this->arena->alloc(size);
+	}
+
+
+	void print_stats()
+	{
+		std::cout << "inline : " << this->calls_inlined << " of " << this->calls_total << " calls inlined, "
+		          << (this->calls_total - this->calls_inlined) << " calls left, "
+		          << this->functions_removed << " functions removed" << std::endl;
+	}
+
+
+	int get_cost(TACFunction *fn)
+	{
+		return fn->instructions.size() + fn->arguments.size();
+	}
+
+
+	bool is_recursive(TACFunction *fn)
+	{
+		for (TACInstruction *inst : fn->instructions)
+		{
+			if (inst == nullptr or inst->type != TACInstructionType::FUNCTION_CALL)
+			{
+				continue;
+			}
+
+			if (((TACFunctionCallInst *)inst->instruction)->ident == fn->ident)
+			{
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+
+	bool can_inline(TACFunction *caller,TACFunctionCallInst *call)
+	{
+		auto it = this->functions.find(call->ident);
+		if (it == this->functions.end())
+		{
+			// native / extern functions have no body to copy
+			return false;
+		}
+
+		TACFunction *callee = it->second;
+
+		if (callee == caller or is_recursive(callee))
+		{
+			return false;
+		}
+
+		if (callee->arguments.size() != call->arguments.size())
+		{
+			return false;
+		}
+
+		return get_cost(callee) <= this->threshold;
+	}
+
+
+	void inline_function(TACFunction *fn)
+	{
+		std::vector<TACInstruction *> instructions;
+
+		for (TACInstruction *inst : fn->instructions)
+		{
+			if (inst == nullptr)
+			{
+				continue;
+			}
+
+			if (inst->type != TACInstructionType::FUNCTION_CALL)
+			{
+				instructions.push_back(inst);
+				continue;
+			}
+
+			TACFunctionCallInst *call = (TACFunctionCallInst *)inst->instruction;
+			this->calls_total++;
+
+			if (not can_inline(fn,call))
+			{
+				instructions.push_back(inst);
+				continue;
+			}
+
+			inline_call(&instructions,call,this->functions[call->ident]);
+			this->calls_inlined++;
+		}
+
+		fn->instructions = instructions;
+	}
+
+
+	void inline_call(std::vector<TACInstruction *> *out,TACFunctionCallInst *call,TACFunction *callee)
+	{
+		this->variable_map.clear();
+		this->label_map.clear();
+		int end_label = this->program->make_label_id();
+
+		for (size_t i = 0; i < callee->arguments.size(); i++)
+		{
+			TACArgument arg = callee->arguments[i];
+			TACValue *dst = make_variable(rename_variable(arg.id),arg.type);
+
+			void *mem = alloc(sizeof(TACCopyInst));
+			TACCopyInst *tac_copy = new(mem) TACCopyInst(dst,call->arguments[i]);
+			tac_copy->add_type(arg.type);
+
+			mem = alloc(sizeof(TACInstruction));
+			out->push_back(new(mem) TACInstruction(TACInstructionType::COPY,tac_copy));
+		}
+
+		int size = callee->instructions.size();
+		bool needs_end_label = false;
+
+		for (int i = 0; i < size; i++)
+		{
+			TACInstruction *inst = callee->instructions[i];
+
+			if (inst == nullptr)
+			{
+				continue;
+			}
+
+			if (inst->type != TACInstructionType::RETURN)
+			{
+				out->push_back(clone_instruction(inst));
+				continue;
+			}
+
+			TACReturnInst *ret = (TACReturnInst *)inst->instruction;
+
+			void *mem = alloc(sizeof(TACCopyInst));
+			TACCopyInst *tac_copy = new(mem) TACCopyInst(call->dst,clone_value(ret->value));
+			tac_copy->add_type(call->data_type);
+
+			mem = alloc(sizeof(TACInstruction));
+			out->push_back(new(mem) TACInstruction(TACInstructionType::COPY,tac_copy));
+
+			if (i == size - 1)
+			{
+				continue;
+			}
+
+			needs_end_label = true;
+
+			mem = alloc(sizeof(TACJmpInst));
+			TACJmpInst *tac_jmp = new(mem) TACJmpInst(end_label);
+
+			mem = alloc(sizeof(TACInstruction));
+			out->push_back(new(mem) TACInstruction(TACInstructionType::JMP,tac_jmp));
+		}
+
+		if (needs_end_label)
+		{
+			void *mem = alloc(sizeof(TACLabelInst));
+			TACLabelInst *tac_label = new(mem) TACLabelInst(end_label);
+
+			mem = alloc(sizeof(TACInstruction));
+			out->push_back(new(mem) TACInstruction(TACInstructionType::LABEL,tac_label));
+		}
+	}
+
+
+	void remove_dead_functions()
+	{
+		std::set<std::string> called;
+
+		for (auto it = this->functions.begin(); it != this->functions.end(); ++it)
+		{
+			for (TACInstruction *inst : it->second->instructions)
+			{
+				if (inst != nullptr and inst->type == TACInstructionType::FUNCTION_CALL)
+				{
+					called.insert(((TACFunctionCallInst *)inst->instruction)->ident);
+				}
+			}
+		}
+
+		std::vector<TACDeclaration *> decls;
+
+		for (TACDeclaration *decl : this->program->decls)
+		{
+			if (decl != nullptr and decl->type == TACDeclarationType::FUNCTION)
+			{
+				TACFunction *fn = (TACFunction *)decl->decl;
+
+				if (not fn->is_public and fn->ident != "main" and called.find(fn->ident) == called.end())
+				{
+					this->functions.erase(fn->ident);
+					this->functions_removed++;
+					continue;
+				}
+			}
+
+			decls.push_back(decl);
+		}
+
+		this->program->decls = decls;
+	}
+
+
+	int rename_label(int label)
+	{
+		auto it = this->label_map.find(label);
+
+		if (it != this->label_map.end())
+		{
+			return it->second;
+		}
+
+		int id = this->program->make_label_id();
+		this->label_map[label] = id;
+		return id;
+	}
+
+
+	int rename_variable(int id)
+	{
+		auto it = this->variable_map.find(id);
+
+		if (it != this->variable_map.end())
+		{
+			return it->second;
+		}
+
+		int new_id = this->program->make_variable_id();
+		this->variable_map[id] = new_id;
+		return new_id;
+	}
+
+
+	TACValue *make_variable(int id,TACType data_type)
+	{
+		void *mem = alloc(sizeof(TACVariable));
+		TACVariable *tac_var = new(mem) TACVariable(id);
+		tac_var->add_type(data_type);
+
+		mem = alloc(sizeof(TACValue));
+		TACValue *tac_value = new(mem) TACValue(TACValueType::VARIABLE,tac_var);
+		tac_value->add_type(data_type);
+
+		return tac_value;
+	}
+
+
+	TACValue *clone_value(TACValue *value)
+	{
+		if (value == nullptr or value->type == TACValueType::CONSTANT)
+		{
+			// constants are never written to, sharing them is fine
+			return value;
+		}
+
+		TACVariable *tac_var = (TACVariable *)value->value;
+
+		if (this->globals.find(tac_var->id) != this->globals.end())
+		{
+			return value;
+		}
+
+		void *mem = alloc(sizeof(TACVariable));
+		TACVariable *new_var = new(mem) TACVariable(rename_variable(tac_var->id));
+		new_var->add_type(tac_var->data_type);
+
+		mem = alloc(sizeof(TACValue));
+		TACValue *new_value = new(mem) TACValue(TACValueType::VARIABLE,new_var);
+		new_value->add_type(value->data_type);
+
+		return new_value;
+	}
+
+
+	TACInstruction *clone_instruction(TACInstruction *inst)
+	{
+		void *mem = nullptr;
+		void *copy = nullptr;
+
+		switch (inst->type)
+		{
+			case TACInstructionType::UNARY:
+			{
+				TACUnaryInst *src = (TACUnaryInst *)inst->instruction;
+				mem = alloc(sizeof(TACUnaryInst));
+				TACUnaryInst *tac_inst = new(mem) TACUnaryInst(clone_value(src->dst),src->op,clone_value(src->src));
+				tac_inst->add_type(src->data_type);
+				copy = tac_inst;
+				break;
+			}
+			case TACInstructionType::BINARY:
+			{
+				TACBinaryInst *src = (TACBinaryInst *)inst->instruction;
+				mem = alloc(sizeof(TACBinaryInst));
+				TACBinaryInst *tac_inst = new(mem) TACBinaryInst(clone_value(src->dst),clone_value(src->src1),src->op,clone_value(src->src2));
+				tac_inst->add_type(src->data_type);
+				copy = tac_inst;
+				break;
+			}
+			case TACInstructionType::JMP:
+			{
+				TACJmpInst *src = (TACJmpInst *)inst->instruction;
+				mem = alloc(sizeof(TACJmpInst));
+				copy = new(mem) TACJmpInst(rename_label(src->label));
+				break;
+			}
+			case TACInstructionType::JMP_ZERO:
+			{
+				TACJmpIfZeroInst *src = (TACJmpIfZeroInst *)inst->instruction;
+				mem = alloc(sizeof(TACJmpIfZeroInst));
+				TACJmpIfZeroInst *tac_inst = new(mem) TACJmpIfZeroInst(clone_value(src->value),rename_label(src->label));
+				tac_inst->add_type(src->data_type);
+				copy = tac_inst;
+				break;
+			}
+			case TACInstructionType::JMP_NOT_ZERO:
+			{
+				TACJmpIfNotZeroInst *src = (TACJmpIfNotZeroInst *)inst->instruction;
+				mem = alloc(sizeof(TACJmpIfNotZeroInst));
+				TACJmpIfNotZeroInst *tac_inst = new(mem) TACJmpIfNotZeroInst(clone_value(src->value),rename_label(src->label));
+				tac_inst->add_type(src->data_type);
+				copy = tac_inst;
+				break;
+			}
+			case TACInstructionType::LABEL:
+			{
+				TACLabelInst *src = (TACLabelInst *)inst->instruction;
+				mem = alloc(sizeof(TACLabelInst));
+				copy = new(mem) TACLabelInst(rename_label(src->label));
+				break;
+			}
+			case TACInstructionType::COPY:
+			{
+				TACCopyInst *src = (TACCopyInst *)inst->instruction;
+				mem = alloc(sizeof(TACCopyInst));
+				TACCopyInst *tac_inst = new(mem) TACCopyInst(clone_value(src->dst),clone_value(src->src));
+				tac_inst->add_type(src->data_type);
+				copy = tac_inst;
+				break;
+			}
+			case TACInstructionType::FUNCTION_CALL:
+			{
+				TACFunctionCallInst *src = (TACFunctionCallInst *)inst->instruction;
+				mem = alloc(sizeof(TACFunctionCallInst));
+				TACFunctionCallInst *tac_inst = new(mem) TACFunctionCallInst(src->ident,clone_value(src->dst));
+				tac_inst->add_type(src->data_type);
+
+				for (TACValue *arg : src->arguments)
+				{
+					tac_inst->add_argument(clone_value(arg));
+				}
+
+				copy = tac_inst;
+				break;
+			}
+			case TACInstructionType::SIGN_EXTEND:
+			{
+				TACSignExtendInst *src = (TACSignExtendInst *)inst->instruction;
+				mem = alloc(sizeof(TACSignExtendInst));
+				TACSignExtendInst *tac_inst = new(mem) TACSignExtendInst(clone_value(src->dst),clone_value(src->src));
+				tac_inst->add_type(src->data_type);
+				copy = tac_inst;
+				break;
+			}
+			case TACInstructionType::TRUNCATE:
+			{
+				TACTruncateInst *src = (TACTruncateInst *)inst->instruction;
+				mem = alloc(sizeof(TACTruncateInst));
+				TACTruncateInst *tac_inst = new(mem) TACTruncateInst(clone_value(src->dst),clone_value(src->src));
+				tac_inst->add_type(src->data_type);
+				copy = tac_inst;
+				break;
+			}
+			case TACInstructionType::ZERO_EXTEND:
+			{
+				TACZeroExtendInst *src = (TACZeroExtendInst *)inst->instruction;
+				mem = alloc(sizeof(TACZeroExtendInst));
+				TACZeroExtendInst *tac_inst = new(mem) TACZeroExtendInst(clone_value(src->dst),clone_value(src->src));
+				tac_inst->add_type(src->data_type);
+				copy = tac_inst;
+				break;
+			}
+			case TACInstructionType::GET_ADDRESS:
+			{
+				TACGetAddressInst *src = (TACGetAddressInst *)inst->instruction;
+				mem = alloc(sizeof(TACGetAddressInst));
+				TACGetAddressInst *tac_inst = new(mem) TACGetAddressInst(clone_value(src->dst),clone_value(src->src));
+				tac_inst->add_type(src->data_type);
+				copy = tac_inst;
+				break;
+			}
+			case TACInstructionType::LOAD:
+			{
+				TACLoadInst *src = (TACLoadInst *)inst->instruction;
+				mem = alloc(sizeof(TACLoadInst));
+				TACLoadInst *tac_inst = new(mem) TACLoadInst(clone_value(src->dst),clone_value(src->src));
+				tac_inst->add_type(src->data_type);
+				copy = tac_inst;
+				break;
+			}
+			case TACInstructionType::STORE:
+			{
+				TACStoreInst *src = (TACStoreInst *)inst->instruction;
+				mem = alloc(sizeof(TACStoreInst));
+				TACStoreInst *tac_inst = new(mem) TACStoreInst(clone_value(src->dst),clone_value(src->src));
+				tac_inst->add_type(src->data_type);
+				copy = tac_inst;
+				break;
+			}
+			default:
+			{
+				DEBUG_PANIC("inline : unhandled tac instruction " + std::to_string((int)inst->type));
+			}
+		}
+
+		mem = alloc(sizeof(TACInstruction));
+		return new(mem) TACInstruction(inst->type,copy);
+	}
+};
+
+
+#endif
@@ -0,0 +1,689 @@
+#ifndef C4C_TAC_LICM_H
+#define C4C_TAC_LICM_H
+
+#include "tac.hpp"
+#include "tac_cfg.hpp"
+#include <map>
+#include <set>
+#include <algorithm>
+
+
+/*
+ * Loop invariant code motion and strength reduction.
+ *
+ * Natural loops are found from the back edges of the CFG (an edge whose
+ * target dominates its source). The preheader is the point just before the
+ * header label, so a loop is only touched when it is entered by falling
+ * through into the header; `while` loops always have that shape.
+ *
+ * Hoisting moves pure, non trapping computations into single definition
+ * temporaries whose operands do not change inside the loop. Globals and
+ * address taken variables count as changing when the loop stores through a
+ * pointer or calls a function.
+ *
+ * Strength reduction rewrites `t = i * k`, where i is a basic induction
+ * variable (one `i = i +/- c` per iteration) and k a constant, into a copy
+ * from a new variable s that starts at `i * k` in the preheader and is
+ * bumped by `c * k` right after every update of i.
+ */
+
+class TACLoop
+{
+public:
+	int header;
+	std::set<int> body;
+
+	TACLoop(int header)
+	{
+		this->header = header;
+	}
+};
+
+
+class TacLicm
+{
+public:
+	std::string file_name;
+	TACProgram *program;
+	Arena *arena;
+
+	int loops_found = 0;
+	int instructions_hoisted = 0;
+	int strength_reduced = 0;
+
+	std::set<int> globals;
+
+	TacLicm(std::string file_name,TACProgram *program,Arena *arena)
+	{
+		this->file_name = file_name;
+		this->program = program;
+		this->arena = arena;
+
+		for (TACDeclaration *decl : this->program->decls)
+		{
+			if (decl != nullptr and decl->type == TACDeclarationType::VARDECL)
+			{
+				this->globals.insert(((TACGlobalVariable *)decl->decl)->id);
+			}
+		}
+
+		for (TACDeclaration *decl : this->program->decls)
+		{
+			if (decl == nullptr or decl->type != TACDeclarationType::FUNCTION)
+			{
+				continue;
+			}
+
+			optimize_function((TACFunction *)decl->decl);
+		}
+	}
+
+
+	void *alloc(int size)
+	{
+		return this->arena->alloc(size);
+	}
+
+
+	void print_stats()
+	{
+		std::cout << "licm : " << this->loops_found << " loops, "
+		          << this->instructions_hoisted << " instructions hoisted, "
+		          << this->strength_reduced << " multiplications strength reduced" << std::endl;
+	}
+
+
+	void optimize_function(TACFunction *fn)
+	{
+		if (fn->instructions.empty())
+		{
+			return;
+		}
+
+		bool first = true;
+
+		// every change invalidates the cfg, so rebuild it and start over
+		// from the innermost loop until nothing moves any more
+		for (int round = 0; round < 256; round++)
+		{
+			TacCfg cfg(fn);
+			std::vector<TACLoop> loops = find_loops(cfg);
+
+			if (first)
+			{
+				this->loops_found += loops.size();
+				first = false;
+			}
+
+			bool changed = false;
+
+			for (TACLoop &loop : loops)
+			{
+				if (optimize_loop(fn,cfg,loop))
+				{
+					changed = true;
+					break;
+				}
+			}
+
+			if (not changed)
+			{
+				break;
+			}
+		}
+	}
+
+
+	std::vector<TACLoop> find_loops(TacCfg &cfg)
+	{
+		std::map<int,TACLoop> by_header;
+
+		for (TACBlock &block : cfg.blocks)
+		{
+			if (not cfg.is_reachable(block.id))
+			{
+				continue;
+			}
+
+			for (int succ : block.succs)
+			{
+				if (not cfg.dominates(succ,block.id))
+				{
+					continue;
+				}
+
+				if (by_header.find(succ) == by_header.end())
+				{
+					by_header.insert({succ,TACLoop(succ)});
+				}
+
+				TACLoop &loop = by_header.find(succ)->second;
+				loop.body.insert(succ);
+
+				std::vector<int> work;
+
+				if (loop.body.insert(block.id).second)
+				{
+					work.push_back(block.id);
+				}
+
+				while (not work.empty())
+				{
+					int current = work.back();
+					work.pop_back();
+
+					for (int pred : cfg.blocks[current].preds)
+					{
+						if (cfg.is_reachable(pred) and loop.body.insert(pred).second)
+						{
+							work.push_back(pred);
+						}
+					}
+				}
+			}
+		}
+
+		std::vector<TACLoop> loops;
+
+		for (auto it = by_header.begin(); it != by_header.end(); ++it)
+		{
+			loops.push_back(it->second);
+		}
+
+		// inner loops first, what they hoist can then leave the outer loop
+		std::stable_sort(loops.begin(),loops.end(),[](const TACLoop &a,const TACLoop &b)
+		{
+			return a.body.size() < b.body.size();
+		});
+
+		return loops;
+	}
+
+
+	// index the preheader code is inserted at, or -1 when the loop can be
+	// entered other than by falling through into its header
+	int find_preheader(TacCfg &cfg,TACLoop &loop)
+	{
+		TACBlock &header = cfg.blocks[loop.header];
+
+		if (loop.header == 0 or cfg.fn->instructions[header.start]->type != TACInstructionType::LABEL)
+		{
+			return -1;
+		}
+
+		int label = ((TACLabelInst *)cfg.fn->instructions[header.start]->instruction)->label;
+		bool entered = false;
+
+		for (int pred : header.preds)
+		{
+			if (loop.body.find(pred) != loop.body.end())
+			{
+				continue;
+			}
+
+			TACInstruction *last = cfg.fn->instructions[cfg.blocks[pred].end - 1];
+
+			if (pred != loop.header - 1 or TacCfg::get_jump_label(last) == label)
+			{
+				return -1;
+			}
+
+			entered = true;
+		}
+
+		return entered ? header.start : -1;
+	}
+
+
+	bool optimize_loop(TACFunction *fn,TacCfg &cfg,TACLoop &loop)
+	{
+		int preheader = find_preheader(cfg,loop);
+
+		if (preheader == -1)
+		{
+			return false;
+		}
+
+		std::vector<int> indices;
+
+		for (int block : loop.body)
+		{
+			for (int i = cfg.blocks[block].start; i < cfg.blocks[block].end; i++)
+			{
+				indices.push_back(i);
+			}
+		}
+
+		std::sort(indices.begin(),indices.end());
+
+		std::map<int,int> def_count;
+		std::map<int,std::vector<int>> loop_defs;
+		bool writes_memory = false;
+
+		for (size_t i = 0; i < fn->instructions.size(); i++)
+		{
+			int id = TacCfg::get_id(TacCfg::get_def(fn->instructions[i]));
+
+			if (id != -1)
+			{
+				def_count[id]++;
+			}
+		}
+
+		for (int i : indices)
+		{
+			TACInstruction *inst = fn->instructions[i];
+			int id = TacCfg::get_id(TacCfg::get_def(inst));
+
+			if (id != -1)
+			{
+				loop_defs[id].push_back(i);
+			}
+
+			if (TacCfg::writes_memory(inst))
+			{
+				writes_memory = true;
+			}
+		}
+
+		LoopInfo info(cfg,def_count,loop_defs,writes_memory);
+
+		if (hoist_invariants(fn,preheader,indices,info))
+		{
+			return true;
+		}
+
+		return reduce_strength(fn,preheader,indices,info);
+	}
+
+
+	class LoopInfo
+	{
+	public:
+		TacCfg &cfg;
+		std::map<int,int> &def_count;
+		std::map<int,std::vector<int>> &loop_defs;
+		bool writes_memory;
+		std::set<int> invariant;
+
+		LoopInfo(TacCfg &cfg,std::map<int,int> &def_count,std::map<int,std::vector<int>> &loop_defs,bool writes_memory)
+			: cfg(cfg),def_count(def_count),loop_defs(loop_defs)
+		{
+			this->writes_memory = writes_memory;
+		}
+	};
+
+
+	bool is_memory(LoopInfo &info,int id)
+	{
+		return this->globals.find(id) != this->globals.end() or
+		       info.cfg.address_taken.find(id) != info.cfg.address_taken.end();
+	}
+
+
+	bool is_invariant(LoopInfo &info,TACValue *value)
+	{
+		if (value->type == TACValueType::CONSTANT)
+		{
+			return true;
+		}
+
+		int id = TacCfg::get_id(value);
+
+		if (info.writes_memory and is_memory(info,id))
+		{
+			return false;
+		}
+
+		if (info.loop_defs.find(id) == info.loop_defs.end())
+		{
+			return true;
+		}
+
+		return info.invariant.find(id) != info.invariant.end();
+	}
+
+
+	bool is_hoistable(TACInstruction *inst)
+	{
+		switch (inst->type)
+		{
+			case TACInstructionType::UNARY:
+			case TACInstructionType::COPY:
+			case TACInstructionType::SIGN_EXTEND:
+			case TACInstructionType::ZERO_EXTEND:
+			case TACInstructionType::TRUNCATE:
+			case TACInstructionType::GET_ADDRESS:
+			{
+				return true;
+			}
+			case TACInstructionType::BINARY:
+			{
+				// division traps on zero, it must not run when the loop doesn't
+				TACBinaryOperator op = ((TACBinaryInst *)inst->instruction)->op;
+				return op != TACBinaryOperator::DIV and op != TACBinaryOperator::MOD;
+			}
+			default:
+			{
+				return false;
+			}
+		}
+	}
+
+
+	bool hoist_invariants(TACFunction *fn,size_t preheader,std::vector<int> &indices,LoopInfo &info)
+	{
+		std::set<int> hoisted;
+		bool changed = true;
+
+		while (changed)
+		{
+			changed = false;
+
+			for (int i : indices)
+			{
+				TACInstruction *inst = fn->instructions[i];
+
+				if (hoisted.find(i) != hoisted.end() or not is_hoistable(inst))
+				{
+					continue;
+				}
+
+				TACValue *dst_value = TacCfg::get_def(inst);
+				int dst = TacCfg::get_id(dst_value);
+
+				if (not TacCfg::is_temporary(dst_value) or info.def_count[dst] != 1 or is_memory(info,dst))
+				{
+					continue;
+				}
+
+				bool invariant = true;
+
+				for (TACValue **slot : TacCfg::get_use_slots(inst))
+				{
+					if (not is_invariant(info,*slot))
+					{
+						invariant = false;
+						break;
+					}
+				}
+
+				if (invariant)
+				{
+					hoisted.insert(i);
+					info.invariant.insert(dst);
+					changed = true;
+				}
+			}
+		}
+
+		if (hoisted.empty())
+		{
+			return false;
+		}
+
+		std::vector<TACInstruction *> instructions;
+
+		for (size_t i = 0; i < fn->instructions.size(); i++)
+		{
+			if (i == preheader)
+			{
+				for (int index : hoisted)
+				{
+					instructions.push_back(fn->instructions[index]);
+				}
+			}
+
+			if (hoisted.find(i) == hoisted.end())
+			{
+				instructions.push_back(fn->instructions[i]);
+			}
+		}
+
+		fn->instructions = instructions;
+		this->instructions_hoisted += hoisted.size();
+
+		return true;
+	}
+
+
+	bool get_constant(TACValue *value,long *result)
+	{
+		if (value == nullptr or value->type != TACValueType::CONSTANT)
+		{
+			return false;
+		}
+
+		TACConstant *constant = (TACConstant *)value->value;
+
+		switch (constant->type)
+		{
+			case TACConstantType::I32:
+			{
+				*result = *(int *)constant->constant;
+				return true;
+			}
+			case TACConstantType::U32:
+			{
+				*result = *(unsigned int *)constant->constant;
+				return true;
+			}
+			case TACConstantType::I64:
+			case TACConstantType::U64:
+			{
+				*result = *(long *)constant->constant;
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+
+	// step of a basic induction variable, the index of the instruction that
+	// updates it is stored in *update
+	bool get_induction_step(TACFunction *fn,LoopInfo &info,int id,long *step,int *update)
+	{
+		auto it = info.loop_defs.find(id);
+
+		if (it == info.loop_defs.end() or it->second.size() != 1 or is_memory(info,id))
+		{
+			return false;
+		}
+
+		*update = it->second[0];
+		TACInstruction *inst = fn->instructions[*update];
+
+		if (inst->type == TACInstructionType::COPY)
+		{
+			// `i = i + 1` is lowered as `t = i + 1` followed by `i = t`
+			TACValue *src = ((TACCopyInst *)inst->instruction)->src;
+			auto tmp_it = info.loop_defs.find(TacCfg::get_id(src));
+
+			if (not TacCfg::is_temporary(src) or tmp_it == info.loop_defs.end() or info.def_count[TacCfg::get_id(src)] != 1)
+			{
+				return false;
+			}
+
+			inst = fn->instructions[tmp_it->second[0]];
+		}
+
+		if (inst->type != TACInstructionType::BINARY)
+		{
+			return false;
+		}
+
+		TACBinaryInst *binary = (TACBinaryInst *)inst->instruction;
+
+		if (binary->op == TACBinaryOperator::ADD and TacCfg::get_id(binary->src1) == id and get_constant(binary->src2,step))
+		{
+			return true;
+		}
+
+		if (binary->op == TACBinaryOperator::ADD and TacCfg::get_id(binary->src2) == id and get_constant(binary->src1,step))
+		{
+			return true;
+		}
+
+		if (binary->op == TACBinaryOperator::SUB and TacCfg::get_id(binary->src1) == id and get_constant(binary->src2,step))
+		{
+			*step = -*step;
+			return true;
+		}
+
+		return false;
+	}
+
+
+	bool reduce_strength(TACFunction *fn,size_t preheader,std::vector<int> &indices,LoopInfo &info)
+	{
+		std::map<std::pair<int,long>,TACValue *> reduced;
+		std::map<int,std::vector<TACInstruction *>> after;
+		std::vector<TACInstruction *> init;
+
+		for (int i : indices)
+		{
+			TACInstruction *inst = fn->instructions[i];
+
+			if (inst->type != TACInstructionType::BINARY)
+			{
+				continue;
+			}
+
+			TACBinaryInst *binary = (TACBinaryInst *)inst->instruction;
+
+			if (binary->op != TACBinaryOperator::MUL)
+			{
+				continue;
+			}
+
+			TACValue *iv = binary->src1;
+			TACValue *factor_value = binary->src2;
+			long factor;
+
+			if (not get_constant(factor_value,&factor))
+			{
+				iv = binary->src2;
+				factor_value = binary->src1;
+
+				if (not get_constant(factor_value,&factor))
+				{
+					continue;
+				}
+			}
+
+			int id = TacCfg::get_id(iv);
+			long step;
+			int update;
+
+			if (id == -1 or id == TacCfg::get_id(binary->dst) or not get_induction_step(fn,info,id,&step,&update))
+			{
+				continue;
+			}
+
+			auto key = std::make_pair(id,factor);
+
+			if (reduced.find(key) == reduced.end())
+			{
+				TACValue *sum = make_variable(this->program->make_variable_id(),binary->data_type);
+				reduced[key] = sum;
+
+				init.push_back(make_binary(sum,iv,TACBinaryOperator::MUL,factor_value,binary->data_type));
+				after[update].push_back(make_binary(sum,sum,TACBinaryOperator::ADD,
+				                                    make_constant(step * factor,factor_value),binary->data_type));
+			}
+
+			void *mem = alloc(sizeof(TACCopyInst));
+			TACCopyInst *tac_copy = new(mem) TACCopyInst(binary->dst,reduced[key]);
+			tac_copy->add_type(binary->data_type);
+
+			inst->type = TACInstructionType::COPY;
+			inst->instruction = tac_copy;
+			this->strength_reduced++;
+		}
+
+		if (init.empty())
+		{
+			return false;
+		}
+
+		std::vector<TACInstruction *> instructions;
+
+		for (size_t i = 0; i < fn->instructions.size(); i++)
+		{
+			if (i == preheader)
+			{
+				instructions.insert(instructions.end(),init.begin(),init.end());
+			}
+
+			instructions.push_back(fn->instructions[i]);
+
+			auto it = after.find(i);
+
+			if (it != after.end())
+			{
+				instructions.insert(instructions.end(),it->second.begin(),it->second.end());
+			}
+		}
+
+		fn->instructions = instructions;
+
+		return true;
+	}
+
+
+	TACValue *make_variable(int id,TACType data_type)
+	{
+		void *mem = alloc(sizeof(TACVariable));
+		TACVariable *tac_var = new(mem) TACVariable(id);
+		tac_var->add_type(data_type);
+
+		mem = alloc(sizeof(TACValue));
+		TACValue *tac_value = new(mem) TACValue(TACValueType::VARIABLE,tac_var);
+		tac_value->add_type(data_type);
+
+		return tac_value;
+	}
+
+
+	// a constant of the same width as `like`
+	TACValue *make_constant(long value,TACValue *like)
+	{
+		TACConstant *constant = (TACConstant *)like->value;
+		void *data = nullptr;
+
+		if (constant->type == TACConstantType::I32 or constant->type == TACConstantType::U32)
+		{
+			data = alloc(sizeof(int));
+			*(int *)data = (int)value;
+		}
+		else
+		{
+			data = alloc(sizeof(long));
+			*(long *)data = value;
+		}
+
+		void *mem = alloc(sizeof(TACConstant));
+		TACConstant *tac_constant = new(mem) TACConstant(constant->type,data);
+
+		mem = alloc(sizeof(TACValue));
+		TACValue *tac_value = new(mem) TACValue(TACValueType::CONSTANT,tac_constant);
+		tac_value->add_type(like->data_type);
+
+		return tac_value;
+	}
+
+
+	TACInstruction *make_binary(TACValue *dst,TACValue *src1,TACBinaryOperator op,TACValue *src2,TACType data_type)
+	{
+		void *mem = alloc(sizeof(TACBinaryInst));
+		TACBinaryInst *tac_binary = new(mem) TACBinaryInst(dst,src1,op,src2);
+		tac_binary->add_type(data_type);
+
+		mem = alloc(sizeof(TACInstruction));
+		return new(mem) TACInstruction(TACInstructionType::BINARY,tac_binary);
+	}
+};
+
+
+#endif
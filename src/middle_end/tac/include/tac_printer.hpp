@@ -0,0 +1,352 @@
+#ifndef C4C_TAC_PRINTER_H
+#define C4C_TAC_PRINTER_H
+
+#include "tac.hpp"
+#include <string>
+#include <vector>
+
+
+/*
+ * Textual dump of a TACProgram, one instruction per line :
+ *
+ *     fn add(a,b):
+ *         c4_tmp.0 = a + b
+ *         return c4_tmp.0
+ */
+
+class TacPrinter
+{
+public:
+	std::string file_name;
+	TACProgram *program;
+	std::string string;
+
+
+	void write_body(std::string string)
+	{
+		this->string += string;
+	}
+
+	TacPrinter(std::string file_name,TACProgram *program)
+	{
+		this->file_name = file_name;
+		this->program = program;
+
+		for (TACDeclaration *decl : this->program->decls)
+		{
+			if (decl == nullptr)
+			{
+				continue;
+			}
+
+			if (decl->type == TACDeclarationType::FUNCTION)
+			{
+				print_function((TACFunction *)decl->decl);
+			}
+			else
+			{
+				print_global((TACGlobalVariable *)decl->decl);
+			}
+		}
+	}
+
+
+	std::string get_type(TACType type)
+	{
+		switch (type)
+		{
+			case TACType::I32:
+			{
+				return "i32";
+			}
+			case TACType::I64:
+			{
+				return "i64";
+			}
+			case TACType::U32:
+			{
+				return "u32";
+			}
+			case TACType::U64:
+			{
+				return "u64";
+			}
+			case TACType::PTR:
+			{
+				return "ptr";
+			}
+		}
+
+		return "?";
+	}
+
+
+	void print_global(TACGlobalVariable *global)
+	{
+		std::string data = "?";
+
+		if (global->data != nullptr)
+		{
+			switch (global->data_type)
+			{
+				case TACType::I32:
+				case TACType::U32:
+				{
+					data = std::to_string(*(int *)global->data);
+					break;
+				}
+				default:
+				{
+					data = std::to_string(*(long *)global->data);
+					break;
+				}
+			}
+		}
+
+		write_body(std::string(global->is_public ? "pub " : "") + get_type(global->data_type) + " " + global->ident + " = " + data + "\n\n");
+	}
+
+
+	void print_function(TACFunction *fn)
+	{
+		std::string args;
+
+		for (size_t i = 0; i < fn->arguments.size(); i++)
+		{
+			args += (i == 0 ? "" : ",") + fn->arguments[i].ident;
+		}
+
+		write_body(std::string(fn->is_public ? "pub " : "") + "fn " + fn->ident + "(" + args + "):\n");
+
+		for (TACInstruction *inst : fn->instructions)
+		{
+			if (inst == nullptr)
+			{
+				continue;
+			}
+
+			if (inst->type == TACInstructionType::LABEL)
+			{
+				write_body("    " + get_label_name(((TACLabelInst *)inst->instruction)->label) + ":\n");
+				continue;
+			}
+
+			write_body("        " + print_instruction(inst) + "\n");
+		}
+
+		write_body("\n");
+	}
+
+
+	std::string print_value(TACValue *value)
+	{
+		if (value == nullptr)
+		{
+			return "_";
+		}
+
+		if (value->type == TACValueType::VARIABLE)
+		{
+			return ((TACVariable *)value->value)->get_name();
+		}
+
+		TACConstant *constant = (TACConstant *)value->value;
+
+		switch (constant->type)
+		{
+			case TACConstantType::I32:
+			{
+				return std::to_string(*(int *)constant->constant);
+			}
+			case TACConstantType::U32:
+			{
+				return std::to_string(*(unsigned int *)constant->constant);
+			}
+			case TACConstantType::I64:
+			{
+				return std::to_string(*(long *)constant->constant);
+			}
+			case TACConstantType::U64:
+			{
+				return std::to_string(*(unsigned long *)constant->constant);
+			}
+		}
+
+		return "?";
+	}
+
+
+	std::string print_binary_op(TACBinaryOperator op)
+	{
+		switch (op)
+		{
+			case TACBinaryOperator::MUL:
+			{
+				return "*";
+			}
+			case TACBinaryOperator::DIV:
+			{
+				return "/";
+			}
+			case TACBinaryOperator::MOD:
+			{
+				return "%";
+			}
+			case TACBinaryOperator::ADD:
+			{
+				return "+";
+			}
+			case TACBinaryOperator::SUB:
+			{
+				return "-";
+			}
+			case TACBinaryOperator::LESS:
+			{
+				return "<";
+			}
+			case TACBinaryOperator::LESS_EQUAL:
+			{
+				return "<=";
+			}
+			case TACBinaryOperator::GREATER:
+			{
+				return ">";
+			}
+			case TACBinaryOperator::GREATER_EQUAL:
+			{
+				return ">=";
+			}
+			case TACBinaryOperator::AND:
+			{
+				return "&&";
+			}
+			case TACBinaryOperator::OR:
+			{
+				return "||";
+			}
+			case TACBinaryOperator::EQUAL:
+			{
+				return "==";
+			}
+			case TACBinaryOperator::NOT_EQUAL:
+			{
+				return "!=";
+			}
+			case TACBinaryOperator::BIT_AND:
+			{
+				return "&";
+			}
+			case TACBinaryOperator::BIT_OR:
+			{
+				return "|";
+			}
+			case TACBinaryOperator::BIT_XOR:
+			{
+				return "^";
+			}
+			case TACBinaryOperator::SHIFT_LEFT:
+			{
+				return "<<";
+			}
+			case TACBinaryOperator::SHIFT_RIGHT:
+			{
+				return ">>";
+			}
+			default:
+			{
+				return "?";
+			}
+		}
+	}
+
+
+	std::string print_instruction(TACInstruction *inst)
+	{
+		switch (inst->type)
+		{
+			case TACInstructionType::RETURN:
+			{
+				return "return " + print_value(((TACReturnInst *)inst->instruction)->value);
+			}
+			case TACInstructionType::UNARY:
+			{
+				TACUnaryInst *unary = (TACUnaryInst *)inst->instruction;
+				std::string op = unary->op == TACUnaryOperator::NEGATE ? "-" : "~";
+				return print_value(unary->dst) + " = " + op + print_value(unary->src);
+			}
+			case TACInstructionType::BINARY:
+			{
+				TACBinaryInst *binary = (TACBinaryInst *)inst->instruction;
+				return print_value(binary->dst) + " = " + print_value(binary->src1) + " " + print_binary_op(binary->op) + " " + print_value(binary->src2);
+			}
+			case TACInstructionType::JMP:
+			{
+				return "jmp " + get_label_name(((TACJmpInst *)inst->instruction)->label);
+			}
+			case TACInstructionType::JMP_ZERO:
+			{
+				TACJmpIfZeroInst *jz = (TACJmpIfZeroInst *)inst->instruction;
+				return "jz " + print_value(jz->value) + " " + get_label_name(jz->label);
+			}
+			case TACInstructionType::JMP_NOT_ZERO:
+			{
+				TACJmpIfNotZeroInst *jnz = (TACJmpIfNotZeroInst *)inst->instruction;
+				return "jnz " + print_value(jnz->value) + " " + get_label_name(jnz->label);
+			}
+			case TACInstructionType::COPY:
+			{
+				TACCopyInst *copy = (TACCopyInst *)inst->instruction;
+				return print_value(copy->dst) + " = " + print_value(copy->src);
+			}
+			case TACInstructionType::FUNCTION_CALL:
+			{
+				TACFunctionCallInst *call = (TACFunctionCallInst *)inst->instruction;
+				std::string args;
+
+				for (size_t i = 0; i < call->arguments.size(); i++)
+				{
+					args += (i == 0 ? "" : ",") + print_value(call->arguments[i]);
+				}
+
+				return print_value(call->dst) + " = call " + call->ident + "(" + args + ")";
+			}
+			case TACInstructionType::SIGN_EXTEND:
+			{
+				TACSignExtendInst *extend = (TACSignExtendInst *)inst->instruction;
+				return print_value(extend->dst) + " = sext " + print_value(extend->src);
+			}
+			case TACInstructionType::TRUNCATE:
+			{
+				TACTruncateInst *truncate = (TACTruncateInst *)inst->instruction;
+				return print_value(truncate->dst) + " = trunc " + print_value(truncate->src);
+			}
+			case TACInstructionType::ZERO_EXTEND:
+			{
+				TACZeroExtendInst *extend = (TACZeroExtendInst *)inst->instruction;
+				return print_value(extend->dst) + " = zext " + print_value(extend->src);
+			}
+			case TACInstructionType::GET_ADDRESS:
+			{
+				TACGetAddressInst *get_address = (TACGetAddressInst *)inst->instruction;
+				return print_value(get_address->dst) + " = &" + print_value(get_address->src);
+			}
+			case TACInstructionType::LOAD:
+			{
+				TACLoadInst *load = (TACLoadInst *)inst->instruction;
+				return print_value(load->dst) + " = load." + get_type(load->data_type) + " " + print_value(load->src);
+			}
+			case TACInstructionType::STORE:
+			{
+				TACStoreInst *store = (TACStoreInst *)inst->instruction;
+				return "store." + get_type(store->data_type) + " " + print_value(store->dst) + " " + print_value(store->src);
+			}
+			default:
+			{
+				return "?";
+			}
+		}
+	}
+};
+
+
+#endif
@@ -63,6 +63,7 @@ public:
     std::string help;
     std::string version;
     std::vector<Argument> arguments;
+    std::vector<std::string> positionals;
 
     Argparser(std::string name,std::string description,std::string help,std::string version)
     {
@@ -129,6 +130,21 @@ public:
     }
 
 
+    // true when the argument was given, even with an empty value
+    bool is_given(std::string long_name)
+    {
+        for(Argument argument : this->arguments)
+        {
+            if(argument.long_name == long_name)
+            {
+                return argument.is_active;
+            }
+        }
+
+        return false;
+    }
+
+
     i64 get_value_i64(std::string long_name)
     {
         for(Argument argument : this->arguments)
@@ -156,26 +172,43 @@ public:
                 if(arg[1] == '-')
                 {
                     arg += 2;
-                    name = arg;
 
-                    for( int j = 0; j < this->arguments.size(); j++)
+                    // --name=value and --name value are the same
+                    std::string long_name(arg);
+                    std::string inline_value;
+                    bool has_inline_value = false;
+
+                    if(long_name.find('=') != std::string::npos)
+                    {
+                        inline_value = long_name.substr(long_name.find('=') + 1);
+                        long_name = long_name.substr(0,long_name.find('='));
+                        has_inline_value = true;
+                    }
+
+                    for( size_t j = 0; j < this->arguments.size(); j++)
                     {
                         Argument argument = this->arguments[j];
                     
-                        if(argument.long_name == name)
+                        if(argument.long_name == long_name)
                         {
                             switch(argument.type)
                             {
                                 case ArgumentType::STRING:
                                 {
-                                    std::string value_string(argv[++i]);
+                                    if(not has_inline_value and i + 1 >= argc)
+                                    {
+                                        fatal("missing value for --" + long_name);
+                                        break;
+                                    }
+
+                                    std::string value_string = has_inline_value ? inline_value : std::string(argv[++i]);
                                     this->arguments[j].value_string = value_string;
                                     this->arguments[j].is_active = true;
                                     break;
                                 }
                                 case ArgumentType::FLAG:
                                 {
-                                    this->arguments[i].flag = true;
+                                    this->arguments[j].flag = true;
                                     this->arguments[j].is_active = true;
                                     break;
                                 }
@@ -192,9 +225,19 @@ public:
                     arg += 1;
                     name = arg;
 
-                    for( int j = 0; j < this->arguments.size(); j++)
+                    for( size_t j = 0; j < this->arguments.size(); j++)
                     {
                         Argument argument = this->arguments[j];
+                        std::string short_name(name);
+
+                        // string options also take their value attached, -O2
+                        if(argument.type == ArgumentType::STRING and argument.short_name != "" and
+                           short_name.size() > argument.short_name.size() and short_name.rfind(argument.short_name,0) == 0)
+                        {
+                            this->arguments[j].value_string = short_name.substr(argument.short_name.size());
+                            this->arguments[j].is_active = true;
+                            continue;
+                        }
                     
                         if(argument.short_name == name)
                         {
@@ -202,6 +245,12 @@ public:
                             {
                                 case ArgumentType::STRING:
                                 {
+                                    if(i + 1 >= argc)
+                                    {
+                                        fatal("missing value for -" + short_name);
+                                        break;
+                                    }
+
                                     std::string value_string(argv[++i]);
                                     this->arguments[j].value_string = value_string;
                                     this->arguments[j].is_active = true;
@@ -209,7 +258,7 @@ public:
                                 }
                                 case ArgumentType::FLAG:
                                 {
-                                    this->arguments[i].flag = true;
+                                    this->arguments[j].flag = true;
                                     this->arguments[j].is_active = true;
                                     break;
                                 }
@@ -222,6 +271,10 @@ public:
                     }
                 }
             }
+            else
+            {
+                this->positionals.push_back(std::string(arg));
+            }
         }
     }
 
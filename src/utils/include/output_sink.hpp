@@ -0,0 +1,130 @@
+#ifndef C4C_OUTPUT_SINK_H
+#define C4C_OUTPUT_SINK_H
+
+#include "utils.hpp"
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+
+
+/*
+ * Fixed size output buffer in front of a file descriptor, shared by the
+ * code generators. Memory use is BUFFER_SIZE however much is written, the
+ * buffer goes to the file whenever it fills up and when the sink is
+ * destroyed.
+ */
+
+class OutputSink
+{
+public:
+	static const int BUFFER_SIZE = 1 << 16;
+
+	std::string file_name;
+	int fd = -1;
+	bool owns_fd = false;
+	char buffer[BUFFER_SIZE];
+	int used = 0;
+	long int written = 0;
+
+	OutputSink(std::string file_name)
+	{
+		this->file_name = file_name;
+		this->fd = open(file_name.c_str(),O_WRONLY | O_CREAT | O_TRUNC,0644);
+		this->owns_fd = true;
+
+		if (this->fd == -1)
+		{
+			DEBUG_PRINT("Error : could not open file  =>  ",file_name);
+		}
+	}
+
+	OutputSink(int fd)
+	{
+		this->fd = fd;
+	}
+
+	~OutputSink()
+	{
+		flush();
+
+		if (this->owns_fd and this->fd != -1)
+		{
+			close(this->fd);
+		}
+	}
+
+
+	void write(const char *data,long int size)
+	{
+		if (this->used + size > BUFFER_SIZE)
+		{
+			flush();
+		}
+
+		// too big to buffer, goes straight to the file
+		if (size > BUFFER_SIZE)
+		{
+			write_fd(data,size);
+			return;
+		}
+
+		memcpy(this->buffer + this->used,data,size);
+		this->used += size;
+	}
+
+
+	void write(const std::string &string)
+	{
+		write(string.data(),string.size());
+	}
+
+
+	void write_tabs(int depth)
+	{
+		for (int i = 0; i < depth; i++)
+		{
+			write("\t",1);
+		}
+	}
+
+
+	void flush()
+	{
+		write_fd(this->buffer,this->used);
+		this->used = 0;
+	}
+
+
+	void write_fd(const char *data,long int size)
+	{
+		this->written += size;
+
+		if (this->fd == -1)
+		{
+			return;
+		}
+
+		while (size > 0)
+		{
+			long int count = ::write(this->fd,data,size);
+
+			if (count == -1)
+			{
+				if (errno == EINTR)
+				{
+					continue;
+				}
+
+				DEBUG_PANIC("Error : could not write file  =>  " + this->file_name);
+			}
+
+			data += count;
+			size -= count;
+		}
+	}
+
+};
+
+
+
+#endif
@@ -0,0 +1,39 @@
+// arithmetic lowering benchmark : division and remainder by constants
+// become multiplies and shifts, by a variable they stay idiv, shifts by a
+// variable count go through cl
+//
+//    driver --native tests/bench/arith.rs
+//    driver tests/bench/arith.rs   (the C output is the reference)
+//
+
+
+fn digits(i64 n)->i64:
+    i64 s = 0
+    while n > 0:
+        s = s + n % 10
+        n = n / 10
+    :
+    return s
+:
+
+
+fn mix(i64 a,i64 b)->i64:
+    return a * 33 + (a << 3) - (b >> 2) + (a & b | a ^ b) + a / 7 - b % 16
+:
+
+
+fn hot(i64 n,i64 d)->i64:
+    i64 s = 0
+    i64 i = 1
+    while i < n:
+        s = s + digits(i) + mix(i,s) / d + (i >> (s & 7))
+        s = s % 1000000007
+        i = i + 1
+    :
+    return s
+:
+
+
+pub fn main()->i32:
+    return cast<i32>(hot(1000000,3) % 251)
+:
@@ -0,0 +1,46 @@
+// branch heavy benchmark : every condition below is a comparison that
+// feeds a jump, so instruction selection emits cmp + jcc with no 0/1 value,
+// and the && / || chains short circuit straight to their targets
+//
+//    driver --native tests/bench/branches.rs
+//
+
+
+fn classify(i64 a,i64 b,i64 c)->i64:
+    i64 r = 0
+    if a < b && b < c || a == c:
+        r = r + 1
+    :
+    elif a == b && (b > c || c >= a):
+        r = r + 2
+    :
+    else:
+        r = r + 3
+    :
+    return r
+:
+
+
+fn scan(i64 n,i64 lo,i64 hi)->i64:
+    i64 i = 0
+    i64 hits = 0
+    while i < n && hits < hi || i < lo:
+        if i % 3 == 0 || i % 5 == 0 && i > lo:
+            hits = hits + 1
+        :
+        i = i + 1
+    :
+    return hits
+:
+
+
+pub fn main()->i32:
+    i64 total = 0
+    i64 round = 0
+    while round < 1000000:
+        total = total + classify(round % 7,round % 5,round % 3)
+        total = total + scan(64,8,40)
+        round = round + 1
+    :
+    return cast<i32>(total % 251)
+:
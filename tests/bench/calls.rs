@@ -0,0 +1,34 @@
+// calling convention benchmark : the first six arguments travel in
+// registers, the rest are pushed with the stack kept 16 byte aligned, and
+// the leaf callees can run without a frame pointer. The inliner removes
+// mix8 and mix9 by default, --inline-threshold 0 keeps the calls
+//
+//    driver --native --inline-threshold 0 tests/bench/calls.rs
+//    driver --native --inline-threshold 0 --omit-frame-pointer tests/bench/calls.rs
+//
+
+
+fn mix8(i64 a,i64 b,i64 c,i64 d,i64 e,i64 f,i64 g,i64 h)->i64:
+    return a + b * 2 - c + d * 3 - e + f * 5 - g + h * 7
+:
+
+
+fn mix9(i64 a,i64 b,i64 c,i64 d,i64 e,i64 f,i64 g,i64 h,i64 i)->i64:
+    return mix8(a,b,c,d,e,f,g,h) - i
+:
+
+
+fn hot(i64 n)->i64:
+    i64 s = 0
+    i64 i = 0
+    while i < n:
+        s = s + mix9(i,s,1,2,3,4,5,i,s) % 1000
+        i = i + 1
+    :
+    return s
+:
+
+
+pub fn main()->i32:
+    return cast<i32>(hot(10000000) % 251)
+:
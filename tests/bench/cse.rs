@@ -0,0 +1,60 @@
+// redundant expression corpus for the tac value numbering pass (gvn)
+//
+//    driver --native tests/bench/cse.rs
+//
+
+
+i64 counter = 0
+
+
+fn bump()->i64:
+    counter = counter + 1
+    return counter
+:
+
+
+fn reads(i64 *p,i64 *q)->i64:
+    i64 a = p@read() + p@read()
+    q@write(a)
+    i64 b = p@read() + q@read()
+    return a + b
+:
+
+
+fn locals(i64 x,i64 y)->i64:
+    i64 v = 5
+    i64 w = 6
+    i64 *pv = &v
+    i64 *pw = &w
+    pw@write(x + y)
+    i64 r = pv@read() + pv@read() + pw@read()
+    bump()
+    return r + pv@read() + (x + y) + (y + x)
+:
+
+
+fn branches(i64 a,i64 b)->i64:
+    i64 r = a - b
+    if a < b:
+        r = (a - b) + (a + b)
+    :
+    else:
+        r = (a - b) - (a + b)
+    :
+    return r + (a + b)
+:
+
+
+fn globals(i64 n)->i64:
+    i64 r = counter + n
+    bump()
+    return r + (counter + n)
+:
+
+
+pub fn main()->i32:
+    i64 x = 4
+    i64 y = 9
+    i64 total = reads(&x,&y) + locals(3,7) + branches(2,5) + globals(11)
+    return cast<i32>(total % 251)
+:
@@ -0,0 +1,54 @@
+// loop heavy benchmark for the tac loop passes (licm, strength reduction)
+//
+//    driver --native tests/bench/loops.rs
+//    bash tests/check.sh bench   (every benchmark at -O0 and -O2, timed)
+//
+
+
+fn invariant_sum(i64 n,i64 a,i64 b)->i64:
+    i64 i = 0
+    i64 sum = 0
+    while i < n:
+        sum = sum + (a + b) + (a - b) + i
+        i = i + 1
+    :
+    return sum
+:
+
+
+fn nested(i64 n,i64 m,i64 k)->i64:
+    i64 i = 0
+    i64 sum = 0
+    while i < n:
+        i64 j = 0
+        while j < m:
+            sum = sum + (k + n) - (m - k) + j
+            j = j + 1
+        :
+        i = i + 1
+    :
+    return sum
+:
+
+
+fn countdown(i64 n,i64 step)->i64:
+    i64 sum = 0
+    while n > 0:
+        sum = sum + (step + step) + n
+        n = n - step
+    :
+    return sum
+:
+
+
+pub fn main()->i32:
+    i64 total = 0
+    i64 round = 0
+    while round < 100:
+        total = total + invariant_sum(100000,round,7)
+        total = total + nested(300,300,round)
+        total = total + countdown(100000,1)
+        round = round + 1
+    :
+    return cast<i32>(total % 251)
+:
@@ -0,0 +1,80 @@
+// register allocation benchmark : a hot loop, a loop around a call (values
+// live across the call need callee saved registers) and a loop body with
+// more live values than there are registers
+//
+//    driver --native tests/bench/regalloc.rs
+//    driver --native --no-regalloc tests/bench/regalloc.rs
+//
+
+
+fn add3(i64 a,i64 b,i64 c)->i64:
+    return a + b - c
+:
+
+
+fn hot(i64 n,i64 x)->i64:
+    i64 s = 0
+    i64 t = 0
+    i64 i = 0
+    while i < n:
+        s = s + (i + x - 7)
+        if s > 100000000:
+            s = s - 100000000
+        :
+        t = i - t + x
+        i = i + 1
+    :
+    return s + t
+:
+
+
+fn calls(i64 n)->i64:
+    i64 s = 0
+    i64 i = 0
+    while i < n:
+        s = add3(s,i,1)
+        i = i + 1
+    :
+    return s
+:
+
+
+fn pressure(i64 n)->i64:
+    i64 acc = 0
+    i64 j = 0
+    while j < n:
+        i64 v0 = j + 0
+        i64 v1 = j + 1
+        i64 v2 = j + 2
+        i64 v3 = j + 3
+        i64 v4 = j + 4
+        i64 v5 = j + 5
+        i64 v6 = j + 6
+        i64 v7 = j + 7
+        i64 v8 = j + 8
+        i64 v9 = j + 9
+        i64 v10 = j + 10
+        i64 v11 = j + 11
+        i64 v12 = j + 12
+        i64 v13 = j + 13
+        i64 v14 = j + 14
+        i64 v15 = j + 15
+        acc = acc - v15 + v14 - v13 + v12 - v11 + v10 - v9 + v8
+        acc = acc - v7 + v6 - v5 + v4 - v3 + v2 - v1 + v0
+        j = j + 1
+    :
+    return acc
+:
+
+
+pub fn main()->i32:
+    i64 total = 0
+    total = total + hot(200000000,5)
+    total = total + calls(100000000)
+    total = total + pressure(50000000)
+    total = total % 251
+    if total < 0:
+        total = total + 251
+    :
+    return cast<i32>(total)
+:
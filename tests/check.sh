@@ -0,0 +1,336 @@
+#!/bin/bash
+#
+# builds the programs in tests/programs and checks what main returns
+#
+#    make check                        every section
+#    bash tests/check.sh inline        only the named sections
+#
+# the first line of a program is "// expect n", n is main's result as
+# the exit status shows it. In tests/makeda it is the last line printed,
+# "; expect" in makasm. Native builds use --emit-object and link
+# with gcc, so nasm is not needed. Without nasm the object section is
+# skipped, REQUIRE_NASM=1 makes that a failure. The benchmarks in tests/bench have
+# no expected result, the c backend gives it.
+#
+
+DRIVER=${DRIVER:-target/driver}
+PROGRAMS=${PROGRAMS:-tests/programs}
+MAKEDA=${MAKEDA:-tests/makeda}
+BENCH=${BENCH:-tests/bench}
+SECTIONS="inline opt passes peephole encoder object symbols c bench makeda intel"
+
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+passed=0
+failed=0
+skipped=0
+
+
+expect()
+{
+	sed -n '1s/^\(\/\/\|;\) expect //p' "$1"
+}
+
+
+# prints the exit status of the native build of file, compiled with the
+# remaining arguments, or why there is none
+native()
+{
+	local file=$1
+	shift
+	local base=$WORK/$(basename "$file" .rs)
+
+	cp "$file" "$base.rs"
+	"$DRIVER" --native --emit-object "$@" "$base.rs" > "$base.log" 2>&1 || { echo "compile error"; return; }
+	gcc "$base.o" -o "$base" >> "$base.log" 2>&1 || { echo "link error"; return; }
+	"$base"
+	echo $?
+}
+
+
+# the same for main run in the makeda vm
+run()
+{
+	local file=$1
+	shift
+	local base=$WORK/$(basename "$file" .rs)
+
+	cp "$file" "$base.rs"
+	"$DRIVER" --run "$@" "$base.rs" > "$base.log" 2>&1
+	echo $?
+}
+
+
+# the same for the c the driver writes next to the source, built by gcc
+c_build()
+{
+	local file=$1
+	shift
+	local base=$WORK/$(basename "$file" .rs)
+
+	cp "$file" "$base.rs"
+	"$DRIVER" "$@" "$base.rs" > "$base.log" 2>&1 || { echo "compile error"; return; }
+	gcc -w "$base.c" -o "$base" >> "$base.log" 2>&1 || { echo "gcc error"; return; }
+	"$base"
+	echo $?
+}
+
+
+check()
+{
+	if [ "$2" = "$3" ]
+	then
+		passed=$((passed + 1))
+	else
+		failed=$((failed + 1))
+		echo "FAIL $1 : expected $2, got $3"
+	fi
+}
+
+
+# inlined and not inlined calls give the same result
+section_inline()
+{
+	for file in "$PROGRAMS"/*.rs
+	do
+		for threshold in 0 40 1000
+		do
+			check "$file native --inline-threshold $threshold" "$(expect "$file")" "$(native "$file" --inline-threshold "$threshold")"
+			check "$file run --inline-threshold $threshold" "$(expect "$file")" "$(run "$file" --inline-threshold "$threshold")"
+		done
+	done
+}
+
+
+# -O0 and -O2 agree with each other and with the expected result, and
+# gvn on its own changes nothing either
+section_opt()
+{
+	for file in "$PROGRAMS"/*.rs
+	do
+		local expected=$(expect "$file")
+		local o0=$(native "$file" -O0)
+		local o2=$(native "$file" -O2)
+
+		check "$file native -O0" "$expected" "$o0"
+		check "$file native -O2 against -O0" "$o0" "$o2"
+		check "$file native --passes=gvn" "$expected" "$(native "$file" --passes=gvn)"
+
+		o0=$(run "$file" -O0)
+		o2=$(run "$file" -O2)
+
+		check "$file run -O0" "$expected" "$o0"
+		check "$file run -O2 against -O0" "$o0" "$o2"
+	done
+}
+
+
+# an empty --passes= runs no tac pass, the program still works
+section_passes()
+{
+	for file in "$PROGRAMS"/*.rs
+	do
+		local base=$WORK/$(basename "$file" .rs)
+
+		check "$file native --passes=" "$(expect "$file")" "$(native "$file" --passes=)"
+		check "$file passes run by --passes=" "" "$(grep -E '^(inline|licm|gvn) :' "$base.log")"
+	done
+}
+
+
+# the peephole pass never changes a result, with allocated registers or
+# with every value in a stack slot
+section_peephole()
+{
+	for file in "$PROGRAMS"/*.rs
+	do
+		for regalloc in "" --no-regalloc
+		do
+			local with=$(native "$file" $regalloc)
+			local without=$(native "$file" $regalloc --no-peephole)
+
+			check "$file native $regalloc" "$(expect "$file")" "$with"
+			check "$file native $regalloc --no-peephole against the peephole build" "$with" "$without"
+		done
+	done
+}
+
+
+# a few fixed instructions encode to the bytes nasm gives them
+section_encoder()
+{
+	if ! g++ -std=c++17 -o "$WORK/encoder" tests/encoder.cpp
+	then
+		check "encoder build" "encoder" "build error"
+		return
+	fi
+
+	"$WORK/encoder" | grep '^FAIL'
+	check "encoder" "0" "${PIPESTATUS[0]}"
+}
+
+
+# the written object matches what nasm assembles from the same code, the
+# directory name needs quoting and nasm's object is removed afterwards
+section_object()
+{
+	if ! command -v nasm > /dev/null
+	then
+		if [ "$REQUIRE_NASM" = 1 ]
+		then
+			check "object : nasm" "found" "not found"
+			return
+		fi
+
+		skipped=$((skipped + 1))
+		echo "SKIP object : nasm not found, --check-object is not tested"
+		return
+	fi
+
+	local dir="$WORK/object dir;x"
+	mkdir -p "$dir"
+
+	for file in "$PROGRAMS"/*.rs
+	do
+		local base=$dir/$(basename "$file" .rs)
+
+		cp "$file" "$base.rs"
+		"$DRIVER" --native --check-object "$base.rs" > "$base.log" 2>&1
+		check "$file --check-object" "0" "$?"
+		check "$file --check-object report" "identical to nasm" "$(grep -o 'identical to nasm' "$base.log")"
+		check "$file nasm object removed" "" "$(ls "$dir" | grep nasm.o)"
+	done
+}
+
+
+# the object exports the pub functions and globals and nothing else
+section_symbols()
+{
+	for file in "$PROGRAMS"/*.rs
+	do
+		local base=$WORK/$(basename "$file" .rs)
+		local public=$(sed -n 's/^pub \(fn \|[a-z0-9]* \**\)\([a-z_0-9]*\).*/\2/p' "$file" | sort)
+
+		native "$file" > /dev/null
+		check "$file exported symbols" "$(echo $public)" "$(echo $(nm -g --defined-only "$base.o" | awk '{ print $3 }' | sort))"
+	done
+}
+
+
+# the native build and the c backend agree, on arguments passed in
+# registers and on the stack, globals, division and shifts
+section_c()
+{
+	for file in "$PROGRAMS"/*.rs
+	do
+		local c=$(c_build "$file")
+
+		check "$file c" "$(expect "$file")" "$c"
+		check "$file native against c" "$c" "$(native "$file")"
+		check "$file native -O0 against c" "$c" "$(native "$file" -O0)"
+	done
+}
+
+
+# the benchmarks give the result of the c backend at -O0 and -O2, with
+# every value in a stack slot and with no call inlined, the time to
+# build and run each native build is printed
+section_bench()
+{
+	for file in "$BENCH"/*.rs
+	do
+		local c=$(c_build "$file")
+
+		for flags in -O0 -O2 --no-regalloc "--inline-threshold 0"
+		do
+			local start=$(date +%s%N)
+			local result=$(native "$file" $flags)
+
+			check "$file native $flags against c" "$c" "$result"
+			echo "bench : $file $flags $(( ($(date +%s%N) - start) / 1000000 )) ms"
+		done
+	done
+}
+
+
+# every makasm program in tests/makeda ends the same way in each makvm
+# dispatch, --profile runs the switch loop, and the driver's programs
+# there the same with and without the jit. The last line printed is
+# compared, without the profile report
+section_makeda()
+{
+	local makvm=$WORK/makvm
+
+	if ! g++ -std=c++17 -O2 -Wall -Werror -o "$makvm" src/middle_end/makeda/makvm/include/main.cpp
+	then
+		check "makvm build" "makvm" "build error"
+		return
+	fi
+
+	for file in "$MAKEDA"/*.masm
+	do
+		for mode in "" --no-verify --jit "--profile $WORK/profile"
+		do
+			local last=$("$makvm" $mode -o "$WORK/out.m" "$file" 2>&1 | grep -v '^makeda profile :\|^    [a-z]' | tail -n 1)
+			check "$file makvm $mode" "$(expect "$file")" "$(echo $last)"
+		done
+	done
+
+	for file in "$MAKEDA"/*.rs
+	do
+		local base=$WORK/$(basename "$file" .rs)
+
+		for mode in "" --jit
+		do
+			run "$file" $mode > /dev/null
+			check "$file run $mode" "$(expect "$file")" "$(tail -n 1 "$base.log")"
+		done
+	done
+}
+
+
+# the register vm rejects a jump outside the program when it loads it, a
+# jump to the end still halts. It writes test.m to the current directory
+section_intel()
+{
+	if ! g++ -std=c++17 -O2 -Wall -Werror -o "$WORK/intel" src/middle_end/intel/makvm/include/main.cpp
+	then
+		check "intel build" "intel" "build error"
+		return
+	fi
+
+	printf 'mov rax,1\njmp 50\nprint rax\n' > "$WORK/far.asm"
+	printf 'mov rax,1\njmp 3\nprint rax\n' > "$WORK/end.asm"
+
+	check "intel jmp 50" "intel : rejected, instruction 1 : jump target 50 is outside the program" \
+		"$(cd "$WORK" && ./intel far.asm 2>&1 | tail -n 1)"
+	check "intel jmp to the end" "0" "$(cd "$WORK" && ./intel end.asm > /dev/null 2>&1; echo $?)"
+
+	# the benchmark runs both vms side by side and refuses what it cannot read
+	if ! g++ -std=c++17 -O2 -Wall -Werror -o "$WORK/vmbench" src/middle_end/intel/makvm/include/bench.cpp
+	then
+		check "vmbench build" "vmbench" "build error"
+		return
+	fi
+
+	check "vmbench pair" "50%" \
+		"$("$WORK/vmbench" tests/bench/makeda/loops.masm tests/bench/intel/loops.masm 2>&1 | grep -o 'runs [0-9]*%' | grep -o '[0-9]*%')"
+	check "vmbench directory" "vmbench : cannot read tests/bench/makeda" \
+		"$("$WORK/vmbench" tests/bench/makeda tests/bench/intel/loops.masm 2>&1 | tail -n 1)"
+}
+
+
+if [ ! -x "$DRIVER" ]
+then
+	echo "check : build $DRIVER first"
+	exit 1
+fi
+
+for section in ${@:-$SECTIONS}
+do
+	"section_$section"
+done
+
+echo "check : $passed passed, $failed failed, $skipped skipped"
+[ "$failed" -eq 0 ]
@@ -0,0 +1,109 @@
+/*
+ * encodes a few fixed instructions and compares the bytes with what
+ * nasm -felf64 makes of the same text, written out by hand so the check
+ * needs no assembler. Built and run by the encoder section of check.sh
+ *
+ *    g++ -std=c++17 -o encoder tests/encoder.cpp && ./encoder
+ */
+
+#include "../src/utils/include/utils.hpp"
+#include "../src/back_end/x86_64/include/encoder.hpp"
+#include <cstdio>
+
+
+ASMOperand *reg(ASMRegisterType type,int size)
+{
+	return new ASMOperand(ASMOperandType::REGISTER,new ASMRegister(type,size));
+}
+
+
+ASMOperand *stack(int size,int index)
+{
+	return new ASMOperand(ASMOperandType::STACK,new ASMStack(size,"rbp",index));
+}
+
+
+ASMOperand *imm(int value)
+{
+	return new ASMOperand(ASMOperandType::IMMEDIATE,new ASMImmediate(ASMImmediateType::I32,new int(value)));
+}
+
+
+std::string hex(std::string bytes)
+{
+	std::string text;
+	char buffer[4];
+
+	for (unsigned char byte : bytes)
+	{
+		snprintf(buffer,sizeof(buffer),"%s%02X",text.empty() ? "" : " ",byte);
+		text += buffer;
+	}
+
+	return text;
+}
+
+
+int passed = 0;
+int failed = 0;
+
+
+// a function holding only inst, its text is inst's bytes
+void check(std::string text,ASMInstruction *inst,std::string expected)
+{
+	ASMFunction *function = new ASMFunction(false,"f");
+	function->add_instruction(inst);
+
+	ASMProgram program;
+	program.add_decl(new ASMDeclaration(ASMDeclarationType::FUNCTION,function));
+
+	Encoder encoder("encoder.o",&program);
+	std::string actual = hex(encoder.text);
+
+	if (actual == expected)
+	{
+		passed++;
+		return;
+	}
+
+	failed++;
+	std::cout << "FAIL encoder " << text << " : expected " << expected << ", got " << actual << std::endl;
+}
+
+
+int main()
+{
+	ASMMovInst *mov = new ASMMovInst(reg(ASMRegisterType::RAX,4),imm(5));
+	mov->add_type(ASMType::I32);
+	check("mov eax,5",new ASMInstruction(ASMInstructionType::MOV,mov),"B8 05 00 00 00");
+
+	mov = new ASMMovInst(reg(ASMRegisterType::RAX,8),reg(ASMRegisterType::R11,8));
+	mov->add_type(ASMType::I64);
+	check("mov rax,r11",new ASMInstruction(ASMInstructionType::MOV,mov),"4C 89 D8");
+
+	mov = new ASMMovInst(stack(8,8),reg(ASMRegisterType::RAX,8));
+	mov->add_type(ASMType::I64);
+	check("mov QWORD [rbp - 8],rax",new ASMInstruction(ASMInstructionType::MOV,mov),"48 89 45 F8");
+
+	ASMAddInst *add = new ASMAddInst(reg(ASMRegisterType::RAX,8),imm(8));
+	add->add_type(ASMType::I64);
+	check("add rax,8",new ASMInstruction(ASMInstructionType::ADD,add),"48 83 C0 08");
+
+	ASMSubInst *sub = new ASMSubInst(reg(ASMRegisterType::RSP,8),imm(16));
+	sub->add_type(ASMType::I64);
+	check("sub rsp,16",new ASMInstruction(ASMInstructionType::SUB,sub),"48 83 EC 10");
+
+	ASMCmpInst *cmp = new ASMCmpInst(reg(ASMRegisterType::R10,4),imm(300));
+	cmp->add_type(ASMType::I32);
+	check("cmp r10d,300",new ASMInstruction(ASMInstructionType::CMP,cmp),"41 81 FA 2C 01 00 00");
+
+	ASMMovSxInst *movsx = new ASMMovSxInst(reg(ASMRegisterType::RAX,8),stack(4,4));
+	movsx->add_type(ASMType::I64);
+	check("movsxd rax,DWORD [rbp - 4]",new ASMInstruction(ASMInstructionType::MOVSX,movsx),"48 63 45 FC");
+
+	check("ret",new ASMInstruction(ASMInstructionType::RET,new ASMRetInst()),"C3");
+
+	std::cout << "encoder : " << passed << " passed, " << failed << " failed" << std::endl;
+
+	return failed == 0 ? 0 : 1;
+}
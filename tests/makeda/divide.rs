@@ -0,0 +1,16 @@
+// expect makeda : trap 6
+//
+// the divisor is only known at run time, the jit leaves for the
+// interpreter on -1 and the interpreter traps
+
+
+fn quot(i64 a,i64 b)->i64:
+    return a / b
+:
+
+
+pub fn main()->i32:
+    i64 m = 1
+    m = m << 63
+    return cast<i32>(quot(m,-1))
+:
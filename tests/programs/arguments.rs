@@ -0,0 +1,30 @@
+// expect 61
+//
+// calls with zero to three arguments, the argument count is the CALL
+// immediate and has to survive the bytecode writer
+
+
+fn zero()->i64:
+    return 7
+:
+
+
+fn one(i64 a)->i64:
+    return a * 3
+:
+
+
+fn two(i64 a,i64 b)->i64:
+    return a - b
+:
+
+
+fn three(i64 a,i64 b,i64 c)->i64:
+    return a * b + c
+:
+
+
+pub fn main()->i32:
+    i64 s = zero() + one(5) + two(20,6) + three(4,5,6)
+    return cast<i32>(s + two(one(2),zero()))
+:
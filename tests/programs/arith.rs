@@ -0,0 +1,37 @@
+// expect 181
+//
+// multiply, divide, remainder, shifts and bitwise operations on negative
+// and positive values, by constants and by variables
+
+
+fn divs(i64 a,i64 b)->i64:
+    return a / b + a % b * 3 + a / 7 - a % 7 + a / 8 + a % 16
+:
+
+
+fn shifts(i64 a,i64 n)->i64:
+    return (a << n) + (a >> n) + (a << 3) - (a >> 2)
+:
+
+
+fn bits(i64 a,i64 b)->i64:
+    return (a & b) + (a | b) * 2 + (a ^ b) * 3
+:
+
+
+fn narrow(i32 a,i32 b)->i32:
+    return a * b / 3 + a % b - (a << 2) + (b >> 1)
+:
+
+
+pub fn main()->i32:
+    i64 total = 0
+    i64 i = -20
+    while i < 20:
+        total = total + divs(i * 37,5) + divs(i - 1000,i * i + 1)
+        total = total + shifts(i,3) + bits(i * 91,i - 44)
+        i = i + 1
+    :
+    i32 small = narrow(-77,6) + narrow(1000,-7)
+    return cast<i32>(total % 241) + small % 13
+:
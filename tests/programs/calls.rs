@@ -0,0 +1,33 @@
+// expect 126
+//
+// calls with more arguments than registers, nested calls as arguments
+// and recursion
+
+
+fn mix8(i64 a,i64 b,i64 c,i64 d,i64 e,i64 f,i64 g,i64 h)->i64:
+    return a + b * 2 - c + d * 3 - e + f * 5 - g + h * 7
+:
+
+
+fn mix9(i64 a,i64 b,i64 c,i64 d,i64 e,i64 f,i64 g,i64 h,i64 i)->i64:
+    return mix8(a,b,c,d,e,f,g,h) - i
+:
+
+
+fn fib(i64 n)->i64:
+    if n < 2:
+        return n
+    :
+    return fib(n - 1) + fib(n - 2)
+:
+
+
+pub fn main()->i32:
+    i64 s = 0
+    i64 i = 0
+    while i < 50:
+        s = s + mix9(i,s % 100,1,2,3,4,5,i,fib(i % 12)) % 1000
+        i = i + 1
+    :
+    return cast<i32>(s % 251)
+:
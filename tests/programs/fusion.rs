@@ -0,0 +1,35 @@
+// expect 40
+//
+// loop and if compares fused into superinstructions ahead of the
+// functions they call, removing the fused instructions moves the entry
+// point, the symbols and every call target
+
+
+fn count(i64 n)->i64:
+    i64 c = 0
+    i64 i = 0
+    while i < n:
+        if i == 3:
+            c = c + 10
+        :
+        c = c + 1
+        i = i + 1
+    :
+    return c
+:
+
+
+fn twice(i64 n)->i64:
+    return count(n) * 2
+:
+
+
+pub fn main()->i32:
+    i64 s = 0
+    i64 i = 0
+    while i < 5:
+        s = s + twice(i)
+        i = i + 1
+    :
+    return cast<i32>(s)
+:
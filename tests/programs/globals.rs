@@ -0,0 +1,36 @@
+// expect 31
+//
+// i64 globals : a value above 2^32 and a negative immediate survive the
+// store and the load, and add, sub and cmp between a global and a stack
+// slot or another global go through a scratch register
+
+
+i64 big = 0
+i64 step = 3
+i64 low = 0
+pub i64 seen = 0
+
+
+fn fold(i64 n)->i64:
+    i64 i = 0
+    while i < n:
+        big = big + step
+        if big > seen:
+            seen = big - step
+        :
+        i = i + 1
+    :
+    return big
+:
+
+
+pub fn main()->i32:
+    big = 1
+    big = big << 40
+    seen = big
+    i64 r = (fold(10) >> 32) + (seen & 255)
+    i64 m = 3
+    low = m - 4
+    r = r + (low >> 32)
+    return cast<i32>(r % 251)
+:
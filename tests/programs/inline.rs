@@ -0,0 +1,30 @@
+// expect 84
+//
+// small leaf functions called in a loop, the inliner copies them in
+
+
+fn square(i64 x)->i64:
+    return x * x
+:
+
+
+fn add3(i64 a,i64 b,i64 c)->i64:
+    return a + b + c
+:
+
+
+fn twice(i64 x)->i64:
+    return add3(x,x,0)
+:
+
+
+pub fn main()->i32:
+    i64 i = 0
+    i64 total = 0
+    while i < 10:
+        total = total + add3(square(i),i,1)
+        i = i + 1
+    :
+    total = total + twice(0)
+    return cast<i32>(total % 256)
+:
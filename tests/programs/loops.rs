@@ -0,0 +1,46 @@
+// expect 182
+//
+// invariant expressions and induction variables for licm and strength
+// reduction, nested and counting down
+
+
+fn invariant_sum(i64 n,i64 a,i64 b)->i64:
+    i64 i = 0
+    i64 sum = 0
+    while i < n:
+        sum = sum + (a + b) + (a - b) + i * 4
+        i = i + 1
+    :
+    return sum
+:
+
+
+fn nested(i64 n,i64 m,i64 k)->i64:
+    i64 i = 0
+    i64 sum = 0
+    while i < n:
+        i64 j = 0
+        while j < m:
+            sum = sum + (k + n) - (m - k) + j * i
+            j = j + 1
+        :
+        i = i + 1
+    :
+    return sum
+:
+
+
+fn countdown(i64 n,i64 step)->i64:
+    i64 sum = 0
+    while n > 0:
+        sum = sum + (step + step) + n
+        n = n - step
+    :
+    return sum
+:
+
+
+pub fn main()->i32:
+    i64 total = invariant_sum(100,3,7) + nested(20,30,5) + countdown(50,3)
+    return cast<i32>(total % 251)
+:
@@ -0,0 +1,25 @@
+// expect 189
+//
+// widening casts : i32 to i64 is a sign extension, u32 to i64 a zero
+// extension, both have to survive -O0 and --no-regalloc where every
+// operand lives in a stack slot. The last cast narrows a value above 2^32
+
+
+i64 wide = 0
+
+
+pub fn main()->i32:
+    i64 s = 0
+    i32 i = 0
+    u32 w = 3
+    while i < 50:
+        i64 t = cast<i64>(cast<i32>(i * 97))
+        i64 n = cast<i64>(cast<i32>(0 - i))
+        wide = cast<i64>(w)
+        s = s + t + n * 3 + wide
+        w = w + 1
+        i = i + 1
+    :
+    s = s + (cast<i64>(i) << 40)
+    return cast<i32>(s % 251)
+: